@@ -52,6 +52,44 @@ struct rtable_t* rtable_create_from_server ( struct server_t *server_to_connect,
  */
 struct server_t* server_create_from_rtable ( struct rtable_t *rtable);
 
+/*
+ * Same as rtable_get for one tuple (OC_IN or OC_COPY) but, if no tuple
+ * matches the template, the server waits up to timeout_ms milliseconds
+ * for one to be put.
+ * Em caso de erro, ou se nenhum tuplo chegou a tempo, devolve NULL.
+ */
+struct tuple_t **rtable_get_wait ( struct rtable_t *rtable, struct tuple_t *template, int keep_tuples, int timeout_ms );
+
+/*
+ * Same as rtable_out but the tuple is taken out of the table (as if by an
+ * OC_IN) once ttl_ms milliseconds have passed.
+ * Devolve 0 (ok) ou -1 (problemas).
+ */
+int rtable_out_lease ( struct rtable_t *rtable, struct tuple_t *tuple, long long ttl_ms );
+
+/*
+ * Same as rtable_out for n_tuples tuples at once: one request and one
+ * acknowledgement for all of them, that the table puts (and the log
+ * records) together. The tuples are still the caller's.
+ * Devolve 0 (ok) ou -1 (problemas, e nenhum tuplo foi posto).
+ */
+int rtable_out_batch ( struct rtable_t *rtable, struct tuple_t **tuples, int n_tuples );
+
+/*
+ * Same as rtable_out for each of the n_tuples tuples, as a request each, but
+ * all sent back-to-back (pipelined) and their acknowledgements matched by
+ * request id, so they cost one round trip instead of n_tuples. Each tuple is
+ * put (or not) on its own. The tuples are still the caller's.
+ * Devolve quantos tuplos foram postos, ou -1 (problemas ao enviar).
+ */
+int rtable_out_pipelined ( struct rtable_t *rtable, struct tuple_t **tuples, int n_tuples );
+
+/*
+ * Sends the get message_to_send and receives the tuples of the response.
+ * Em caso de erro, devolve NULL.
+ */
+struct tuple_t **rtable_send_get ( struct rtable_t *rtable, struct message_t *message_to_send );
+
 /*
  * Função que dada dois argumentos (keep_tuples, on_or_all) define o opcode
  * retorna -1 em caso de erro
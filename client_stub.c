@@ -211,6 +211,87 @@ int rtable_out(struct rtable_t *rtable, struct tuple_t *tuple){
     return SUCCEEDED;
 }
 
+int rtable_out_lease ( struct rtable_t *rtable, struct tuple_t *tuple, long long ttl_ms ) {
+    
+    //o tuplo vai numa entry, com quanto tempo dura (o switch torna-o no instante em que expira)
+    struct entry_t *lease = entry_create2(tuple_retain(tuple), 0);
+    if ( lease == NULL )
+        return FAILED;
+    lease->expires = ttl_ms;
+    struct message_t *message_to_send = message_create_with(OC_OUT, CT_LEASE, lease);
+    
+    struct server_t *connected_server = rtable_get_server(rtable);
+    struct message_t *received_msg = network_send_receive(connected_server, message_to_send);
+    
+    int taskSuccess = received_msg != NULL && response_with_success(message_to_send, received_msg) ? SUCCEEDED : FAILED;
+    if ( taskSuccess == FAILED )
+        puts("CLIENT-STUB > RTABLE_OUT_LEASE > Failed to send/receive message or received an error.");
+    
+    free_message(message_to_send);
+    free_message(received_msg);
+    return taskSuccess;
+}
+
+int rtable_out_batch ( struct rtable_t *rtable, struct tuple_t **tuples, int n_tuples ) {
+    
+    //os tuplos vão em entries sem timestamp (o switch dá o mesmo a todas)
+    struct batch_t *batch = tuples != NULL ? batch_create(n_tuples) : NULL;
+    if ( batch == NULL )
+        return FAILED;
+    int i;
+    for ( i = 0; i < n_tuples; i++ )
+        batch->entries[i] = entry_create2(tuple_retain(tuples[i]), 0);
+    struct message_t *message_to_send = message_create_with(OC_OUT, CT_BATCH, batch);
+    
+    struct server_t *connected_server = rtable_get_server(rtable);
+    struct message_t *received_msg = network_send_receive(connected_server, message_to_send);
+    
+    int taskSuccess = received_msg != NULL && response_with_success(message_to_send, received_msg)
+        && received_msg->content.result == SUCCEEDED ? SUCCEEDED : FAILED;
+    if ( taskSuccess == FAILED )
+        puts("CLIENT-STUB > RTABLE_OUT_BATCH > Failed to send/receive message or the batch was refused.");
+    
+    free_message(message_to_send);
+    free_message(received_msg);
+    return taskSuccess;
+}
+
+int rtable_out_pipelined ( struct rtable_t *rtable, struct tuple_t **tuples, int n_tuples ) {
+    
+    if ( tuples == NULL || n_tuples <= 0 )
+        return FAILED;
+    
+    struct message_t **messages_to_send = (struct message_t**) malloc(sizeof(struct message_t*) * n_tuples);
+    struct message_t **received_msgs = (struct message_t**) malloc(sizeof(struct message_t*) * n_tuples);
+    if ( messages_to_send == NULL || received_msgs == NULL ) {
+        free(messages_to_send);
+        free(received_msgs);
+        return FAILED;
+    }
+    int i;
+    for ( i = 0; i < n_tuples; i++ )
+        messages_to_send[i] = message_create_with(OC_OUT, CT_TUPLE, tuples[i]);
+    
+    struct server_t *connected_server = rtable_get_server(rtable);
+    int n_received = network_send_receive_pipelined(connected_server, n_tuples, messages_to_send, received_msgs);
+    
+    //conta os que foram postos (os que não tiveram resposta não contam)
+    int n_put = 0;
+    for ( i = 0; n_received != FAILED && i < n_tuples; i++ ) {
+        n_put += received_msgs[i] != NULL && response_with_success(messages_to_send[i], received_msgs[i]);
+        free_message(received_msgs[i]);
+    }
+    if ( n_received != n_tuples )
+        puts("CLIENT-STUB > RTABLE_OUT_PIPELINED > Failed to send/receive some of the messages.");
+    
+    //os tuplos são de quem chamou
+    for ( i = 0; i < n_tuples; i++ )
+        free_message2(messages_to_send[i], NO);
+    free(messages_to_send);
+    free(received_msgs);
+    return n_received == FAILED ? FAILED : n_put;
+}
+
 /* Função para obter tuplos da tabela.
  * Em caso de erro, devolve NULL.
  */
@@ -219,22 +300,42 @@ struct tuple_t **rtable_get( struct rtable_t *rtable, struct tuple_t *template,
     int opcode = assign_opcode(keep_tuples, one_or_all);
     int content_type = assign_ctype(opcode, NO );
     
-    //cria server_t com base em rtable
-    struct server_t *connected_server = rtable_get_server(rtable);
-    
     //cria mensagem a enviar ao servidor
     struct message_t *message_to_send = message_create_with(opcode, content_type, template);
     
+    struct tuple_t **received_tuples = rtable_send_get(rtable, message_to_send);
+    
+    //o template é de quem chamou
+    free_message2(message_to_send, NO);
+    return received_tuples;
+}
+
+struct tuple_t **rtable_get_wait ( struct rtable_t *rtable, struct tuple_t *template, int keep_tuples, int timeout_ms ) {
+    
+    int opcode = assign_opcode(keep_tuples, 1);
+    
+    //o template vai numa entry, com o tempo de espera no lugar do timestamp
+    struct entry_t *template_entry = entry_create2(tuple_retain(template), timeout_ms);
+    struct message_t *message_to_send = message_create_with(opcode, CT_ENTRY, template_entry);
+    
+    struct tuple_t **received_tuples = rtable_send_get(rtable, message_to_send);
+    
+    //a resposta pode chegar só quando outro cliente puser um tuplo, ou ao fim de timeout_ms sem nenhum
+    free_message(message_to_send);
+    return received_tuples;
+}
+
+struct tuple_t **rtable_send_get ( struct rtable_t *rtable, struct message_t *message_to_send ) {
+    
+    //cria server_t com base em rtable
+    struct server_t *connected_server = rtable_get_server(rtable);
+    
     //envia mensagem para o servidor e recebe mensagem do servidor com o resultado da operação
     struct message_t *received_msg = network_send_receive(connected_server, message_to_send);
     
     //faz verificação da mensagem recebida
+    //(a mensagem enviada é de quem a criou)
     if (received_msg == NULL) {
-        if ( message_to_send)
-            free_message(message_to_send);
-        if (received_msg )
-            free_message(received_msg);
-        
         return NULL;
     }
     
@@ -242,21 +343,51 @@ struct tuple_t **rtable_get( struct rtable_t *rtable, struct tuple_t *template,
     struct tuple_t **received_tuples = NULL;
     
     //verifica se a mensagem recebida foi de sucesso
-    if (response_with_success(message_to_send, received_msg)) {
+    //(uma resposta grande vem em partes: cada CT_PART diz quantos tuplos a seguem, e a última é um CT_RESULT)
+    int number_of_tuples = 0;
+    int last_part = NO;
+    while ( received_msg != NULL && !last_part && response_with_success(message_to_send, received_msg) ) {
+        last_part = received_msg->c_type != CT_PART;
         //checks what has to do now...
         if ( client_decision_to_take(message_to_send, received_msg) == CLIENT_RECEIVE_TUPLES ) {
-            int number_of_tuples = received_msg->content.result;
-            printf("--- has %d tuples to get from the server.\n", number_of_tuples);
-            received_tuples = (struct tuple_t**) malloc(sizeof(struct tuple_t*)*number_of_tuples);
+            int i = number_of_tuples;
+            number_of_tuples += received_msg->content.result;
+            printf("--- has %d tuples to get from the server.\n", number_of_tuples - i);
+            struct tuple_t **grown_tuples = (struct tuple_t**) realloc(received_tuples, sizeof(struct tuple_t*)*number_of_tuples);
+            if ( grown_tuples == NULL )
+                break;
+            received_tuples = grown_tuples;
             
-            int i;
-            for (i = 0; i < number_of_tuples; i++){
+            //they come many to a message (CT_TUPLES), or one (CT_TUPLE) if it is too big to share one
+            while ( i < number_of_tuples ) {
+                free_message2(received_msg, NO);
                 received_msg = receive_message(connected_server->socketfd);
-                received_tuples[i] = tuple_from_message(received_msg);
+                if ( received_msg == NULL )
+                    break;
+                if ( received_msg->c_type == CT_TUPLES ) {
+                    int j;
+                    for ( j = 0; j < received_msg->content.tuples->n_tuples && i < number_of_tuples; j++ )
+                        received_tuples[i++] = received_msg->content.tuples->tuples[j];
+                }
+                else {
+                    received_tuples[i++] = tuple_from_message(received_msg);
+                }
             }
+            //what did not come is NULL
+            while ( i < number_of_tuples )
+                received_tuples[i++] = NULL;
+            if ( received_msg == NULL )
+                break;
+        }
+        //the next part
+        if ( !last_part ) {
+            free_message2(received_msg, NO);
+            received_msg = receive_message(connected_server->socketfd);
         }
     }
-    else { puts("---- NOT response_with_success !!");  }
+    if ( received_msg != NULL && !response_with_success(message_to_send, received_msg) )
+        puts("---- NOT response_with_success !!");
+    free_message2(received_msg, NO);
     
     //devolve os tuplos recebidos (ou nulo se nao recebeu nenhum tuplo)
     return received_tuples;
@@ -12,6 +12,20 @@
 #include <stdio.h>
 #include "entry.h"
 
+//number of tuple elements that have a byte on the entry signature
+#define ENTRY_SIGNATURE_FIELDS 7
+//bit of each element byte of the signature set if the element is NULL
+#define ENTRY_SIGNATURE_NULL_BITS 0x8080808080808000ULL
+
+/*
+ * A template compiled to be checked against the entries signatures:
+ * an entry may match it only if its signature has value on the mask bits.
+ */
+struct entry_signature_t {
+    unsigned long long value;
+    unsigned long long mask;
+};
+
 
 struct entry_t *entry_create2(struct tuple_t *tuple, long long timestamp );
 
@@ -21,6 +35,11 @@ struct entry_t *entry_create2(struct tuple_t *tuple, long long timestamp );
  */
 char * entry_key (struct entry_t * entry);
 
+/*
+ * Returns the length of the key of a given entry (-1 if NULL).
+ */
+int entry_key_length ( struct entry_t * entry );
+
 /*
  * Returns the value (tuple) of a given entry.
  */
@@ -36,4 +55,27 @@ struct entry_t *entry_deserialize(char *buffer, int buffer_size);
 
 int entry_size_bytes ( struct entry_t * entry);
 
+/*
+ * Frees the entry and its tuple at once. entry_destroy retires them
+ * through the epochs, so this is only called once no one can read them.
+ */
+void entry_free ( void * entry );
+
+/*
+ * Compiles tup_template into the signature the entries must have to match it.
+ */
+void entry_template_signature ( struct tuple_t * tup_template, struct entry_signature_t * signature );
+
+/*
+ * Checks, with the signatures only, if the entry may match the template of
+ * signature. NO means it does not match; YES must still be confirmed
+ * with tuple_matches_template.
+ */
+int entry_may_match ( struct entry_t * entry, struct entry_signature_t * signature );
+
+/*
+ * Same as entry_may_match but given the signature of the entry.
+ */
+int entry_signature_may_match ( unsigned long long entry_signature, struct entry_signature_t * signature );
+
 #endif /* defined(__SD15_Project__entry_private__) */
@@ -9,20 +9,60 @@
 #include "tuple.h"
 #include "tuple-private.h"
 #include "entry.h"
+#include "entry-private.h"
+#include "general_utils.h"
 #include <stdlib.h>
 #include <string.h> // memcpy
 #include "message-private.h"
 #include <stdio.h>
 #include <assert.h>
+#include "slab.h"
+#include "epoch.h"
+
+/*
+ * Returns the byte of the signature that stands for the iElement of tuple:
+ * 7 bits of the element hash (the 8th is the NULL bit).
+ */
+unsigned long long entry_signature_byte ( struct tuple_t * tuple, int iElement ) {
+    return hash_bytes_64(tuple_element(tuple, iElement), tuple_element_length(tuple, iElement)) >> 57;
+}
+
+/*
+ * Sets the signature of the entry: its lowest byte is the tuple dimension
+ * and the following ones stand for each of the first ENTRY_SIGNATURE_FIELDS
+ * elements, either a hash of its value or, if it is NULL, the NULL bit.
+ */
+void entry_sign ( struct entry_t * entry ) {
+    entry->signature = 0;
+    if ( entry->value == NULL )
+        return;
+    
+    entry->signature = tuple_size(entry->value) & 0xFF;
+    
+    int i;
+    for ( i = 0; i < tuple_size(entry->value) && i < ENTRY_SIGNATURE_FIELDS; i++ ) {
+        int shift = 8 * (i + 1);
+        if ( tuple_element(entry->value, i) == NULL )
+            entry->signature |= 0x80ULL << shift;
+        else
+            entry->signature |= entry_signature_byte(entry->value, i) << shift;
+    }
+}
 
 /* Função que cria um novo par chave-valor (isto é, que inicializa
  * a estrutura e aloca a memória necessária), recebendo um timestamp a atribuir.
  */
 struct entry_t * entry_create2(struct tuple_t *tuple, long long timestamp ) {
-    struct entry_t *newEntry = (struct entry_t*) malloc(sizeof(struct entry_t));
+    struct entry_t *newEntry = (struct entry_t*) slab_alloc(sizeof(struct entry_t));
     if ( newEntry != NULL ) {
         newEntry->timestamp = timestamp;
         newEntry->value = tuple;
+        newEntry->index_nodes = NULL;
+        newEntry->time_node = NULL;
+        newEntry->key_node = NULL;
+        newEntry->expires = 0;
+        newEntry->lease = NULL;
+        entry_sign(newEntry);
     }
     return newEntry;
 }
@@ -38,24 +78,71 @@ struct entry_t *entry_create(struct tuple_t *tuple) {
 
 /* Função que destroi um par chave-valor e liberta toda a memoria.
  */
+void entry_free ( void * object ) {
+    struct entry_t * entry = (struct entry_t *) object;
+    //the index nodes array has one position per tuple element
+    if ( entry->index_nodes != NULL )
+        slab_free(entry->index_nodes, tuple_size(entry->value) * sizeof(struct node_t *));
+    //a lease is only left here if the entry was still on a table being destroyed
+    free(entry->lease);
+    tuple_destroy(entry->value);
+    slab_free(entry, sizeof(struct entry_t));
+}
+
 void entry_destroy(struct entry_t *entry) {
-    if ( entry != NULL) {
-        tuple_destroy(entry->value);
-    }
-    free(entry);
+    if ( entry == NULL )
+        return;
+
+    //a reader walking a slot without locks may still be on it
+    epoch_retire(entry, entry_free);
 }
 
-/* Funcao que duplica um par chave-valor. */
+/* Funcao que duplica um par chave-valor (o tuplo, imutável, é partilhado). */
 struct entry_t *entry_dup(struct entry_t *entry){
     if ( entry == NULL || entry->value == NULL )
         return NULL;
     
     //if entry is valid
-    return  entry_create(tuple_dup(entry->value));
+    return  entry_create(tuple_retain(entry->value));
 }
 
 /**********  Implementation of entry-private.h   ***********/
 
+/*
+ * Compiles tup_template into the signature the entries must have to match it:
+ * the dimension must be the same and so must be the bytes of its non NULL elements.
+ */
+void entry_template_signature ( struct tuple_t * tup_template, struct entry_signature_t * signature ) {
+    signature->value = tuple_size(tup_template) & 0xFF;
+    signature->mask = 0xFF;
+    
+    int i;
+    for ( i = 0; i < tuple_size(tup_template) && i < ENTRY_SIGNATURE_FIELDS; i++ ) {
+        if ( tuple_element(tup_template, i) != NULL ) {
+            int shift = 8 * (i + 1);
+            signature->value |= entry_signature_byte(tup_template, i) << shift;
+            signature->mask |= 0x7FULL << shift;
+        }
+    }
+}
+
+/*
+ * Checks, with the signatures only, if the entry may match the template of
+ * signature (the NULL elements of the entry match any value).
+ */
+int entry_may_match ( struct entry_t * entry, struct entry_signature_t * signature ) {
+    return entry_signature_may_match(entry->signature, signature);
+}
+
+/*
+ * Same as entry_may_match but given the signature of the entry.
+ */
+int entry_signature_may_match ( unsigned long long entry_signature, struct entry_signature_t * signature ) {
+    //spreads the NULL bits of the entry to whole bytes, that are not compared
+    unsigned long long wildcards = ((entry_signature & ENTRY_SIGNATURE_NULL_BITS) >> 7) * 0xFF;
+    return ((entry_signature ^ signature->value) & signature->mask & ~wildcards) == 0;
+}
+
 /*
  * Returns the key of a given entry.
  */
@@ -63,6 +150,10 @@ char * entry_key (struct entry_t * entry) {
     return tuple_key(entry->value);
 }
 
+int entry_key_length ( struct entry_t * entry ) {
+    return tuple_key_length(entry->value);
+}
+
 /*
  * Returns the value (tuple) of a given entry.
  */
@@ -122,6 +213,7 @@ int entry_serialize(struct entry_t * entry, char **serialized_entry) {
     //adds the serialized tuple to the serialized entry buffer
     memcpy(serialized_entry[0]+offset, serialized_tuple, serialized_tuple_size);
     offset+=serialized_tuple_size;
+    free(serialized_tuple);
     
     assert( serialized_entry_size == offset);
     
@@ -188,6 +280,24 @@ struct entry_t * entry_create_from_string(const char * input ) {
     return entry_create2(create_tuple_from_input(input), timestamp);
 }
 
+struct entry_t * entry_lease_create_from_string ( const char * input ) {
+    struct entry_t * entry = entry_create_from_string(input);
+    if ( entry == NULL )
+        return NULL;
+    
+    //opcode, ctype, timestamp and then when it expires
+    char * inception = strdup(input);
+    char * rest;
+    strtok_r(inception, " ", &rest);
+    strtok_r(NULL, " ", &rest);
+    strtok_r(NULL, " ", &rest);
+    char * expires_s = strtok_r(NULL, " ", &rest);
+    entry->expires = expires_s != NULL ? atoll(expires_s) : 0;
+    
+    free(inception);
+    return entry;
+}
+
 
 
 
@@ -3,6 +3,9 @@
 
 #include "tuple.h"
 
+struct node_t;
+struct wheel_timer_t;
+
 /* Esta estrutura define o par chave-valor para a tabela */
 
 struct entry_t {
@@ -12,6 +15,18 @@ struct entry_t {
     long long timestamp; /* Por agora vai ter valor igual a 0.
                           Será utilizado no projeto 5. */
     struct tuple_t *value; /* Bloco de dados. Um tuplo neste caso. */
+    struct node_t **index_nodes; /* Nós das field indexes da tabela que
+                                  referenciam esta entry (por posição). */
+    unsigned long long signature; /* Dimensão e um byte por elemento do
+                                    tuplo, para rejeitar templates. */
+    struct node_t *time_node; /* Nó do índice por timestamp da tabela
+                               que referencia esta entry. */
+    struct node_t *key_node; /* Nó do índice ordenado das chaves da
+                              tabela (NULL se a tabela não o tem). */
+    long long expires; /* Quando o tuplo expira (milissegundos desde a
+                        Epoch), ou 0 se nunca expira. */
+    struct wheel_timer_t *lease; /* Timer da tabela que o faz expirar
+                                  (NULL se não estiver na tabela). */
 };
 
 /* Função que cria um novo par chave-valor (isto é, que inicializa
@@ -28,4 +43,9 @@ struct entry_t *entry_dup(struct entry_t *entry);
 
 struct entry_t * entry_create_from_string(const char * input );
 
+/* Igual a entry_create_from_string para uma entry que expira, escrita
+ * como "opcode ctype timestamp expires tuplo".
+ */
+struct entry_t * entry_lease_create_from_string(const char * input );
+
 #endif
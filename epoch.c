@@ -0,0 +1,169 @@
+//
+//  epoch.c
+//  SD15-Product
+//
+//  Epoch based reclamation.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "epoch.h"
+#include "general_utils.h"
+
+//number of epochs a thread keeps retired objects for (the current one and the two before)
+#define EPOCH_N_BAGS 3
+//initial number of objects of a bag
+#define EPOCH_BAG_INITIAL_CAPACITY 64
+
+/*
+ * An object retired and the function that frees it.
+ */
+struct epoch_object_t {
+    void * object;
+    void (*free_object) (void *);
+};
+
+/*
+ * The objects a thread retired during one epoch.
+ */
+struct epoch_bag_t {
+    unsigned long long epoch;
+    int n_objects;
+    int capacity;
+    struct epoch_object_t * objects;
+};
+
+/*
+ * What a thread publishes to the others: if it is inside an epoch and which.
+ */
+struct epoch_thread_t {
+    int active;
+    unsigned long long epoch;
+};
+
+//the global epoch: it only moves forward once every active thread has seen it
+static unsigned long long epoch_global = 0;
+//the threads that ever used the epochs
+static struct epoch_thread_t epoch_threads[EPOCH_MAX_THREADS];
+static int epoch_n_threads = 0;
+//objects retired and not freed yet (all threads)
+static unsigned long long epoch_n_pending = 0;
+
+//the record of this thread, its nesting depth and its bags
+static __thread struct epoch_thread_t * epoch_self = NULL;
+static __thread int epoch_depth = 0;
+static __thread struct epoch_bag_t epoch_bags[EPOCH_N_BAGS];
+static __thread unsigned int epoch_n_retired = 0;
+
+/*
+ * Returns the record of the current thread, registering it on its first call.
+ */
+struct epoch_thread_t * epoch_register () {
+    if ( epoch_self == NULL ) {
+        int slot = __atomic_fetch_add(&epoch_n_threads, 1, __ATOMIC_SEQ_CST);
+        if ( slot >= EPOCH_MAX_THREADS ) {
+            //a thread the others can not see would have its memory freed under it
+            fprintf(stderr, "epoch > more than %d threads\n", EPOCH_MAX_THREADS);
+            abort();
+        }
+        epoch_self = &epoch_threads[slot];
+    }
+    return epoch_self;
+}
+
+void epoch_enter () {
+    struct epoch_thread_t * self = epoch_register();
+    if ( epoch_depth++ > 0 )
+        return;
+
+    //active first: until the epoch is published the old one holds the global epoch back
+    __atomic_store_n(&(self->active), YES, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&(self->epoch), __atomic_load_n(&epoch_global, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+}
+
+void epoch_exit () {
+    if ( epoch_self == NULL || epoch_depth == 0 )
+        return;
+
+    if ( --epoch_depth == 0 )
+        __atomic_store_n(&(epoch_self->active), NO, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Moves the global epoch forward if every active thread is on it.
+ */
+void epoch_try_advance () {
+    unsigned long long global = __atomic_load_n(&epoch_global, __ATOMIC_SEQ_CST);
+    int n_threads = __atomic_load_n(&epoch_n_threads, __ATOMIC_SEQ_CST);
+    if ( n_threads > EPOCH_MAX_THREADS )
+        n_threads = EPOCH_MAX_THREADS;
+
+    int i;
+    for ( i = 0; i < n_threads; i++ ) {
+        if ( __atomic_load_n(&(epoch_threads[i].active), __ATOMIC_SEQ_CST)
+            && __atomic_load_n(&(epoch_threads[i].epoch), __ATOMIC_SEQ_CST) != global )
+            return;
+    }
+    __atomic_compare_exchange_n(&epoch_global, &global, global + 1, NO, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Frees every object of the bag.
+ */
+void epoch_free_bag ( struct epoch_bag_t * bag ) {
+    int i;
+    for ( i = 0; i < bag->n_objects; i++ )
+        bag->objects[i].free_object(bag->objects[i].object);
+
+    __atomic_sub_fetch(&epoch_n_pending, bag->n_objects, __ATOMIC_RELAXED);
+    bag->n_objects = 0;
+}
+
+void epoch_retire ( void * object, void (*free_object) (void *) ) {
+    if ( object == NULL )
+        return;
+    epoch_register();
+
+    unsigned long long global = __atomic_load_n(&epoch_global, __ATOMIC_SEQ_CST);
+    struct epoch_bag_t * bag = &epoch_bags[global % EPOCH_N_BAGS];
+
+    //the bag of this epoch still holds the objects of EPOCH_N_BAGS (or more) epochs ago: they are safe to free
+    if ( bag->epoch != global ) {
+        epoch_free_bag(bag);
+        bag->epoch = global;
+    }
+
+    if ( bag->n_objects == bag->capacity ) {
+        int capacity = bag->capacity == 0 ? EPOCH_BAG_INITIAL_CAPACITY : bag->capacity * 2;
+        struct epoch_object_t * objects = (struct epoch_object_t *) realloc(bag->objects, capacity * sizeof(struct epoch_object_t));
+        //with no room to retire it the object is never freed (it is not safe to free it now)
+        if ( objects == NULL )
+            return;
+        bag->objects = objects;
+        bag->capacity = capacity;
+    }
+    bag->objects[bag->n_objects].object = object;
+    bag->objects[bag->n_objects].free_object = free_object;
+    bag->n_objects++;
+    __atomic_add_fetch(&epoch_n_pending, 1, __ATOMIC_RELAXED);
+
+    if ( ++epoch_n_retired % EPOCH_ADVANCE_EVERY == 0 )
+        epoch_collect();
+}
+
+void epoch_collect () {
+    epoch_try_advance();
+
+    //an object retired on epoch e is freed once the global epoch is e + 2:
+    //every thread active then entered after it was unlinked
+    unsigned long long global = __atomic_load_n(&epoch_global, __ATOMIC_SEQ_CST);
+    int i;
+    for ( i = 0; i < EPOCH_N_BAGS; i++ ) {
+        if ( epoch_bags[i].n_objects > 0 && epoch_bags[i].epoch + 2 <= global )
+            epoch_free_bag(&epoch_bags[i]);
+    }
+}
+
+unsigned long long epoch_pending () {
+    return __atomic_load_n(&epoch_n_pending, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,55 @@
+//
+//  epoch.h
+//  SD15-Product
+//
+//  Epoch based reclamation: memory that leaves a shared structure is not
+//  freed at once but retired, and only freed when every thread that could
+//  still be reading it (because it was inside an epoch when it was retired)
+//  has left that epoch. This is what lets the table readers walk the slot
+//  lists without taking their locks.
+//
+//  A thread reading shared memory without locks does it between
+//  epoch_enter and epoch_exit. A thread taking memory out of a shared
+//  structure gives it to epoch_retire instead of freeing it.
+//
+//  The retired memory is kept per thread and freed by the thread that
+//  retired it (so the slab pools stay per thread).
+//
+
+#ifndef SD15_Product_epoch_h
+#define SD15_Product_epoch_h
+
+//maximum number of threads that can use the epochs
+#define EPOCH_MAX_THREADS 256
+//retires a thread makes between two attempts to move the global epoch forward
+#define EPOCH_ADVANCE_EVERY 64
+
+/*
+ * Enters an epoch: until epoch_exit, nothing retired from now on by any
+ * thread is freed. Calls can be nested.
+ */
+void epoch_enter ();
+
+/*
+ * Leaves the epoch entered by the matching epoch_enter.
+ */
+void epoch_exit ();
+
+/*
+ * Retires object: free_object(object) is called once no thread can be
+ * reading it anymore.
+ */
+void epoch_retire ( void * object, void (*free_object) (void *) );
+
+/*
+ * Frees what the current thread retired and can already be freed,
+ * moving the global epoch forward if every thread has caught up with it.
+ */
+void epoch_collect ();
+
+/*
+ * Returns the number of objects retired by all the threads and not freed yet.
+ */
+unsigned long long epoch_pending ();
+
+#endif
@@ -0,0 +1,279 @@
+//
+//  field_index.c
+//  SD15-Product
+//
+//  Inverted index from the values of one field position to the entries
+//  that hold them.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "field_index.h"
+#include "list.h"
+#include "list-private.h"
+#include "tuple-private.h"
+#include "entry-private.h"
+#include "general_utils.h"
+#include "slab.h"
+#include "epoch.h"
+
+/*
+ * Returns the hashcode of an element value of length bytes (NULL values hash to 0).
+ */
+unsigned long long field_index_hashcode ( char * value, int length ) {
+    return value == NULL ? 0 : hash_bytes_64(value, length);
+}
+
+/*
+ * Checks if the index value holds the given element value. YES or NO
+ */
+int index_value_is ( struct index_value_t * index_value, char * value, int length, unsigned long long hashcode ) {
+    if ( index_value->value == NULL || value == NULL )
+        return index_value->value == value;
+
+    return index_value->hashcode == hashcode && index_value->length == length
+        && memcmp(index_value->value, value, length) == 0;
+}
+
+/*
+ * Creates an empty index for the given field position.
+ */
+struct field_index_t * field_index_create ( int position ) {
+    struct field_index_t * newIndex = (struct field_index_t *) malloc(sizeof(struct field_index_t));
+
+    if ( newIndex != NULL ) {
+        newIndex->position = position;
+        newIndex->n_values = 0;
+        newIndex->n_slots = FIELD_INDEX_INITIAL_SLOTS;
+        newIndex->slots = (struct index_value_t **) calloc(newIndex->n_slots, sizeof(struct index_value_t *));
+        if ( newIndex->slots == NULL ) {
+            free(newIndex);
+            return NULL;
+        }
+    }
+    return newIndex;
+}
+
+/*
+ * Destroys an index value and its posting list (not the entries).
+ */
+void index_value_destroy ( struct index_value_t * index_value ) {
+    node_t * currentNode = list_head(index_value->entries);
+    int nodesToDestroy = list_size(index_value->entries);
+
+    while ( nodesToDestroy-- > 0 ) {
+        node_t * nextNode = currentNode->next;
+        node_destroy(currentNode);
+        currentNode = nextNode;
+    }
+    free(index_value->entries);
+    free(index_value->value);
+    free(index_value);
+}
+
+/*
+ * Frees a retired index value (see field_index_drop_value).
+ */
+void index_value_free ( void * index_value ) {
+    index_value_destroy((struct index_value_t *) index_value);
+}
+
+/*
+ * Destroys the index. The indexed entries are not destroyed.
+ */
+void field_index_destroy ( struct field_index_t * index ) {
+    if ( index == NULL )
+        return;
+
+    unsigned int i;
+    for ( i = 0; i < index->n_slots; i++ ) {
+        struct index_value_t * index_value = index->slots[i];
+        while ( index_value != NULL ) {
+            struct index_value_t * next = index_value->next;
+            index_value_destroy(index_value);
+            index_value = next;
+        }
+    }
+    free(index->slots);
+    free(index);
+}
+
+/*
+ * Returns the index value holding value or NULL if there is none.
+ * It can be called without the indexes lock (see table_read_no_key): the
+ * links are followed as list_follow does, and the number of slots before
+ * the slots, that are published the other way round.
+ */
+struct index_value_t * field_index_find ( struct field_index_t * index, char * value, int length ) {
+    unsigned long long hashcode = field_index_hashcode(value, length);
+    unsigned int n_slots = list_follow(index->n_slots);
+    struct index_value_t ** slots = list_follow(index->slots);
+    struct index_value_t * index_value = list_follow(slots[hashcode % n_slots]);
+
+    while ( index_value != NULL && !index_value_is(index_value, value, length, hashcode) )
+        index_value = list_follow(index_value->next);
+
+    return index_value;
+}
+
+/*
+ * Doubles the number of slots of the values hash map.
+ * (only the distinct values move, the posting lists are kept as they are;
+ * the old slots are retired, a read without locks may still be on them)
+ */
+int field_index_rehash ( struct field_index_t * index ) {
+    unsigned int n_slots = index->n_slots * 2;
+    struct index_value_t ** slots = (struct index_value_t **) calloc(n_slots, sizeof(struct index_value_t *));
+    if ( slots == NULL )
+        return FAILED;
+
+    unsigned int i;
+    for ( i = 0; i < index->n_slots; i++ ) {
+        struct index_value_t * index_value = index->slots[i];
+        while ( index_value != NULL ) {
+            struct index_value_t * next = index_value->next;
+            list_publish(index_value->next, slots[index_value->hashcode % n_slots]);
+            slots[index_value->hashcode % n_slots] = index_value;
+            index_value = next;
+        }
+    }
+    epoch_retire(index->slots, free);
+    list_publish(index->slots, slots);
+    list_publish(index->n_slots, n_slots);
+
+    return SUCCEEDED;
+}
+
+/*
+ * Returns the index value holding value, creating it if there is none.
+ */
+struct index_value_t * field_index_find_or_create ( struct field_index_t * index, char * value, int length ) {
+    struct index_value_t * index_value = field_index_find(index, value, length);
+    if ( index_value != NULL )
+        return index_value;
+
+    index_value = (struct index_value_t *) malloc(sizeof(struct index_value_t));
+    if ( index_value == NULL )
+        return NULL;
+
+    index_value->value = value == NULL ? NULL : (char *) malloc(length);
+    if ( value != NULL && index_value->value == NULL ) {
+        free(index_value);
+        return NULL;
+    }
+    if ( value != NULL )
+        memcpy(index_value->value, value, length);
+    index_value->length = length;
+    index_value->hashcode = field_index_hashcode(value, length);
+    index_value->entries = list_create();
+
+    unsigned int slot = index_value->hashcode % index->n_slots;
+    index_value->next = index->slots[slot];
+    list_publish(index->slots[slot], index_value);
+    index->n_values++;
+
+    if ( index->n_values > index->n_slots * FIELD_INDEX_MAX_LOAD_FACTOR )
+        field_index_rehash(index);
+
+    return index_value;
+}
+
+/*
+ * Unlinks the index value from the hash map and retires it (a read without
+ * locks may still be on it).
+ */
+void field_index_drop_value ( struct field_index_t * index, struct index_value_t * index_value ) {
+    struct index_value_t ** link = &(index->slots[index_value->hashcode % index->n_slots]);
+
+    while ( *link != index_value )
+        link = &((*link)->next);
+
+    list_publish(*link, index_value->next);
+    index->n_values--;
+    epoch_retire(index_value, index_value_free);
+}
+
+/*
+ * Indexes the entry by the value of its element at the index position.
+ * Entries with no element at that position are not indexed.
+ * Returns 0 (OK) or -1 (error).
+ */
+int field_index_add ( struct field_index_t * index, struct entry_t * entry ) {
+    if ( index == NULL || entry == NULL || entry_value(entry) == NULL )
+        return FAILED;
+
+    //a tuple without this position never matches a template using it
+    if ( index->position >= tuple_size(entry_value(entry)) )
+        return SUCCEEDED;
+
+    //each entry keeps its posting nodes so it can be unindexed in constant time
+    if ( entry->index_nodes == NULL ) {
+        entry->index_nodes = (struct node_t **) slab_calloc(tuple_size(entry_value(entry)), sizeof(struct node_t *));
+        if ( entry->index_nodes == NULL )
+            return FAILED;
+    }
+
+    struct index_value_t * index_value = field_index_find_or_create(index, tuple_element(entry_value(entry), index->position),
+                                                                    tuple_element_length(entry_value(entry), index->position));
+    if ( index_value == NULL )
+        return FAILED;
+
+    node_t * posting = node_create(NULL, NULL, entry);
+    if ( list_add_node(index_value->entries, posting, ADD_WITHOUT_CRITERION, 0) == FAILED ) {
+        node_destroy(posting);
+        return FAILED;
+    }
+    entry->index_nodes[index->position] = posting;
+
+    return SUCCEEDED;
+}
+
+/*
+ * Removes the entry from the index, in constant time.
+ * Returns 0 (OK) or -1 (error, entry was not indexed).
+ */
+int field_index_remove ( struct field_index_t * index, struct entry_t * entry ) {
+    if ( index == NULL || entry == NULL || entry->index_nodes == NULL
+        || index->position >= tuple_size(entry_value(entry))
+        || entry->index_nodes[index->position] == NULL )
+        return FAILED;
+
+    struct index_value_t * index_value = field_index_find(index, tuple_element(entry_value(entry), index->position),
+                                                          tuple_element_length(entry_value(entry), index->position));
+    if ( index_value == NULL )
+        return FAILED;
+
+    node_t * posting = entry->index_nodes[index->position];
+    entry->index_nodes[index->position] = NULL;
+
+    int taskSuccess = list_remove_node(index_value->entries, posting, NOT_DESTROY);
+    node_destroy(posting);
+
+    //values with no entries are dropped so the index does not keep growing
+    if ( list_isEmpty(index_value->entries) )
+        field_index_drop_value(index, index_value);
+
+    return taskSuccess;
+}
+
+/*
+ * Returns the posting list of the entries having value (or NULL) at the
+ * index position, or NULL if there is none.
+ */
+struct list_t * field_index_entries ( struct field_index_t * index, char * value, int length ) {
+    struct index_value_t * index_value = field_index_find(index, value, length);
+    return index_value == NULL ? NULL : index_value->entries;
+}
+
+/*
+ * Returns the number of entries that may match value at the index position,
+ * ie, the ones having value plus the ones having NULL.
+ */
+int field_index_count ( struct field_index_t * index, char * value, int length ) {
+    struct list_t * entries = field_index_entries(index, NULL, -1);
+    int count = entries == NULL ? 0 : list_follow(entries->size);
+    entries = value != NULL ? field_index_entries(index, value, length) : NULL;
+    if ( entries != NULL )
+        count += list_follow(entries->size);
+    return count;
+}
@@ -0,0 +1,85 @@
+//
+//  field_index.h
+//  SD15-Product
+//
+//  Inverted index from the values of one field position to the entries
+//  that hold them. Used by the table to answer templates whose key is
+//  a wildcard without scanning every slot.
+//
+
+#ifndef SD15_Product_field_index_h
+#define SD15_Product_field_index_h
+
+#include "list-private.h"
+
+//initial number of slots of the values hash map
+#define FIELD_INDEX_INITIAL_SLOTS 64
+//average number of values per slot above which the hash map doubles
+#define FIELD_INDEX_MAX_LOAD_FACTOR 2
+
+/*
+ * One distinct value of the indexed position and all the entries having it.
+ * A NULL value holds the entries whose element is NULL (they match any value).
+ */
+struct index_value_t {
+    //the length bytes of the value (not '\0' terminated)
+    char * value;
+    int length;
+    unsigned long long hashcode;
+    //posting list: nodes that reference (do not own) the entries
+    struct list_t * entries;
+    struct index_value_t * next;
+};
+
+/*
+ * The index of one field position.
+ * It changes under the indexes lock of its table, but it may be read
+ * without it (field_index_find, field_index_entries, field_index_count and
+ * the posting lists) inside an epoch: what leaves it is retired, not freed.
+ */
+struct field_index_t {
+    //the indexed position of the tuples
+    int position;
+    //the number of distinct values on the index
+    unsigned int n_values;
+    //the number of slots of the values hash map
+    unsigned int n_slots;
+    struct index_value_t ** slots;
+};
+
+/*
+ * Creates an empty index for the given field position.
+ */
+struct field_index_t * field_index_create ( int position );
+
+/*
+ * Destroys the index. The indexed entries are not destroyed.
+ */
+void field_index_destroy ( struct field_index_t * index );
+
+/*
+ * Indexes the entry by the value of its element at the index position.
+ * Entries with no element at that position are not indexed.
+ * Returns 0 (OK) or -1 (error).
+ */
+int field_index_add ( struct field_index_t * index, struct entry_t * entry );
+
+/*
+ * Removes the entry from the index, in constant time.
+ * Returns 0 (OK) or -1 (error, entry was not indexed).
+ */
+int field_index_remove ( struct field_index_t * index, struct entry_t * entry );
+
+/*
+ * Returns the posting list of the entries having value (its length bytes,
+ * or NULL) at the index position, or NULL if there is none.
+ */
+struct list_t * field_index_entries ( struct field_index_t * index, char * value, int length );
+
+/*
+ * Returns the number of entries that may match value at the index position,
+ * ie, the ones having value plus the ones having NULL.
+ */
+int field_index_count ( struct field_index_t * index, char * value, int length );
+
+#endif
@@ -11,6 +11,7 @@
 #include "general_utils.h"
 #include <string.h>
 #include <time.h>
+#include <ctype.h>
 
 int is_number (char * stringWithNumber ) {
     char *ptr;
@@ -32,4 +33,61 @@ int get_random_number(int min, int max){
     return (random_numer % (max-min)) +1;
 }
 
+/*
+ * Returns a well mixed 64 bits hash of the first length bytes of data
+ * (MurmurHash64A). Every byte of the input takes part on the result.
+ */
+unsigned long long hash_bytes_64 (const void * data, unsigned long length) {
+    const unsigned long long m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    
+    unsigned long long hash = 0x9747b28c5ad3e1f7ULL ^ (length * m);
+    
+    const unsigned char * bytes = (const unsigned char *) data;
+    const unsigned char * end = bytes + (length / 8) * 8;
+    
+    //mixes 8 bytes at a time
+    while ( bytes != end ) {
+        unsigned long long k;
+        memcpy(&k, bytes, sizeof(k));
+        
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        
+        hash ^= k;
+        hash *= m;
+        
+        bytes += 8;
+    }
+    
+    //and then the remaining (up to 7) bytes
+    switch ( length & 7 ) {
+        case 7: hash ^= (unsigned long long) bytes[6] << 48; /* fall through */
+        case 6: hash ^= (unsigned long long) bytes[5] << 40; /* fall through */
+        case 5: hash ^= (unsigned long long) bytes[4] << 32; /* fall through */
+        case 4: hash ^= (unsigned long long) bytes[3] << 24; /* fall through */
+        case 3: hash ^= (unsigned long long) bytes[2] << 16; /* fall through */
+        case 2: hash ^= (unsigned long long) bytes[1] << 8; /* fall through */
+        case 1: hash ^= (unsigned long long) bytes[0];
+            hash *= m;
+    }
+    
+    //final avalanche
+    hash ^= hash >> r;
+    hash *= m;
+    hash ^= hash >> r;
+    
+    return hash;
+}
 
+int bytes_casecmp (const char * a, int a_length, const char * b, int b_length) {
+    int length = a_length < b_length ? a_length : b_length;
+    int i;
+    for ( i = 0; i < length; i++ ) {
+        int difference = tolower((unsigned char) a[i]) - tolower((unsigned char) b[i]);
+        if ( difference != 0 )
+            return difference;
+    }
+    return a_length - b_length;
+}
@@ -32,4 +32,17 @@ int is_number (char * stringWithNumber );
  */
 int get_random_number(int min, int max);
 
+/*
+ * Returns a well mixed 64 bits hash of the first length bytes of data
+ * (MurmurHash64A). Every byte of the input takes part on the result.
+ */
+unsigned long long hash_bytes_64 (const void * data, unsigned long length);
+
+/*
+ * Compares the a_length bytes of a with the b_length bytes of b ignoring
+ * case, as strcasecmp would if they were strings (the bytes may have '\0').
+ * Returns < 0, 0 or > 0 if a is lower, equal or higher than b.
+ */
+int bytes_casecmp (const char * a, int a_length, const char * b, int b_length);
+
 #endif
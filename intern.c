@@ -0,0 +1,177 @@
+//
+//  intern.c
+//  SD15-Product
+//
+//  Pool of the short element values shared by the tuples.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "intern.h"
+#include "general_utils.h"
+
+/*
+ * A value of the pool. The chains of the buckets and of the free ids are
+ * made of ids + 1 (0 ends them).
+ */
+struct intern_string_t {
+    char * bytes;
+    int length;
+    int refs;
+    unsigned long long hash;
+    int next;
+};
+
+static int intern_on = NO;
+static pthread_once_t intern_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t intern_stripes[INTERN_STRIPES];
+static int intern_buckets[INTERN_BUCKETS];
+static struct intern_string_t * intern_segments[INTERN_MAX_SEGMENTS];
+//the ids ever given out, the ones free to give again and the lock of both
+static int intern_n_ids = 0;
+static int intern_free_ids = 0;
+static pthread_mutex_t intern_ids_lock = PTHREAD_MUTEX_INITIALIZER;
+static int intern_n_strings = 0;
+
+void intern_init () {
+    int i;
+    for ( i = 0; i < INTERN_STRIPES; i++ )
+        pthread_mutex_init(&intern_stripes[i], NULL);
+}
+
+void intern_enable ( int on ) {
+    pthread_once(&intern_once, intern_init);
+    __atomic_store_n(&intern_on, on, __ATOMIC_RELEASE);
+}
+
+int intern_enabled () {
+    return __atomic_load_n(&intern_on, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Returns the value of id.
+ */
+struct intern_string_t * intern_string ( int id ) {
+    return &intern_segments[id / INTERN_SEGMENT_SIZE][id % INTERN_SEGMENT_SIZE];
+}
+
+/*
+ * Takes a free id, making a new segment if they are all in use.
+ * Returns the id or -1 (the pool is full).
+ */
+int intern_new_id () {
+    pthread_mutex_lock(&intern_ids_lock);
+    int id = -1;
+    if ( intern_free_ids != 0 ) {
+        id = intern_free_ids - 1;
+        intern_free_ids = intern_string(id)->next;
+    }
+    else if ( intern_n_ids < INTERN_MAX_SEGMENTS * INTERN_SEGMENT_SIZE ) {
+        int segment = intern_n_ids / INTERN_SEGMENT_SIZE;
+        if ( intern_segments[segment] == NULL ) {
+            struct intern_string_t * strings = (struct intern_string_t *) calloc(INTERN_SEGMENT_SIZE, sizeof(struct intern_string_t));
+            //the readers of an id only get it after its segment is there
+            __atomic_store_n(&intern_segments[segment], strings, __ATOMIC_RELEASE);
+        }
+        if ( intern_segments[segment] != NULL )
+            id = intern_n_ids++;
+    }
+    pthread_mutex_unlock(&intern_ids_lock);
+    return id;
+}
+
+/*
+ * Gives id back to be reused.
+ */
+void intern_free_id ( int id ) {
+    pthread_mutex_lock(&intern_ids_lock);
+    intern_string(id)->next = intern_free_ids;
+    intern_free_ids = id + 1;
+    pthread_mutex_unlock(&intern_ids_lock);
+}
+
+int intern_acquire ( const char * bytes, int length ) {
+    if ( !intern_enabled() || bytes == NULL || length < 0 || length > INTERN_MAX_LENGTH )
+        return -1;
+
+    unsigned long long hash = hash_bytes_64(bytes, length);
+    int bucket = (int) (hash % INTERN_BUCKETS);
+    pthread_mutex_t * stripe = &intern_stripes[bucket % INTERN_STRIPES];
+
+    pthread_mutex_lock(stripe);
+
+    //already on the pool: one more reference
+    int id = intern_buckets[bucket] - 1;
+    while ( id != -1 ) {
+        struct intern_string_t * string = intern_string(id);
+        if ( string->hash == hash && string->length == length && memcmp(string->bytes, bytes, length) == 0 ) {
+            string->refs++;
+            pthread_mutex_unlock(stripe);
+            return id;
+        }
+        id = string->next - 1;
+    }
+
+    //a new value
+    char * copy = (char *) malloc(length + 1);
+    id = copy != NULL ? intern_new_id() : -1;
+    if ( id != -1 ) {
+        memcpy(copy, bytes, length);
+        copy[length] = '\0';
+        struct intern_string_t * string = intern_string(id);
+        string->bytes = copy;
+        string->length = length;
+        string->refs = 1;
+        string->hash = hash;
+        string->next = intern_buckets[bucket];
+        intern_buckets[bucket] = id + 1;
+        __atomic_add_fetch(&intern_n_strings, 1, __ATOMIC_RELAXED);
+    }
+    else {
+        free(copy);
+    }
+
+    pthread_mutex_unlock(stripe);
+    return id;
+}
+
+void intern_retain ( int id ) {
+    struct intern_string_t * string = intern_string(id);
+    pthread_mutex_t * stripe = &intern_stripes[(string->hash % INTERN_BUCKETS) % INTERN_STRIPES];
+
+    pthread_mutex_lock(stripe);
+    string->refs++;
+    pthread_mutex_unlock(stripe);
+}
+
+void intern_release ( int id ) {
+    struct intern_string_t * string = intern_string(id);
+    int bucket = (int) (string->hash % INTERN_BUCKETS);
+    pthread_mutex_t * stripe = &intern_stripes[bucket % INTERN_STRIPES];
+
+    pthread_mutex_lock(stripe);
+    int isLast = --string->refs == 0;
+    if ( isLast ) {
+        //out of its bucket, so no one finds it before the id is reused
+        int * link = &intern_buckets[bucket];
+        while ( *link != id + 1 )
+            link = &(intern_string(*link - 1)->next);
+        *link = string->next;
+        free(string->bytes);
+        string->bytes = NULL;
+        __atomic_sub_fetch(&intern_n_strings, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(stripe);
+
+    if ( isLast )
+        intern_free_id(id);
+}
+
+char * intern_bytes ( int id ) {
+    return intern_string(id)->bytes;
+}
+
+int intern_size () {
+    return __atomic_load_n(&intern_n_strings, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,68 @@
+//
+//  intern.h
+//  SD15-Product
+//
+//  Pool of the short element values the tuples keep repeating (status
+//  strings, tenant ids...). With it on, a tuple keeps the id of such a
+//  value instead of its bytes, and all the tuples with the same value
+//  share one copy, counted by references: it is freed with the last tuple
+//  that has it. Two interned values are equal only if their ids are.
+//
+//  The values are on segments that never move, so reading the value of an
+//  id takes no lock. Interning and releasing a value take the lock of its
+//  stripe only.
+//
+
+#ifndef SD15_Product_intern_h
+#define SD15_Product_intern_h
+
+//longer values stay on the tuple (they are not likely to repeat)
+#define INTERN_MAX_LENGTH 64
+//locks of the pool, each guarding the buckets with the same remainder
+#define INTERN_STRIPES 64
+//buckets of the values by hash (they do not grow: the pool is for a small set of values)
+#define INTERN_BUCKETS (64 * 1024)
+//values per segment and maximum number of segments (distinct values at once)
+#define INTERN_SEGMENT_SIZE 4096
+#define INTERN_MAX_SEGMENTS 1024
+
+/*
+ * Turns the pool on or off (YES or NO) for the tuples created from then on.
+ * The tuples already interned keep their values until destroyed.
+ */
+void intern_enable ( int on );
+
+/*
+ * Checks if the pool is on. YES or NO
+ */
+int intern_enabled ();
+
+/*
+ * Gets a reference to the value with the length bytes of bytes, adding it
+ * to the pool if it is not there yet.
+ * Returns its id, or -1 if it is not interned (the pool is off, the value
+ * is too long or the pool is full): the caller keeps its own copy then.
+ */
+int intern_acquire ( const char * bytes, int length );
+
+/*
+ * Gets one more reference to the value of id.
+ */
+void intern_retain ( int id );
+
+/*
+ * Gives back a reference to the value of id, freeing it if it was the last.
+ */
+void intern_release ( int id );
+
+/*
+ * Returns the value of id ('\0' terminated). The caller must hold a reference.
+ */
+char * intern_bytes ( int id );
+
+/*
+ * Returns the number of distinct values on the pool.
+ */
+int intern_size ();
+
+#endif
@@ -20,6 +20,13 @@ struct list_t {
     int  size;
     struct node_t *head;
     struct node_t *tail;
+    //YES if the header was taken from the request arena
+    int in_arena;
+    //YES while every node was added by key (the list is in descending key order)
+    int key_ordered;
+    //number of express lanes and the first node on each of them
+    int n_lanes;
+    struct node_t ** lane_heads;
 };
 /*
  * Structure that defines a doubly linked-list node.
@@ -28,8 +35,23 @@ typedef struct node_t {
     struct node_t *prev;
     struct node_t *next;
     struct entry_t *entry;
+    //copy of the entry signature, so the lists are searched without reading the entries
+    unsigned long long signature;
+    //the express lanes of the node (NULL if it is only on the list itself)
+    struct node_lanes_t * lanes;
 } node_t;
 
+/*
+ * Express lanes of a node of a key ordered list, making it a skip list.
+ * Each lane is a doubly linked (NULL terminated) list of the nodes at least
+ * that tall, in the same order than the list itself. A node is on
+ * lanes 0..height-1: links[2*lane] is its next and links[2*lane+1] its prev.
+ */
+struct node_lanes_t {
+    int height;
+    struct node_t * links[];
+};
+
 
 
 /*
@@ -52,11 +74,47 @@ typedef struct node_t {
 #define MUST_DESTROY 1
 #define NOT_DESTROY 0
 
+/*
+ * The head, the size and the next links of a list are what a reader walking
+ * it without locks follows (see table_read_slot), so they are written with
+ * list_publish: a node is only published once its own links are set, and a
+ * reader never sees half a pointer.
+ */
+#define list_publish(link, value) __atomic_store_n(&(link), (value), __ATOMIC_RELEASE)
+#define list_follow(link) __atomic_load_n(&(link), __ATOMIC_ACQUIRE)
+
+//maximum number of express lanes of a list
+#define LIST_MAX_LANES 16
+//one in LIST_LANE_FRACTION nodes on a lane is also on the lane above
+#define LIST_LANE_FRACTION 4
 
 
 
 
 
+
+/*
+ * Creates a list whose header lives in the request arena (if open).
+ * Used for the temporary lists of a get.
+ */
+struct list_t * list_create_temporary();
+
+/*
+ * Returns the last node of the key ordered list whose key goes before key
+ * (its key_length bytes) (is higher or, if include_equal, the same), or NULL if there is none.
+ * If update is not NULL it gets the last such node on each express lane.
+ * O(log n) on the express lanes.
+ */
+node_t * list_seek_key ( struct list_t * list, char * key, int key_length, int include_equal, node_t ** update );
+
+/*
+ * Returns the last node of the key ordered list whose key goes before every
+ * key starting with prefix (its prefix_length bytes, ignoring case), or NULL
+ * if there is none: the keys with the prefix come right after it.
+ * O(log n) on the express lanes.
+ */
+node_t * list_seek_prefix ( struct list_t * list, char * prefix, int prefix_length );
+
 /*
  * Creates a node having the prev and next node and its entry.
  */
@@ -70,14 +128,20 @@ node_t * node_create_empty();
  */
 node_t * node_dup(node_t* node);
 /*
- * Destroyes a node.
+ * Destroyes a node (it is freed once no reader can be walking on it).
  */
 int node_destroy (struct node_t * node);
+
+/*
+ * Frees a node retired by node_destroy.
+ */
+void node_free ( void * node );
 /*
  * Method that checks if a certain tuple matches a template.
  * If the tuple and the template have different sizes they dont match.
  * If a field of the template is not null and is not equal to element
- * at same position of the tuple, they dont match.
+ * at same position of the tuple, they dont match. A field with an
+ * operator must be satisfied by the element (see tuple_operator_matches).
  * Returns 1 (true) if they match, 0 otherwise.
  */
 int tuple_matches_template ( struct tuple_t * tuple , struct tuple_t * template );
@@ -92,6 +156,18 @@ int tuple_matches_template ( struct tuple_t * tuple , struct tuple_t * template
  */
 int list_insert_node(struct list_t* list,  node_t * newNode, node_t* aNode, int beforeOrAfter);
 
+/*
+ * Adds newNode to the list according to add_criterion (key, time or to the tail).
+ * Returns 0 in success case, -1 in error case.
+ */
+int list_add_node (struct list_t *list, node_t * newNode, int add_criterion, long long reference_timestamp );
+
+/*
+ * Takes nodeToRemove out of the list, destroying it and its entry if mustDestroy.
+ * Returns 0 in success case, -1 in error case.
+ */
+int list_remove_node (struct list_t * list, node_t * nodeToRemove, int mustDestroy );
+
 /*
  * Method that gets a node from the given list that matches the tup_template.
  * It returns the first matching node (head to tail) or NULL if none match.
@@ -121,7 +197,7 @@ struct entry_t * node_entry(node_t* node);
 
 
 /*
- * Method that compares two entry keys with strcmp 
+ * Method that compares two entry keys with bytes_casecmp
  * on the same order than the parameters are received.
  */
 int entry_keys_compare(struct entry_t * entryA, struct entry_t* entryB);
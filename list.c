@@ -14,6 +14,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include "message-private.h"
+#include "slab.h"
+#include "epoch.h"
 
 /* Cria uma nova lista. Em caso de erro, retorna NULL.
  */
@@ -24,10 +26,35 @@ struct list_t *list_create() {
         newList->size = 0;
         newList->head = NULL;
         newList->tail = NULL;
+        newList->in_arena = NO;
+        newList->key_ordered = YES;
+        newList->n_lanes = 0;
+        newList->lane_heads = NULL;
     }
     return newList;
 }
 
+/*
+ * Creates a list that only lives during the current request: if the
+ * request arena is open the list header is taken from it (and list_destroy
+ * leaves it there), otherwise it is the same as list_create.
+ */
+struct list_t * list_create_temporary() {
+    struct list_t * newList = (struct list_t*) slab_arena_alloc (sizeof(struct list_t));
+    
+    if ( newList == NULL )
+        return list_create();
+    
+    newList->size = 0;
+    newList->head = NULL;
+    newList->tail = NULL;
+    newList->in_arena = YES;
+    newList->key_ordered = YES;
+    newList->n_lanes = 0;
+    newList->lane_heads = NULL;
+    return newList;
+}
+
 /* Elimina uma lista, libertando *toda* a memoria utilizada pela
  * lista
  * Retorna 0 (OK) ou -1 (erro)
@@ -42,20 +69,172 @@ struct list_t *list_create() {
     //the number of nodes the list has
     int numberOfNodes = list_size(list);
     
-    while ( current != NULL && numberOfFreedNodes < numberOfNodes-1 ) {
-        if ( current->prev != NULL ) {
-            //if node is destroyed it increments the freed nodes number
-            if ( node_destroy(current->prev)  == SUCCEEDED ) {
-                numberOfFreedNodes++;
-            }
+    int nodesToFree = numberOfNodes;
+    while ( nodesToFree-- > 0 ) {
+        //the next node must be saved before the current is freed
+        node_t * next = current->next;
+        //if node is destroyed it increments the freed nodes number
+        if ( node_destroy(current) == SUCCEEDED ) {
+            numberOfFreedNodes++;
         }
-        current = current->next;
+        current = next;
     }
-    free(list);
+    free(list->lane_heads);
+    //headers from the request arena are given back with it
+    if ( !list->in_arena )
+        free(list);
     
     return numberOfFreedNodes == numberOfNodes ? 0 : -1;
 }
 
+/*
+ * Returns a random number of express lanes for a new node: 0 for most
+ * nodes, and each lane LIST_LANE_FRACTION times rarer than the one below.
+ */
+int list_random_height () {
+    //xorshift, per thread so the lists of different threads don't share it
+    static __thread unsigned int state = 2463534242u;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    
+    unsigned int bits = state;
+    int height = 0;
+    while ( height < LIST_MAX_LANES && bits % LIST_LANE_FRACTION == 0 ) {
+        height++;
+        bits /= LIST_LANE_FRACTION;
+    }
+    return height;
+}
+
+/*
+ * The next and prev nodes of node on an express lane.
+ */
+node_t ** node_lane_next ( node_t * node, int lane ) {
+    return &(node->lanes->links[2 * lane]);
+}
+node_t ** node_lane_prev ( node_t * node, int lane ) {
+    return &(node->lanes->links[2 * lane + 1]);
+}
+
+/*
+ * Checks if node goes before key on a key ordered list, ie, if its key is
+ * higher than key (or the same, if include_equal).
+ * With as_prefix the key of the node is cut to key_length bytes first, so
+ * the ones starting with key do not go before it.
+ */
+int node_goes_before ( node_t * node, char * key, int key_length, int include_equal, int as_prefix ) {
+    int node_key_length = entry_key_length(node->entry);
+    if ( as_prefix && node_key_length > key_length )
+        node_key_length = key_length;
+    int comparison = bytes_casecmp(key, key_length, node_key(node), node_key_length);
+    return comparison < 0 || (include_equal && comparison == 0);
+}
+
+/*
+ * What list_seek_key and list_seek_prefix do: the nodes go before key as node_goes_before says.
+ */
+node_t * list_seek ( struct list_t * list, char * key, int key_length, int include_equal, int as_prefix, node_t ** update ) {
+    //the last node known to go before key
+    node_t * last = NULL;
+    
+    //goes down the express lanes, from the top one
+    int lane;
+    for ( lane = list->n_lanes - 1; lane >= 0; lane-- ) {
+        node_t * next = last == NULL ? list->lane_heads[lane] : *node_lane_next(last, lane);
+        while ( next != NULL && node_goes_before(next, key, key_length, include_equal, as_prefix) ) {
+            last = next;
+            next = *node_lane_next(last, lane);
+        }
+        if ( update != NULL )
+            update[lane] = last;
+    }
+    
+    //and ends on the list itself
+    node_t * next = last == NULL ? list_head(list) : ( last == list_tail(list) ? NULL : last->next );
+    while ( next != NULL && node_goes_before(next, key, key_length, include_equal, as_prefix) ) {
+        last = next;
+        next = last == list_tail(list) ? NULL : last->next;
+    }
+    return last;
+}
+
+node_t * list_seek_key ( struct list_t * list, char * key, int key_length, int include_equal, node_t ** update ) {
+    return list_seek(list, key, key_length, include_equal, NO, update);
+}
+
+node_t * list_seek_prefix ( struct list_t * list, char * prefix, int prefix_length ) {
+    return list_seek(list, prefix, prefix_length, NO, YES, NULL);
+}
+
+/*
+ * Puts node, just inserted on the list, on a random number of express lanes,
+ * after the update nodes (the ones found by list_seek_key).
+ * Returns 0 (OK) or -1 (error, the node is kept only on the list).
+ */
+int list_lanes_add ( struct list_t * list, node_t * node, node_t ** update ) {
+    int height = list_random_height();
+    if ( height == 0 )
+        return SUCCEEDED;
+    
+    //the list gets the new lanes the node needs (empty until now)
+    if ( height > list->n_lanes ) {
+        node_t ** lane_heads = (node_t **) realloc(list->lane_heads, height * sizeof(node_t *));
+        if ( lane_heads == NULL )
+            return FAILED;
+        int lane;
+        for ( lane = list->n_lanes; lane < height; lane++ ) {
+            lane_heads[lane] = NULL;
+            update[lane] = NULL;
+        }
+        list->lane_heads = lane_heads;
+        list->n_lanes = height;
+    }
+    
+    node->lanes = (struct node_lanes_t *) slab_alloc(sizeof(struct node_lanes_t) + 2 * height * sizeof(node_t *));
+    if ( node->lanes == NULL )
+        return FAILED;
+    node->lanes->height = height;
+    
+    int lane;
+    for ( lane = 0; lane < height; lane++ ) {
+        node_t * prev = update[lane];
+        node_t * next = prev == NULL ? list->lane_heads[lane] : *node_lane_next(prev, lane);
+        
+        *node_lane_prev(node, lane) = prev;
+        *node_lane_next(node, lane) = next;
+        if ( prev == NULL )
+            list->lane_heads[lane] = node;
+        else
+            *node_lane_next(prev, lane) = node;
+        if ( next != NULL )
+            *node_lane_prev(next, lane) = node;
+    }
+    return SUCCEEDED;
+}
+
+/*
+ * Takes node, that is leaving the list, out of its express lanes.
+ */
+void list_lanes_remove ( struct list_t * list, node_t * node ) {
+    if ( node->lanes == NULL )
+        return;
+    
+    int lane;
+    for ( lane = 0; lane < node->lanes->height; lane++ ) {
+        node_t * prev = *node_lane_prev(node, lane);
+        node_t * next = *node_lane_next(node, lane);
+        if ( prev == NULL )
+            list->lane_heads[lane] = next;
+        else
+            *node_lane_next(prev, lane) = next;
+        if ( next != NULL )
+            *node_lane_prev(next, lane) = prev;
+    }
+    slab_free(node->lanes, sizeof(struct node_lanes_t) + 2 * node->lanes->height * sizeof(node_t *));
+    node->lanes = NULL;
+}
+
 // nodeToAdd fica antes do currentNode se...
 int node_matches_criterion( node_t * nodeToAdd, node_t * currentNode, int criterion, long long reference_timestamp) {
     int matches = NO;
@@ -81,6 +260,24 @@ int  list_add_node (struct list_t *list, node_t * newNode, int add_criterion, lo
     if ( newNode == NULL)
         return taskSucess;
     
+    //on a key ordered list the place is found on the express lanes, in O(log n)
+    if ( add_criterion == ADD_WITH_CRITERION_KEY && list->key_ordered ) {
+        node_t * update[LIST_MAX_LANES];
+        //the new node goes after all the nodes with higher or equal key
+        node_t * lastBefore = list_seek_key(list, node_key(newNode), entry_key_length(node_entry(newNode)), YES, update);
+        
+        taskSucess = lastBefore == NULL ? list_insert_node(list, newNode, list_head(list), 0)
+                                        : list_insert_node(list, newNode, lastBefore, 1);
+        if ( taskSucess == SUCCEEDED )
+            list_lanes_add(list, newNode, update);
+        
+        return taskSucess;
+    }
+    
+    //any other criterion leaves the list out of key order
+    if ( add_criterion != ADD_WITH_CRITERION_KEY && !list_isEmpty(list) )
+        list->key_ordered = NO;
+    
     //pointer iterate
 
     node_t * currentNode = add_criterion ? list_head(list) : list_tail(list);
@@ -156,10 +353,14 @@ int list_remove_node (struct list_t * list, node_t * nodeToRemove, int mustDestr
     //success flag, fail as a start since nothing was done yet
     int taskSuccess = FAILED;
     
+    list_lanes_remove(list, nodeToRemove);
+    
     if ( list_size(list) == 1 ) {
-        list->head = NULL;
+        list_publish(list->head, NULL);
         list->tail = NULL;
         list_size_dec(list);
+        //an empty list is in key order again
+        list->key_ordered = YES;
     }
     else {
         //nodeA is the prev of aNode
@@ -168,13 +369,14 @@ int list_remove_node (struct list_t * list, node_t * nodeToRemove, int mustDestr
         node_t * nodeAfter = nodeToRemove->next;
         
         //all the redifining happens...
-        nodeBefore->next = nodeAfter;
+        //(the removed node keeps its next, so a reader standing on it can go on)
+        list_publish(nodeBefore->next, nodeAfter);
         nodeAfter->prev = nodeBefore;
         // if nodeB was now added before nodeC which was the head,
         // nodeB becames the list->head and tail->next points to nodeB.
         if ( list_head(list) == nodeToRemove ) {
-            list->head = nodeAfter;
-            list->tail->next = nodeAfter;
+            list_publish(list->head, nodeAfter);
+            list_publish(list->tail->next, nodeAfter);
         }
         // if nodeC was now added after nodeB which was the tail,
         // nodeC becames the list->tail and head->prev points to nodeC.
@@ -254,11 +456,13 @@ struct entry_t *list_get(struct list_t *list, struct tuple_t *tup_template) {
  * Creates a node having the prev and next node and its entry.
  */
  node_t * node_create( struct node_t * prev, struct node_t* next, struct entry_t * entry) {
-    node_t * newNode = (node_t *) malloc ( sizeof(node_t));
+    node_t * newNode = (node_t *) slab_alloc ( sizeof(node_t));
     if ( newNode != NULL ) {
         newNode->prev =  prev;
         newNode->next = next;
         newNode->entry = entry;
+        newNode->signature = entry == NULL ? 0 : entry->signature;
+        newNode->lanes = NULL;
     }
     
     return newNode;
@@ -268,7 +472,9 @@ struct entry_t *list_get(struct list_t *list, struct tuple_t *tup_template) {
  * Creates an empty node - just allocates memory for the structure.
  */
  node_t * node_create_empty() {
-    node_t * newNode = (node_t *) malloc ( sizeof(node_t) );
+    node_t * newNode = (node_t *) slab_alloc ( sizeof(node_t) );
+    if ( newNode != NULL )
+        newNode->lanes = NULL;
     return newNode;
 }
 
@@ -292,17 +498,28 @@ struct entry_t *list_get(struct list_t *list, struct tuple_t *tup_template) {
     if ( node == NULL || node->entry == NULL )
         return FAILED;
     
-    free(node);
+    //the lanes are only walked under the slot lock, so they go at once
+    if ( node->lanes != NULL ) {
+        slab_free(node->lanes, sizeof(struct node_lanes_t) + 2 * node->lanes->height * sizeof(node_t *));
+        node->lanes = NULL;
+    }
+    //the node itself may still be under a reader walking the list without locks
+    epoch_retire(node, node_free);
     
     //success
     return SUCCEEDED;
 }
 
+void node_free ( void * node ) {
+    slab_free(node, sizeof(node_t));
+}
+
 /*
  * Method that checks if a certain tuple matches a template.
  * If the tuple and the template have different sizes they dont match.
  * If a field of the template is not null and is not equal to element
- * at same position of the tuple, they dont match.
+ * at same position of the tuple, they dont match. A field with an
+ * operator must be satisfied by the element (see tuple_operator_matches).
  * Returns 1 (true) if they match, 0 otherwise.
  */
  int tuple_matches_template ( struct tuple_t * tuple , struct tuple_t * template ) {
@@ -316,14 +533,28 @@ struct entry_t *list_get(struct list_t *list, struct tuple_t *tup_template) {
     int iElement = 0;
     
     while ( matches && iElement < tuple_size(tuple) ) {
-        //tuple iElement
-        char * tupleElement = tuple_element(tuple, iElement);
-        //template iElement
-        char * templateElement = tuple_element(template, iElement);
+        //the lengths of the elements (-1 if NULL)
+        int tupleLength = tuple_element_length(tuple, iElement);
+        int templateLength = tuple_element_length(template, iElement);
         
+        //a NULL templateElement matches anything, unless it has an operator (a prefix or a range)
+        struct tuple_operator_t operator;
+        if ( templateLength == -1 && tupleLength != -1 && tuple_element_operator(template, iElement, &operator) != TUPLE_OP_NONE ) {
+            matches = tuple_operator_matches(&operator, tuple_element(tuple, iElement), tupleLength);
+        }
         //if templateElement is not null but not equal to the tupleElement, doesnt match.
-        if ( templateElement != NULL &&  tupleElement != NULL &&  strcmp(tupleElement, templateElement) != 0 )
-            matches = 0;
+        //(the lengths are checked first, then the ids if both are interned, the bytes otherwise)
+        else if ( templateLength != -1 && tupleLength != -1 ) {
+            if ( templateLength != tupleLength ) {
+                matches = 0;
+            }
+            else {
+                int tupleId = tuple_element_id(tuple, iElement);
+                int templateId = tuple_element_id(template, iElement);
+                matches = tupleId != -1 && templateId != -1 ? tupleId == templateId
+                    : memcmp(tuple_element(tuple, iElement), tuple_element(template, iElement), tupleLength) == 0;
+            }
+        }
         
         iElement++;
     }
@@ -349,7 +580,7 @@ struct entry_t *list_get(struct list_t *list, struct tuple_t *tup_template) {
     if ( aNode == NULL && list_isEmpty(list) ) {
         newNode->next = newNode;
         newNode->prev = newNode;
-        list->head = newNode;
+        list_publish(list->head, newNode);
         list->tail = newNode;
     }
     else {
@@ -364,12 +595,13 @@ struct entry_t *list_get(struct list_t *list, struct tuple_t *tup_template) {
         node_t * nodeA = beforeOrAfter == 0 ? newNode : aNode;
         node_t * nodeB = nodeA == newNode ? aNode : newNode;
 
-        nodeA->next = nodeB;
-        nodeB->prev = nodeA;
-        nodeA->prev = nodeB;
-        nodeB->next = nodeA;
+        //the new node is linked before it is published
+        newNode->next = aNode;
+        newNode->prev = aNode;
+        aNode->prev = newNode;
+        list_publish(aNode->next, newNode);
 
-        list->head = nodeA;
+        list_publish(list->head, nodeA);
         list->tail = nodeB;
     }
     else {
@@ -389,18 +621,19 @@ struct entry_t *list_get(struct list_t *list, struct tuple_t *tup_template) {
         node_t * nodeC = nodeB == newNode ? aNode : newNode;
 
         //all the redifining happens...
-        nodeA->next = nodeB;
-        nodeB->prev = nodeA;
-        nodeB->next = nodeC;
-        nodeC->prev = nodeB;
-        nodeC->next = nodeD;
-        nodeD->prev = nodeC;
+        //the new node gets its own links first, so it is complete when the node before publishes it
+        node_t * nodeBefore = nodeB == newNode ? nodeA : nodeB;
+        node_t * nodeAfter = nodeB == newNode ? nodeC : nodeD;
+        newNode->prev = nodeBefore;
+        newNode->next = nodeAfter;
+        nodeAfter->prev = newNode;
+        list_publish(nodeBefore->next, newNode);
 
         // if nodeB was now added before nodeC which was the head,
         // nodeB becames the list->head and tail->next points to nodeB.
         if ( nodeB == newNode && list_head(list) == aNode ) {
-            list->head = nodeB;
-            list->tail->next = nodeB;
+            list_publish(list->head, nodeB);
+            list_publish(list->tail->next, nodeB);
         }
 
         // if nodeC was now added after nodeB which was the tail,
@@ -420,9 +653,11 @@ return SUCCEEDED;
 }
 
 int list_insert_to_tail ( struct list_t * list, node_t* node) {
+    list->key_ordered = list_isEmpty(list);
     return list_insert_node(list, node, NULL, 1);
 }
 int list_insert_to_head ( struct list_t * list, node_t* node) {
+    list->key_ordered = list_isEmpty(list);
     return list_insert_node(list, node, NULL, 0);
 }
 
@@ -477,9 +712,10 @@ int list_insert_to_head ( struct list_t * list, node_t* node) {
         //if it must be removed from the original list we only need to
         // remove it from the original list without destroying it.
         taskSuccess+= list_remove_node(fromList, node, NOT_DESTROY );
-        //now the matchedNode is out of the list and can be inserted
-        //or added (depending on mustMoveWithCritirion option ) to the matching nodes list
-        taskSuccess+= list_add_node(toList, node, move_criterium, reference_timestamp);
+        //the entry goes in a new node: a reader walking fromList without
+        //locks may still be on node, so it is retired and not relinked
+        taskSuccess+= list_add_with_criterion(toList, node_entry(node), move_criterium, reference_timestamp);
+        node_destroy(node);
     }
     else if ( whatToDoWithTheNode == JUST_DELETE_NODES ) {
         taskSuccess+= list_remove_node(fromList, node, MUST_DESTROY );
@@ -497,19 +733,39 @@ struct list_t * list_matching_nodes (struct list_t *list, struct tuple_t *tup_te
     
     
     //the list where to save all the matching nodes found on this list.
-    struct list_t * matching_nodes = list_create();
+    struct list_t * matching_nodes = list_create_temporary();
+    
+    //the template is compiled once so most nodes are rejected by their signature
+    struct entry_signature_t signature;
+    entry_template_signature(tup_template, &signature);
     
     //pointer node to iterare
     node_t * matchedNode = list_head(list);
     //number of nodes to check matching
     unsigned int nodesToCheck = list_size(list);
     
+    //on a key ordered list, with a template key, only the nodes with that key are checked
+    char * key = tuple_key(tup_template);
+    int key_length = tuple_key_length(tup_template);
+    int onlyWithKey = key != NULL && list->key_ordered;
+    if ( onlyWithKey ) {
+        node_t * lastBefore = list_seek_key(list, key, key_length, NO, NULL);
+        if ( lastBefore != NULL ) {
+            matchedNode = lastBefore->next;
+            nodesToCheck = lastBefore == list_tail(list) ? 0 : nodesToCheck;
+        }
+    }
+    
     //It will move forward until it currentNode matches the template
     while ( nodesToCheck-- > 0 ) {
 
         //in case of a match and a node is removed
         node_t * nextNode = matchedNode->next;
-        if ( node_matches_template(matchedNode, tup_template) ) {
+        if ( onlyWithKey && bytes_casecmp(key, key_length, node_key(matchedNode), entry_key_length(node_entry(matchedNode))) != 0 ) {
+            //all the nodes with the key were checked
+            nodesToCheck = 0;
+        }
+        else if ( entry_signature_may_match(matchedNode->signature, &signature) && node_matches_template(matchedNode, tup_template) ) {
             //if moves the matchedNode from list to matching_nodes
             // with adding criterion and matchedNode whatToDoWithTheNode or not.
             list_move_node(list, matching_nodes, matchedNode, MOVE_WITH_CRITERION_KEY, 0, whatToDoWithTheNode);
@@ -534,7 +790,7 @@ struct list_t * list_entries_newer_than (struct list_t *list, long long timestam
     
     
     //the list where to save all the matching nodes found on this list.
-    struct list_t * newer_entries = list_create();
+    struct list_t * newer_entries = list_create_temporary();
     
     //pointer node to iterare
     node_t * currentNode = list_head(list);
@@ -594,25 +850,25 @@ struct list_t * list_entries_newer_than (struct list_t *list, long long timestam
 }
 
 /*
- * Method that compares two entry keys with strcmp/2
+ * Method that compares two entry keys with bytes_casecmp
  * on the same order than the parameters are received.
  */
  int entry_keys_compare(struct entry_t * entryA, struct entry_t * entryB ) {
-    return strcasecmp(entry_key(entryA), entry_key(entryB));
+    return bytes_casecmp(entry_key(entryA), entry_key_length(entryA), entry_key(entryB), entry_key_length(entryB));
 }
 
 /*
  * Method that increments +1 to the size of the the given list.
  */
  void list_size_inc(struct list_t * list) {
-    list->size++;
+    list_publish(list->size, list->size + 1);
 }
 
 /*
  * Method that decrements -1 to the size of the given list.
  */
  void list_size_dec( struct list_t * list) {
-    list->size--;
+    list_publish(list->size, list->size - 1);
 }
 
 /*
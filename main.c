@@ -6,6 +6,7 @@
 #include "table-private.h"
 #include "table.h"
 #include "list-private.h"
+#include "tuple-private.h"
 
 #define GET_ALL 0
 #define GET_ONE 1
@@ -23,8 +24,8 @@ int tuple_match(struct tuple_t *tup, struct tuple_t *tup_template){
         return 0;
     
     for(i = 0; i < tup->tuple_dimension; i++)
-        if (tup_template->tuple[i] != NULL)
-            if (strcmp(tup_template->tuple[i], tup->tuple[i]) != 0)
+        if (tuple_element(tup_template, i) != NULL)
+            if (strcmp(tuple_element(tup_template, i), tuple_element(tup, i)) != 0)
                 return 0;
     return 1;
 }
@@ -50,15 +51,16 @@ int tuple_match(struct tuple_t *tup, struct tuple_t *tup_template){
         int result, i;
         struct table_t *table = table_create(10);
         
-        char *tdata[3] = {"       ", "2014", "Fixe!"};
-        struct tuple_t *t = tuple_create2(3, tdata);
+        char key[16];
+        char *tdata[3] = {key, "2014", "Fixe!"};
+        struct tuple_t *t = NULL;
         struct tuple_t *tdups[1024];
         
         struct list_t *res;
         
         for(i = 0; i < 1024; i++) {
-            sprintf(t->tuple[0], "SD-%d", i);
-            tdups[i] = tuple_dup(t);
+            sprintf(key, "SD-%d", i);
+            tdups[i] = tuple_create2(3, tdata);
             table_put(table, tdups[i]);
         }
         
@@ -69,8 +71,7 @@ int tuple_match(struct tuple_t *tup, struct tuple_t *tup_template){
             res = table_get(table, tdups[i], KEEP_TUPLES, GET_ONE);
             assert(list_size(res) == 1);
             assert(tuple_match(res->head->entry->value, tdups[i]) == 1 || res->head->entry->value == tdups[i]);
-            free(res->head);
-            free(res);
+            list_destroy(res);
         }
         
         assert(table_size(table) == 1024);
@@ -90,19 +91,21 @@ int tuple_match(struct tuple_t *tup, struct tuple_t *tup_template){
     int testDuplicados(){
         int result, i;
         struct table_t *table = table_create(10);
-        char *tdata[3] = {"       ", "2014", "Fixe!"};
-        struct tuple_t *t = tuple_create2(3, tdata);
+        char key[16];
+        char *tdata[3] = {key, "2014", "Fixe!"};
+        struct tuple_t *t = NULL;
         struct tuple_t *tdups[20];
         
         struct list_t *res;
         
         for(i = 0; i < 20; i++) {
-            sprintf(t->tuple[0], "SD-%d", i);
-            tdups[i] = tuple_dup(t);
+            sprintf(key, "SD-%d", i);
+            tdups[i] = tuple_create2(3, tdata);
             table_put(table, tdups[i]);
         }
         
-        sprintf(t->tuple[0], "SD-%d", 10);
+        sprintf(key, "SD-%d", 10);
+        t = tuple_create2(3, tdata);
         table_put(table, t);
         
         assert(table_size(table) == 21);
@@ -129,14 +132,15 @@ int tuple_match(struct tuple_t *tup, struct tuple_t *tup_template){
     int testAll(){
         int result, i;
         struct table_t *table = table_create(10);
-        char *tdata[3] = {"       ", "2014", "Fixe!"};
-        struct tuple_t *t = tuple_create2(3, tdata);
+        char key[16];
+        char *tdata[3] = {key, "2014", "Fixe!"};
+        struct tuple_t *t = NULL;
         struct tuple_t *tdups[20];
         struct list_t *res;
         
         for(i = 0; i < 20; i++) {
-            sprintf(t->tuple[0], "SD-%d", i);
-            tdups[i] = tuple_dup(t);
+            sprintf(key, "SD-%d", i);
+            tdups[i] = tuple_create2(3, tdata);
             table_put(table, tdups[i]);
         }
         
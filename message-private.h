@@ -15,6 +15,7 @@
 #include "entry-private.h"
 #include "entry.h"
 #include "message.h"
+#include "inet.h"
 
 //operation codes
 #define OC_ERROR -99
@@ -32,8 +33,19 @@
 #define ENTRY_DIMENSION_SIZE 4
 #define ENTRY_ELEMENTSIZE_SIZE 4
 #define RESULT_SIZE 	4
+#define REQUEST_ID_SIZE 4
+
+//the bit of the C_TYPE that says a REQUEST_ID follows it
+#define C_TYPE_REQUEST_ID 0x4000
+//the request_id of a message without one
+#define NO_REQUEST_ID 0
 #define TOKEN_STRING_SIZE   4
 
+//the most bytes the content of a CT_TUPLES (or CT_TUPLE) message has, so that the message fits in MAX_MSG with a request id
+#define TUPLES_MAX_BYTES (MAX_MSG - OPCODE_SIZE - C_TYPE_SIZE - REQUEST_ID_SIZE)
+//the most tuples a CT_TUPLES message can have (each takes at least its size and its dimension)
+#define TUPLES_MAX_PER_MESSAGE ((TUPLES_MAX_BYTES - BUFFER_INTEGER_SIZE) / (BUFFER_INTEGER_SIZE + TUPLE_DIMENSION_SIZE))
+
 
 long long swap_bytes_64(long long number);
 
@@ -57,6 +69,11 @@ struct message_t ** message_create_set ( int msg_num );
  */
 void free_message_set(struct message_t ** message_set, int num);
 
+/*
+ * Gives the num messages of message_set the request_id (of the request they answer).
+ */
+void message_set_request_id(struct message_t ** message_set, int num, int request_id);
+
 /*
  * Returns the tuple_t from the message or NULL if msg is NULL.
  * Assumes the invoker knows what he is doing, ie., that
@@ -74,8 +91,92 @@ int message_size_bytes (  struct message_t * msg );
  */
 int message_content_size_bytes (  struct message_t * msg );
 
+/*
+ * Serializes a lease (the content of a CT_LEASE message): when it expires
+ * followed by the entry. Returns the size of the buffer or -1 (error).
+ */
+int message_serialize_lease ( struct entry_t * entry, char ** buffer );
+
+/*
+ * Deserializes a lease serialized by message_serialize_lease.
+ */
+struct entry_t * message_deserialize_lease ( char * buffer, int buffer_size );
+
+/*
+ * Creates a batch for n_entries entries (all NULL until set).
+ * Returns NULL in case of error.
+ */
+struct batch_t * batch_create ( int n_entries );
+
+/*
+ * Frees the batch and, if free_entries (YES/NO), its entries.
+ */
+void batch_destroy ( struct batch_t * batch, int free_entries );
+
+/*
+ * Returns the size in bytes of the batch as serialized.
+ */
+int batch_size_bytes ( struct batch_t * batch );
+
+/*
+ * Serializes a batch (the content of a CT_BATCH message): the number of
+ * entries followed by each entry, after its size.
+ * Returns the size of the buffer or -1 (error).
+ */
+int message_serialize_batch ( struct batch_t * batch, char ** buffer );
+
+/*
+ * Deserializes a batch serialized by message_serialize_batch.
+ */
+struct batch_t * message_deserialize_batch ( char * buffer, int buffer_size );
+
+/*
+ * Creates an empty set of tuples with room for capacity of them, to be the
+ * content of a CT_TUPLES message. Returns NULL in case of error.
+ */
+struct tuples_t * tuples_create ( int capacity );
+
+/*
+ * Frees the set and, if free_tuples (YES/NO), its tuples.
+ */
+void tuples_destroy ( struct tuples_t * tuples, int free_tuples );
+
+/*
+ * Adds tuple to the set if it has room for it and the CT_TUPLES message
+ * still fits in MAX_MSG with it (an empty set takes any tuple).
+ * YES or NO (the set is full: tuple goes on the next one).
+ */
+int tuples_add_fitting ( struct tuples_t * tuples, struct tuple_t * tuple );
+
+/*
+ * Serializes a set of tuples (the content of a CT_TUPLES message): the number
+ * of tuples followed by each tuple, after its size.
+ * Returns the size of the buffer or -1 (error).
+ */
+int message_serialize_tuples ( struct tuples_t * tuples, char ** buffer );
+
+/*
+ * Deserializes a set of tuples serialized by message_serialize_tuples.
+ */
+struct tuples_t * message_deserialize_tuples ( char * buffer, int buffer_size );
+
+/*
+ * Creates the message with opcode that carries the tuples: a CT_TUPLES or,
+ * if they are a single tuple too big for one, a CT_TUPLE (the set is then freed).
+ */
+struct message_t * message_of_tuples ( int opcode, struct tuples_t * tuples );
+
+/*
+ * Builds a batch from its text (see message_to_string):
+ * "opcode ctype n_entries timestamp tuple timestamp tuple ...".
+ * Returns NULL if it is malformed.
+ */
+struct batch_t * batch_create_from_string ( const char * input );
+
 /*
  * More flexible free_message function that gets the option free_content (YES/NO).
+ * The array of a CT_BATCH or a CT_TUPLES is the message's, so it is always freed:
+ * free_content says if its entries (or tuples) are too.
  */
 void free_message2(struct  message_t * message, int free_content);
 
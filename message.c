@@ -25,6 +25,8 @@
  */
 struct message_t * message_create () {
     struct message_t * new_message = (struct message_t*) malloc ( sizeof(struct message_t) );
+    if ( new_message != NULL )
+        new_message->request_id = NO_REQUEST_ID;
     return new_message;
 }
 
@@ -43,12 +45,20 @@ struct message_t * message_create_with ( int opcode, int content_type, void * el
         //depending on the content_type sets the content
         switch (content_type) {
             case CT_ENTRY:
+            case CT_LEASE:
                 new_message->content.entry = element;
                 break;
             case CT_TUPLE:
                 new_message->content.tuple = element;
                 break;
+            case CT_BATCH:
+                new_message->content.batch = element;
+                break;
+            case CT_TUPLES:
+                new_message->content.tuples = element;
+                break;
             case CT_RESULT:
+            case CT_PART:
                 new_message->content.result = * ((int *) element);
                 break;
                 // * (Atualizado para Projeto 5) - TOKEN
@@ -86,6 +96,14 @@ void free_message_set(struct message_t ** message_set, int num) {
     }
 }
 
+void message_set_request_id(struct message_t ** message_set, int num, int request_id) {
+    int i;
+    for ( i = 0; message_set != NULL && i < num; i++ ) {
+        if ( message_set[i] != NULL )
+            message_set[i]->request_id = request_id;
+    }
+}
+
 /*
  * Returns the tuple_t from the message or NULL if msg is NULL.
  * Assumes the invoker knows what he is doing, ie., that
@@ -99,7 +117,8 @@ struct tuple_t * tuple_from_message(struct message_t * msg ) {
  * Returns the size of the given message in bytes.
  */
 int message_size_bytes ( struct message_t * msg ) {
-    return OPCODE_SIZE + C_TYPE_SIZE + message_content_size_bytes(msg);
+    int request_id_size = msg != NULL && msg->request_id != NO_REQUEST_ID ? REQUEST_ID_SIZE : 0;
+    return OPCODE_SIZE + C_TYPE_SIZE + request_id_size + message_content_size_bytes(msg);
 }
 
 /*
@@ -123,7 +142,16 @@ int message_content_size_bytes ( struct message_t * msg ) {
     else if ( msg->c_type == CT_ENTRY ) {
         content_size_bytes = entry_size_bytes(msg->content.entry);
     }
-    else if ( msg->c_type == CT_RESULT ) {
+    else if ( msg->c_type == CT_LEASE ) {
+        content_size_bytes = TIMESTAMP_SIZE + entry_size_bytes(msg->content.entry);
+    }
+    else if ( msg->c_type == CT_BATCH ) {
+        content_size_bytes = batch_size_bytes(msg->content.batch);
+    }
+    else if ( msg->c_type == CT_TUPLES ) {
+        content_size_bytes = msg->content.tuples->size_bytes;
+    }
+    else if ( msg->c_type == CT_RESULT || msg->c_type == CT_PART ) {
         content_size_bytes = RESULT_SIZE;
     }
     else if (msg->c_type == CT_SFAILURE || msg->c_type == CT_SRUNNING || msg->c_type == CT_INVCMD){
@@ -154,7 +182,16 @@ int message_serialize_content ( struct message_t * message, char ** buffer ) {
     else if ( message->c_type == CT_ENTRY ) {
         buffer_size = entry_serialize(message->content.entry, buffer);
     }
-    else if ( message->c_type == CT_RESULT ) {
+    else if ( message->c_type == CT_LEASE ) {
+        buffer_size = message_serialize_lease(message->content.entry, buffer);
+    }
+    else if ( message->c_type == CT_BATCH ) {
+        buffer_size = message_serialize_batch(message->content.batch, buffer);
+    }
+    else if ( message->c_type == CT_TUPLES ) {
+        buffer_size = message_serialize_tuples(message->content.tuples, buffer);
+    }
+    else if ( message->c_type == CT_RESULT || message->c_type == CT_PART ) {
         buffer[0] = (char*) malloc(RESULT_SIZE );
         int result_to_network = htonl(message->content.result);
         memcpy(buffer[0], &result_to_network, RESULT_SIZE);
@@ -174,14 +211,302 @@ int message_serialize_content ( struct message_t * message, char ** buffer ) {
     return buffer_size;
 }
 
+/*
+ * Serializes a lease: when it expires followed by the entry.
+ */
+int message_serialize_lease ( struct entry_t * entry, char ** buffer ) {
+    char * serialized_entry = NULL;
+    int serialized_entry_size = entry_serialize(entry, &serialized_entry);
+    if ( serialized_entry_size == FAILED )
+        return FAILED;
+    
+    *buffer = (char*) malloc(TIMESTAMP_SIZE + serialized_entry_size);
+    long long expires_to_network = swap_bytes_64(entry->expires);
+    memcpy(*buffer, &expires_to_network, TIMESTAMP_SIZE);
+    memcpy(*buffer + TIMESTAMP_SIZE, serialized_entry, serialized_entry_size);
+    free(serialized_entry);
+    
+    return TIMESTAMP_SIZE + serialized_entry_size;
+}
+
+/*
+ * Deserializes a lease (see message_serialize_lease).
+ */
+struct entry_t * message_deserialize_lease ( char * buffer, int buffer_size ) {
+    if ( buffer == NULL || buffer_size <= TIMESTAMP_SIZE )
+        return NULL;
+    
+    long long expires_network = 0;
+    memcpy(&expires_network, buffer, TIMESTAMP_SIZE);
+    
+    struct entry_t * entry = entry_deserialize(buffer + TIMESTAMP_SIZE, buffer_size - TIMESTAMP_SIZE);
+    if ( entry != NULL )
+        entry->expires = swap_bytes_64(expires_network);
+    return entry;
+}
+
+struct batch_t * batch_create ( int n_entries ) {
+    if ( n_entries <= 0 )
+        return NULL;
+    
+    struct batch_t * batch = (struct batch_t *) malloc(sizeof(struct batch_t));
+    if ( batch == NULL )
+        return NULL;
+    batch->n_entries = n_entries;
+    batch->entries = (struct entry_t **) calloc(n_entries, sizeof(struct entry_t *));
+    if ( batch->entries == NULL ) {
+        free(batch);
+        return NULL;
+    }
+    return batch;
+}
+
+void batch_destroy ( struct batch_t * batch, int free_entries ) {
+    if ( batch == NULL )
+        return;
+    
+    if ( free_entries ) {
+        int i;
+        for ( i = 0; i < batch->n_entries; i++ )
+            entry_destroy(batch->entries[i]);
+    }
+    free(batch->entries);
+    free(batch);
+}
+
+int batch_size_bytes ( struct batch_t * batch ) {
+    if ( batch == NULL )
+        return FAILED;
+    
+    int size = BUFFER_INTEGER_SIZE;
+    int i;
+    for ( i = 0; i < batch->n_entries; i++ )
+        size += BUFFER_INTEGER_SIZE + entry_size_bytes(batch->entries[i]);
+    return size;
+}
+
+/*
+ * Serializes a batch: how many entries it has and then each entry after its size.
+ */
+int message_serialize_batch ( struct batch_t * batch, char ** buffer ) {
+    int buffer_size = batch_size_bytes(batch);
+    if ( buffer_size == FAILED )
+        return FAILED;
+    
+    *buffer = (char*) malloc(buffer_size);
+    if ( *buffer == NULL )
+        return FAILED;
+    
+    int offset = 0;
+    int n_entries_to_network = htonl(batch->n_entries);
+    memcpy(*buffer + offset, &n_entries_to_network, BUFFER_INTEGER_SIZE);
+    offset += BUFFER_INTEGER_SIZE;
+    
+    int i;
+    for ( i = 0; i < batch->n_entries; i++ ) {
+        char * serialized_entry = NULL;
+        int serialized_entry_size = entry_serialize(batch->entries[i], &serialized_entry);
+        if ( serialized_entry_size == FAILED ) {
+            free(*buffer);
+            return FAILED;
+        }
+        int entry_size_to_network = htonl(serialized_entry_size);
+        memcpy(*buffer + offset, &entry_size_to_network, BUFFER_INTEGER_SIZE);
+        offset += BUFFER_INTEGER_SIZE;
+        memcpy(*buffer + offset, serialized_entry, serialized_entry_size);
+        offset += serialized_entry_size;
+        free(serialized_entry);
+    }
+    
+    return offset;
+}
+
+/*
+ * Deserializes a batch (see message_serialize_batch).
+ */
+struct batch_t * message_deserialize_batch ( char * buffer, int buffer_size ) {
+    if ( buffer == NULL || buffer_size < BUFFER_INTEGER_SIZE )
+        return NULL;
+    
+    int offset = 0;
+    int n_entries_network = 0;
+    memcpy(&n_entries_network, buffer + offset, BUFFER_INTEGER_SIZE);
+    offset += BUFFER_INTEGER_SIZE;
+    
+    //each entry takes at least its size, so a bigger count is not believed
+    int n_entries = ntohl(n_entries_network);
+    if ( n_entries <= 0 || n_entries > (buffer_size - offset) / BUFFER_INTEGER_SIZE )
+        return NULL;
+    
+    struct batch_t * batch = batch_create(n_entries);
+    int valid = batch != NULL;
+    int i;
+    for ( i = 0; valid && i < n_entries; i++ ) {
+        int entry_size_network = 0;
+        valid = buffer_size - offset >= BUFFER_INTEGER_SIZE;
+        if ( valid ) {
+            memcpy(&entry_size_network, buffer + offset, BUFFER_INTEGER_SIZE);
+            offset += BUFFER_INTEGER_SIZE;
+        }
+        int entry_size = ntohl(entry_size_network);
+        valid = valid && entry_size > TIMESTAMP_SIZE && entry_size <= buffer_size - offset;
+        if ( valid ) {
+            batch->entries[i] = entry_deserialize(buffer + offset, entry_size);
+            offset += entry_size;
+            valid = batch->entries[i] != NULL;
+        }
+    }
+    
+    if ( !valid ) {
+        batch_destroy(batch, YES);
+        return NULL;
+    }
+    return batch;
+}
+
+struct tuples_t * tuples_create ( int capacity ) {
+    if ( capacity <= 0 )
+        return NULL;
+    
+    struct tuples_t * tuples = (struct tuples_t *) malloc(sizeof(struct tuples_t));
+    if ( tuples == NULL )
+        return NULL;
+    tuples->n_tuples = 0;
+    tuples->capacity = capacity;
+    tuples->size_bytes = BUFFER_INTEGER_SIZE;
+    tuples->tuples = (struct tuple_t **) calloc(capacity, sizeof(struct tuple_t *));
+    if ( tuples->tuples == NULL ) {
+        free(tuples);
+        return NULL;
+    }
+    return tuples;
+}
+
+void tuples_destroy ( struct tuples_t * tuples, int free_tuples ) {
+    if ( tuples == NULL )
+        return;
+    
+    if ( free_tuples ) {
+        int i;
+        for ( i = 0; i < tuples->n_tuples; i++ )
+            tuple_destroy(tuples->tuples[i]);
+    }
+    free(tuples->tuples);
+    free(tuples);
+}
+
+int tuples_add_fitting ( struct tuples_t * tuples, struct tuple_t * tuple ) {
+    int tuple_bytes = BUFFER_INTEGER_SIZE + tuple_size_bytes(tuple);
+    if ( tuples->n_tuples == tuples->capacity
+        || (tuples->n_tuples > 0 && tuples->size_bytes + tuple_bytes > TUPLES_MAX_BYTES) )
+        return NO;
+    
+    tuples->tuples[tuples->n_tuples++] = tuple;
+    tuples->size_bytes += tuple_bytes;
+    return YES;
+}
+
+/*
+ * Serializes a set of tuples: how many it has and then each tuple after its size.
+ */
+int message_serialize_tuples ( struct tuples_t * tuples, char ** buffer ) {
+    *buffer = (char*) malloc(tuples->size_bytes);
+    if ( *buffer == NULL )
+        return FAILED;
+    
+    int offset = 0;
+    int n_tuples_to_network = htonl(tuples->n_tuples);
+    memcpy(*buffer + offset, &n_tuples_to_network, BUFFER_INTEGER_SIZE);
+    offset += BUFFER_INTEGER_SIZE;
+    
+    int i;
+    for ( i = 0; i < tuples->n_tuples; i++ ) {
+        char * serialized_tuple = NULL;
+        int serialized_tuple_size = tuple_serialize(tuples->tuples[i], &serialized_tuple);
+        if ( serialized_tuple_size == FAILED ) {
+            free(*buffer);
+            return FAILED;
+        }
+        int tuple_size_to_network = htonl(serialized_tuple_size);
+        memcpy(*buffer + offset, &tuple_size_to_network, BUFFER_INTEGER_SIZE);
+        offset += BUFFER_INTEGER_SIZE;
+        memcpy(*buffer + offset, serialized_tuple, serialized_tuple_size);
+        offset += serialized_tuple_size;
+        free(serialized_tuple);
+    }
+    
+    return offset;
+}
+
+/*
+ * Deserializes a set of tuples (see message_serialize_tuples).
+ */
+struct tuples_t * message_deserialize_tuples ( char * buffer, int buffer_size ) {
+    if ( buffer == NULL || buffer_size < BUFFER_INTEGER_SIZE )
+        return NULL;
+    
+    int offset = 0;
+    int n_tuples_network = 0;
+    memcpy(&n_tuples_network, buffer + offset, BUFFER_INTEGER_SIZE);
+    offset += BUFFER_INTEGER_SIZE;
+    
+    //each tuple takes at least its size, so a bigger count is not believed
+    int n_tuples = ntohl(n_tuples_network);
+    if ( n_tuples <= 0 || n_tuples > (buffer_size - offset) / BUFFER_INTEGER_SIZE )
+        return NULL;
+    
+    struct tuples_t * tuples = tuples_create(n_tuples);
+    int valid = tuples != NULL;
+    int i;
+    for ( i = 0; valid && i < n_tuples; i++ ) {
+        int tuple_size_network = 0;
+        valid = buffer_size - offset >= BUFFER_INTEGER_SIZE;
+        if ( valid ) {
+            memcpy(&tuple_size_network, buffer + offset, BUFFER_INTEGER_SIZE);
+            offset += BUFFER_INTEGER_SIZE;
+        }
+        int tuple_size = ntohl(tuple_size_network);
+        valid = valid && tuple_size >= TUPLE_DIMENSION_SIZE && tuple_size <= buffer_size - offset;
+        if ( valid ) {
+            tuples->tuples[i] = tuple_deserialize(buffer + offset, tuple_size);
+            offset += tuple_size;
+            valid = tuples->tuples[i] != NULL;
+            tuples->n_tuples += valid;
+        }
+    }
+    
+    if ( !valid ) {
+        tuples_destroy(tuples, YES);
+        return NULL;
+    }
+    tuples->size_bytes = offset;
+    return tuples;
+}
+
+struct message_t * message_of_tuples ( int opcode, struct tuples_t * tuples ) {
+    if ( tuples == NULL || tuples->n_tuples == 0 )
+        return NULL;
+    
+    //the one tuple that does not fit as TUPLES still does as TUPLE (it came in one, and
+    //buffer_to_message only takes the tuples that fit in one with a request id)
+    if ( tuples->n_tuples == 1 && tuples->size_bytes > TUPLES_MAX_BYTES ) {
+        if ( tuple_size_bytes(tuples->tuples[0]) > TUPLES_MAX_BYTES )
+            return NULL;
+        struct message_t * message = message_create_with(opcode, CT_TUPLE, tuples->tuples[0]);
+        tuples_destroy(tuples, NO);
+        return message;
+    }
+    return message_create_with(opcode, CT_TUPLES, tuples);
+}
+
 /* Converte o conteúdo de uma message_t num char*, retornando o tamanho do
  * buffer alocado para a mensagem serializada como um array de
  * bytes, ou FAILED em caso de erro.
  *
  * A mensagem serializada deve ter o seguinte formato:
  *
- * OPCODE C_TYPE
- * [2 bytes] [2 bytes]
+ * OPCODE C_TYPE [REQUEST_ID]
+ * [2 bytes] [2 bytes] [4 bytes, se C_TYPE tem o bit C_TYPE_REQUEST_ID]
  *
  *  a partir daí, o formato difere para cada c_type:
  *
@@ -198,6 +523,15 @@ int message_serialize_content ( struct message_t * message, char ** buffer ) {
  * TOKEN    DIMENSION   TOKENDATA
  *          [4 BYTES]   [TD BYTES]
  *
+ * LEASE EXPIRES TIMESTAMP DIMENSION ELEMENTSIZE ELEMENTDATA
+ *     [8 bytes] [8 bytes] [4 bytes] [4 bytes] [ES bytes] ...
+ *
+ * BATCH N_ENTRIES ENTRYSIZE ENTRY ...
+ *     [4 bytes] [4 bytes] [ES bytes]
+ *
+ * TUPLES N_TUPLES TUPLESIZE TUPLE ...
+ *     [4 bytes] [4 bytes] [TS bytes]
+ *
  */
 int message_to_buffer(struct message_t *msg, char **msg_buf) {
     
@@ -220,14 +554,21 @@ int message_to_buffer(struct message_t *msg, char **msg_buf) {
     //moves offset
     offset+=OPCODE_SIZE;
     
-    //2. adds the content type code
-    int ctype_to_network = htons(msg->c_type);
+    //2. adds the content type code (with the bit that says if the request id follows)
+    int ctype_to_network = htons(msg->request_id != NO_REQUEST_ID ? msg->c_type | C_TYPE_REQUEST_ID : msg->c_type);
     
     memcpy(msg_buf[0]+offset, &ctype_to_network, C_TYPE_SIZE);
     
     //moves the offset
     offset+=C_TYPE_SIZE;
     
+    //2.1 and the request id, if it has one
+    if ( msg->request_id != NO_REQUEST_ID ) {
+        int request_id_to_network = htonl(msg->request_id);
+        memcpy(msg_buf[0]+offset, &request_id_to_network, REQUEST_ID_SIZE);
+        offset+=REQUEST_ID_SIZE;
+    }
+    
     //buffer to serialize the message content
     char * message_serialized_content = NULL;
     // serializes the content message
@@ -272,24 +613,53 @@ struct message_t *buffer_to_message(char *msg_buf, int msg_size) {
     int ctype_host = ntohs(ctype_network);
     //moves offset
     offset+=C_TYPE_SIZE;
+    
+    //the request id, if the c_type says there is one
+    int request_id = NO_REQUEST_ID;
+    if ( ctype_host & C_TYPE_REQUEST_ID ) {
+        if ( msg_size < offset + REQUEST_ID_SIZE )
+            return NULL;
+        int request_id_network = 0;
+        memcpy(&request_id_network, msg_buf+offset, REQUEST_ID_SIZE);
+        request_id = ntohl(request_id_network);
+        ctype_host &= ~C_TYPE_REQUEST_ID;
+        offset+=REQUEST_ID_SIZE;
+    }
     //sets it
     void * message_content = NULL;
+    //a result is copied by message_create_with, so it only has to live until then
+    int result_host = 0;
     
     switch (ctype_host) {
         case CT_TUPLE:
-            message_content = tuple_deserialize(msg_buf+offset, msg_size-offset);
+            //a tuple that could not be sent back in a response with a request id is refused
+            if ( msg_size - offset <= TUPLES_MAX_BYTES )
+                message_content = tuple_deserialize(msg_buf+offset, msg_size-offset);
             break;
        
         case CT_ENTRY:
             message_content = entry_deserialize(msg_buf+offset, msg_size-offset);
             break;
         
+        case CT_LEASE:
+            message_content = message_deserialize_lease(msg_buf+offset, msg_size-offset);
+            break;
+        
+        case CT_BATCH:
+            message_content = message_deserialize_batch(msg_buf+offset, msg_size-offset);
+            break;
+        
+        case CT_TUPLES:
+            message_content = message_deserialize_tuples(msg_buf+offset, msg_size-offset);
+            break;
+        
         case CT_RESULT:
+        case CT_PART:
         {
             int result_network = 0;
             memcpy(&result_network, msg_buf+offset, RESULT_SIZE);
             //gets to host
-            int result_host = ntohl(result_network);
+            result_host = ntohl(result_network);
             message_content = &result_host;
             break;
         }
@@ -312,6 +682,8 @@ struct message_t *buffer_to_message(char *msg_buf, int msg_size) {
     
     //finally creates the message with all its components
     struct message_t * message = message_create_with(opcode_host, ctype_host, message_content);
+    if ( message != NULL )
+        message->request_id = request_id;
     
     return message != NULL ? message : NULL;
 }
@@ -331,11 +703,18 @@ void free_message2(struct message_t * message, int free_content) {
     if ( message == NULL)
         return;
     
+    //the array of a batch (or of a set of tuples) is always the message's
+    if ( message->c_type == CT_BATCH ) {
+        batch_destroy(message->content.batch, free_content);
+    }
+    else if ( message->c_type == CT_TUPLES ) {
+        tuples_destroy(message->content.tuples, free_content);
+    }
     if ( free_content ) {
         if ( message->c_type == CT_TUPLE ) {
             tuple_destroy(message->content.tuple);
         }
-        else if ( message->c_type == CT_ENTRY ) {
+        else if ( message->c_type == CT_ENTRY || message->c_type == CT_LEASE ) {
             entry_destroy(message->content.entry);
         }
         
@@ -521,26 +900,89 @@ int assign_ctype (int opcode, int callFromServer ){
 char * message_to_string ( struct message_t * msg ) {
     
     char * msg_str = NULL;
+    //the tuple as text (its bytes escaped)
+    char * tuple_str = NULL;
     
     if ( message_opcode_setter(msg) ) {
         
         if ( msg->c_type == CT_TUPLE) {
+            tuple_str = tuple_to_string(msg->content.tuple);
             msg_str = malloc(OPCODE_SIZE+1 + C_TYPE_SIZE+1 + tuple_size_as_string(msg->content.tuple)+5);
-            sprintf(msg_str, "%hu %hu %s", msg->opcode, msg->c_type, tuple_to_string(msg->content.tuple));
+            sprintf(msg_str, "%hu %hu %s", msg->opcode, msg->c_type, tuple_str);
         }
         else if ( msg->c_type == CT_ENTRY ) {
+            tuple_str = tuple_to_string(msg->content.entry->value);
             msg_str = malloc(OPCODE_SIZE+1 + C_TYPE_SIZE+1 + TIMESTAMP_SIZE+1 + tuple_size_as_string(msg->content.entry->value)+5);
-            sprintf(msg_str, "%hu %hu %llu %s", msg->opcode, msg->c_type, msg->content.entry->timestamp, tuple_to_string(msg->content.entry->value));
+            sprintf(msg_str, "%hu %hu %llu %s", msg->opcode, msg->c_type, msg->content.entry->timestamp, tuple_str);
+        }
+        else if ( msg->c_type == CT_LEASE ) {
+            tuple_str = tuple_to_string(msg->content.entry->value);
+            msg_str = malloc(OPCODE_SIZE+1 + C_TYPE_SIZE+1 + 2 * (20+1) + tuple_size_as_string(msg->content.entry->value)+5);
+            sprintf(msg_str, "%hu %hu %llu %lld %s", msg->opcode, msg->c_type, msg->content.entry->timestamp,
+                    msg->content.entry->expires, tuple_str);
+        }
+        else if ( msg->c_type == CT_BATCH ) {
+            //the timestamp and the tuple of each entry, one after the other, on the same line
+            struct batch_t * batch = msg->content.batch;
+            int msg_str_size = OPCODE_SIZE+1 + C_TYPE_SIZE+1 + 11+1 + 5;
+            int i;
+            for ( i = 0; i < batch->n_entries; i++ )
+                msg_str_size += 20+1 + tuple_size_as_string(entry_value(batch->entries[i])) + 1;
+            msg_str = malloc(msg_str_size);
+            int offset = sprintf(msg_str, "%hu %hu %d", msg->opcode, msg->c_type, batch->n_entries);
+            for ( i = 0; i < batch->n_entries; i++ ) {
+                tuple_str = tuple_to_string(entry_value(batch->entries[i]));
+                offset += sprintf(msg_str + offset, " %llu %s", batch->entries[i]->timestamp, tuple_str);
+                free(tuple_str);
+            }
+            tuple_str = NULL;
         }
     }
     else if ( message_opcode_taker(msg) ) {
-        msg_str = malloc(OPCODE_SIZE+1 + C_TYPE_SIZE+1 + tuple_size_as_string(msg->content.tuple)+5);
-        sprintf(msg_str, "%hu %hu %s", msg->opcode, msg->c_type, tuple_to_string(msg->content.tuple));
+        //an IN that waited brings its template in an entry: it is logged as a plain IN
+        struct tuple_t * template = msg->c_type == CT_ENTRY ? msg->content.entry->value : msg->content.tuple;
+        tuple_str = tuple_to_string(template);
+        msg_str = malloc(OPCODE_SIZE+1 + C_TYPE_SIZE+1 + tuple_size_as_string(template)+5);
+        sprintf(msg_str, "%hu %hu %s", msg->opcode, CT_TUPLE, tuple_str);
     }
     
+    free(tuple_str);
     return msg_str;
 }
 
+struct batch_t * batch_create_from_string ( const char * input ) {
+    //opcode, ctype and how many entries
+    char * rest = NULL;
+    strtol(input, &rest, 10);
+    strtol(rest, &rest, 10);
+    const char * text = rest;
+    struct batch_t * batch = batch_create((int) strtol(text, &rest, 10));
+    if ( batch == NULL )
+        return NULL;
+    
+    //then the timestamp and the tuple of each one
+    int valid = YES;
+    int i;
+    for ( i = 0; valid && i < batch->n_entries; i++ ) {
+        text = rest;
+        long long timestamp = strtoll(text, &rest, 10);
+        valid = rest != text;
+        if ( valid ) {
+            text = rest;
+            struct tuple_t * tuple = tuple_from_text(text, &text);
+            batch->entries[i] = tuple != NULL ? entry_create2(tuple, timestamp) : NULL;
+            valid = batch->entries[i] != NULL;
+            rest = (char *) text;
+        }
+    }
+    
+    if ( !valid ) {
+        batch_destroy(batch, YES);
+        return NULL;
+    }
+    return batch;
+}
+
 /*
  * Returns a message_t * built from the command string.
  * Assumes the command is valid.
@@ -561,6 +1003,12 @@ struct message_t * command_to_message (const char * command) {
     else if ( ctype == CT_ENTRY ) {
         message_content = entry_create_from_string(command);
     }
+    else if ( ctype == CT_LEASE ) {
+        message_content = entry_lease_create_from_string(command);
+    }
+    else if ( ctype == CT_BATCH ) {
+        message_content = batch_create_from_string(command);
+    }
     
     else if ( ctype == CT_RESULT ) {
         int resultValue = 0;
@@ -591,13 +1039,37 @@ void message_print ( struct message_t * msg ) {
             tuple_print(msg->content.entry->value);
             printf("> ] ");
         }
+        else if ( msg->c_type == CT_LEASE ) {
+            printf(" [%hd , %hd , <%llu , %lld , ", msg->opcode, msg->c_type, msg->content.entry->timestamp, msg->content.entry->expires);
+            tuple_print(msg->content.entry->value);
+            printf("> ] ");
+        }
+        else if ( msg->c_type == CT_TUPLES ) {
+            printf(" [%hd , %hd , %d :", msg->opcode, msg->c_type, msg->content.tuples->n_tuples);
+            int i;
+            for ( i = 0; i < msg->content.tuples->n_tuples; i++ ) {
+                printf(" ");
+                tuple_print(msg->content.tuples->tuples[i]);
+            }
+            printf(" ] ");
+        }
+        else if ( msg->c_type == CT_BATCH ) {
+            printf(" [%hd , %hd , %d :", msg->opcode, msg->c_type, msg->content.batch->n_entries);
+            int i;
+            for ( i = 0; i < msg->content.batch->n_entries; i++ ) {
+                printf(" <%llu , ", msg->content.batch->entries[i]->timestamp);
+                tuple_print(msg->content.batch->entries[i]->value);
+                printf(">");
+            }
+            printf(" ] ");
+        }
         
         // * (Atualizado para Projeto 5)
         else if (msg->c_type == CT_SFAILURE || msg->c_type == CT_SRUNNING || msg->c_type == CT_INVCMD ) {
             printf (" [ %hd , %hd , %s ]", msg->opcode, msg->c_type, msg->content.token);
         }
         
-        else if ( msg->c_type == CT_RESULT ) {
+        else if ( msg->c_type == CT_RESULT || msg->c_type == CT_PART ) {
             printf(" [%hd , %hd , %d ] ", msg->opcode, msg->c_type, msg->content.result );
         }
     }
@@ -21,6 +21,30 @@
 #define CT_SFAILURE 400 //mensagem com informação de endereço_ip:porta do switch que falhou
 #define CT_SRUNNING 500 //mensagem com informação de endereço_ip:porta do novo switch
 #define CT_INVCMD 600 //mensagem para informar comando invalido
+#define CT_LEASE    700 //mensagem de entry que expira
+#define CT_BATCH    800 //mensagem com várias entries
+#define CT_TUPLES   900 //mensagem com vários tuplos
+#define CT_PART     1000 //mensagem com quantos tuplos uma parte da resposta tem (e que há mais partes)
+/*
+ * Conteúdo de uma mensagem CT_BATCH: as entries postas de uma vez.
+ */
+struct batch_t {
+    int n_entries;
+    struct entry_t **entries;
+};
+
+/*
+ * Conteúdo de uma mensagem CT_TUPLES: os tuplos de uma resposta que cabem
+ * numa só mensagem (tem lugar para capacity, e size_bytes é o tamanho do
+ * conteúdo serializado).
+ */
+struct tuples_t {
+    int n_tuples;
+    int capacity;
+    int size_bytes;
+    struct tuple_t **tuples;
+};
+
 /*
  * Estrutura que representa uma mensagem genérica a ser transmitida.
  * Esta mensagem pode ter vários tipos de conteúdos.
@@ -28,9 +52,12 @@
 struct message_t {
 	short opcode; /* código da operação na mensagem */
 	short c_type; /* tipo do conteúdo da mensagem */
+	int request_id; /* identificador do pedido (0: sem identificador) */
 	union content_u {
 		struct tuple_t *tuple;
 		struct entry_t *entry;
+		struct batch_t *batch;
+		struct tuples_t *tuples;
 		int result;
         char *token;
 	} content; /* conteúdo da mensagem */
@@ -43,8 +70,13 @@ struct message_t {
  *
  * A mensagem serializada deve ter o seguinte formato:
  *
- * OPCODE		C_TYPE
- * [2 bytes]	[2 bytes]
+ * OPCODE		C_TYPE      [REQUEST_ID]
+ * [2 bytes]	[2 bytes]   [4 bytes]
+ *
+ * REQUEST_ID só vem se o bit C_TYPE_REQUEST_ID estiver ligado no C_TYPE:
+ * um cliente que põe vários pedidos seguidos na ligação (sem esperar pelas
+ * respostas) dá a cada um o seu, e todas as mensagens da resposta a um
+ * pedido vêm com o dele. Sem ele (0) a mensagem é como sempre foi.
  *
  * a partir daí, o formato difere para cada c_type:
  *
@@ -58,6 +90,43 @@ struct message_t {
  *
  * REPORT   REPORTSIZE  REPORTDATA
  *          [4 bytes]   [RD bytes]
+ *
+ * LEASE    EXPIRES     TIMESTAMP   DIMENSION   ELEMENTSIZE ELEMENTDATA
+ *          [8 bytes]   [8 bytes]   [4 bytes]   [4 bytes]   [ES bytes]  ...
+ *
+ * BATCH    N_ENTRIES   ENTRYSIZE   ENTRY (como em ENTRY)   ...
+ *          [4 bytes]   [4 bytes]   [ES bytes]
+ *
+ * TUPLES   N_TUPLES    TUPLESIZE   TUPLE (como em TUPLE)   ...
+ *          [4 bytes]   [4 bytes]   [TS bytes]
+ *
+ * PART     RESULT
+ *          [4 bytes]
+ *
+ * ELEMENTSIZE é o número de bytes do elemento, que podem ser quaisquer
+ * (não há '\0' no fim), ou -1 para um elemento NULL (sem ELEMENTDATA).
+ *
+ * Um OC_IN ou OC_COPY com uma ENTRY (em vez de um TUPLE) espera que seja
+ * posto um tuplo se nenhum corresponder ao template: o TIMESTAMP da entry
+ * é quanto tempo espera, em milissegundos.
+ *
+ * Um OC_OUT com uma LEASE põe um tuplo que é tirado da tabela quando
+ * expira. Do cliente para o switch EXPIRES é quanto tempo o tuplo dura
+ * (milissegundos); o switch torna-o no instante em que expira
+ * (milissegundos desde a Epoch), que é o que os servidores recebem.
+ *
+ * Um OC_OUT com um BATCH põe todas as suas entries com um só pedido, uma
+ * só resposta e um só registo no log. Do cliente vêm com TIMESTAMP 0: o
+ * switch dá-lhes a todas o mesmo, e os servidores põem-nas ou rejeitam-nas
+ * juntas.
+ *
+ * A resposta a um IN, IN_ALL, COPY ou COPY_ALL é um RESULT com quantos
+ * tuplos a seguem e depois mensagens TUPLES com tantos quantos cabem em
+ * MAX_MSG cada, até serem todos (um tuplo que sozinho não cabe numa TUPLES
+ * vai numa TUPLE). Quem a recebe lê mensagens até ter os tuplos anunciados.
+ * A de um COPY_ALL grande pode vir em partes: cada uma é um PART (com o
+ * mesmo RESULT, quantos tuplos a parte tem) seguido dos seus tuplos, e a
+ * última é como uma resposta inteira, com um RESULT.
  */
 int message_to_buffer(struct message_t *msg, char **msg_buf);
 
@@ -132,7 +132,7 @@ struct message_t * network_send_receive(struct server_t *server, struct message_
     
     while ( retries <= 1 && !taskSucceeded ) {
         if (send_message(server->socketfd, msg) == SUCCEEDED){
-            usleep(200);
+            //the receive blocks until the response is there
             received_msg = receive_message(server->socketfd);
             taskSucceeded = received_msg != NULL;
         }
@@ -151,6 +151,40 @@ struct message_t * network_send_receive(struct server_t *server, struct message_
     return taskSucceeded ? received_msg : NULL;
 }
 
+int network_send_receive_pipelined(struct server_t *server, int n_requests, struct message_t **requests, struct message_t **responses){
+    
+    //each request goes with its position (+1) as its id, all in one write
+    int i;
+    for ( i = 0; i < n_requests; i++ ) {
+        requests[i]->request_id = i + 1;
+        responses[i] = NULL;
+    }
+    int taskSuccess = send_messages(server->socketfd, n_requests, requests);
+    for ( i = 0; i < n_requests; i++ )
+        requests[i]->request_id = NO_REQUEST_ID;
+    if ( taskSuccess == FAILED )
+        return FAILED;
+    
+    //the responses come in the order the server has them, each put back with its request
+    int n_received = 0;
+    while ( n_received < n_requests ) {
+        struct message_t *received_msg = receive_message(server->socketfd);
+        if ( received_msg == NULL )
+            break;
+        
+        int request_index = received_msg->request_id - 1;
+        if ( request_index < 0 || request_index >= n_requests || responses[request_index] != NULL ) {
+            printf("--- network_send_receive_pipelined > response to no request sent (id %d)\n", received_msg->request_id);
+            free_message(received_msg);
+            continue;
+        }
+        responses[request_index] = received_msg;
+        n_received++;
+    }
+    
+    return n_received;
+}
+
 /* A funcao network_close() deve fechar a ligação estabelecida por
  * network_connect(). Se network_connect() alocou memoria, a função
  * deve libertar essa memoria.
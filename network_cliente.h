@@ -33,6 +33,17 @@ struct server_t *network_connect(const char *address_port);
  */
 struct message_t *network_send_receive(struct server_t *server,struct message_t *msg);
 
+/*
+ * Sends the n_requests requests back-to-back, each with a request id (the
+ * server gets them all without waiting for a response in between), and then
+ * receives their responses, putting on responses[i] the one to requests[i]
+ * in whatever order they come. For requests answered with one message
+ * (OC_OUT, OC_SIZE, ...).
+ * Returns how many responses it got (the others are NULL), or FAILED if the
+ * requests could not be sent.
+ */
+int network_send_receive_pipelined(struct server_t *server, int n_requests, struct message_t **requests, struct message_t **responses);
+
 /* A funcao network_close() deve fechar a ligação estabelecida por
  * network_connect(). Se network_connect() alocou memoria, a função
  * deve libertar essa memoria.
@@ -15,6 +15,10 @@
 #include "network_utils.h"
 #include "tuple.h"
 #include "general_utils.h"
+#include "network_server.h"
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
 
 
 /*
@@ -25,29 +29,72 @@ struct message_t * server_receive_request(int socketfd ) {
     return receive_message(socketfd);
 }
 
+/* the loop of this thread, where its client connections are */
+__thread struct server_loop_t * thread_loop = NULL;
+
 int server_send_response(int socketfd, int number_of_messages, struct message_t ** response_messages) {
+    if ( server_queue_response(socketfd, number_of_messages, response_messages) == FAILED )
+        return FAILED;
+    return server_flush_response(socketfd);
+}
+
+int server_queue_response(int socketfd, int number_of_messages, struct message_t ** response_messages) {
     if ( number_of_messages <= 0 || response_messages == NULL ) {
         return FAILED;
     }
     
-    int taskSuccess = SUCCEEDED;
-    int index = 0;
-    //sends each message. in error case stops to send.
-    while ( index >= 0 && index < number_of_messages ) {
-        if ( send_message(socketfd, response_messages[index]) == FAILED ) {
-            taskSuccess = FAILED;
-            index = -1;
-        }
-        else {
-            index++;
+    //a connection of this thread: the messages wait on its chain for the socket
+    struct server_connection_t * connection = server_connection_of(socketfd);
+    if ( connection != NULL ) {
+        int index;
+        for ( index = 0; index < number_of_messages && !connection->failed; index++ ) {
+            server_connection_queue(connection, response_messages[index]);
+            //a chain that fills a sendmsg goes now, so a big response is not all held at once
+            if ( connection->out_frames >= SERVER_FLUSH_IOVECS / 2 )
+                server_connection_flush(connection);
         }
+        return connection->failed ? FAILED : SUCCEEDED;
     }
-    return taskSuccess;
+    
+    //any other socket (a neighbour server) is blocking: they are sent at once
+    return send_messages(socketfd, number_of_messages, response_messages);
+}
+
+int server_produce_response(int socketfd, struct server_producer_t producer) {
+    struct server_connection_t * connection = server_connection_of(socketfd);
+    if ( connection == NULL ) {
+        //a blocking socket takes it all now, as the producer makes it
+        int more = YES;
+        while ( more == YES )
+            more = producer.produce(producer.state, socketfd);
+        producer.destroy(producer.state);
+        return more == FAILED ? FAILED : SUCCEEDED;
+    }
+    
+    //one at a time: the requests after the one producing are not taken until it is done
+    if ( connection->producer.produce != NULL || connection->failed ) {
+        producer.destroy(producer.state);
+        return FAILED;
+    }
+    connection->producer = producer;
+    return server_connection_produce(connection);
+}
+
+int server_socket_producing(int socketfd) {
+    struct server_connection_t * connection = server_connection_of(socketfd);
+    return connection != NULL && connection->producer.produce != NULL ? YES : NO;
 }
 
-int server_sends_error_msg( int connection_socket_fd ) {
+int server_flush_response(int socketfd) {
+    struct server_connection_t * connection = server_connection_of(socketfd);
+    return connection != NULL && !connection->holding ? server_connection_flush(connection) : SUCCEEDED;
+}
+
+int server_sends_error_msg( int connection_socket_fd, int request_id ) {
     struct message_t * errorMessage = message_of_error();
-    int taskSuccess = send_message(connection_socket_fd, errorMessage);
+    if ( errorMessage != NULL )
+        errorMessage->request_id = request_id;
+    int taskSuccess = server_send_response(connection_socket_fd, 1, &errorMessage);
 
     if ( errorMessage != NULL )
         free_message(errorMessage);
@@ -55,3 +102,357 @@ int server_sends_error_msg( int connection_socket_fd ) {
     return taskSuccess;
 }
 
+
+int server_loop_init ( struct server_loop_t * loop, int listen_fd ) {
+    loop->listen_fd = listen_fd;
+    loop->n_connections = 0;
+    loop->capacity = SERVER_LOOP_INITIAL_FDS;
+    loop->connections = (struct server_connection_t **) calloc(loop->capacity, sizeof(struct server_connection_t *));
+    loop->epoll_fd = epoll_create1(0);
+    if ( loop->connections == NULL || loop->epoll_fd < 0 ) {
+        free(loop->connections);
+        if ( loop->epoll_fd >= 0 )
+            close(loop->epoll_fd);
+        return FAILED;
+    }
+    
+    //the edges of the listening socket say there are new connections: all of them are accepted
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = listen_fd;
+    if ( fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL, 0) | O_NONBLOCK) < 0
+        || epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) < 0 ) {
+        perror("server_loop_init > error watching the listening socket");
+        server_loop_destroy(loop);
+        return FAILED;
+    }
+    thread_loop = loop;
+    return SUCCEEDED;
+}
+
+int server_loop_wait ( struct server_loop_t * loop, int timeout_ms ) {
+    int n_events = epoll_wait(loop->epoll_fd, loop->events, SERVER_LOOP_EVENTS, timeout_ms);
+    if ( n_events < 0 && errno == EINTR )
+        return 0;
+    return n_events;
+}
+
+/*
+ * Puts the connection of fd on the table of the loop (growing it if fd does not fit)
+ * and watches it. Returns 0 (OK) or -1 (error).
+ */
+int server_loop_add ( struct server_loop_t * loop, int fd ) {
+    if ( fd >= loop->capacity ) {
+        int capacity = loop->capacity;
+        while ( capacity <= fd )
+            capacity *= 2;
+        struct server_connection_t ** connections = (struct server_connection_t **)
+            realloc(loop->connections, capacity * sizeof(struct server_connection_t *));
+        if ( connections == NULL )
+            return FAILED;
+        memset(connections + loop->capacity, 0, (capacity - loop->capacity) * sizeof(struct server_connection_t *));
+        loop->connections = connections;
+        loop->capacity = capacity;
+    }
+    
+    struct server_connection_t * connection = (struct server_connection_t *) calloc(1, sizeof(struct server_connection_t));
+    if ( connection == NULL )
+        return FAILED;
+    connection->fd = fd;
+    connection->frame_state = SERVER_FRAME_SIZE;
+    connection->in_capacity = SERVER_CONNECTION_BUFFER;
+    connection->in = (char *) malloc(connection->in_capacity);
+    
+    //the client closing it (RDHUP) is an event too, and so is the socket getting writable again
+    //(edge-triggered, it only comes after a write that did not go whole)
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = fd;
+    if ( connection->in == NULL || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) < 0
+        || epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0 ) {
+        free(connection->in);
+        free(connection);
+        return FAILED;
+    }
+    loop->connections[fd] = connection;
+    loop->n_connections++;
+    return SUCCEEDED;
+}
+
+int server_loop_accept ( struct server_loop_t * loop ) {
+    int n_accepted = 0;
+    int fd;
+    while ( (fd = accept(loop->listen_fd, NULL, NULL)) >= 0 || errno == EINTR || errno == ECONNABORTED ) {
+        if ( fd < 0 )
+            continue;
+        if ( server_loop_add(loop, fd) == FAILED ) {
+            perror("server_loop_accept > no room for the connection");
+            close(fd);
+            continue;
+        }
+        n_accepted++;
+    }
+    //EAGAIN: there are no more; anything else (out of fds) waits for the next edge
+    if ( errno != EAGAIN && errno != EWOULDBLOCK )
+        perror("server_loop_accept > error on accept()");
+    return n_accepted;
+}
+
+void server_loop_close ( struct server_loop_t * loop, int fd ) {
+    if ( fd < 0 || fd >= loop->capacity || loop->connections[fd] == NULL )
+        return;
+    
+    //closing the fd takes it out of the epoll set too
+    shutdown(fd, SHUT_RDWR);
+    close(fd);
+    struct server_connection_t * connection = loop->connections[fd];
+    while ( connection->out_head != NULL ) {
+        struct server_out_t * written = connection->out_head;
+        connection->out_head = written->next;
+        free(written->message);
+        free(written);
+    }
+    if ( connection->producer.produce != NULL )
+        connection->producer.destroy(connection->producer.state);
+    free(connection->in);
+    free(connection);
+    loop->connections[fd] = NULL;
+    loop->n_connections--;
+}
+
+void server_loop_destroy ( struct server_loop_t * loop ) {
+    int fd;
+    for ( fd = 0; fd < loop->capacity && loop->n_connections > 0; fd++ )
+        server_loop_close(loop, fd);
+    free(loop->connections);
+    loop->connections = NULL;
+    close(loop->epoll_fd);
+    if ( thread_loop == loop )
+        thread_loop = NULL;
+}
+
+struct server_connection_t * server_connection_of ( int fd ) {
+    if ( thread_loop == NULL || fd < 0 || fd >= thread_loop->capacity )
+        return NULL;
+    return thread_loop->connections[fd];
+}
+
+/*
+ * Makes room for more bytes after buffer[*end] (of *capacity bytes), moving the
+ * ones still there (from *start) to its beginning and, if that is not enough,
+ * growing it. Returns 0 (OK) or -1 (error, or it would go past the limit).
+ */
+int server_buffer_room ( char ** buffer, int * start, int * end, int * capacity, int more ) {
+    if ( *start > 0 ) {
+        memmove(*buffer, *buffer + *start, *end - *start);
+        *end -= *start;
+        *start = 0;
+    }
+    if ( *end + more <= *capacity )
+        return SUCCEEDED;
+    if ( *end + more > SERVER_CONNECTION_MAX_BUFFERED )
+        return FAILED;
+    
+    int new_capacity = *capacity > 0 ? *capacity : SERVER_CONNECTION_BUFFER;
+    while ( new_capacity < *end + more )
+        new_capacity *= 2;
+    char * grown = (char *) realloc(*buffer, new_capacity);
+    if ( grown == NULL )
+        return FAILED;
+    *buffer = grown;
+    *capacity = new_capacity;
+    return SUCCEEDED;
+}
+
+int server_connection_read ( struct server_connection_t * connection ) {
+    while ( YES ) {
+        //a full buffer has room made (the frame being read may need all of it)
+        if ( connection->in_end == connection->in_capacity
+            && server_buffer_room(&connection->in, &connection->in_start, &connection->in_end,
+                                  &connection->in_capacity, SERVER_CONNECTION_BUFFER) == FAILED ) {
+            connection->failed = YES;
+            return FAILED;
+        }
+        
+        ssize_t n_read = read(connection->fd, connection->in + connection->in_end, connection->in_capacity - connection->in_end);
+        if ( n_read > 0 ) {
+            connection->in_end += n_read;
+        }
+        else if ( n_read < 0 && errno == EINTR ) {
+            continue;
+        }
+        else {
+            //nothing more for now, or 0: the client closed it
+            return n_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ? SUCCEEDED : FAILED;
+        }
+    }
+}
+
+int server_connection_next_request ( struct server_connection_t * connection, struct message_t ** request ) {
+    int n_buffered = connection->in_end - connection->in_start;
+    
+    if ( connection->frame_state == SERVER_FRAME_SIZE ) {
+        if ( n_buffered < BUFFER_INTEGER_SIZE )
+            return NO;
+        int frame_size_n;
+        memcpy(&frame_size_n, connection->in + connection->in_start, BUFFER_INTEGER_SIZE);
+        connection->frame_size = ntohl(frame_size_n);
+        //a size that no message has: the frames can not be told apart anymore
+        if ( connection->frame_size <= 0 || connection->frame_size > MAX_MSG ) {
+            puts("server_connection_next_request > message size <= 0 or > MAX_MSG");
+            return FAILED;
+        }
+        connection->in_start += BUFFER_INTEGER_SIZE;
+        n_buffered -= BUFFER_INTEGER_SIZE;
+        connection->frame_state = SERVER_FRAME_MESSAGE;
+    }
+    
+    if ( n_buffered < connection->frame_size )
+        return NO;
+    
+    *request = buffer_to_message(connection->in + connection->in_start, connection->frame_size);
+    if ( *request != NULL ) {
+        printf("Received message: "); message_print(*request); printf(" <> %d bytes\n", message_size_bytes(*request));
+    }
+    else {
+        puts("server_connection_next_request -> failed to buffer_to_message (returned null)\n");
+    }
+    connection->in_start += connection->frame_size;
+    connection->frame_state = SERVER_FRAME_SIZE;
+    if ( connection->in_start == connection->in_end )
+        connection->in_start = connection->in_end = 0;
+    return YES;
+}
+
+void server_connection_hold ( struct server_connection_t * connection ) {
+    connection->holding = YES;
+}
+
+int server_connection_release ( struct server_connection_t * connection ) {
+    connection->holding = NO;
+    return server_connection_flush(connection);
+}
+
+int server_connection_queue ( struct server_connection_t * connection, struct message_t * message ) {
+    if ( message == NULL || connection->failed )
+        return FAILED;
+    
+    struct server_out_t * out = (struct server_out_t *) malloc(sizeof(struct server_out_t));
+    if ( out == NULL )
+        return FAILED;
+    out->message = NULL;
+    out->message_size = message_to_buffer(message, &out->message);
+    if ( out->message_size == -1 ) {
+        printf("server_connection_queue > error on message_to_buffer\n");
+        free(out->message);
+        free(out);
+        return FAILED;
+    }
+    
+    out->size_n = htonl(out->message_size);
+    out->next = NULL;
+    if ( connection->out_tail != NULL )
+        connection->out_tail->next = out;
+    else
+        connection->out_head = out;
+    connection->out_tail = out;
+    connection->out_bytes += BUFFER_INTEGER_SIZE + out->message_size;
+    connection->out_frames++;
+    
+    printf("Sent message: "); message_print(message); printf(" <> %d bytes\n", message_size_bytes(message));
+    return SUCCEEDED;
+}
+
+int server_connection_flush ( struct server_connection_t * connection ) {
+    struct iovec iov[SERVER_FLUSH_IOVECS];
+    
+    while ( connection->out_head != NULL && !connection->failed ) {
+        //the frames from the head, the first without what of it already went
+        int iovcnt = 0;
+        int skip = connection->out_sent;
+        struct server_out_t * out;
+        for ( out = connection->out_head; out != NULL && iovcnt < SERVER_FLUSH_IOVECS; out = out->next ) {
+            if ( skip < BUFFER_INTEGER_SIZE ) {
+                iov[iovcnt].iov_base = (char *) &out->size_n + skip;
+                iov[iovcnt].iov_len = BUFFER_INTEGER_SIZE - skip;
+                iovcnt++;
+                skip = 0;
+            }
+            else {
+                skip -= BUFFER_INTEGER_SIZE;
+            }
+            if ( iovcnt < SERVER_FLUSH_IOVECS ) {
+                iov[iovcnt].iov_base = out->message + skip;
+                iov[iovcnt].iov_len = out->message_size - skip;
+                iovcnt++;
+                skip = 0;
+            }
+        }
+        
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        ssize_t n_written = sendmsg(connection->fd, &msg, MSG_NOSIGNAL);
+        if ( n_written < 0 ) {
+            if ( errno == EAGAIN || errno == EWOULDBLOCK )
+                //the rest goes when the socket is writable again
+                return SUCCEEDED;
+            if ( errno != EINTR )
+                //EPIPE or ECONNRESET: the client is gone
+                connection->failed = YES;
+            continue;
+        }
+        
+        //drops the frames that went whole
+        connection->out_bytes -= n_written;
+        n_written += connection->out_sent;
+        while ( connection->out_head != NULL
+               && n_written >= BUFFER_INTEGER_SIZE + connection->out_head->message_size ) {
+            struct server_out_t * written = connection->out_head;
+            n_written -= BUFFER_INTEGER_SIZE + written->message_size;
+            connection->out_head = written->next;
+            connection->out_frames--;
+            free(written->message);
+            free(written);
+        }
+        if ( connection->out_head == NULL )
+            connection->out_tail = NULL;
+        connection->out_sent = (int) n_written;
+    }
+    
+    return connection->failed ? FAILED : SUCCEEDED;
+}
+
+int server_connection_produce ( struct server_connection_t * connection ) {
+    while ( connection->producer.produce != NULL && !connection->failed ) {
+        //the chain is not let grow with a client that reads slower than it is produced
+        if ( connection->out_bytes >= SERVER_CONNECTION_HIGH_WATER ) {
+            server_connection_flush(connection);
+            if ( connection->out_bytes >= SERVER_CONNECTION_HIGH_WATER )
+                //the socket is full: the rest comes after its next EPOLLOUT
+                break;
+        }
+        
+        int more = connection->producer.produce(connection->producer.state, connection->fd);
+        if ( more != YES ) {
+            connection->producer.destroy(connection->producer.state);
+            connection->producer.produce = NULL;
+            //a response cut in the middle can not be told from the next ones
+            if ( more == FAILED )
+                connection->failed = YES;
+        }
+    }
+    
+    if ( !connection->holding )
+        server_connection_flush(connection);
+    return connection->failed ? FAILED : SUCCEEDED;
+}
+
+void server_raise_fd_limit () {
+    struct rlimit limit;
+    if ( getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max ) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
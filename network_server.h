@@ -10,21 +10,210 @@
 #define SD15_Product_network_server_h
 
 #include "message-private.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+//the pending connections the kernel keeps for accept()
+#define SERVER_LISTEN_BACKLOG SOMAXCONN
+//the most events one server_loop_wait gets
+#define SERVER_LOOP_EVENTS 256
+//the connection table starts with room for this many fds, and doubles when it needs more
+#define SERVER_LOOP_INITIAL_FDS 64
+
+//the frame states of a connection: waiting for the size of the next frame, then for its message
+#define SERVER_FRAME_SIZE 0
+#define SERVER_FRAME_MESSAGE 1
+//the buffers of a connection start with this many bytes, and grow as needed
+#define SERVER_CONNECTION_BUFFER 4096
+//a client that piles up this many bytes of requests not yet served is dropped
+#define SERVER_CONNECTION_MAX_BUFFERED (64 * 1024 * 1024)
+//a producer is paused while the responses waiting on its connection are this many bytes, until the socket takes them
+#define SERVER_CONNECTION_HIGH_WATER (1024 * 1024)
+
+//the most buffers one flush hands to sendmsg (two per message: its size and itself)
+#define SERVER_FLUSH_IOVECS 1024
+
+/*
+ * A response waiting to be written: its frame is size_n (the size of
+ * message, in network format) followed by message.
+ */
+struct server_out_t {
+    int size_n;
+    char * message;
+    int message_size;
+    struct server_out_t * next;
+};
+
+/*
+ * A response too big to be queued at once, queued a part at a time as its
+ * connection drains: produce queues the next part on socketfd and returns
+ * YES (there is more), NO (that was the last) or FAILED; destroy frees
+ * state, once it is done or its connection closes.
+ */
+struct server_producer_t {
+    int (*produce) ( void * state, int socketfd );
+    void (*destroy) ( void * state );
+    void * state;
+};
+
+/*
+ * A client connection of a server loop. The socket is non-blocking: what
+ * arrives waits on in until it is a whole frame, and what can not be
+ * written at once waits on the out chain until the socket is writable again.
+ */
+struct server_connection_t {
+    int fd;
+    //the bytes read and not yet taken as frames: in[in_start..in_end[
+    char * in;
+    int in_start;
+    int in_end;
+    int in_capacity;
+    //what the frame at in_start is waiting for, SERVER_FRAME_SIZE or SERVER_FRAME_MESSAGE (of frame_size bytes)
+    int frame_state;
+    int frame_size;
+    //the responses not yet written, oldest first; out_sent bytes of the first frame already went
+    struct server_out_t * out_head;
+    struct server_out_t * out_tail;
+    int out_sent;
+    int out_bytes;
+    int out_frames;
+    //the response being produced (produce is NULL if there is none): the next requests wait for it
+    struct server_producer_t producer;
+    //YES once a write failed or a buffer got too big: it is closed on its next event
+    int failed;
+    //YES while the frames of one read are handled: their responses are flushed together after the last
+    int holding;
+};
+
+/*
+ * An epoll loop (edge-triggered) over a listening socket and the connections
+ * it accepts, kept on a table indexed by their fds. Each thread that serves
+ * clients has its own.
+ */
+struct server_loop_t {
+    int epoll_fd;
+    int listen_fd;
+    //connections[fd] is the connection of fd, or NULL
+    struct server_connection_t ** connections;
+    int capacity;
+    int n_connections;
+    //the events of the last server_loop_wait
+    struct epoll_event events[SERVER_LOOP_EVENTS];
+};
 
 
 /*
 * Sends number_of_messages from response_messages to the socketfd.
+* If socketfd is a connection of the loop of this thread they go through
+* its buffer, without blocking.
 */
 int server_send_response(int socketfd, int number_of_messages, struct message_t ** response_messages);
 /*
+* Like server_send_response, but on a connection of the loop of this thread the
+* messages only join its chain (written once it holds a whole flush), so that a
+* response of many messages goes in few writes. server_flush_response writes the rest.
+*/
+int server_queue_response(int socketfd, int number_of_messages, struct message_t ** response_messages);
+/*
+* Writes what server_queue_response left waiting for socketfd (unless its
+* connection is holding its responses, see server_connection_hold).
+*/
+int server_flush_response(int socketfd);
+/*
+* Sends the response of producer to socketfd. On a connection of the loop of
+* this thread it is produced while the chain is under SERVER_CONNECTION_HIGH_WATER,
+* and goes on as the socket takes it (server_connection_produce); on any other
+* socket it is all produced now. Returns 0 (OK) or -1 (error).
+*/
+int server_produce_response(int socketfd, struct server_producer_t producer);
+/*
+* Returns YES if socketfd is a connection of the loop of this thread with a
+* response being produced (whatever else is sent to it has to wait), NO otherwise.
+*/
+int server_socket_producing(int socketfd);
+/*
 * Receive_request simply receive_message from socketfd.
 * Useful to improve readability.
 */
 struct message_t * server_receive_request(int socketfd );
 /*
-* Given the socket_fd it will send an error message to it.
+* Given the socket_fd it will send an error message to it, as the response
+* to the request with request_id (NO_REQUEST_ID if it has none).
 */
-int server_sends_error_msg( int connection_socket_fd);
+int server_sends_error_msg( int connection_socket_fd, int request_id );
+
+/*
+ * Starts loop over listen_fd (made non-blocking, so every pending connection
+ * is accepted at once). Returns 0 (OK) or -1 (error).
+ */
+int server_loop_init ( struct server_loop_t * loop, int listen_fd );
+/*
+ * Waits up to timeout_ms for events, that are then on loop->events.
+ * Returns how many there are (0 if interrupted), or -1 on error.
+ */
+int server_loop_wait ( struct server_loop_t * loop, int timeout_ms );
+/*
+ * Accepts all the connections waiting on the listening socket.
+ * Returns how many it accepted.
+ */
+int server_loop_accept ( struct server_loop_t * loop );
+/*
+ * Closes the connection of fd and forgets it.
+ */
+void server_loop_close ( struct server_loop_t * loop, int fd );
+/*
+ * Closes every connection and the loop itself (not the listening socket).
+ */
+void server_loop_destroy ( struct server_loop_t * loop );
+/*
+ * Returns the connection of fd on the loop of this thread, or NULL.
+ */
+struct server_connection_t * server_connection_of ( int fd );
+/*
+ * Reads all that arrived on the connection (with edge-triggered events it
+ * is read until there is nothing more).
+ * Returns 0 (OK) or -1 (the client closed it or it failed).
+ */
+int server_connection_read ( struct server_connection_t * connection );
+/*
+ * Takes the next whole frame read on the connection, as a message on
+ * *request (NULL if it does not deserialize).
+ * Returns YES (there was one), NO (not yet) or FAILED (the frame can not be,
+ * so nothing after it can be read either).
+ */
+int server_connection_next_request ( struct server_connection_t * connection, struct message_t ** request );
+/*
+ * Holds the responses queued on the connection from now on, so that those of
+ * all the frames of one read (pipelined requests) go together.
+ */
+void server_connection_hold ( struct server_connection_t * connection );
+/*
+ * Stops holding the responses of the connection, and flushes them.
+ * Returns 0 (OK) or -1 (the write failed).
+ */
+int server_connection_release ( struct server_connection_t * connection );
+/*
+ * Puts the message, serialized and framed, at the end of the chain waiting to be written.
+ * Returns 0 (OK) or -1 (error).
+ */
+int server_connection_queue ( struct server_connection_t * connection, struct message_t * message );
+/*
+ * Writes the chain waiting on the connection, as much as the socket takes now,
+ * with one sendmsg per SERVER_FLUSH_IOVECS buffers.
+ * Returns 0 (OK, even if some is left for when it is writable) or -1 (the write failed).
+ */
+int server_connection_flush ( struct server_connection_t * connection );
+/*
+ * Goes on producing the response of the connection (if it has one) until it
+ * is done or the chain is over SERVER_CONNECTION_HIGH_WATER again, flushing it.
+ * Returns 0 (OK, even if it is paused until the socket is writable) or -1 (it failed).
+ */
+int server_connection_produce ( struct server_connection_t * connection );
+/*
+ * Raises the limit of open fds of the process as far as it is allowed,
+ * so the loops can hold many thousands of connections.
+ */
+void server_raise_fd_limit ();
 
 
 #endif
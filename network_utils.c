@@ -12,6 +12,7 @@
 #include "list-private.h"
 #include "message-private.h"
 #include <netdb.h> //hostent
+#include <sys/uio.h>
 #include "general_utils.h"
 #include "network_utils.h"
 
@@ -87,34 +88,55 @@ int socket_is_closed(int socket_fd ) {
 
 /*
  * Ensures that all nbytesToWrite of the buffer are written to the socket_fd.
- * The only case it doesn't happen is if some EINTR EPIPE happens.
+ * The only case it doesn't happen is if the write fails (EPIPE or ECONNRESET
+ * when the other side closed it).
  * Returns the number of bytes written so if its different
  * than nbytesToWrite something went wrong.
  */
 int write_all(int socket_fd, const void *buffer, int bytesToWrite) {
-    //checks if socket is closed...
-    if ( socket_is_closed(socket_fd) )
-        return FAILED;
-    
-    int bufsize = bytesToWrite;
-    
-    while(bytesToWrite>0 ) {
-        //checks it to avoid issues
-        if ( socket_is_closed(socket_fd) )
+    struct iovec iov;
+    iov.iov_base = (void *) buffer;
+    iov.iov_len = bytesToWrite;
+    return writev_all(socket_fd, &iov, 1);
+}
+
+/*
+ * Ensures that all the bytes of the iovcnt buffers of iov are written to the
+ * socket_fd, with as few syscalls as the socket allows (iov is changed while
+ * it goes). A closed socket is told by the write itself (EPIPE or ECONNRESET),
+ * and MSG_NOSIGNAL keeps it from raising a SIGPIPE.
+ * Returns the number of bytes written, or FAILED.
+ */
+int writev_all(int socket_fd, struct iovec * iov, int iovcnt) {
+    int writtenTotal = 0;
+    
+    while ( iovcnt > 0 ) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt > WRITE_MAX_IOVECS ? WRITE_MAX_IOVECS : iovcnt;
+        
+        ssize_t writtenBytes = sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+        if ( writtenBytes < 0 ) {
+            if ( errno == EINTR ) continue;
+            if ( errno != EPIPE && errno != ECONNRESET )
+                perror("writev_all > error on sendmsg()");
             return FAILED;
-        //if its open then it can write into it.
-        int writtenBytes = (int) write(socket_fd, buffer, bytesToWrite);
-        if(writtenBytes<0) {
-            if(errno==EINTR) continue;
-            return writtenBytes;
         }
+        writtenTotal += writtenBytes;
         
-        //moves buffer pointer
-        buffer += writtenBytes;
-        //bytes to write
-        bytesToWrite -= writtenBytes;
+        //skips the buffers that went whole and moves into the one that went in part
+        while ( iovcnt > 0 && (size_t) writtenBytes >= iov->iov_len ) {
+            writtenBytes -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if ( iovcnt > 0 ) {
+            iov->iov_base = (char *) iov->iov_base + writtenBytes;
+            iov->iov_len -= writtenBytes;
+        }
     }
-    return bufsize;
+    return writtenTotal;
 }
 
 /*
@@ -145,46 +167,62 @@ int read_all( int socket_fd, void *buffer, int nBytesToRead ) {
 
 /*
  * Sends a given message to the connection_socket_fd.
- * First sends an integer with the message buffer size and then the message itself.
+ * An integer with the message buffer size goes first and then the message itself, on the same write.
  * In error case returns FAILED, SUCCEEDED otherwise.
  */
 int send_message (int connection_socket_fd, struct message_t * messageToSend) {
-    //puts("\t --- sending message ---");
-    if ( messageToSend == NULL )
+    return send_messages(connection_socket_fd, 1, &messageToSend);
+}
+
+/*
+ * Sends the number_of_messages of messagesToSend to the connection_socket_fd,
+ * each framed as send_message does, all in one writev_all.
+ * In error case returns FAILED, SUCCEEDED otherwise.
+ */
+int send_messages (int connection_socket_fd, int number_of_messages, struct message_t ** messagesToSend) {
+    if ( number_of_messages <= 0 || messagesToSend == NULL )
         return FAILED;
     
-    //the buffer
-    char * messageToSend_buffer = NULL;
-    //the message size
-    int message_size = -1;
-    //fills buffer with the serialized messageToSend
-    if ( (message_size = message_to_buffer(messageToSend, &messageToSend_buffer)) == -1 ) {
-        printf("send message > error on message_to_buffer\n");
-        return FAILED;
+    //two buffers per message: its size (in network format) and the message serialized
+    int * sizes_n = (int *) malloc(number_of_messages * sizeof(int));
+    char ** buffers = (char **) calloc(number_of_messages, sizeof(char *));
+    struct iovec * iov = (struct iovec *) malloc(2 * number_of_messages * sizeof(struct iovec));
+    int taskSuccess = sizes_n != NULL && buffers != NULL && iov != NULL ? SUCCEEDED : FAILED;
+    
+    int totalBytes = 0;
+    int index;
+    for ( index = 0; index < number_of_messages && taskSuccess == SUCCEEDED; index++ ) {
+        int message_size = messagesToSend[index] == NULL ? FAILED : message_to_buffer(messagesToSend[index], &buffers[index]);
+        if ( message_size == FAILED ) {
+            printf("send message > error on message_to_buffer\n");
+            taskSuccess = FAILED;
+            break;
+        }
+        sizes_n[index] = htonl(message_size);
+        iov[2*index].iov_base = &sizes_n[index];
+        iov[2*index].iov_len = BUFFER_INTEGER_SIZE;
+        iov[2*index+1].iov_base = buffers[index];
+        iov[2*index+1].iov_len = message_size;
+        totalBytes += BUFFER_INTEGER_SIZE + message_size;
     }
     
-    //converts it to network format
-    int message_size_n = htonl(message_size);
-    //sends the size of the message
-    int writtenBytes = 0;
-    if ( (writtenBytes = write_all(connection_socket_fd, &message_size_n, BUFFER_INTEGER_SIZE)) != BUFFER_INTEGER_SIZE ) {
-       
-        puts("\t--- failed to write the buffer size into the socket channel");
-        
-        return FAILED;
-    }
-    //and sends the message
-    if ( write_all(connection_socket_fd, messageToSend_buffer, message_size ) != message_size ) {
-        puts("\t--- failed to write buffer into the socket channel");
-        return FAILED;
+    if ( taskSuccess == SUCCEEDED && writev_all(connection_socket_fd, iov, 2 * number_of_messages) != totalBytes ) {
+        puts("\t--- failed to write the messages into the socket channel");
+        taskSuccess = FAILED;
     }
-    //frees the local buffer
-    free(messageToSend_buffer);
     
-    printf("Sent message: "); message_print(messageToSend); printf(" <> %d bytes\n", message_size_bytes(messageToSend));
+    for ( index = 0; index < number_of_messages && taskSuccess == SUCCEEDED; index++ ) {
+        printf("Sent message: "); message_print(messagesToSend[index]); printf(" <> %d bytes\n", message_size_bytes(messagesToSend[index]));
+    }
     
+    //frees the local buffers
+    for ( index = 0; buffers != NULL && index < number_of_messages; index++ )
+        free(buffers[index]);
+    free(buffers);
+    free(sizes_n);
+    free(iov);
     
-    return SUCCEEDED;
+    return taskSuccess;
 }
 
 
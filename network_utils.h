@@ -10,12 +10,15 @@
 #define SD15_Product_network_utils_h
 
 #include "client_stub-private.h"
+#include <sys/uio.h>
 
 
 //time to retry to reconnect
 #define RETRY_TIME 5
 #define SWITCH_SERVER_IDENTIFIER "S"
 #define SYSTEM_CONFIGURATION_FILE "./SD15-Project/sd15_system_config"
+//the most buffers one sendmsg takes (IOV_MAX on linux)
+#define WRITE_MAX_IOVECS 1024
 
 
 
@@ -48,12 +51,20 @@ int socket_is_closed(int socket_fd );
 
 /*
  * Ensures that all nbytesToWrite of the buffer are written to the socket_fd.
- * The only case it doesn't happen is if some EINTR EPIPE happens.
+ * The only case it doesn't happen is if the write fails (EPIPE or ECONNRESET
+ * when the other side closed it).
  * Returns the number of bytes written so if its different
  * than nbytesToWrite something went wrong.
  */
 int write_all(int socket_fd, const void *buffer, int nbytesToWrite);
 
+/*
+ * Ensures that all the bytes of the iovcnt buffers of iov are written to the
+ * socket_fd, with as few syscalls as the socket allows (iov is changed while it goes).
+ * Returns the number of bytes written, or FAILED.
+ */
+int writev_all(int socket_fd, struct iovec * iov, int iovcnt);
+
 /*
  * Ensures that all nbytesToRead are readed from the socket
  * and moved into the buffer.
@@ -67,6 +78,12 @@ int read_all( int socket_fd, void *buffer, int nBytesToRead );
  */
 int send_message (int connection_socket_fd, struct message_t * messageToSend);
 
+/*
+ * Sends the number_of_messages of messagesToSend to the connection_socket_fd,
+ * all in one write (as far as the socket takes them).
+ */
+int send_messages (int connection_socket_fd, int number_of_messages, struct message_t ** messagesToSend);
+
 
 /*
  * Receives an integer with conection_socket_fd.
@@ -14,6 +14,7 @@
 #include "message.h"
 #include "server_log.h"
 #include "network_utils.h"
+#include "network_server.h"
 #include "table_skel.h"
 #include "table.h"
 
@@ -94,6 +95,12 @@ struct message_t * server_log_to_message (const char * command, int callFromServ
     else if ( ctype == CT_ENTRY ) {
         message_content = entry_create_from_string(command);
     }
+    else if ( ctype == CT_LEASE ) {
+        message_content = entry_lease_create_from_string(command);
+    }
+    else if ( ctype == CT_BATCH ) {
+        message_content = batch_create_from_string(command);
+    }
     
     else if ( ctype == CT_RESULT ) {
         int resultValue = 0;
@@ -107,6 +114,10 @@ struct message_t * server_log_to_message (const char * command, int callFromServ
 }
 
 int server_log_invoke_over_table(struct table_t * table) {
+    return server_log_invoke_from(table, 0);
+}
+
+int server_log_invoke_from ( struct table_t * table, long long offset ) {
     
     if ( table==NULL)
         return FAILED;
@@ -119,6 +130,12 @@ int server_log_invoke_over_table(struct table_t * table) {
     if (fp == NULL)
 		return 0;
     
+    //the records before offset are already on the table (from a snapshot)
+    if ( offset > 0 && fseeko(fp, offset, SEEK_SET) != 0 ) {
+        fclose(fp);
+        return FAILED;
+    }
+    
     while( (read = getline(&line, &len, fp) ) != -1 ) {
         struct message_t * operation = server_log_to_message(line, YES);
         struct message_t ** msg_out = NULL;
@@ -126,31 +143,84 @@ int server_log_invoke_over_table(struct table_t * table) {
         free_message2(operation, NO);
     }
     
+    free(line);
+    fclose(fp);
     return SUCCEEDED;
 }
 
-int server_log_send_to ( int addressee_fd, int from_operation_n ) {
+long long server_log_size () {
+    FILE* fp = _log_file != NULL ? fopen(_log_file, "r") : NULL;
+    if ( fp == NULL )
+        return 0;
     
-    char * line = NULL;
-	size_t len = 0;
-	ssize_t read;
+    long long size = fseeko(fp, 0, SEEK_END) == 0 ? ftello(fp) : 0;
+    fclose(fp);
+    return size;
+}
+
+/*
+ * The records of the log being sent to a neighbor: the next one read from
+ * fp is record n_operation + 1, and the last to send is to_operation_n.
+ */
+struct server_log_sender_t {
+    FILE * fp;
+    char * line;
+    size_t len;
+    int n_operation;
+    int to_operation_n;
+};
+
+/*
+ * Producer of the records of a server_log_sender_t: queues the next
+ * SERVER_LOG_SEND_BATCH of them on addressee_fd.
+ */
+int server_log_produce ( void * state, int addressee_fd ) {
+    struct server_log_sender_t * sender = (struct server_log_sender_t *) state;
+    int n_queued = 0;
+    
+    //the records after to_operation_n are being logged meanwhile, and are not read
+    while ( n_queued < SERVER_LOG_SEND_BATCH && sender->n_operation < sender->to_operation_n
+           && getline(&sender->line, &sender->len, sender->fp) != -1 ) {
+        sender->n_operation++;
+        struct message_t * operation = server_log_to_message(sender->line, YES);
+        int taskSuccess = server_queue_response(addressee_fd, 1, &operation);
+        free_message(operation);
+        if ( taskSuccess == FAILED )
+            return FAILED;
+        n_queued++;
+    }
+    return n_queued == SERVER_LOG_SEND_BATCH && sender->n_operation < sender->to_operation_n ? YES : NO;
+}
+
+void server_log_sender_destroy ( void * state ) {
+    struct server_log_sender_t * sender = (struct server_log_sender_t *) state;
+    free(sender->line);
+    fclose(sender->fp);
+    free(sender);
+}
+
+int server_log_send_to ( int addressee_fd, int from_operation_n, int to_operation_n ) {
     
-    FILE* fp = fopen(_log_file, "r");
-    if (fp == NULL)
+    struct server_log_sender_t * sender = (struct server_log_sender_t *) calloc(1, sizeof(struct server_log_sender_t));
+    if ( sender == NULL )
+        return FAILED;
+    sender->fp = fopen(_log_file, "r");
+    if ( sender->fp == NULL ) {
+        free(sender);
 		return 0;
-    
-    int n_operation = 0;
-    
-    while ( (read = getline(&line, &len, fp) ) != -1 ) {
-        n_operation++;
-        if ( n_operation > from_operation_n ) {
-            struct message_t * operation = server_log_to_message(line, YES);
-            if ( send_message(addressee_fd, operation) == SUCCEEDED )
-                free_message(operation);
-        }
     }
-    
-    return SUCCEEDED;
+    sender->to_operation_n = to_operation_n;
+    
+    //the neighbor has the first from_operation_n already
+    while ( sender->n_operation < from_operation_n && getline(&sender->line, &sender->len, sender->fp) != -1 )
+        sender->n_operation++;
+    
+    //they go as the neighbor takes them, not all at once on its connection
+    struct server_producer_t producer;
+    producer.produce = server_log_produce;
+    producer.destroy = server_log_sender_destroy;
+    producer.state = sender;
+    return server_produce_response(addressee_fd, producer);
 }
 //table_skel_update_neighboor
 
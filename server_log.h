@@ -11,6 +11,9 @@
 
 #include "table.h"
 
+//how many records of the log are read each time the neighbor being sent them takes more
+#define SERVER_LOG_SEND_BATCH 256
+
 /* 
  * initializes the log
  */
@@ -37,7 +40,24 @@ int server_log_message( struct message_t * message );
 
 int server_log_invoke_over_table(struct table_t * table);
 
-int server_log_send_to (int addressee_fd, int from_operation_n);
+/*
+ * Same as server_log_invoke_over_table for the records from the byte
+ * offset of the log on (the ones a snapshot does not have yet).
+ */
+int server_log_invoke_from ( struct table_t * table, long long offset );
+
+/*
+ * Returns the size of the log, in bytes (0 if there is none).
+ */
+long long server_log_size ();
+
+/*
+ * Sends to addressee_fd the records of the log after the first
+ * from_operation_n, up to record to_operation_n (the count when the send
+ * started: the log may be growing meanwhile). They are read and sent
+ * SERVER_LOG_SEND_BATCH at a time, as the neighbor takes them.
+ */
+int server_log_send_to (int addressee_fd, int from_operation_n, int to_operation_n);
 
 void server_log_print();
 
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <sched.h>
  
 #include "server_proxy.h"
 #include "network_cliente.h"
@@ -55,6 +56,7 @@ struct request_t * create_request_with(int socket_fd, struct message_t * request
         new_request->acknowledged = n_proxies;
         new_request->deliveries = deliveries;
         new_request->answered = answered;
+        new_request->delivered_to_n = 0;
 
     }
     
@@ -69,6 +71,16 @@ void request_free(struct request_t * request ) {
     }
 }
 
+void requests_forget_requestor ( pthread_mutex_t * bucket_access, struct request_t ** bucket, int requestor_fd ) {
+    pthread_mutex_lock(bucket_access);
+    int i;
+    for ( i = 0; i < REQUESTS_BUCKET_SIZE; i++ ) {
+        if ( bucket[i] != NULL && bucket[i]->requestor_fd == requestor_fd )
+            bucket[i]->requestor_fd = -1;
+    }
+    pthread_mutex_unlock(bucket_access);
+}
+
 int get_number_of_proxies() {
   return number_of_proxies;
 }
@@ -122,7 +134,7 @@ void run_postman ( pthread_mutex_t * bucket_access, struct request_t ** bucket,
                     
                     /** IF some error happened, it will notify the client **/
                     if ( failed_tasks > 0 ) {
-                        server_sends_error_msg(bucket[i]->requestor_fd);
+                        server_sends_error_msg(bucket[i]->requestor_fd, bucket[i]->request->request_id);
                     }
                     
                     
@@ -192,9 +204,18 @@ void * run_server_proxy ( void *p ) {
      /* gets the requests from the bucket */
     request = proxy->requests_bucket[index_to_read_request];
 
+    //after a whole turn of the bucket the slot may still hold the request this proxy already
+    //delivered (the postman frees it later): it is not sent again, the proxy waits for the next one
+    if ( request != NULL && (request->delivered_to_n & (1 << proxy->id)) ) {
+      pthread_mutex_unlock(proxy->bucket_access);
+      sched_yield();
+      continue;
+    }
+
     if ( (request != NULL)  ) {
         
       request->deliveries++;
+      request->delivered_to_n |= 1 << proxy->id;
       client_request = request->request;
 
       /* unlocks the bucket */
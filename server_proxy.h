@@ -31,14 +31,14 @@ struct thread_data{
  * A structure for a request
  */
 struct request_t {
-    short requestor_fd;
+    int requestor_fd;
     short flags; // 1 = ACK, 2 = NACK, ... Uso geral...
     struct message_t *request; // Mensagem recebida
     struct message_t *response; // Mensagem de resposta
     short deliveries;
     int acknowledged;  // Cada proxy, ao receber resposta decrementa esta
     int answered; // Já foi dada uma resposta ao cliente?
-    int delivered_to_n;
+    int delivered_to_n; // os proxies que já o entregaram (bit id de cada um)
 };
 
 
@@ -58,6 +58,12 @@ struct request_t * create_request_with(int socket_fd, struct message_t *request_
 
 void request_free(struct request_t * request );
 
+/*
+ * The client on requestor_fd is gone: its requests on the bucket are still
+ * done, but answered to no one (the fd may be given to another client).
+ */
+void requests_forget_requestor ( pthread_mutex_t * bucket_access, struct request_t ** bucket, int requestor_fd );
+
 
 int get_number_of_proxies();
 
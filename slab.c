@@ -0,0 +1,169 @@
+//
+//  slab.c
+//  SD15-Product
+//
+//  Size-classed slab pools and per-request arena.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "slab.h"
+
+//alignment of the memory served by the arena
+#define SLAB_ARENA_ALIGNMENT 16
+
+/*
+ * A free object of a pool: its first bytes point to the next free one.
+ */
+struct slab_object_t {
+    struct slab_object_t * next;
+};
+
+/*
+ * The arena of a thread: a block used from the start and reset at once.
+ */
+struct slab_arena_t {
+    char * block;
+    size_t used;
+    int open;
+};
+
+//the free lists of the size classes of this thread
+static __thread struct slab_object_t * slab_free_lists[SLAB_N_CLASSES];
+//the arena of this thread
+static __thread struct slab_arena_t slab_arena;
+
+//allocations served without malloc (all threads)
+static unsigned long long slab_avoided = 0;
+
+/*
+ * Counts one allocation served without malloc.
+ */
+static void slab_count_avoided () {
+    __atomic_fetch_add(&slab_avoided, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Returns the size class of size or -1 if it is too big for the pools.
+ */
+static int slab_class_of ( size_t size ) {
+    if ( size > SLAB_MAX_SIZE )
+        return -1;
+
+    int class = 0;
+    size_t class_size = SLAB_MIN_SIZE;
+    while ( class_size < size ) {
+        class_size <<= 1;
+        class++;
+    }
+    return class;
+}
+
+/*
+ * Fills the free list of class with a new chunk cut in objects of its size.
+ * Returns 0 (OK) or -1 (error, out of memory).
+ */
+static int slab_refill ( int class ) {
+    size_t object_size = (size_t) SLAB_MIN_SIZE << class;
+    char * chunk = (char *) malloc(SLAB_CHUNK_BYTES);
+    if ( chunk == NULL )
+        return -1;
+
+    //the objects are linked from the end so the first one is served first
+    size_t offset = SLAB_CHUNK_BYTES - SLAB_CHUNK_BYTES % object_size;
+    while ( offset > 0 ) {
+        offset -= object_size;
+        struct slab_object_t * object = (struct slab_object_t *) (chunk + offset);
+        object->next = slab_free_lists[class];
+        slab_free_lists[class] = object;
+    }
+    return 0;
+}
+
+void * slab_alloc ( size_t size ) {
+    int class = slab_class_of(size);
+    if ( class == -1 )
+        return malloc(size);
+
+    if ( slab_free_lists[class] == NULL ) {
+        if ( slab_refill(class) == -1 )
+            return NULL;
+    }
+    else {
+        slab_count_avoided();
+    }
+
+    struct slab_object_t * object = slab_free_lists[class];
+    slab_free_lists[class] = object->next;
+    return object;
+}
+
+void * slab_calloc ( size_t n_members, size_t size ) {
+    void * ptr = slab_alloc(n_members * size);
+    if ( ptr != NULL )
+        memset(ptr, 0, n_members * size);
+    return ptr;
+}
+
+void slab_free ( void * ptr, size_t size ) {
+    if ( ptr == NULL )
+        return;
+
+    int class = slab_class_of(size);
+    if ( class == -1 ) {
+        free(ptr);
+        return;
+    }
+
+    struct slab_object_t * object = (struct slab_object_t *) ptr;
+    object->next = slab_free_lists[class];
+    slab_free_lists[class] = object;
+}
+
+char * slab_strndup ( const char * string, size_t length ) {
+    char * copy = (char *) slab_alloc(length + 1);
+    if ( copy != NULL ) {
+        memcpy(copy, string, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+char * slab_strdup ( const char * string ) {
+    return slab_strndup(string, strlen(string));
+}
+
+void slab_free_string ( char * string ) {
+    if ( string != NULL )
+        slab_free(string, strlen(string) + 1);
+}
+
+unsigned long long slab_allocations_avoided () {
+    return __atomic_load_n(&slab_avoided, __ATOMIC_RELAXED);
+}
+
+void slab_arena_begin () {
+    //the block is allocated once and kept for the next requests
+    if ( slab_arena.block == NULL )
+        slab_arena.block = (char *) malloc(SLAB_ARENA_BYTES);
+
+    slab_arena.used = 0;
+    slab_arena.open = slab_arena.block != NULL;
+}
+
+void * slab_arena_alloc ( size_t size ) {
+    size_t aligned_size = (size + SLAB_ARENA_ALIGNMENT - 1) & ~((size_t) SLAB_ARENA_ALIGNMENT - 1);
+
+    if ( !slab_arena.open || slab_arena.used + aligned_size > SLAB_ARENA_BYTES )
+        return NULL;
+
+    void * ptr = slab_arena.block + slab_arena.used;
+    slab_arena.used += aligned_size;
+    slab_count_avoided();
+    return ptr;
+}
+
+void slab_arena_reset () {
+    slab_arena.used = 0;
+    slab_arena.open = 0;
+}
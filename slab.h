@@ -0,0 +1,84 @@
+//
+//  slab.h
+//  SD15-Product
+//
+//  Size-classed slab pools for the small structures the table keeps
+//  allocating and freeing (tuples, their elements, entries and nodes),
+//  plus a per-request arena for the temporary lists of a get.
+//
+//  The pools are per thread: an object freed by one thread goes to the
+//  free list of that thread. Memory taken by the pools is never given
+//  back to the system, it is reused.
+//
+
+#ifndef SD15_Product_slab_h
+#define SD15_Product_slab_h
+
+#include <stddef.h>
+
+//sizes served by the pools: 16, 32, 64, 128 and 256 bytes
+#define SLAB_MIN_SIZE 16
+#define SLAB_MAX_SIZE 256
+#define SLAB_N_CLASSES 5
+//bytes taken from malloc each time a pool runs out of objects
+#define SLAB_CHUNK_BYTES (64 * 1024)
+//bytes of the per-request arena of each thread
+#define SLAB_ARENA_BYTES (16 * 1024)
+
+/*
+ * Returns size bytes from the pool of its size class (malloc if bigger
+ * than SLAB_MAX_SIZE), or NULL in case of error.
+ */
+void * slab_alloc ( size_t size );
+
+/*
+ * Same as slab_alloc but with the memory set to zero.
+ */
+void * slab_calloc ( size_t n_members, size_t size );
+
+/*
+ * Gives ptr, of size bytes, back to its pool. size must be the same
+ * given to slab_alloc.
+ */
+void slab_free ( void * ptr, size_t size );
+
+/*
+ * Duplicates a string into the pools. Free it with slab_free_string.
+ */
+char * slab_strdup ( const char * string );
+
+/*
+ * Duplicates the first length bytes of string (plus the '\0') into the pools.
+ */
+char * slab_strndup ( const char * string, size_t length );
+
+/*
+ * Gives back a string created by slab_strdup/slab_strndup.
+ */
+void slab_free_string ( char * string );
+
+/*
+ * Returns the number of allocations served without calling malloc,
+ * by the pools and by the arenas, since the process started.
+ */
+unsigned long long slab_allocations_avoided ();
+
+/*
+ * Opens the arena of the current thread. Until slab_arena_reset is
+ * called slab_arena_alloc serves memory from it.
+ */
+void slab_arena_begin ();
+
+/*
+ * Returns size bytes from the open arena of the current thread or NULL
+ * if there is no arena open or it is full (the caller must then malloc).
+ * The memory is not freed: it is all given back at once by slab_arena_reset.
+ */
+void * slab_arena_alloc ( size_t size );
+
+/*
+ * Closes the arena of the current thread, giving back everything it served.
+ */
+void slab_arena_reset ();
+
+#endif
@@ -0,0 +1,259 @@
+//
+//  snapshot.c
+//  SD15-Product
+//
+//  Binary snapshot of the table, loaded from a mapping of its file.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+#include "table-private.h"
+#include "entry-private.h"
+#include "message-private.h"
+#include "list-private.h"
+#include "general_utils.h"
+#include "epoch.h"
+#include "inet.h"
+
+/*
+ * Writes number (network byte order) to the header field at offset.
+ */
+void snapshot_put_field ( char * header, int offset, long long number ) {
+    long long number_to_network = swap_bytes_64(number);
+    memcpy(header + offset, &number_to_network, sizeof(long long));
+}
+
+/*
+ * Reads the header field at offset.
+ */
+long long snapshot_get_field ( const char * header, int offset ) {
+    long long number_network = 0;
+    memcpy(&number_network, header + offset, sizeof(long long));
+    return swap_bytes_64(number_network);
+}
+
+/*
+ * Writes the entry (as a lease, after its size) to file.
+ * Returns 0 (OK) or -1 (error).
+ */
+int snapshot_write_entry ( FILE * file, struct entry_t * entry ) {
+    char * buffer = NULL;
+    int size = message_serialize_lease(entry, &buffer);
+    if ( size == FAILED )
+        return FAILED;
+    
+    int size_to_network = htonl(size);
+    int taskSuccess = fwrite(&size_to_network, BUFFER_INTEGER_SIZE, 1, file) == 1
+        && fwrite(buffer, size, 1, file) == 1 ? SUCCEEDED : FAILED;
+    free(buffer);
+    return taskSuccess;
+}
+
+long long snapshot_write ( struct table_t ** tables, int n_tables, const char * path, struct snapshot_info_t * info ) {
+    if ( tables == NULL || n_tables <= 0 || path == NULL || info == NULL )
+        return FAILED;
+    
+    char tmp_path[strlen(path) + strlen(".tmp") + 1];
+    sprintf(tmp_path, "%s.tmp", path);
+    FILE * file = fopen(tmp_path, "w+");
+    if ( file == NULL )
+        return FAILED;
+    
+    //the header is filled in at the end, when the number of entries is known
+    char header[SNAPSHOT_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    int taskSuccess = fwrite(header, sizeof(header), 1, file) == 1 ? SUCCEEDED : FAILED;
+    
+    //every entry, the ones on the spill too, is newer than -1
+    long long n_entries = 0;
+    long long since = -1;
+    struct table_cursor_t cursors[n_tables];
+    struct entry_t * heads[n_tables];
+    int n_open = 0;
+    epoch_enter();
+    while ( taskSuccess == SUCCEEDED && n_open < n_tables ) {
+        taskSuccess = table_cursor_open(&cursors[n_open], tables[n_open], &since, GET_BY_TIME, 0);
+        if ( taskSuccess == SUCCEEDED ) {
+            heads[n_open] = table_cursor_next(&cursors[n_open]);
+            n_open++;
+        }
+    }
+    
+    //the oldest first, whatever table it is on, so the loaded tables are only appended to
+    while ( taskSuccess == SUCCEEDED ) {
+        int oldest = -1;
+        int i;
+        for ( i = 0; i < n_tables; i++ ) {
+            if ( heads[i] != NULL && (oldest == -1 || entry_timestamp(heads[i]) < entry_timestamp(heads[oldest])) )
+                oldest = i;
+        }
+        if ( oldest == -1 )
+            break;
+        taskSuccess = snapshot_write_entry(file, heads[oldest]);
+        heads[oldest] = table_cursor_next(&cursors[oldest]);
+        n_entries++;
+    }
+    while ( n_open > 0 )
+        table_cursor_close(&cursors[--n_open]);
+    epoch_exit();
+    
+    memcpy(header, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+    snapshot_put_field(header, SNAPSHOT_MAGIC_SIZE + 8, info->log_records);
+    snapshot_put_field(header, SNAPSHOT_MAGIC_SIZE + 16, info->log_offset);
+    snapshot_put_field(header, SNAPSHOT_MAGIC_SIZE + 24, info->latest_put);
+    snapshot_put_field(header, SNAPSHOT_MAGIC_SIZE + 32, n_entries);
+    if ( taskSuccess == SUCCEEDED )
+        taskSuccess = fseek(file, 0, SEEK_SET) == 0 && fwrite(header, sizeof(header), 1, file) == 1
+            && fflush(file) == 0 ? SUCCEEDED : FAILED;
+    
+    //the checksum is of the file as it is on disk
+    long long file_size = taskSuccess == SUCCEEDED ? lseek(fileno(file), 0, SEEK_END) : FAILED;
+    char * mapped = file_size > 0 ? mmap(NULL, file_size, PROT_READ, MAP_SHARED, fileno(file), 0) : MAP_FAILED;
+    if ( mapped != MAP_FAILED ) {
+        int checked = SNAPSHOT_MAGIC_SIZE + 8;
+        snapshot_put_field(header, SNAPSHOT_MAGIC_SIZE, (long long) hash_bytes_64(mapped + checked, file_size - checked));
+        munmap(mapped, file_size);
+        taskSuccess = pwrite(fileno(file), header + SNAPSHOT_MAGIC_SIZE, 8, SNAPSHOT_MAGIC_SIZE) == 8 ? SUCCEEDED : FAILED;
+    }
+    else {
+        taskSuccess = FAILED;
+    }
+    
+    //only a whole snapshot, on disk, replaces the old one
+    if ( taskSuccess == SUCCEEDED )
+        taskSuccess = fsync(fileno(file)) == 0 ? SUCCEEDED : FAILED;
+    fclose(file);
+    if ( taskSuccess == SUCCEEDED )
+        taskSuccess = rename(tmp_path, path) == 0 ? SUCCEEDED : FAILED;
+    if ( taskSuccess == FAILED ) {
+        unlink(tmp_path);
+        return FAILED;
+    }
+    return n_entries;
+}
+
+/*
+ * Checks that the n_entries leases after the header of the mapped snapshot
+ * fit exactly on its size bytes.
+ * Returns YES or NO
+ */
+int snapshot_well_formed ( const char * mapped, long long size, long long n_entries ) {
+    long long offset = SNAPSHOT_HEADER_SIZE;
+    long long i;
+    for ( i = 0; i < n_entries; i++ ) {
+        if ( size - offset < BUFFER_INTEGER_SIZE )
+            return NO;
+        int size_network = 0;
+        memcpy(&size_network, mapped + offset, BUFFER_INTEGER_SIZE);
+        int lease_size = ntohl(size_network);
+        offset += BUFFER_INTEGER_SIZE;
+        if ( lease_size <= TIMESTAMP_SIZE || lease_size > size - offset )
+            return NO;
+        offset += lease_size;
+    }
+    return offset == size;
+}
+
+int snapshot_read_info ( const char * path, struct snapshot_info_t * info ) {
+    if ( path == NULL || info == NULL )
+        return FAILED;
+    
+    int fd = open(path, O_RDONLY);
+    if ( fd == -1 )
+        return FAILED;
+    char header[SNAPSHOT_HEADER_SIZE];
+    int taskSuccess = pread(fd, header, sizeof(header), 0) == sizeof(header)
+        && memcmp(header, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) == 0 ? SUCCEEDED : FAILED;
+    close(fd);
+    
+    if ( taskSuccess == SUCCEEDED ) {
+        info->log_records = snapshot_get_field(header, SNAPSHOT_MAGIC_SIZE + 8);
+        info->log_offset = snapshot_get_field(header, SNAPSHOT_MAGIC_SIZE + 16);
+        info->latest_put = snapshot_get_field(header, SNAPSHOT_MAGIC_SIZE + 24);
+    }
+    return taskSuccess;
+}
+
+long long snapshot_load ( struct table_t ** tables, int n_tables, const char * path, struct snapshot_info_t * info ) {
+    if ( tables == NULL || n_tables <= 0 || path == NULL || info == NULL )
+        return FAILED;
+    
+    int fd = open(path, O_RDONLY);
+    if ( fd == -1 )
+        return FAILED;
+    struct stat file_stat;
+    long long size = fstat(fd, &file_stat) == 0 ? file_stat.st_size : 0;
+    char * mapped = size >= SNAPSHOT_HEADER_SIZE ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if ( mapped == MAP_FAILED )
+        return FAILED;
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    
+    //a snapshot cut short or damaged is not loaded at all
+    int checked = SNAPSHOT_MAGIC_SIZE + 8;
+    long long n_entries = snapshot_get_field(mapped, SNAPSHOT_MAGIC_SIZE + 32);
+    struct entry_t ** batches = NULL;
+    if ( memcmp(mapped, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) != 0
+        || (unsigned long long) snapshot_get_field(mapped, SNAPSHOT_MAGIC_SIZE) != hash_bytes_64(mapped + checked, size - checked)
+        || n_entries < 0 || !snapshot_well_formed(mapped, size, n_entries)
+        || (batches = (struct entry_t **) malloc(n_tables * SNAPSHOT_LOAD_BATCH * sizeof(struct entry_t *))) == NULL ) {
+        munmap(mapped, size);
+        return FAILED;
+    }
+    info->log_records = snapshot_get_field(mapped, SNAPSHOT_MAGIC_SIZE + 8);
+    info->log_offset = snapshot_get_field(mapped, SNAPSHOT_MAGIC_SIZE + 16);
+    info->latest_put = snapshot_get_field(mapped, SNAPSHOT_MAGIC_SIZE + 24);
+    
+    //no slot is split (moving its entries) while they are put
+    int shard;
+    for ( shard = 0; shard < n_tables; shard++ )
+        table_reserve(tables[shard], n_entries / n_tables);
+    
+    //the entries go on the table of their key a batch at a time
+    int n_batch[n_tables];
+    memset(n_batch, 0, sizeof(n_batch));
+    long long n_loaded = 0;
+    long long offset = SNAPSHOT_HEADER_SIZE;
+    int taskSuccess = SUCCEEDED;
+    long long i;
+    for ( i = 0; i < n_entries && taskSuccess == SUCCEEDED; i++ ) {
+        int size_network = 0;
+        memcpy(&size_network, mapped + offset, BUFFER_INTEGER_SIZE);
+        int lease_size = ntohl(size_network);
+        offset += BUFFER_INTEGER_SIZE;
+        
+        struct entry_t * entry = message_deserialize_lease(mapped + offset, lease_size);
+        offset += lease_size;
+        shard = entry == NULL ? -1 : n_tables == 1 ? 0 : table_shard_index(entry_key(entry), entry_key_length(entry), n_tables);
+        if ( shard == -1 ) {
+            entry_free(entry);
+            taskSuccess = FAILED;
+            break;
+        }
+        
+        struct entry_t ** batch = batches + shard * SNAPSHOT_LOAD_BATCH;
+        batch[n_batch[shard]++] = entry;
+        if ( n_batch[shard] == SNAPSHOT_LOAD_BATCH ) {
+            taskSuccess = table_put_batch(tables[shard], batch, n_batch[shard]);
+            n_loaded += n_batch[shard];
+            n_batch[shard] = 0;
+        }
+    }
+    
+    //what is left on the batches (even after an error: those entries are not lost)
+    for ( shard = 0; shard < n_tables; shard++ ) {
+        if ( n_batch[shard] > 0 && table_put_batch(tables[shard], batches + shard * SNAPSHOT_LOAD_BATCH, n_batch[shard]) == FAILED )
+            taskSuccess = FAILED;
+        n_loaded += n_batch[shard];
+    }
+    
+    free(batches);
+    munmap(mapped, size);
+    return taskSuccess == SUCCEEDED ? n_loaded : FAILED;
+}
@@ -0,0 +1,74 @@
+//
+//  snapshot.h
+//  SD15-Product
+//
+//  Binary snapshot of the table, so a restart does not replay (and parse)
+//  the whole text log: it loads the latest snapshot and replays only the
+//  records of the log written after it.
+//
+//  The file has no pointers, only sizes, all in network byte order, so it
+//  is read straight from a read-only mapping of it:
+//
+//  MAGIC       CHECKSUM    LOG_RECORDS LOG_OFFSET  LATEST_PUT  N_ENTRIES
+//  [8 bytes]   [8 bytes]   [8 bytes]   [8 bytes]   [8 bytes]   [8 bytes]
+//
+//  followed by each entry as the content of a CT_LEASE message (an entry
+//  that does not expire has EXPIRES 0), after its size:
+//
+//  LEASESIZE   EXPIRES     TIMESTAMP   DIMENSION   ELEMENTSIZE ELEMENTDATA
+//  [4 bytes]   [8 bytes]   [8 bytes]   [4 bytes]   [4 bytes]   [ES bytes]  ...
+//
+//  CHECKSUM is the hash_bytes_64 of all that comes after it, so a snapshot
+//  cut short or damaged is never loaded. LOG_RECORDS and LOG_OFFSET say
+//  how much of the log (records and bytes) the snapshot already has. It is
+//  written to a temporary file that then replaces the old one, so there is
+//  always a whole snapshot on disk.
+//
+
+#ifndef SD15_Product_snapshot_h
+#define SD15_Product_snapshot_h
+
+#include "table.h"
+
+#define SNAPSHOT_MAGIC "SD15SNP1"
+#define SNAPSHOT_MAGIC_SIZE 8
+#define SNAPSHOT_HEADER_SIZE (SNAPSHOT_MAGIC_SIZE + 5 * 8)
+//entries put on the table at once when a snapshot is loaded
+#define SNAPSHOT_LOAD_BATCH 1024
+
+/*
+ * What a snapshot says about the log: how many records and bytes of it
+ * it has, and the timestamp of the latest put.
+ */
+struct snapshot_info_t {
+    long long log_records;
+    long long log_offset;
+    long long latest_put;
+};
+
+/*
+ * Writes every entry of the n_tables tables (the ones on their spills too)
+ * to a snapshot at path, with info, the oldest first. The tables must not
+ * change while it is written.
+ * Returns the number of entries written or -1 (error: the old snapshot,
+ * if any, stays).
+ */
+long long snapshot_write ( struct table_t ** tables, int n_tables, const char * path, struct snapshot_info_t * info );
+
+/*
+ * Reads only the info of the snapshot at path (without checking its entries).
+ * Returns 0 (OK) or -1 (no snapshot).
+ */
+int snapshot_read_info ( const char * path, struct snapshot_info_t * info );
+
+/*
+ * Puts the entries of the snapshot at path on the n_tables tables (each on
+ * the one of its key, see table_shard_index), and fills info. The number of
+ * tables may not be the one the snapshot was written with.
+ * Returns the number of entries loaded or -1 (no snapshot, or a damaged
+ * one: nothing was put on the tables then, unless it ran out of memory
+ * half way).
+ */
+long long snapshot_load ( struct table_t ** tables, int n_tables, const char * path, struct snapshot_info_t * info );
+
+#endif
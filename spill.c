@@ -0,0 +1,355 @@
+//
+//  spill.c
+//  SD15-Product
+//
+//  Segment file of the entries that do not fit on the table memory budget.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "spill.h"
+#include "entry-private.h"
+#include "tuple-private.h"
+#include "list-private.h"
+#include "general_utils.h"
+#include "slab.h"
+
+struct spill_t * spill_create ( const char * path ) {
+    if ( path == NULL )
+        return NULL;
+
+    struct spill_t * spill = (struct spill_t *) malloc(sizeof(struct spill_t));
+    if ( spill == NULL )
+        return NULL;
+
+    spill->path = strdup(path);
+    spill->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    spill->buckets = (struct spill_record_t **) calloc(SPILL_INITIAL_BUCKETS, sizeof(struct spill_record_t *));
+    if ( spill->path == NULL || spill->fd == -1 || spill->buckets == NULL ) {
+        if ( spill->fd != -1 )
+            close(spill->fd);
+        free(spill->path);
+        free(spill->buckets);
+        free(spill);
+        return NULL;
+    }
+
+    spill->n_buckets = SPILL_INITIAL_BUCKETS;
+    spill->file_size = 0;
+    spill->live_bytes = 0;
+    spill->n_records = 0;
+    spill->head = NULL;
+    spill->tail = NULL;
+    pthread_mutex_init(&(spill->lock), NULL);
+    return spill;
+}
+
+void spill_destroy ( struct spill_t * spill ) {
+    if ( spill == NULL )
+        return;
+
+    struct spill_record_t * record = spill->head;
+    while ( record != NULL ) {
+        struct spill_record_t * next = record->next;
+        slab_free(record, sizeof(struct spill_record_t));
+        record = next;
+    }
+
+    close(spill->fd);
+    unlink(spill->path);
+    free(spill->path);
+    free(spill->buckets);
+    pthread_mutex_destroy(&(spill->lock));
+    free(spill);
+}
+
+int spill_size ( struct spill_t * spill ) {
+    return spill == NULL ? 0 : __atomic_load_n(&(spill->n_records), __ATOMIC_RELAXED);
+}
+
+/*
+ * Returns the hash the records of key (its key_length bytes) are found by.
+ */
+unsigned long long spill_key_hash ( char * key, int key_length ) {
+    return key == NULL ? 0 : hash_bytes_64(key, key_length);
+}
+
+/*
+ * Writes size bytes of buffer to fd at offset, however many writes it takes.
+ * Returns 0 (OK) or -1 (error).
+ */
+int spill_pwrite ( int fd, char * buffer, int size, long long offset ) {
+    int written = 0;
+    while ( written < size ) {
+        ssize_t n = pwrite(fd, buffer + written, size - written, offset + written);
+        if ( n <= 0 )
+            return FAILED;
+        written += n;
+    }
+    return SUCCEEDED;
+}
+
+/*
+ * Reads size bytes at offset of fd to buffer.
+ * Returns 0 (OK) or -1 (error).
+ */
+int spill_pread ( int fd, char * buffer, int size, long long offset ) {
+    int read = 0;
+    while ( read < size ) {
+        ssize_t n = pread(fd, buffer + read, size - read, offset + read);
+        if ( n <= 0 )
+            return FAILED;
+        read += n;
+    }
+    return SUCCEEDED;
+}
+
+struct spill_record_t * spill_write ( struct spill_t * spill, struct entry_t * entry ) {
+    if ( spill == NULL || entry == NULL )
+        return NULL;
+
+    char * buffer = NULL;
+    int size = entry_serialize(entry, &buffer);
+    if ( size <= 0 )
+        return NULL;
+
+    struct spill_record_t * record = (struct spill_record_t *) slab_alloc(sizeof(struct spill_record_t));
+    if ( record == NULL ) {
+        free(buffer);
+        return NULL;
+    }
+    record->size = size;
+    record->timestamp = entry_timestamp(entry);
+    record->signature = entry->signature;
+    record->key_hash = spill_key_hash(entry_key(entry), entry_key_length(entry));
+    record->prev = NULL;
+    record->next = NULL;
+    record->bucket_next = NULL;
+
+    //appended to the end of the file
+    pthread_mutex_lock(&(spill->lock));
+    record->offset = spill->file_size;
+    int taskSuccess = spill_pwrite(spill->fd, buffer, size, record->offset);
+    if ( taskSuccess == SUCCEEDED )
+        spill->file_size += size;
+    pthread_mutex_unlock(&(spill->lock));
+
+    free(buffer);
+    if ( taskSuccess == FAILED ) {
+        slab_free(record, sizeof(struct spill_record_t));
+        return NULL;
+    }
+    return record;
+}
+
+/*
+ * Doubles the buckets, rehashing every record (its lock must be held).
+ */
+void spill_grow_buckets ( struct spill_t * spill ) {
+    int n_buckets = spill->n_buckets * 2;
+    struct spill_record_t ** buckets = (struct spill_record_t **) calloc(n_buckets, sizeof(struct spill_record_t *));
+    //with no memory for them the chains just get longer
+    if ( buckets == NULL )
+        return;
+
+    struct spill_record_t * record;
+    for ( record = spill->head; record != NULL; record = record->next ) {
+        struct spill_record_t ** bucket = &buckets[record->key_hash % n_buckets];
+        record->bucket_next = *bucket;
+        *bucket = record;
+    }
+    free(spill->buckets);
+    spill->buckets = buckets;
+    spill->n_buckets = n_buckets;
+}
+
+void spill_link ( struct spill_t * spill, struct spill_record_t * record ) {
+    if ( spill == NULL || record == NULL )
+        return;
+
+    pthread_mutex_lock(&(spill->lock));
+
+    record->prev = spill->tail;
+    record->next = NULL;
+    if ( spill->tail != NULL )
+        spill->tail->next = record;
+    else
+        spill->head = record;
+    spill->tail = record;
+
+    struct spill_record_t ** bucket = &(spill->buckets[record->key_hash % spill->n_buckets]);
+    record->bucket_next = *bucket;
+    *bucket = record;
+
+    spill->live_bytes += record->size;
+    __atomic_add_fetch(&(spill->n_records), 1, __ATOMIC_RELAXED);
+    if ( spill->n_records > 2 * spill->n_buckets )
+        spill_grow_buckets(spill);
+
+    pthread_mutex_unlock(&(spill->lock));
+}
+
+/*
+ * Rewrites the file with only the entries still on the spill, one after
+ * the other (its lock must be held). If it fails the old file stays.
+ */
+void spill_compact ( struct spill_t * spill ) {
+    char * tmp_path = (char *) malloc(strlen(spill->path) + 5);
+    if ( tmp_path == NULL )
+        return;
+    sprintf(tmp_path, "%s.tmp", spill->path);
+
+    int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    char * buffer = NULL;
+    int buffer_size = 0;
+    long long offset = 0;
+    int taskSuccess = fd != -1 ? SUCCEEDED : FAILED;
+
+    //first copied, only then moved: the records keep the old offsets until it all went well
+    struct spill_record_t * record;
+    for ( record = spill->head; record != NULL && taskSuccess == SUCCEEDED; record = record->next ) {
+        if ( record->size > buffer_size ) {
+            char * bigger = (char *) realloc(buffer, record->size);
+            if ( bigger == NULL ) {
+                taskSuccess = FAILED;
+                break;
+            }
+            buffer = bigger;
+            buffer_size = record->size;
+        }
+        taskSuccess = spill_pread(spill->fd, buffer, record->size, record->offset) == SUCCEEDED
+            && spill_pwrite(fd, buffer, record->size, offset) == SUCCEEDED ? SUCCEEDED : FAILED;
+        offset += record->size;
+    }
+    free(buffer);
+
+    if ( taskSuccess == SUCCEEDED && rename(tmp_path, spill->path) == 0 ) {
+        offset = 0;
+        for ( record = spill->head; record != NULL; record = record->next ) {
+            record->offset = offset;
+            offset += record->size;
+        }
+        close(spill->fd);
+        spill->fd = fd;
+        spill->file_size = offset;
+    }
+    else {
+        if ( fd != -1 )
+            close(fd);
+        unlink(tmp_path);
+    }
+    free(tmp_path);
+}
+
+/*
+ * Takes the record out of the spill and frees it (its lock must be held).
+ */
+void spill_remove ( struct spill_t * spill, struct spill_record_t * record ) {
+    if ( record->prev != NULL )
+        record->prev->next = record->next;
+    else
+        spill->head = record->next;
+    if ( record->next != NULL )
+        record->next->prev = record->prev;
+    else
+        spill->tail = record->prev;
+
+    struct spill_record_t ** link = &(spill->buckets[record->key_hash % spill->n_buckets]);
+    while ( *link != record )
+        link = &((*link)->bucket_next);
+    *link = record->bucket_next;
+
+    spill->live_bytes -= record->size;
+    __atomic_sub_fetch(&(spill->n_records), 1, __ATOMIC_RELAXED);
+    slab_free(record, sizeof(struct spill_record_t));
+
+    //an empty spill starts the file over, a mostly dead one is rewritten
+    if ( spill->n_records == 0 ) {
+        if ( ftruncate(spill->fd, 0) == 0 )
+            spill->file_size = 0;
+    }
+    else if ( spill->file_size > SPILL_COMPACT_MIN_BYTES && spill->live_bytes < spill->file_size / 2 ) {
+        spill_compact(spill);
+    }
+}
+
+/*
+ * Reads the entry of the record back from the file (its lock must be held).
+ * Returns a new entry or NULL (error).
+ */
+struct entry_t * spill_read ( struct spill_t * spill, struct spill_record_t * record ) {
+    char * buffer = (char *) malloc(record->size);
+    if ( buffer == NULL )
+        return NULL;
+
+    struct entry_t * entry = spill_pread(spill->fd, buffer, record->size, record->offset) == SUCCEEDED ?
+        entry_deserialize(buffer, record->size) : NULL;
+    free(buffer);
+    return entry;
+}
+
+int spill_get ( struct spill_t * spill, void * search_element, int get_criterion, int keep_tuples,
+                int one_or_all, struct list_t * matches )
+{
+    if ( spill == NULL || search_element == NULL || matches == NULL )
+        return FAILED;
+    if ( spill_size(spill) == 0 )
+        return 0;
+
+    struct tuple_t * tup_template = get_criterion == GET_BY_TUPLE_MATCH ? (struct tuple_t *) search_element : NULL;
+    long long timestamp = get_criterion == GET_BY_TIME ? *((long long *) search_element) : 0;
+    struct entry_signature_t signature;
+    if ( tup_template != NULL )
+        entry_template_signature(tup_template, &signature);
+
+    //the records of the key, or all of them (the newest first when by time, so each goes before the others)
+    char * key = tup_template != NULL ? tuple_key(tup_template) : NULL;
+    unsigned long long key_hash = spill_key_hash(key, tup_template != NULL ? tuple_key_length(tup_template) : -1);
+
+    pthread_mutex_lock(&(spill->lock));
+
+    struct spill_record_t * record = key != NULL ? spill->buckets[key_hash % spill->n_buckets]
+        : get_criterion == GET_BY_TIME ? spill->tail : spill->head;
+    int n_matches = 0;
+    int stillSearching = YES;
+    while ( record != NULL && stillSearching ) {
+        struct spill_record_t * current = record;
+        record = key != NULL ? record->bucket_next : get_criterion == GET_BY_TIME ? record->prev : record->next;
+
+        //only what may match is read from disk
+        if ( key != NULL && current->key_hash != key_hash )
+            continue;
+        if ( tup_template != NULL ? !entry_signature_may_match(current->signature, &signature) : current->timestamp <= timestamp )
+            continue;
+
+        struct entry_t * entry = spill_read(spill, current);
+        if ( entry == NULL )
+            continue;
+        if ( tup_template != NULL && !tuple_matches_template(entry_value(entry), tup_template) ) {
+            entry_free(entry);
+            continue;
+        }
+
+        n_matches++;
+        stillSearching = !one_or_all;
+        if ( keep_tuples != KEEP_AT_ORIGIN )
+            spill_remove(spill, current);
+
+        if ( keep_tuples == JUST_DELETE_NODES ) {
+            entry_free(entry);
+        }
+        else {
+            list_add_with_criterion(matches, entry, get_criterion == GET_BY_TIME ? ADD_WITH_CRITERION_TIME : ADD_WITH_CRITERION_KEY, timestamp);
+            //a copy lives until the epoch of the caller ends
+            if ( keep_tuples == KEEP_AT_ORIGIN )
+                entry_destroy(entry);
+        }
+    }
+
+    pthread_mutex_unlock(&(spill->lock));
+
+    return n_matches;
+}
@@ -0,0 +1,108 @@
+//
+//  spill.h
+//  SD15-Product
+//
+//  Segment file where the table puts its coldest entries when they do not
+//  fit on its memory budget. The entries are written (serialized as in a
+//  CT_ENTRY message) one after the other to the file, and only a small
+//  record of each (where it is, its timestamp, its signature and the hash
+//  of its key) stays in memory: the records of a key are found by its
+//  hash, and the templates without key go through the signatures of every
+//  record, so only the entries that may match are read back from disk.
+//
+//  An entry read back is a new entry: the ones kept on the spill are
+//  destroyed (retired) at once, so the caller must be inside an epoch
+//  while it uses them; the ones taken out are the caller's.
+//
+//  The space of the entries taken out is reclaimed by rewriting the file
+//  when it is mostly dead, and the file is deleted with the spill: it is
+//  a cache of the table, that the log rebuilds.
+//
+//  Thread safe (one lock per spill). When the spill changes and who sees
+//  it is up to the table locks.
+//
+
+#ifndef SD15_Product_spill_h
+#define SD15_Product_spill_h
+
+#include <pthread.h>
+#include "entry.h"
+#include "list.h"
+
+//initial number of buckets of the records by key hash (doubles as they grow)
+#define SPILL_INITIAL_BUCKETS 1024
+//the file is rewritten when it is bigger than this and more than half of it is dead
+#define SPILL_COMPACT_MIN_BYTES (4 * 1024 * 1024)
+
+/*
+ * Where an entry is on the file and what is needed to tell if it may match
+ * a search without reading it.
+ */
+struct spill_record_t {
+    long long offset;
+    int size;
+    long long timestamp;
+    unsigned long long signature;
+    unsigned long long key_hash;
+    //all the records, by the order they were spilled
+    struct spill_record_t * prev;
+    struct spill_record_t * next;
+    //the records of the same bucket
+    struct spill_record_t * bucket_next;
+};
+
+struct spill_t {
+    char * path;
+    int fd;
+    //bytes written to the file and bytes of it still in use
+    long long file_size;
+    long long live_bytes;
+    int n_records;
+    struct spill_record_t * head;
+    struct spill_record_t * tail;
+    struct spill_record_t ** buckets;
+    int n_buckets;
+    pthread_mutex_t lock;
+};
+
+/*
+ * Creates an empty spill on the file at path (created or truncated).
+ * Returns NULL in case of error.
+ */
+struct spill_t * spill_create ( const char * path );
+
+/*
+ * Destroys the spill and deletes its file.
+ */
+void spill_destroy ( struct spill_t * spill );
+
+/*
+ * Returns the number of entries on the spill.
+ */
+int spill_size ( struct spill_t * spill );
+
+/*
+ * Writes entry to the file, without linking it yet: no search finds it
+ * until spill_link. The entry is still the caller's.
+ * Returns the record of the entry or NULL (error).
+ */
+struct spill_record_t * spill_write ( struct spill_t * spill, struct entry_t * entry );
+
+/*
+ * Links the record written by spill_write, so the searches find it.
+ */
+void spill_link ( struct spill_t * spill, struct spill_record_t * record );
+
+/*
+ * Same as table_get_by over the entries on the spill: adds the matches of
+ * search_element (a template or a timestamp) to matches (by key or by
+ * timestamp, as table_get_by orders them). Kept (KEEP_AT_ORIGIN) they are
+ * copies that live until the epoch of the caller ends; taken out
+ * (DONT_KEEP_AT_ORIGIN) they are the caller's; JUST_DELETE_NODES destroys
+ * them instead of adding them.
+ * Returns the number of matches or -1 (error).
+ */
+int spill_get ( struct spill_t * spill, void * search_element, int get_criterion, int keep_tuples,
+                int one_or_all, struct list_t * matches );
+
+#endif
@@ -0,0 +1,820 @@
+//
+//  table-bench.c
+//  SD15-Product
+//
+//  Benchmarks of the table module. Not part of the SD15 executables:
+//  build it with "make bench".
+//
+//  Uso: ./SD15_BENCH [max_tuples]
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "table-private.h"
+#include "table.h"
+#include "list-private.h"
+#include "tuple-private.h"
+#include "entry-private.h"
+#include "message-private.h"
+#include "slab.h"
+#include "epoch.h"
+#include "intern.h"
+#include "snapshot.h"
+#include "general_utils.h"
+
+#define GET_ONE 1
+#define KEEP_TUPLES KEEP_AT_ORIGIN
+#define DEFAULT_MAX_TUPLES 10000000
+#define N_GETS 100000
+#define BUCKET_SIZE 1000000
+#define N_WORKERS 1000
+#define N_SCANS 10
+#define MAX_THREADS 8
+//the soak puts SOAK_PAYLOAD bytes tuples with a budget of SOAK_BUDGET bytes, reporting SOAK_REPORTS times
+#define SOAK_TUPLES 500000
+#define SOAK_PAYLOAD 1024
+#define SOAK_BUDGET (32 * 1024 * 1024)
+#define SOAK_REPORTS 10
+//the repeated values of benchIntern: statuses and tenants
+#define INTERN_STATUSES 5
+#define INTERN_TENANTS 100
+//few enough to fit on the cache, so the match cost does not depend on where the pools put them
+#define INTERN_TUPLES 10000
+//the replicas each write of benchShare goes to
+#define SHARE_REPLICAS 3
+//tuples per table_put_batch of benchBatch
+#define BATCH_TUPLES 1000
+
+/*
+ * Returns the current time in nanoseconds.
+ */
+double bench_now_ns () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/*
+ * Creates the tuple number i. All the keys share prefix and suffix.
+ */
+struct tuple_t * bench_tuple ( int i ) {
+    char key[32];
+    sprintf(key, "job-%09d-q", i);
+    char *tdata[3] = {key, "pending", "payload"};
+    return tuple_create2(3, tdata);
+}
+
+/***********************************************************************
+ Custo de put/get com n tuplos na tabela
+ */
+void benchPutGet ( int n ) {
+    struct table_t * table = table_create(7);
+
+    double start = bench_now_ns();
+    int i;
+    for ( i = 0; i < n; i++ )
+        table_put(table, bench_tuple(i));
+    double put_ns = (bench_now_ns() - start) / n;
+
+    int n_gets = n < N_GETS ? n : N_GETS;
+    struct tuple_t ** templates = tuple_create_array(n_gets);
+    for ( i = 0; i < n_gets; i++ )
+        templates[i] = bench_tuple(rand() % n);
+
+    start = bench_now_ns();
+    for ( i = 0; i < n_gets; i++ )
+        list_destroy(table_get(table, templates[i], KEEP_TUPLES, GET_ONE));
+    double get_ns = (bench_now_ns() - start) / n_gets;
+
+    printf("  %9d tuplos: put %8.1f ns/op | get %8.1f ns/op | %d slots\n",
+           n, put_ns, get_ns, table_slots(table));
+
+    tuple_array_destroy(templates, n_gets);
+    table_destroy(table);
+}
+
+/*
+ * Returns the nanoseconds per node of scanning the bucket with the template:
+ * with list_matching_nodes (signatures) or comparing every tuple (as before).
+ */
+double bench_scan ( struct list_t * bucket, struct tuple_t * template, int with_signatures, int * matches ) {
+    double start = bench_now_ns();
+    int scan;
+    for ( scan = 0; scan < N_SCANS; scan++ ) {
+        if ( with_signatures ) {
+            struct list_t * result = list_matching_nodes(bucket, template, KEEP_AT_ORIGIN, 0);
+            *matches = list_size(result);
+            list_destroy(result);
+        }
+        else {
+            *matches = 0;
+            node_t * node = list_head(bucket);
+            int nodesToCheck = list_size(bucket);
+            while ( nodesToCheck-- > 0 ) {
+                *matches += tuple_matches_template(entry_value(node_entry(node)), template);
+                node = node->next;
+            }
+        }
+    }
+    return (bench_now_ns() - start) / N_SCANS / list_size(bucket);
+}
+
+/***********************************************************************
+ Procura num bucket de n tuplos com a mesma chave, com templates pouco seletivos
+ */
+void benchBucketMatch ( int n ) {
+    struct list_t * bucket = list_create();
+    
+    char worker[32], payload[32];
+    char *tdata[3] = {"queue", worker, payload};
+    int i;
+    for ( i = 0; i < n; i++ ) {
+        sprintf(worker, "worker-%04d", i % N_WORKERS);
+        sprintf(payload, "payload-%09d", i);
+        list_add_with_criterion(bucket, entry_create(tuple_create2(3, tdata)), ADD_WITHOUT_CRITERION, 0);
+    }
+    
+    //one template matching n/N_WORKERS tuples and one matching a single tuple
+    sprintf(worker, "worker-%04d", N_WORKERS / 2);
+    char *by_worker[3] = {"queue", worker, NULL};
+    sprintf(payload, "payload-%09d", n / 2);
+    char *by_payload[3] = {"queue", NULL, payload};
+    struct tuple_t * templates[2] = { tuple_create2(3, by_worker), tuple_create2(3, by_payload) };
+    
+    for ( i = 0; i < 2; i++ ) {
+        int matches_before, matches_now;
+        double before_ns = bench_scan(bucket, templates[i], NO, &matches_before);
+        double now_ns = bench_scan(bucket, templates[i], YES, &matches_now);
+        printf("  bucket de %d, template %d (%d tuplos): strcmp %6.2f ns/nó | signature %6.2f ns/nó\n",
+               n, i, matches_now, before_ns, now_ns);
+    }
+    
+    tuple_destroy(templates[0]);
+    tuple_destroy(templates[1]);
+    while ( !list_isEmpty(bucket) )
+        list_remove_node(bucket, list_head(bucket), MUST_DESTROY);
+    list_destroy(bucket);
+}
+
+/***********************************************************************
+ Custo de um OC_UPDATE (tuplos mais recentes que T) numa tabela com n tuplos
+ */
+void benchUpdate ( int n ) {
+    struct table_t * table = table_create(7);
+    int i;
+    for ( i = 0; i < n; i++ )
+        table_put_entry(table, entry_create2(bench_tuple(i), i + 1));
+    
+    //a replica that missed the last 1% of the writes
+    long long since = n - n / 100;
+    double start = bench_now_ns();
+    struct list_t * newer = table_get_entries(table, since, KEEP_TUPLES, 0);
+    double update_ns = bench_now_ns() - start;
+    
+    printf("  %9d tuplos: update de %d tuplos em %10.1f us\n", n, list_size(newer), update_ns / 1000);
+    
+    list_destroy(newer);
+    table_destroy(table);
+}
+
+/***********************************************************************
+ Um COPY_ALL de todos os n tuplos: lista materializada vs cursor
+ */
+void benchCopyAll ( int n ) {
+    struct table_t * table = table_create(7);
+    int i;
+    for ( i = 0; i < n; i++ )
+        table_put(table, bench_tuple(i));
+    
+    char *all[3] = {NULL, "pending", NULL};
+    struct tuple_t * template = tuple_create2(3, all);
+    
+    double start = bench_now_ns();
+    struct list_t * copied = table_get(table, template, KEEP_TUPLES, 0);
+    int n_listed = list_size(copied);
+    list_destroy(copied);
+    double list_ns = bench_now_ns() - start;
+    
+    start = bench_now_ns();
+    struct table_cursor_t cursor;
+    int n_walked = 0;
+    table_cursor_open(&cursor, table, template, GET_BY_TUPLE_MATCH, 0);
+    while ( table_cursor_next(&cursor) != NULL )
+        n_walked++;
+    table_cursor_close(&cursor);
+    double cursor_ns = bench_now_ns() - start;
+    
+    printf("  %9d tuplos: lista %10.1f us (%d) | cursor %10.1f us (%d)\n",
+           n, list_ns / 1000, n_listed, cursor_ns / 1000, n_walked);
+    
+    tuple_destroy(template);
+    table_destroy(table);
+}
+
+/***********************************************************************
+ A resposta a um COPY_ALL dos n tuplos: uma mensagem por tuplo ou tantos
+ quantos cabem em cada CT_TUPLES (serializada e lida de volta)
+ */
+void benchCopyAllFrames ( int n ) {
+    struct tuple_t ** tuples = (struct tuple_t **) malloc(n * sizeof(struct tuple_t *));
+    int i;
+    for ( i = 0; i < n; i++ )
+        tuples[i] = bench_tuple(i);
+    
+    int packed;
+    for ( packed = NO; packed <= YES; packed++ ) {
+        long long wire_bytes = 0;
+        int n_messages = 0;
+        int n_read = 0;
+        
+        double start = bench_now_ns();
+        struct tuples_t * chunk = NULL;
+        for ( i = 0; i <= n; i++ ) {
+            struct message_t * message = NULL;
+            if ( !packed && i < n ) {
+                message = message_create_with(OC_COPY_ALL+1, CT_TUPLE, tuples[i]);
+            }
+            else if ( packed && (i == n || chunk == NULL || !tuples_add_fitting(chunk, tuples[i])) ) {
+                message = message_of_tuples(OC_COPY_ALL+1, chunk);
+                chunk = NULL;
+                if ( i < n ) {
+                    chunk = tuples_create(TUPLES_MAX_PER_MESSAGE);
+                    tuples_add_fitting(chunk, tuples[i]);
+                }
+            }
+            if ( message == NULL )
+                continue;
+            
+            char * buffer = NULL;
+            int size = message_to_buffer(message, &buffer);
+            wire_bytes += BUFFER_INTEGER_SIZE + size;
+            n_messages++;
+            struct message_t * received = buffer_to_message(buffer, size);
+            n_read += received->c_type == CT_TUPLES ? received->content.tuples->n_tuples : 1;
+            free_message2(received, YES);
+            free(buffer);
+            free_message2(message, NO);
+        }
+        double frames_ns = bench_now_ns() - start;
+        
+        printf("  %9d tuplos, %s: %10.1f us | %7d mensagens (%d tuplos), %5.1f bytes/tuplo\n",
+               n, packed ? "CT_TUPLES " : "um a um   ", frames_ns / 1000, n_messages, n_read, (double) wire_bytes / n);
+    }
+    
+    for ( i = 0; i < n; i++ )
+        tuple_destroy(tuples[i]);
+    free(tuples);
+}
+
+/***********************************************************************
+ Custo de um prefixo e de um intervalo de chaves: scan vs índice de chaves
+ */
+double bench_key_cursor ( struct table_t * table, struct tuple_t * template, int * matches ) {
+    double start = bench_now_ns();
+    struct table_cursor_t cursor;
+    *matches = 0;
+    table_cursor_open(&cursor, table, template, GET_BY_TUPLE_MATCH, 0);
+    while ( table_cursor_next(&cursor) != NULL )
+        (*matches)++;
+    table_cursor_close(&cursor);
+    return bench_now_ns() - start;
+}
+
+void benchKeyRange ( int n ) {
+    struct table_t * scanned = table_create(7);
+    struct table_t * ordered = table_create(7);
+    table_order_keys(ordered);
+    int i;
+    for ( i = 0; i < n; i++ ) {
+        table_put(scanned, bench_tuple(i));
+        table_put(ordered, bench_tuple(i));
+    }
+    
+    //the 100 keys job-0000001xx-q, and the 1000 keys from job-000002000 to job-000002999
+    struct tuple_operator_t operators[3] = { { TUPLE_OP_PREFIX, "job-0000001", 11, NULL, 0, NO, 0, 0 } };
+    struct tuple_t * prefix = tuple_create_template(3, (char *[]) {NULL, NULL, NULL}, (int []) {-1, -1, -1}, operators);
+    operators[0] = (struct tuple_operator_t) { TUPLE_OP_RANGE, "job-000002000", 13, "job-000002999~", 14, NO, 0, 0 };
+    struct tuple_t * range = tuple_create_template(3, (char *[]) {NULL, NULL, NULL}, (int []) {-1, -1, -1}, operators);
+    
+    int scan_matches, index_matches, scan_range, index_range;
+    double scan_ns = bench_key_cursor(scanned, prefix, &scan_matches);
+    double index_ns = bench_key_cursor(ordered, prefix, &index_matches);
+    double scan_range_ns = bench_key_cursor(scanned, range, &scan_range);
+    double index_range_ns = bench_key_cursor(ordered, range, &index_range);
+    
+    printf("  %9d tuplos: prefixo scan %10.1f us (%d) | índice %8.1f us (%d) || intervalo scan %10.1f us (%d) | índice %8.1f us (%d)\n",
+           n, scan_ns / 1000, scan_matches, index_ns / 1000, index_matches,
+           scan_range_ns / 1000, scan_range, index_range_ns / 1000, index_range);
+    
+    tuple_destroy(prefix);
+    tuple_destroy(range);
+    table_destroy(scanned);
+    table_destroy(ordered);
+}
+
+/*
+ * The work of one thread of benchParallelCopy: N_GETS copies of random keys.
+ */
+struct bench_copier_t {
+    struct table_t * table;
+    int n_tuples;
+    unsigned int seed;
+};
+
+void * bench_copier ( void * arg ) {
+    struct bench_copier_t * copier = (struct bench_copier_t *) arg;
+    int i;
+    for ( i = 0; i < N_GETS; i++ ) {
+        struct tuple_t * template = bench_tuple(rand_r(&(copier->seed)) % copier->n_tuples);
+        slab_arena_begin();
+        list_destroy(table_get(copier->table, template, KEEP_TUPLES, GET_ONE));
+        slab_arena_reset();
+        tuple_destroy(template);
+    }
+    return NULL;
+}
+
+/***********************************************************************
+ OC_COPY de uma chave em paralelo numa tabela com n tuplos, de 1 a MAX_THREADS threads
+ */
+void benchParallelCopy ( int n ) {
+    struct table_t * table = table_create(7);
+    int i;
+    for ( i = 0; i < n; i++ )
+        table_put(table, bench_tuple(i));
+    
+    int n_threads;
+    for ( n_threads = 1; n_threads <= MAX_THREADS; n_threads *= 2 ) {
+        pthread_t threads[MAX_THREADS];
+        struct bench_copier_t copiers[MAX_THREADS];
+        
+        double start = bench_now_ns();
+        for ( i = 0; i < n_threads; i++ ) {
+            copiers[i].table = table;
+            copiers[i].n_tuples = n;
+            copiers[i].seed = i + 1;
+            pthread_create(&threads[i], NULL, bench_copier, &copiers[i]);
+        }
+        for ( i = 0; i < n_threads; i++ )
+            pthread_join(threads[i], NULL);
+        double elapsed_s = (bench_now_ns() - start) / 1e9;
+        
+        printf("  %9d tuplos, %d threads: %10.0f copies/s\n", n, n_threads, n_threads * N_GETS / elapsed_s);
+    }
+    
+    table_destroy(table);
+}
+
+/*
+ * The work of one thread of benchShards: N_GETS outs and ins of keys of its own,
+ * each on the table of the shard of its key.
+ */
+struct bench_sharder_t {
+    struct table_t ** shards;
+    int n_shards;
+    int first_key;
+};
+
+void * bench_sharder ( void * arg ) {
+    struct bench_sharder_t * sharder = (struct bench_sharder_t *) arg;
+    char key[32];
+    int i;
+    for ( i = 0; i < N_GETS; i++ ) {
+        int key_number = sharder->first_key + i;
+        sprintf(key, "job-%09d-q", key_number);
+        struct table_t * table = sharder->shards[table_shard_index(key, (int) strlen(key), sharder->n_shards)];
+        struct tuple_t * template = bench_tuple(key_number);
+        slab_arena_begin();
+        epoch_enter();
+        table_put(table, bench_tuple(key_number));
+        list_destroy(table_get(table, template, DONT_KEEP_AT_ORIGIN, GET_ONE));
+        epoch_exit();
+        slab_arena_reset();
+        tuple_destroy(template);
+    }
+    return NULL;
+}
+
+/***********************************************************************
+ OC_OUT + OC_IN em paralelo, de 1 a MAX_THREADS threads: todas numa tabela ou uma tabela (shard) por thread
+ */
+void benchShards ( int n ) {
+    int n_threads;
+    for ( n_threads = 1; n_threads <= MAX_THREADS; n_threads *= 2 ) {
+        double ops_per_s[2];
+        int sharded;
+        for ( sharded = NO; sharded <= YES; sharded++ ) {
+            int n_shards = sharded ? n_threads : 1;
+            struct table_t * shards[MAX_THREADS];
+            pthread_t threads[MAX_THREADS];
+            struct bench_sharder_t sharders[MAX_THREADS];
+            int i;
+            //the n tuples that are always there, spread over the shards
+            for ( i = 0; i < n_shards; i++ )
+                shards[i] = table_create(7);
+            for ( i = 0; i < n; i++ ) {
+                char key[32];
+                sprintf(key, "job-%09d-q", i);
+                table_put(shards[table_shard_index(key, (int) strlen(key), n_shards)], bench_tuple(i));
+            }
+            
+            double start = bench_now_ns();
+            for ( i = 0; i < n_threads; i++ ) {
+                sharders[i].shards = shards;
+                sharders[i].n_shards = n_shards;
+                sharders[i].first_key = n + i * N_GETS;
+                pthread_create(&threads[i], NULL, bench_sharder, &sharders[i]);
+            }
+            for ( i = 0; i < n_threads; i++ )
+                pthread_join(threads[i], NULL);
+            ops_per_s[sharded] = 2.0 * n_threads * N_GETS / ((bench_now_ns() - start) / 1e9);
+            
+            for ( i = 0; i < n_shards; i++ )
+                table_destroy(shards[i]);
+        }
+        
+        printf("  %9d tuplos, %d threads: uma tabela %10.0f ops/s | %d shards %10.0f ops/s\n",
+               n, n_threads, ops_per_s[NO], n_threads, ops_per_s[YES]);
+    }
+}
+
+/***********************************************************************
+ Inserção ordenada (por chave) e procura de uma chave num bucket de n tuplos
+ */
+void benchBucketOrdered ( int n ) {
+    struct list_t * bucket = list_create();
+    
+    char key[32];
+    char *tdata[3] = {key, "pending", "payload"};
+    double start = bench_now_ns();
+    int i;
+    for ( i = 0; i < n; i++ ) {
+        sprintf(key, "job-%09d-q", rand() % n);
+        list_add(bucket, entry_create(tuple_create2(3, tdata)));
+    }
+    double add_ns = (bench_now_ns() - start) / n;
+    
+    int n_gets = n < N_GETS ? n : N_GETS;
+    start = bench_now_ns();
+    for ( i = 0; i < n_gets; i++ ) {
+        sprintf(key, "job-%09d-q", rand() % n);
+        struct tuple_t * template = tuple_create2(3, tdata);
+        list_destroy(list_matching_nodes(bucket, template, KEEP_AT_ORIGIN, 1));
+        tuple_destroy(template);
+    }
+    double get_ns = (bench_now_ns() - start) / n_gets;
+    
+    printf("  bucket de %d: add %8.1f ns/op | procura %8.1f ns/op | %d lanes\n",
+           n, add_ns, get_ns, bucket->n_lanes);
+    
+    while ( !list_isEmpty(bucket) )
+        list_remove_node(bucket, list_head(bucket), MUST_DESTROY);
+    list_destroy(bucket);
+}
+
+/*
+ * Returns the resident memory of the process in bytes.
+ */
+long long bench_rss_bytes () {
+    long long pages = 0, resident = 0;
+    FILE * statm = fopen("/proc/self/statm", "r");
+    if ( statm == NULL )
+        return 0;
+    if ( fscanf(statm, "%lld %lld", &pages, &resident) != 2 )
+        resident = 0;
+    fclose(statm);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/***********************************************************************
+ Soak: n tuplos de 1KB postos mais depressa do que são tirados, com um
+ orçamento de memória (o RSS deve estabilizar, o resto vai para disco)
+ */
+void benchSoak ( int n ) {
+    struct table_t * table = table_create(7);
+    if ( table_set_memory_budget(table, SOAK_BUDGET, "SD15_BENCH_SPILL.bin") == FAILED ) {
+        printf("  não foi possível criar o ficheiro do spill\n");
+        table_destroy(table);
+        return;
+    }
+    
+    char payload[SOAK_PAYLOAD];
+    memset(payload, 'x', SOAK_PAYLOAD - 1);
+    payload[SOAK_PAYLOAD - 1] = '\0';
+    char key[32];
+    char *tdata[3] = {key, "pending", payload};
+    char *tkey[3] = {key, NULL, NULL};
+    
+    double start = bench_now_ns();
+    long long bytes_put = 0;
+    int n_taken = 0;
+    int i;
+    for ( i = 0; i < n; i++ ) {
+        sprintf(key, "job-%09d-q", i);
+        struct entry_t * entry = entry_create2(tuple_create2(3, tdata), i + 1);
+        bytes_put += entry_size_bytes(entry);
+        table_put_entry(table, entry);
+        
+        //the consumer takes one for every four put, the oldest first (so from disk)
+        if ( i % 4 == 3 ) {
+            sprintf(key, "job-%09d-q", n_taken++);
+            struct tuple_t * template = tuple_create2(3, tkey);
+            slab_arena_begin();
+            epoch_enter();
+            struct list_t * taken = table_get(table, template, DONT_KEEP_AT_ORIGIN, GET_ONE);
+            if ( !list_isEmpty(taken) )
+                entry_destroy(node_entry(list_head(taken)));
+            list_destroy(taken);
+            epoch_exit();
+            slab_arena_reset();
+            tuple_destroy(template);
+        }
+        
+        if ( (i + 1) % (n / SOAK_REPORTS) == 0 )
+            printf("  %9d postos (%6.1f MB) | em memória %6.1f MB | em disco %8d | RSS %6.1f MB\n",
+                   i + 1, bytes_put / 1048576.0, table->memory_used / 1048576.0,
+                   spill_size(table->spill), bench_rss_bytes() / 1048576.0);
+    }
+    double elapsed_s = (bench_now_ns() - start) / 1e9;
+    
+    printf("  %d puts e %d ins em %.1f s, orçamento de %d MB\n", n, n_taken, elapsed_s, SOAK_BUDGET / 1048576);
+    
+    table_destroy(table);
+}
+
+/*
+ * Returns the bytes of the block of tuple (not counting the interned values).
+ */
+long long bench_tuple_bytes ( struct tuple_t * tuple ) {
+    return sizeof(struct tuple_t) + tuple->tuple_dimension * sizeof(struct tuple_element_t) + tuple->body_size;
+}
+
+/*
+ * Puts n tuples with repeated status and tenant on bucket and times the
+ * matches of one (status, tenant) template over it.
+ * Returns the bytes of the tuples and sets *match_ns (per tuple).
+ */
+long long bench_intern_run ( struct list_t * bucket, int n, double * match_ns ) {
+    char key[32], status[32], tenant[48];
+    char *tdata[3] = {key, status, tenant};
+    long long bytes = 0;
+    int i;
+    for ( i = 0; i < n; i++ ) {
+        sprintf(key, "job-%09d-q", i);
+        sprintf(status, "status-%d", i % INTERN_STATUSES);
+        sprintf(tenant, "tenant-0000-0000-%04d", i % INTERN_TENANTS);
+        struct entry_t * entry = entry_create(tuple_create2(3, tdata));
+        bytes += bench_tuple_bytes(entry_value(entry));
+        list_add(bucket, entry);
+    }
+    
+    char *tmatch[3] = {NULL, "status-3", "tenant-0000-0000-0017"};
+    struct tuple_t * template = tuple_create2(3, tmatch);
+    int matches = 0;
+    double start = bench_now_ns();
+    int scan;
+    for ( scan = 0; scan < N_SCANS; scan++ ) {
+        node_t * node = list_head(bucket);
+        int nodesToCheck = list_size(bucket);
+        while ( nodesToCheck-- > 0 ) {
+            matches += tuple_matches_template(entry_value(node_entry(node)), template);
+            node = node->next;
+        }
+    }
+    *match_ns = (bench_now_ns() - start) / N_SCANS / n;
+    tuple_destroy(template);
+    
+    return bytes;
+}
+
+/***********************************************************************
+ n tuplos com status e tenant repetidos: bytes e custo do match, com e sem intern pool
+ */
+void benchIntern ( int n ) {
+    int on;
+    for ( on = NO; on <= YES; on++ ) {
+        intern_enable(on);
+        struct list_t * bucket = list_create();
+        double match_ns = 0;
+        long long bytes = bench_intern_run(bucket, n, &match_ns);
+        printf("  %9d tuplos, intern %s: %6.1f bytes/tuplo (%d valores no pool) | match %6.1f ns/tuplo\n",
+               n, on ? "on " : "off", (double) bytes / n, intern_size(), match_ns);
+        
+        while ( !list_isEmpty(bucket) )
+            list_remove_node(bucket, list_head(bucket), MUST_DESTROY);
+        list_destroy(bucket);
+        epoch_collect();
+    }
+    intern_enable(NO);
+}
+
+/***********************************************************************
+ Uma escrita pelo switch: o tuplo do pedido vai para SHARE_REPLICAS
+ tabelas, copiado (tuple_dup) ou partilhado (tuple_retain)
+ */
+void benchShare ( int n ) {
+    int shared;
+    for ( shared = NO; shared <= YES; shared++ ) {
+        struct table_t * replicas[SHARE_REPLICAS];
+        int r;
+        for ( r = 0; r < SHARE_REPLICAS; r++ )
+            replicas[r] = table_create(7);
+        
+        unsigned long long copies = tuple_copies_made();
+        double start = bench_now_ns();
+        int i;
+        for ( i = 0; i < n; i++ ) {
+            struct tuple_t * request = bench_tuple(i);
+            for ( r = 0; r < SHARE_REPLICAS; r++ )
+                table_put_entry(replicas[r], entry_create2(shared ? tuple_retain(request) : tuple_dup(request), i + 1));
+            tuple_destroy(request);
+        }
+        double put_ns = bench_now_ns() - start;
+        
+        printf("  %9d escritas, tuplos %s: %6.1f ns/escrita | %llu cópias\n",
+               n, shared ? "partilhados" : "copiados   ", put_ns / n, tuple_copies_made() - copies);
+        
+        for ( r = 0; r < SHARE_REPLICAS; r++ )
+            table_destroy(replicas[r]);
+        epoch_collect();
+    }
+}
+
+/***********************************************************************
+ Pôr n tuplos um a um ou em batches de BATCH_TUPLES (com as mensagens
+ que iriam para o switch)
+ */
+void benchBatch ( int n ) {
+    int batched;
+    for ( batched = NO; batched <= YES; batched++ ) {
+        struct table_t * table = table_create(7);
+        long long wire_bytes = 0;
+        int n_messages = 0;
+        
+        double start = bench_now_ns();
+        int i;
+        for ( i = 0; i < n; i += batched ? BATCH_TUPLES : 1 ) {
+            int n_tuples = batched ? (n - i < BATCH_TUPLES ? n - i : BATCH_TUPLES) : 1;
+            struct batch_t * batch = batch_create(n_tuples);
+            int j;
+            for ( j = 0; j < n_tuples; j++ )
+                batch->entries[j] = entry_create2(bench_tuple(i + j), i + 1);
+            struct message_t * message = batched ? message_create_with(OC_OUT, CT_BATCH, batch)
+                : message_create_with(OC_OUT, CT_ENTRY, batch->entries[0]);
+            
+            char * buffer = NULL;
+            wire_bytes += message_to_buffer(message, &buffer);
+            free(buffer);
+            n_messages++;
+            
+            if ( batched )
+                table_put_batch(table, batch->entries, n_tuples);
+            else
+                table_put_entry(table, batch->entries[0]);
+            free_message2(message, NO);
+            if ( !batched )
+                batch_destroy(batch, NO);
+        }
+        double put_ns = bench_now_ns() - start;
+        
+        printf("  %9d tuplos, %s: %6.1f ns/tuplo | %7d mensagens, %5.1f bytes/tuplo\n",
+               n, batched ? "em batches" : "um a um   ", put_ns / n, n_messages, (double) wire_bytes / n);
+        
+        table_destroy(table);
+        epoch_collect();
+    }
+}
+
+/*
+ * Returns the size of the file at path, in MB.
+ */
+double bench_file_mb ( const char * path ) {
+    struct stat info;
+    return stat(path, &info) == 0 ? info.st_size / 1048576.0 : 0;
+}
+
+/***********************************************************************
+ Arranque do servidor com n tuplos: reler o log de texto todo ou
+ carregar o snapshot binário
+ */
+void benchStartup ( int n ) {
+    //the log and the snapshot the server would have before the restart
+    struct table_t * table = table_create(7);
+    FILE * log = fopen("SD15_BENCH_LOG.txt", "w");
+    if ( log == NULL ) {
+        printf("  não foi possível criar o ficheiro do log\n");
+        table_destroy(table);
+        return;
+    }
+    int i;
+    for ( i = 0; i < n; i++ ) {
+        struct entry_t * entry = entry_create2(bench_tuple(i), i + 1);
+        struct message_t * message = message_create_with(OC_OUT, CT_ENTRY, entry);
+        char * line = message_to_string(message);
+        fprintf(log, "%s\n", line);
+        free(line);
+        free_message2(message, NO);
+        table_put_entry(table, entry);
+    }
+    fclose(log);
+    struct snapshot_info_t info = {n, 0, n};
+    snapshot_write(&table, 1, "SD15_BENCH_SNAPSHOT.bin", &info);
+    table_destroy(table);
+    epoch_collect();
+    
+    //every line parsed and put, as server_log_invoke_over_table does
+    table = table_create(7);
+    double start = bench_now_ns();
+    log = fopen("SD15_BENCH_LOG.txt", "r");
+    char * line = NULL;
+    size_t length = 0;
+    while ( getline(&line, &length, log) != -1 )
+        table_put_entry(table, entry_create_from_string(line));
+    free(line);
+    fclose(log);
+    double log_ms = (bench_now_ns() - start) / 1e6;
+    int log_size = table_size(table);
+    table_destroy(table);
+    epoch_collect();
+    
+    table = table_create(7);
+    start = bench_now_ns();
+    snapshot_load(&table, 1, "SD15_BENCH_SNAPSHOT.bin", &info);
+    double snapshot_ms = (bench_now_ns() - start) / 1e6;
+    int snapshot_size = table_size(table);
+    table_destroy(table);
+    epoch_collect();
+    
+    printf("  %9d tuplos: log %8.1f ms (%6.1f MB, %d) | snapshot %8.1f ms (%6.1f MB, %d) | %4.1fx\n",
+           n, log_ms, bench_file_mb("SD15_BENCH_LOG.txt"), log_size,
+           snapshot_ms, bench_file_mb("SD15_BENCH_SNAPSHOT.bin"), snapshot_size, log_ms / snapshot_ms);
+    unlink("SD15_BENCH_LOG.txt");
+    unlink("SD15_BENCH_SNAPSHOT.bin");
+}
+
+int main ( int argc, char *argv[] ) {
+    int max_tuples = argc > 1 ? atoi(argv[1]) : DEFAULT_MAX_TUPLES;
+
+    printf("Benchmark do módulo table: put/get de 1K a %d tuplos\n", max_tuples);
+
+    int n;
+    for ( n = 1000; n <= max_tuples; n *= 10 )
+        benchPutGet(n);
+
+    printf("Benchmark do OC_UPDATE\n");
+    for ( n = 1000; n <= max_tuples; n *= 10 )
+        benchUpdate(n);
+
+    printf("Benchmark do COPY_ALL\n");
+    for ( n = 1000; n <= max_tuples; n *= 10 )
+        benchCopyAll(n);
+
+    printf("Benchmark da resposta do COPY_ALL: um tuplo por mensagem vs CT_TUPLES\n");
+    for ( n = 1000; n <= max_tuples; n *= 10 )
+        benchCopyAllFrames(n);
+
+    printf("Benchmark dos prefixos e intervalos de chaves\n");
+    for ( n = 1000; n <= max_tuples && n <= BUCKET_SIZE; n *= 10 )
+        benchKeyRange(n);
+
+    printf("Benchmark do OC_COPY em paralelo\n");
+    benchParallelCopy(max_tuples < BUCKET_SIZE ? max_tuples : BUCKET_SIZE);
+
+    printf("Benchmark dos shards: OC_OUT + OC_IN em paralelo\n");
+    benchShards(max_tuples < BUCKET_SIZE ? max_tuples : BUCKET_SIZE);
+
+    printf("Benchmark dos buckets ordenados\n");
+    for ( n = 1000; n <= max_tuples && n <= BUCKET_SIZE; n *= 10 )
+        benchBucketOrdered(n);
+
+    printf("Benchmark das signatures: procura num bucket\n");
+    benchBucketMatch(max_tuples < BUCKET_SIZE ? max_tuples : BUCKET_SIZE);
+
+    printf("Benchmark do intern pool\n");
+    benchIntern(max_tuples < INTERN_TUPLES ? max_tuples : INTERN_TUPLES);
+
+    printf("Benchmark do OC_OUT em batches de %d\n", BATCH_TUPLES);
+    for ( n = 1000; n <= max_tuples && n <= BUCKET_SIZE; n *= 10 )
+        benchBatch(n);
+
+    printf("Benchmark das escritas pelo switch (%d réplicas)\n", SHARE_REPLICAS);
+    for ( n = 1000; n <= max_tuples && n <= BUCKET_SIZE; n *= 10 )
+        benchShare(n);
+
+    printf("Benchmark do arranque: log de texto vs snapshot\n");
+    for ( n = 1000; n <= max_tuples && n <= BUCKET_SIZE; n *= 10 )
+        benchStartup(n);
+
+    printf("Benchmark do orçamento de memória (soak)\n");
+    benchSoak(max_tuples < SOAK_TUPLES ? max_tuples : SOAK_TUPLES);
+
+    printf("Alocações evitadas pelos slabs: %llu\n", slab_allocations_avoided());
+
+    return 0;
+}
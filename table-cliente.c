@@ -134,6 +134,7 @@ void invalid_command () {
     puts("\n\n####### SD15-CLIENT ##############");
     puts("Sorry, your command was not valid.");
     puts("IN | IN_ALL | COPY | COPY_ALL | OUT \"elem1\" \"elem2\" \"elem3\"");
+    puts("(templates: \"*\" any | \"pre\"* prefix | \"low\"..\"high\" range)");
     puts("SIZE | QUIT");
     puts("####### SD15-CLIENT ##############\n\n");
 }
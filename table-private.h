@@ -13,37 +13,525 @@
 #include "table.h"
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
+#include "timing_wheel.h"
+#include "spill.h"
+#include "tuple-private.h"
 
 #define TABLE_DIMENSION 12
 
+//number of slots of each segment of the table directory
+#define TABLE_SEGMENT_SIZE 1024
+//average number of entries per slot above which a slot is split
+#define TABLE_MAX_LOAD_FACTOR 2
+//number of field positions that can be indexed
+#define TABLE_MAX_INDEXES 8
+//number of locks the slots are striped over (slot i is guarded by stripe i % TABLE_LOCK_STRIPES)
+#define TABLE_LOCK_STRIPES 64
 
+//times a reader tries to read a slot without its lock before locking it
+#define TABLE_OPTIMISTIC_READS 16
+//times a cursor with no key tries to read the whole table without locks before locking it
+#define TABLE_OPTIMISTIC_SCANS 2
+//entries a cursor reading one key holds without allocating
+#define TABLE_CURSOR_INLINE 8
+//nodes the cursor of a walk goes over before it stops (at the next other key or timestamp)
+#define TABLE_WALK_NODES 4096
+
+//number of lists the waiters with a template key are hashed over
+#define TABLE_WAITER_SLOTS 64
+
+//what table_lock_slots locks besides one slot index
+#define TABLE_ALL_SLOTS -1
+#define TABLE_NO_SLOTS -2
+
+struct field_index_t;
+
+/*
+ * An OC_IN or OC_COPY that found nothing and waits for a put that matches
+ * it. It belongs to whoever registered it (table_get_or_wait); the table
+ * only links it while it waits.
+ * The put that satisfies it hands it the entry and sets ready: an IN waiter
+ * gets the entry itself (it never goes into the table), a COPY waiter gets
+ * a copy of it. Either way the entry is then the waiter's to destroy.
+ */
+struct table_waiter_t {
+    struct tuple_t * tup_template;
+    struct entry_signature_t signature;
+    //KEEP_AT_ORIGIN (OC_COPY) or DONT_KEEP_AT_ORIGIN (OC_IN)
+    int keep_tuples;
+    //registration order: the oldest IN waiter is the one served
+    unsigned long long sequence;
+    struct entry_t * entry;
+    int ready;
+    //free for the owner to find its own data
+    void * owner;
+    //called by the put that hands an IN waiter its entry, on the thread of
+    //that put and before the waiter is ready (NULL: nothing to do)
+    void (*taken)(struct table_waiter_t * waiter, struct entry_t * entry);
+    struct table_waiter_t * next;
+};
+
+
+/*
+ * The table is a linear hashing table: it starts with <initial_size> slots
+ * and, every time the load factor goes above TABLE_MAX_LOAD_FACTOR, the slot
+ * at <split> is rehashed into a new slot appended at the end of the table.
+ * This way the table grows online, one slot at a time, and no operation ever
+ * pays for the rehash of the whole table.
+ * The slots live in fixed size segments so growing never moves a slot list.
+ *
+ * Locking, always taken in this order:
+ *  - lock: read locked by every write, write locked to split a slot or
+ *    to change the table structure (the slot of a key only changes then);
+ *  - stripes: the slot lists, write locked to change them. A write on one
+ *    key locks the stripe of its slot only; the others lock every stripe,
+ *    in ascending order;
+ *  - indexes_lock: the field indexes, the timestamp and key indexes and the leases.
+ * The reads that keep the tuples (OC_COPY) of one key, or of no key but on
+ * a field index or every slot, take none of them: they walk the lists while
+ * they may change, inside an epoch, and only count if the versions of what
+ * they walked did not change meanwhile (version for the splits, the one
+ * of each stripe for its slots, indexes_version for the indexes). The walks
+ * of the key and timestamp indexes read lock the indexes_lock only.
+ * The waiters_lock comes before all of them: the puts read lock it (so
+ * none is halfway while a get registers a waiter) and write lock it when
+ * there are waiters, to hand them what they put.
+ */
 typedef struct table_t {
     //the size of the table: numbero of slots
     unsigned int size;
-    //a bucket of <size> slots
-    struct list_t ** bucket;
+    //the number of slots the table was created with
+    unsigned int initial_size;
+    //number of times the table doubled its number of slots
+    unsigned int level;
+    //the next slot to be split
+    unsigned int split;
+    //the number of entries on the table
+    unsigned int n_entries;
+    //the number of segments the directory has room for
+    unsigned int n_segments;
+    //directory of segments, each with TABLE_SEGMENT_SIZE slots
+    struct list_t *** bucket;
+    //optional indexes of the field positions (NULL if not indexed)
+    struct field_index_t * indexes[TABLE_MAX_INDEXES];
+    //all the entries of the table by ascending timestamp (nodes reference the entries)
+    struct list_t * time_index;
+    //all the entries of the table in key order, a skip list (NULL unless table_order_keys)
+    struct list_t * key_index;
+    pthread_rwlock_t lock;
+    //odd while a split moves entries between slots, bumped before and after
+    unsigned int version;
+    pthread_rwlock_t stripes[TABLE_LOCK_STRIPES];
+    //odd while a writer holds the stripe, bumped before and after each change
+    unsigned int versions[TABLE_LOCK_STRIPES];
+    pthread_rwlock_t indexes_lock;
+    //the same for the indexes_lock
+    unsigned int indexes_version;
+    //the waiters with a key, by the hash of the key, and the ones without key
+    struct table_waiter_t * waiters[TABLE_WAITER_SLOTS];
+    struct table_waiter_t * wildcard_waiters;
+    int n_waiters;
+    unsigned long long waiters_sequence;
+    pthread_rwlock_t waiters_lock;
+    //the timers of the entries that expire (wall clock milliseconds)
+    struct timing_wheel_t * leases;
+    //bytes of the entries in memory (entry_size_bytes) and how many they may take (0: no limit)
+    long long memory_used;
+    long long memory_budget;
+    //where the coldest entries go above the budget (NULL: nowhere) and how many went so far
+    struct spill_t * spill;
+    unsigned int spills;
 } table_t;
 
+/*
+ * Where a walk over the entries of a table matching a search element with no
+ * key is, so that it is read a part at a time, each by a cursor of its own
+ * (table_cursor_open_walk) and with the locks let go in between. It goes over
+ * the key index (a template with a prefix or a range of keys, by_keys) or
+ * else over the timestamp index, and each cursor stops past TABLE_WALK_NODES
+ * nodes, between two keys or two timestamps: the next one goes on after them.
+ */
+struct table_walk_t {
+    int by_keys;
+    //after the entries of key (key_length bytes; NULL: from the first) or the ones of timestamp or older
+    char * key;
+    int key_length;
+    long long timestamp;
+    //YES once the matches on the spill were given (by the first cursor)
+    int started;
+    //YES once the last cursor went to the end
+    int done;
+};
+
+/*
+ * A cursor over the entries of the table that match a search element (a
+ * tuple template or a timestamp), yielded one at a time: nothing is copied
+ * and nothing leaves the table. It walks the same lists table_get_by would
+ * search (one slot, the key index, the field index candidates, every slot or
+ * the timestamp index) but the matches come in the order they are found.
+ * A template with no prefix or range on the key (one key, a field index or
+ * every slot) is read at open, into the snapshot, without locks (see
+ * table_read_unlocked): the entries are kept alive by an epoch. Otherwise,
+ * while the cursor is open it holds read locks on what it walks, so the
+ * table must not be changed by the thread that opened it.
+ * The matches on the spill (if any) come after the ones in memory: they
+ * are read back at once, into the snapshot, when those run out.
+ */
+struct table_cursor_t {
+    struct table_t * table;
+    int get_criterion;
+    void * search_element;
+    //if YES it stops after the first match
+    int one_or_all;
+    //the template compiled (GET_BY_TUPLE_MATCH only)
+    struct entry_signature_t signature;
+    //the lists still to walk: the field index candidates or the slots next_slot..last_slot
+    struct list_t * candidates[2];
+    //YES if it walks the key index, down to the end of the prefix or the range on the key
+    int by_keys;
+    struct tuple_operator_t key_operator;
+    int n_candidates;
+    int next_candidates;
+    int next_slot;
+    int last_slot;
+    //the next node of the list being walked and how many are left on it
+    node_t * node;
+    int nodes_left;
+    int exhausted;
+    //what the cursor has locked: the table, a slot (or TABLE_ALL_SLOTS or TABLE_NO_SLOTS) and the indexes
+    int locked_table;
+    int locked_slots;
+    int locked_indexes;
+    //if the matching entries were read at open, and are yielded from here
+    int from_snapshot;
+    struct entry_t ** snapshot;
+    int n_snapshot;
+    int snapshot_capacity;
+    int next_snapshot;
+    struct entry_t * snapshot_inline[TABLE_CURSOR_INLINE];
+    int in_epoch;
+    //if the matches on the spill were already read (into the snapshot)
+    int spill_read;
+    //the walk the cursor is a part of (NULL: none), the nodes it went over and the last one
+    struct table_walk_t * walk;
+    int walked;
+    node_t * last_walked;
+};
+
 
 int table_put_entry(struct table_t *table, struct entry_t *entry);
 
+/*
+ * Puts the n_entries entries in the table (or hands them to the waiters)
+ * taking the table locks once for all of them, and each stripe once for
+ * all its entries. The entries are the table's afterwards.
+ * A batch with an entry table_batch_valid refuses is refused whole.
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_put_batch ( struct table_t * table, struct entry_t ** entries, int n_entries );
+
+/*
+ * Returns YES if every one of the n_entries entries can be put (it has a
+ * key and no operators), NO otherwise.
+ */
+int table_batch_valid ( struct entry_t ** entries, int n_entries );
+
+/*
+ * Puts the entry in the table, ignoring the waiters.
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_insert_entry ( struct table_t * table, struct entry_t * entry );
+
+/*
+ * Same as table_insert_entry for n_entries entries at once.
+ */
+int table_insert_batch ( struct table_t * table, struct entry_t ** entries, int n_entries );
+
+/*
+ * Adds entry to the slot slot_index and to the indexes and the counters of
+ * the table (the stripe of the slot and the indexes must be write locked).
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_slot_add ( struct table_t * table, int slot_index, struct entry_t * entry );
+
+/*
+ * Gets one tuple matching the template of waiter (taking or keeping it as
+ * the waiter says) or, if none matches, registers waiter so the first put
+ * matching it hands it the entry. Both at once: no put gets in between.
+ * Returns 0 (OK) with *matches the list of the tuple got, or NULL if the
+ * waiter was registered, or -1 (error).
+ */
+int table_get_or_wait ( struct table_t * table, struct table_waiter_t * waiter, struct list_t ** matches );
+
+/*
+ * Unregisters waiter (it timed out).
+ * Returns YES if it was waiting, NO if a put handed it an entry meanwhile.
+ */
+int table_cancel_wait ( struct table_t * table, struct table_waiter_t * waiter );
+
+/*
+ * Takes out of the table the entries whose lease (entry->expires) ended
+ * by now_ms (milliseconds since the Epoch), without looking at the others.
+ * Returns the list of the entries expired, that are the caller's to
+ * destroy (the list may be empty), or NULL (error). The caller must be
+ * inside an epoch.
+ */
+struct list_t * table_expire ( struct table_t * table, long long now_ms );
+
+/*
+ * Limits the bytes (entry_size_bytes) of the entries the table keeps in
+ * memory to budget_bytes (0: no limit). Above it the coldest entries (the
+ * oldest timestamps) go to a segment file at spill_path, where the gets
+ * still find them (after the ones in memory). With a budget the gets
+ * that keep the tuples must be inside an epoch: what they find on disk
+ * are copies, freed when it ends.
+ * Returns 0 (OK) or -1 (error: the spill file could not be created).
+ */
+int table_set_memory_budget ( struct table_t * table, long long budget_bytes, const char * spill_path );
+
+/*
+ * Moves the coldest entries that do not expire to the spill until the
+ * entries in memory fit on the budget (the table lock must be read locked).
+ */
+void table_spill ( struct table_t * table );
+
+/*
+ * Checks if the entries in memory take more than the budget. YES or NO
+ */
+int table_over_budget ( struct table_t * table );
+
+/*
+ * Hands entry to the waiters it matches: a copy to every COPY waiter and
+ * the entry to the oldest IN waiter. The waiters_lock must be write locked.
+ * Returns YES if an IN waiter took the entry (so it is not to be put), NO otherwise.
+ */
+int table_hand_to_waiters ( struct table_t * table, struct entry_t * entry );
+
 void table_print( struct table_t * table );
-int table_slot_index ( table_t * table, char * key );
+/*
+ * Returns the slot where the entries with the key_length bytes of key live, -1 if key is NULL or empty.
+ */
+int table_slot_index ( table_t * table, char * key, int key_length );
 
 struct list_t *table_get_entries(struct table_t *table, long long timestamp, int keep_tuples, int one_or_all);
 
 struct list_t *table_get_by(struct table_t *table, void * search_element, int get_criterion, int keep_tuples, int one_or_all);
 
 /*
- * Method that gets a table and a tuple key and returns the proper table index.
+ * Method that gets a table and a tuple key (its key_length bytes) and returns its 64 bits hashcode.
  */
-int table_hashcode (table_t * table, char * key);
+unsigned long long table_hashcode (table_t * table, char * key, int key_length);
+
+/*
+ * Returns which of n_shards tables the entries with the key_length bytes of
+ * key go to when the keys are spread over many (its slot on that table comes
+ * from the other bits of the same hashcode), -1 if key is NULL or empty.
+ */
+int table_shard_index ( char * key, int key_length, int n_shards );
+
+/*
+ * Returns the slot where the entries with the given hashcode live.
+ */
+int table_slot_of_hash ( table_t * table, unsigned long long hashcode );
+
+/*
+ * Splits one slot of the table if its load factor is above TABLE_MAX_LOAD_FACTOR.
+ */
+int table_grow ( table_t * table );
+
+/*
+ * Checks if the load factor of the table is above TABLE_MAX_LOAD_FACTOR. YES or NO
+ * (the table lock must be held)
+ */
+int table_needs_to_grow ( table_t * table );
+
+/*
+ * Keeps an ordered index of the keys of the table (indexing the entries
+ * already on it): from now on the templates with a prefix or a range of
+ * bytes on the key (see tuple_create_template) walk just their keys on
+ * it, in O(log n + k), instead of every slot. Each put pays O(log n) more.
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_order_keys ( table_t * table );
+
+/*
+ * Checks if the key index of the table can find the keys of the template,
+ * ie, if the table has it and the template has a prefix or a range of
+ * bytes on the key, that is copied to key_operator. YES or NO
+ */
+int table_key_operator ( table_t * table, struct tuple_t * tup_template, struct tuple_operator_t * key_operator );
+
+/*
+ * Grows the table up front so n_entries more entries fit on it without
+ * splitting slots (their entries would be moved), as before a snapshot is loaded.
+ * Returns 0 (OK) or -1 (error)
+ */
+int table_reserve ( table_t * table, long long n_entries );
+
+/*
+ * Appends a new empty slot to the table.
+ */
+int table_add_slot ( table_t * table );
+
+/*
+ * Rehashes the next slot to split into itself and a new slot.
+ */
+int table_split_slot ( table_t * table );
 
 
 struct list_t * table_slot_list ( table_t * table, int index );
 
 int table_slots ( struct table_t * table );
 
+/*
+ * Creates an index on the given field position of the tuples on the table.
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_index_field ( struct table_t * table, int position );
+
+/*
+ * Returns the concrete field index of tup_template with fewest candidates, or NULL.
+ */
+struct field_index_t * table_best_index ( struct table_t * table, struct tuple_t * tup_template );
+
+struct list_t * table_get_by_index ( struct table_t * table, struct tuple_t * tup_template,
+                                    struct field_index_t * field_index, int whatToDoWithTheNodes, int one_or_all );
+
+/*
+ * Returns the node of the slot list that holds entry, or NULL if it is not on the table.
+ */
+node_t * table_slot_node ( struct table_t * table, struct entry_t * entry );
+
+/*
+ * Takes the node of the entry out of its slot and returns it.
+ */
+node_t * table_take_slot_node ( struct table_t * table, struct entry_t * entry );
+
+void table_index_entry ( struct table_t * table, struct entry_t * entry );
+
+void table_unlink_entry ( struct table_t * table, struct entry_t * entry );
+
+/*
+ * Adds the entry to the timestamp index of the table.
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_time_index_add ( struct table_t * table, struct entry_t * entry );
+
+/*
+ * Adds the entry to the key index of the table, if it has one.
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_key_index_add ( struct table_t * table, struct entry_t * entry );
+
+/*
+ * The first node of the key index that may be on key_operator, and if a node is already past it.
+ */
+node_t * table_first_key_node ( struct table_t * table, struct tuple_operator_t * key_operator );
+
+int table_keys_past ( struct tuple_operator_t * key_operator, node_t * node );
+
+struct list_t * table_get_by_keys ( struct table_t * table, struct tuple_t * tup_template,
+                                   struct tuple_operator_t * key_operator, int whatToDoWithTheNodes, int one_or_all );
+
+/*
+ * Puts the timer of the entry on the table leases, if it expires.
+ */
+void table_lease_entry ( struct table_t * table, struct entry_t * entry );
+
+/*
+ * Same as table_get_by (by time) but seeking the entries newer than timestamp
+ * on the timestamp index instead of scanning every slot.
+ * The entries come in ascending timestamp order.
+ */
+struct list_t * table_get_by_time ( struct table_t * table, long long timestamp, int whatToDoWithTheNodes, int one_or_all );
+
+void table_unlink_entries ( struct table_t * table, struct list_t * list, int whatToDoWithTheNodes );
+
+/*
+ * Opens cursor over the entries of table matching search_element, found by
+ * get_criterion (GET_BY_TUPLE_MATCH or GET_BY_TIME). If one_or_all is 1 it
+ * yields at most one entry.
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_cursor_open ( struct table_cursor_t * cursor, struct table_t * table, void * search_element,
+                        int get_criterion, int one_or_all );
+
+/*
+ * Returns the next matching entry (still on the table) or NULL if there are no more.
+ */
+struct entry_t * table_cursor_next ( struct table_cursor_t * cursor );
+
+/*
+ * Moves the cursor back to the first match, keeping its locks, so a second
+ * pass sees exactly the same entries.
+ */
+void table_cursor_rewind ( struct table_cursor_t * cursor );
+
+/*
+ * Starts walk from the entries newer than timestamp (-1: all of them).
+ */
+void table_walk_init ( struct table_walk_t * walk, long long timestamp );
+/*
+ * Frees what walk holds (the key where it stopped).
+ */
+void table_walk_destroy ( struct table_walk_t * walk );
+/*
+ * Opens cursor over the next part of walk on table: the entries matching
+ * search_element (a template with no key, or a timestamp) from where the
+ * last cursor on walk stopped. It holds only the read locks of the table
+ * and of its indexes (the key and timestamp indexes are there), and it
+ * yields no more after TABLE_WALK_NODES nodes and the end of their key or
+ * timestamp; walk->done says if it got to the end. The matches on the spill
+ * come first, on the first part.
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_cursor_open_walk ( struct table_cursor_t * cursor, struct table_t * table, void * search_element,
+                             int get_criterion, struct table_walk_t * walk );
+/*
+ * Closes the cursor, releasing its locks. It can be opened again.
+ */
+void table_cursor_close ( struct table_cursor_t * cursor );
+
+/*
+ * Locks the stripe of slot (or every stripe if slot is TABLE_ALL_SLOTS, none
+ * if TABLE_NO_SLOTS) for writing or reading. The table lock must be held.
+ */
+void table_lock_slots ( struct table_t * table, int slot, int writing );
+
+void table_unlock_slots ( struct table_t * table, int slot, int writing );
+
+/*
+ * Adds the entries of slot matching the template of cursor to its snapshot
+ * (and the ones on the spill too, if with_spill), without locking the slot.
+ * The caller must be inside an epoch.
+ * Returns 0 (OK) or -1 (a writer changed the slot meanwhile: nothing was
+ * added, read again).
+ */
+int table_read_slot ( struct table_cursor_t * cursor, int slot, int with_spill );
+
+/*
+ * Reads into the snapshot of cursor the entries matching its template (with
+ * a key, or with no prefix or range on it), without locks. The caller must
+ * be inside an epoch.
+ * Returns 0 (OK) or -1 (the table changed meanwhile: read again).
+ */
+int table_read_unlocked ( struct table_cursor_t * cursor );
+
+/*
+ * Same as table_get_by (by tuple match, keeping the tuples) for a template
+ * with a key, reading its slot without locks. The entries stay alive while
+ * the caller is in an epoch (invoke is, for the whole request).
+ */
+struct list_t * table_copy_key ( struct table_t * table, struct tuple_t * tup_template, int one_or_all );
+
+/*
+ * Locks the field indexes and the timestamp index for writing or reading.
+ */
+void table_lock_indexes ( struct table_t * table, int writing );
+
+void table_unlock_indexes ( struct table_t * table, int writing );
+
 int table_get_array(struct table_t *table, struct tuple_t *tup_template, int whatToDOWithTheNodes, int one_or_all, struct tuple_t *** matching_tuples);
 
 #endif
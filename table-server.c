@@ -14,7 +14,6 @@
 #include "network_utils.h"
 #include <signal.h>
 #include "table_skel.h"
-#include <sys/poll.h>
 #include <limits.h>
 #include <sys/uio.h>
 #include "client_stub-private.h"
@@ -25,22 +24,14 @@
 #include "message-private.h"
 #include <pthread.h>
 #include <time.h>
+#include <sched.h>
+#include "epoch.h"
 
 
-#define N_MAX_CLIENTS 25
-#define POLL_TIME_OUT 10
+//how long (ms) a loop waits for events before its periodic work (waiters, leases, snapshots)
+#define EVENTS_TIME_OUT 50
 #define N_TABLE_SLOTS 7
 
-int get_open_slot(struct pollfd * connections, int connected_fds) {
-    int open_slot = connected_fds;
-    int i;
-    for ( i = 1; i < connected_fds; i++) {
-        if ( connections[i].fd == -1 )
-            open_slot = i;
-    }
-    return open_slot;
-}
-
 int input_is_valid (int argc, char *argv[]) {
     return  argc > 1 && is_number (argv[1]);
 }
@@ -50,33 +41,67 @@ void invalid_input_message () {
     puts("Sorry, your input was not valid.");
     puts("You must provide a valid number to be the server port.");
     puts("NOTE: Port invalid if (portNumber >=1 && portNumber<=1023) OR (portNumber >=49152 && portNumber<=65535)");
+    puts("Optionally, a second number is the memory budget of the table (MB): the tuples above it go to disk.");
+    puts("Optionally, a third number is how many writes go between two snapshots of the table (0: none).");
+    puts("Optionally, a fourth number is how many workers (threads sharing the table, split in as many shards) the server runs (0: one per core).");
     puts("####### SD15-SERVER ##############");
 }
 
-int get_highest_open_connection ( struct pollfd * connections, int currentHighest ) {
-    int i = currentHighest;
-    int highest = i-1;
-    int stillSearching = YES;
-    while ( (i-- > 1) && stillSearching ) {
-        if ( connections[i].fd != -1 ) {
-            highest = i;
-            stillSearching = NO;
-        }
-    } 
-    return highest;
+/*
+ * The last timestamp the switch gave a write (only its loop gives them).
+ */
+long long switch_latest_timestamp = 0;
+
+/*
+ * Returns the timestamp of the next write the switch sends to the replicas:
+ * the wall clock in microseconds, but always above the last one given (the
+ * replicas refuse a write that is not newer than the last they put).
+ */
+long long switch_next_timestamp () {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    long long timestamp = now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+    if ( timestamp <= switch_latest_timestamp )
+        timestamp = switch_latest_timestamp + 1;
+    switch_latest_timestamp = timestamp;
+    return timestamp;
 }
 
-
-
 struct message_t *request_to_switch_mode ( struct message_t * original ) {
+    struct message_t * converted = original;
     if ( message_opcode_setter(original) && original->c_type == CT_TUPLE ) {
-        time_t timePassed;
-        time ( &timePassed );
-        struct entry_t * entry = entry_create2(tuple_dup(original->content.tuple), (timePassed) );
-        return message_create_with(original->opcode, CT_ENTRY, entry);
+        long long timePassed = switch_next_timestamp();
+        struct entry_t * entry = entry_create2(tuple_retain(original->content.tuple), (timePassed) );
+        converted = message_create_with(original->opcode, CT_ENTRY, entry);
+    }
+    /* the client says how long the tuple lasts and the switch when it expires, the same for every replica */
+    else if ( message_opcode_setter(original) && original->c_type == CT_LEASE ) {
+        long long timePassed = switch_next_timestamp();
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        struct entry_t * entry = entry_create2(tuple_retain(entry_value(original->content.entry)), (timePassed) );
+        entry->expires = now.tv_sec * 1000LL + now.tv_nsec / 1000000 + original->content.entry->expires;
+        converted = message_create_with(original->opcode, CT_LEASE, entry);
+    }
+    /* a batch keeps its entries, all with the same timestamp: the replicas put them or refuse them together */
+    else if ( message_opcode_setter(original) && original->c_type == CT_BATCH ) {
+        long long timePassed = switch_next_timestamp();
+        int i;
+        for ( i = 0; i < original->content.batch->n_entries; i++ )
+            original->content.batch->entries[i]->timestamp = timePassed;
+    }
+    /* the replicas must take the same tuples in the same order, so the switch never lets a get wait */
+    else if ( message_opcode_getter(original) && original->c_type == CT_ENTRY ) {
+        converted = message_create_with(original->opcode, CT_TUPLE, tuple_retain(entry_value(original->content.entry)));
     }
 
-    return original;
+    //the converted request shares the tuple, so the original only gives its reference back
+    if ( converted != original ) {
+        if ( converted != NULL )
+            converted->request_id = original->request_id;
+        free_message(original);
+    }
+    return converted;
 }
 
 struct message_t * respond_to_report ( struct message_t * report, void * useful_info ) {
@@ -88,19 +113,6 @@ struct message_t * respond_to_report ( struct message_t * report, void * useful_
 }
 
 
-void reorder_connections(struct pollfd * connections, int begin, int end ) {
-    int i;
-    for ( i = begin; i <= end; i++) {
-        if ( connections[i].fd == -1 ) {
-            connections[i].fd = connections[i+1].fd;
-            connections[i].events = connections[i+1].events;
-            connections[i].revents = connections[i+1].revents;
-            connections[i+1].fd = -1;
-        }
-    }
-}
-
-
 int server_update_from_neighbor(long long n_write_operation, char * my_address_and_port, char ** system_rtables, int numberOfServers )
 {
     
@@ -147,24 +159,25 @@ int server_update_from_neighbor(long long n_write_operation, char * my_address_a
 
 
 
- int server_run ( char * my_address_and_port, char ** system_rtables, int numberOfServers ) {
-
-    //gets the port number
-    int portnumber = atoi(get_port(my_address_and_port));
-    //case its invalid
-    if ( portnumber_is_invalid(portnumber) ) {
-        invalid_input_message();
-        return FAILED;
-    }
+ /* one worker of the server: its own listener, its own connections and its own epoll loop */
+struct server_worker_t {
+    int id;
+    int socket_fd;
+    pthread_t thread;
+    /* held while the worker handles requests, free while it is blocked on epoll_wait() */
+    pthread_mutex_t busy;
+    char ** system_rtables;
+};
 
+/* the workers of this server (one by default, table-server's fourth argument) */
+struct server_worker_t * workers = NULL;
+int n_workers = 1;
 
-    /** 0. SIGPIPE Handling */
-    struct sigaction s;
-            //what must do with a signal - ignore
-    s.sa_handler = SIG_IGN;
-            //set what to do when gets the SIGPIPE
-    sigaction(SIGPIPE, &s, NULL);
 
+/* creates the listening socket of a worker; with reuse_port every worker binds its own to the same port
+   and the kernel spreads the new connections between them */
+int server_listen ( int portnumber, int reuse_port ) {
+    
             //1 . Socket
     int socket_fd;
 
@@ -179,8 +192,16 @@ int server_update_from_neighbor(long long n_write_operation, char * my_address_a
     int setSocketReusable = YES;
     if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, (int *)&setSocketReusable, sizeof(setSocketReusable)) < 0 ) {
         perror("SO_REUSEADDR setsockopt error");
+        close(socket_fd);
         return FAILED;
-    } 
+    }
+    
+    // the other workers listen on the same port
+    if ( reuse_port && setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, (int *)&setSocketReusable, sizeof(setSocketReusable)) < 0 ) {
+        perror("SO_REUSEPORT setsockopt error");
+        close(socket_fd);
+        return FAILED;
+    }
 
     // 2. Bind
     struct sockaddr_in server;
@@ -197,157 +218,272 @@ int server_update_from_neighbor(long long n_write_operation, char * my_address_a
         return FAILED;
     };
     //3. Listen
-    if (listen(socket_fd, 0) < 0 ) {
+    if (listen(socket_fd, SERVER_LISTEN_BACKLOG) < 0 ) {
         perror("server > server_run > error on listen() \n");
         close(socket_fd);
         return FAILED;
     };
+    
+    return socket_fd;
+}
 
+/* waits for events with the worker not busy, so a snapshot can be taken while it waits */
+int server_worker_wait ( struct server_worker_t * worker, struct server_loop_t * loop ) {
+    pthread_mutex_unlock(&worker->busy);
+    int n_events = server_loop_wait(loop, EVENTS_TIME_OUT);
+    pthread_mutex_lock(&worker->busy);
+    return n_events;
+}
 
-            /*  From now on the server will wait that clients
-                 send requests that will be receive_and_send. */
+/* the snapshot must match the log, so the other workers are stopped (between two requests) while it is written */
+void server_snapshot () {
+    if ( !table_skel_snapshot_due() )
+        return;
+    
+    int i;
+    for ( i = 1; i < n_workers; i++ )
+        pthread_mutex_lock(&workers[i].busy);
+    
+    table_skel_snapshot();
+    
+    for ( i = 1; i < n_workers; i++ )
+        pthread_mutex_unlock(&workers[i].busy);
+}
 
-            //sockaddres_in struct for a client
-    struct sockaddr_in client;
-            //the connection socket with a client
-    int connection_socket_fd;
-            //the cliente socket size
-    socklen_t  client_socket_size = sizeof (client);
+/* answers client_request (NULL if it came unreadable), from the client on connection_socket_fd */
+void server_handle_request ( struct server_worker_t * worker, int connection_socket_fd, struct message_t * client_request ) {
+    char ** system_rtables = worker->system_rtables;
+    
+    int failed_tasks = 0;
+    //flag to track errors during the request-response process
 
-     
-     
-     /****     Initializes the table from the log and asks a neighboor for to get updated           ******/
-     if ( table_skel_init_with(N_TABLE_SLOTS, SERVER_RESPONSE_MODE, YES, YES, my_address_and_port) == FAILED)
-        return FAILED;
-     
-     server_update_from_neighbor( table_skel_write_operations(), my_address_and_port, system_rtables, numberOfServers );
-     
+    //error case
+    failed_tasks += client_request == NULL;
+    //the responses of a pipelined request go with its id
+    int request_id = client_request != NULL ? client_request->request_id : NO_REQUEST_ID;
 
+   
+    /** where all the response message will be stored **/
+    struct message_t ** response_message = NULL;
+    int response_messages_num = 0;
+    int message_was_sent = NO;
+    
+    if ( message_report(client_request) ) {
+        char * server_address_port = strndup(system_rtables[0], strlen(system_rtables[0]));
+        struct message_t * report_response = respond_to_report(client_request, server_address_port);
+        message_set_request_id(&report_response, 1, request_id);
+        response_messages_num = 1;
+        message_was_sent = server_send_response(connection_socket_fd, response_messages_num, &report_response);
+        failed_tasks = message_was_sent == FAILED;
+    }
+    else if ( message_update_request(client_request) ) {
+        table_skel_update_neighboor(connection_socket_fd, client_request);
+    }
+    else if ( table_skel_waits(client_request) ) {
+        //if nothing matches it is parked, and answered later by table_skel_answer_waiters
+        response_messages_num = table_skel_wait_get(client_request, connection_socket_fd, &response_message);
+        failed_tasks+= response_messages_num < 0;
+        
+        if ( response_messages_num > 0 ) {
+            message_was_sent = server_send_response(connection_socket_fd, response_messages_num, response_message);
+            failed_tasks+= message_was_sent == FAILED;
+        }
+        else if ( response_messages_num == 0 ) {
+            //the skeleton keeps the request
+            client_request = NULL;
+        }
+    }
+    else if ( table_skel_streams(client_request) ) {
+        //the reads are sent as they are found, without building the response set
+        //(a part at a time, as the client takes them: the skeleton keeps the request until then)
+        message_was_sent = table_skel_stream_get(client_request, connection_socket_fd);
+        client_request = NULL;
+        //error case
+        failed_tasks+= message_was_sent == FAILED;
+    }
+    else {
+        //the table_skel will process the client request and resolve response_message
+        //(what it read back from the spill lives until the epoch ends, after it is sent)
+        epoch_enter();
+        int response_messages_num = invoke(client_request, &response_message);
+        // error case
+        failed_tasks+= response_messages_num < 0 || response_message == NULL;
+
+        //sends the response to the client
+        message_was_sent = server_send_response(connection_socket_fd, response_messages_num, response_message);
+        epoch_exit();
+        //error case
+        failed_tasks+= message_was_sent == FAILED;
+    }
 
-            /** creates a pollfd **/
-    struct pollfd connections[N_MAX_CLIENTS];
-            //the socket_fd is at first
-    connections[0].fd = socket_fd;
-    connections[0].events = POLLIN;
 
-    int i = 1;
-    for( i=1; i < N_MAX_CLIENTS; i++){
-        connections[i].fd = -1;
-        connections[i].events = 0;
-        connections[i].revents = 0;
+    /** IF some error happened, it will notify the client **/
+    if ( failed_tasks > 0 ) {
+        server_sends_error_msg(connection_socket_fd, request_id);
     }
 
-    //for now only the listening socket
-    int connected_fds = 1;
-    // to save the result from poll function
-    int polled_fds = 0; 
+    /** frees memory **/
+    free_message2(client_request, NO);
+    free_message_set(response_message, response_messages_num);
+}
 
-            // Gets clients connection requests and handles its requests
-    printf("\n--------- waiting for clients requests ---------\n");
+void * server_worker_run ( void * worker_arg ) {
     
+    struct server_worker_t * worker = (struct server_worker_t *) worker_arg;
     
-    while ((polled_fds = poll(connections, connected_fds, 50)) >= 0) {
-
-        //if there was any polled sockets fd with events
-        if ( polled_fds > 0 ) { 
-            /** enters if there is a request on the listening socket **/ 
-            if ( (connections[0].revents & POLLIN) && (connected_fds < N_MAX_CLIENTS) ) {  
-                /* gets an open slot*/
-                int open_slot = connected_fds;
-
-                if ((connections[open_slot].fd = accept(connections[0].fd, (struct sockaddr *) &client, &client_socket_size)) > 0) { // Ligação feita ?
-                    connections[open_slot].events = POLLIN; // Vamos esperar dados nesta socket
-                    connected_fds++;
-                }
+            /*  From now on the server will wait that clients
+                 send requests that will be receive_and_send. */
+
+            /** the epoll loop of this worker, over its listening socket and its clients **/
+    struct server_loop_t loop;
+    if ( server_loop_init(&loop, worker->socket_fd) == FAILED )
+        return NULL;
+
+    // to save the result from server_worker_wait
+    int n_events = 0;
+
+    pthread_mutex_lock(&worker->busy);
+    
+    while ((n_events = server_worker_wait(worker, &loop)) >= 0) {
+
+        //only the sockets with events are looked at
+        int e;
+        for ( e = 0; e < n_events; e++ ) {
+            int connection_socket_fd = loop.events[e].data.fd;
+            
+            /** new connections on the listening socket **/
+            if ( connection_socket_fd == loop.listen_fd ) {
+                server_loop_accept(&loop);
+                continue;
             }
             
+            struct server_connection_t * connection = loop.connections[connection_socket_fd];
+            if ( connection == NULL )
+                continue;
+            
+            //the responses that did not go whole go on as the socket takes them,
+            //and so does the one being produced
+            if ( loop.events[e].events & EPOLLOUT ) {
+                server_connection_flush(connection);
+                server_connection_produce(connection);
+            }
+            
+            //the events are edge-triggered: all that arrived is read now, and each request
+            //is handled as soon as its whole frame is there (the rest waits for the next event)
+            int reading = loop.events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR) ?
+                server_connection_read(connection) : SUCCEEDED;
+            //(pipelined requests are all handled from this read, and their responses written together;
+            //the ones after a response being produced wait on the buffer until it is all sent)
+            struct message_t * client_request = NULL;
+            int framed = NO;
+            server_connection_hold(connection);
+            while ( connection->producer.produce == NULL
+                   && (framed = server_connection_next_request(connection, &client_request)) == YES )
+                server_handle_request(worker, connection_socket_fd, client_request);
+            server_connection_release(connection);
+            
+            //closed by the client, or of no use anymore
+            if ( reading == FAILED || framed == FAILED || connection->failed ) {
+                //a request it left waiting has no one to answer to
+                table_skel_forget_waiters(connection_socket_fd);
+                server_loop_close(&loop, connection_socket_fd);
+            }
+        }
+        
+        /* answers the requests that were waiting and got a tuple (from the puts above) or timed out */
+        table_skel_answer_waiters();
+        
+        /* the tuples of every shard expire and are snapshot from the first worker only */
+        if ( worker->id == 0 ) {
+            /* takes out the tuples whose lease ended */
+            table_skel_expire_leases();
+            
+            /* a snapshot of the table from time to time, so a restart does not replay the whole log */
+            server_snapshot();
+        }
+    }
+    pthread_mutex_unlock(&worker->busy);
 
-            //for each connected cliente it will receive a request and give a response
-            int i = 0;
-            for (i = 1; i < connected_fds ; i++) {
-                connection_socket_fd = connections[i].fd;
-  
-                /**  checks if this socket closed on the client side and updates connections **/
-                if ( socket_is_closed(connection_socket_fd) ) {
-                    
-                    if ( (connection_socket_fd != -1)) {
-                        shutdown(connections[i].fd, SHUT_RDWR);
-                        connections[i].fd = -1;
-                        connected_fds--;
-                    }
-                    reorder_connections(connections, 1, connected_fds);
-                    connection_socket_fd = connections[i].fd;
-                }
-
+    //closes all the client sockets and the listening one
+    server_loop_destroy(&loop);
+    close(worker->socket_fd);
 
-                //flag to check if socket is on or was closed on client side.
-               
-                if ( (connections[i].revents & POLLIN) ) { // Dados para ler ?
+    return NULL;
+}
 
 
-                    int failed_tasks = 0;
-                    //flag to track errors during the request-response process
 
-                    /** Gets the client request **/
-                    struct message_t * client_request = server_receive_request(connection_socket_fd);
+ int server_run ( char * my_address_and_port, char ** system_rtables, int numberOfServers ) {
 
-                    //error case
-                    failed_tasks += client_request == NULL;
+    //gets the port number
+    int portnumber = atoi(get_port(my_address_and_port));
+    //case its invalid
+    if ( portnumber_is_invalid(portnumber) ) {
+        invalid_input_message();
+        return FAILED;
+    }
 
-                   
-                    /** where all the response message will be stored **/
-                    struct message_t ** response_message = NULL;
-                    int response_messages_num = 0;
-                    int message_was_sent = NO;
-                    
-                    if ( message_report(client_request) ) {
-                        char * server_address_port = strndup(system_rtables[0], strlen(system_rtables[0]));
-                        struct message_t * report_response = respond_to_report(client_request, server_address_port);
-                        response_messages_num = 1;
-                        message_was_sent = server_send_response(connection_socket_fd, response_messages_num, &report_response);
-                        failed_tasks = message_was_sent == FAILED;
-                    }
-                    else if ( message_update_request(client_request) ) {
-                        table_skel_update_neighboor(connection_socket_fd, client_request);
-                    }
-                    else {
-                        //the table_skel will process the client request and resolve response_message
-                        int response_messages_num = invoke(client_request, &response_message);
-                        // error case
-                        failed_tasks+= response_messages_num < 0 || response_message == NULL;
-
-                        //sends the response to the client
-                        message_was_sent = server_send_response(connection_socket_fd, response_messages_num, response_message);
-                        //error case
-                        failed_tasks+= message_was_sent == FAILED;
-                    }
 
+    /** 0. SIGPIPE Handling */
+    struct sigaction s;
+            //what must do with a signal - ignore
+    s.sa_handler = SIG_IGN;
+            //set what to do when gets the SIGPIPE
+    sigaction(SIGPIPE, &s, NULL);
 
-                    /** IF some error happened, it will notify the client **/
-                    if ( failed_tasks > 0 ) {
-                        server_sends_error_msg(connection_socket_fd);
-                    }
+     
+     /****     Initializes the table from the log and asks a neighboor for to get updated           ******/
+     /* the table is split in as many shards as there are workers, but every worker uses all of them */
+     table_shards = n_workers;
+     if ( table_skel_init_with(N_TABLE_SLOTS, SERVER_RESPONSE_MODE, YES, YES, my_address_and_port) == FAILED)
+        return FAILED;
+     
+     server_update_from_neighbor( table_skel_write_operations(), my_address_and_port, system_rtables, numberOfServers );
+     
 
-                    /** frees memory **/
-                    free_message2(client_request, NO);
-                    free_message_set(response_message, response_messages_num);
-                }
-            }
+    /** every worker gets its listener before any accepts, so no connection waits on a worker that is not there yet **/
+    workers = (struct server_worker_t *) calloc(n_workers, sizeof(struct server_worker_t));
+    if ( workers == NULL ) {
+        table_skel_destroy();
+        return FAILED;
+    }
+    int i;
+    for ( i = 0; i < n_workers; i++ ) {
+        workers[i].id = i;
+        workers[i].system_rtables = system_rtables;
+        pthread_mutex_init(&workers[i].busy, NULL);
+        if ( (workers[i].socket_fd = server_listen(portnumber, n_workers > 1)) == FAILED ) {
+            while ( i-- > 0 )
+                close(workers[i].socket_fd);
+            free(workers);
+            workers = NULL;
+            table_skel_destroy();
+            return FAILED;
         }
     }
 
-            //closes all the sockets socket
-        int j;
-        for (j = 0; j < N_MAX_CLIENTS; j++){
-            if (connections[j].fd >= 0){
-                close(connections[j].fd);
-            }
-        }
-            //destroys the table_skel
-        table_skel_destroy();
+            // Gets clients connection requests and handles its requests
+    printf("\n--------- waiting for clients requests (%d workers) ---------\n", n_workers);
+    
+    /** the first worker is this thread **/
+    int n_started = 1;
+    while ( n_started < n_workers && pthread_create(&workers[n_started].thread, NULL, &server_worker_run, &workers[n_started]) == 0 )
+        n_started++;
+    if ( n_started < n_workers )
+        perror("server > server_run > error creating a worker thread");
+    
+    server_worker_run(&workers[0]);
+    
+    for ( i = 1; i < n_started; i++ )
+        pthread_join(workers[i].thread, NULL);
+    
+    //destroys the table_skel
+    table_skel_destroy();
+    free(workers);
+    workers = NULL;
 
-        return SUCCEEDED;
-    }
+    return SUCCEEDED;
+}
 
 
 
@@ -419,7 +555,7 @@ int switch_run ( char * my_address_and_port, char ** system_rtables, int numberO
     };
 
     //3. Listen
-    if (listen(socket_fd, 0) < 0 ) {
+    if (listen(socket_fd, SERVER_LISTEN_BACKLOG) < 0 ) {
         perror("server > server_run > error on listen() \n");
         close(socket_fd);
         return FAILED;
@@ -488,15 +624,11 @@ int switch_run ( char * my_address_and_port, char ** system_rtables, int numberO
     
     
 
-    /** Sets up all the poll structures to support multiple client connections **/
+    /** Sets up the epoll loop to support many client connections **/
 
 
-    //sockaddres_in struct for a client
-    struct sockaddr_in client;
     //the connection socket with a client
     int connection_socket_fd;
-    //the cliente socket size
-    socklen_t  client_socket_size = sizeof (client);
    
     /* initializes the table_skel */
     if ( table_skel_init_with( N_TABLE_SLOTS, SWITCH_RESPONSE_MODE, YES, YES, my_address_and_port ) == FAILED )
@@ -506,134 +638,130 @@ int switch_run ( char * my_address_and_port, char ** system_rtables, int numberO
     
     
 
-    /** creates a pollfd **/ 
-    struct pollfd connections[N_MAX_CLIENTS];
-    /* the socket_fd is the listening socket */
-    connections[0].fd = socket_fd;
-    connections[0].events = POLLIN;
-    /* initializes each connection slot */
-    for( i=1; i < N_MAX_CLIENTS; i++){
-        connections[i].fd = -1;
-        connections[i].events = 0;
-        connections[i].revents = 0;
+    /** the epoll loop of the switch, over the listening socket and its clients **/
+    struct server_loop_t loop;
+    if ( server_loop_init(&loop, socket_fd) == FAILED ) {
+        close(socket_fd);
+        return FAILED;
     }
 
-    //for now only the listening socket
-    int connected_fds = 1;
-    // to save the result from poll function
-    int polled_fds = 0;
+    // to save the result from server_loop_wait
+    int n_events = 0;
     
     // Gets clients connection requests and handles its requests
     printf("\n--------- waiting for clients requests ---------\n");
     
     
-    while ((polled_fds = poll(connections, connected_fds, 50)) >= 0) {
+    while ((n_events = server_loop_wait(&loop, EVENTS_TIME_OUT)) >= 0) {
         
-        //if there was any polled sockets fd with events
-        if ( polled_fds > 0 ) {
-            /** enters if there is a request on the listening socket **/
-            if ( (connections[0].revents & POLLIN) && (connected_fds < N_MAX_CLIENTS) ) {
-                /* gets an open slot*/
-                int open_slot = connected_fds;
-                
-                if ((connections[open_slot].fd = accept(connections[0].fd, (struct sockaddr *) &client, &client_socket_size)) > 0) {
-                    connections[open_slot].events = POLLIN;
-                    connected_fds++;
-                }
+        //only the sockets with events are looked at
+        int e;
+        for ( e = 0; e < n_events; e++ ) {
+            connection_socket_fd = loop.events[e].data.fd;
+            
+            /** new connections on the listening socket **/
+            if ( connection_socket_fd == loop.listen_fd ) {
+                server_loop_accept(&loop);
+                continue;
             }
             
+            struct server_connection_t * connection = loop.connections[connection_socket_fd];
+            if ( connection == NULL )
+                continue;
+            
+            //the responses that did not go whole go on as the socket takes them
+            if ( loop.events[e].events & EPOLLOUT )
+                server_connection_flush(connection);
             
-            //for each connected cliente it will receive a request and give a response
-            int i = 0;
-            for (i = 1; i < connected_fds ; i++) {
-
-                connection_socket_fd = connections[i].fd;
-                
-                /**  checks if this socket closed on the client side and updates connections **/
-                if ( socket_is_closed(connection_socket_fd) ) {
-                    if ( (connection_socket_fd != -1)) {
-                        shutdown(connections[i].fd, SHUT_RDWR);
-                        connections[i].fd = -1;
-                        connected_fds--;
+            //the events are edge-triggered: all that arrived is read now, and each request
+            //is handled as soon as its whole frame is there (the rest waits for the next event)
+            int reading = loop.events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR) ?
+                server_connection_read(connection) : SUCCEEDED;
+            struct message_t * client_request_raw = NULL;
+            int framed;
+            server_connection_hold(connection);
+            while ( (framed = server_connection_next_request(connection, &client_request_raw)) == YES ) {
+
+                //flag to track errors during the request-response process
+                int failed_tasks = 0;
+
+                /** prepares the raw client request to respect the authority of the switch **/
+                struct message_t * client_request = request_to_switch_mode(client_request_raw);
+                //checks error
+                failed_tasks += client_request == NULL;
+
+
+                /** If client request is a writter it's proxies work, otherwise will send report  **/
+                if ( message_is_writer(client_request) ) {
+
+                    /** UPDATES THE REQUESTS_BUCKET **/
+
+                    /* a full bucket is emptied by the proxies: the postman answers (and frees) what they finished meanwhile */
+                    while ( bucket_is_full ) {
+                        run_postman(&bucket_access, requests_bucket, &bucket_is_full, &requests_counter, &bucket_has_requests);
+                        if ( bucket_is_full )
+                            sched_yield();
                     }
-                    reorder_connections(connections, 1, connected_fds);
-                    connection_socket_fd = connections[i].fd;
-                }
 
-                if ( (connections[i].revents & POLLIN) ) {
-
-                    connection_socket_fd = connections[i].fd;
-
-                    //flag to track errors during the request-response process
-                    int failed_tasks = 0;
-
-                    /** Gets the client request as it was**/
-                    struct message_t * client_request_raw = server_receive_request(connection_socket_fd);
-                    /** prepares the raw client request to respect the authority of the switch **/
-                    struct message_t * client_request = request_to_switch_mode(client_request_raw);
-                    //checks error
-                    failed_tasks += client_request == NULL;
-
-
-                    /** If client request is a writter it's proxies work, otherwise will send report  **/
-                    if ( message_is_writer(client_request) ) {
-
-                        /** UPDATES THE REQUESTS_BUCKET **/
-
-                        /* locks the access to the bucket */
-                        pthread_mutex_lock(&bucket_access); 
-
-                        /** If bucket is not full it will store the client_request **/
-                        if ( !bucket_is_full ) {
-                            
-                            /* creates a switch recognizable request */
-                            current_request = create_request_with(connection_socket_fd, client_request, NULL,0,NUMBER_OF_PROXIES, 0,NO);
-                           
-                            /* if it was created successfully it will put it on the bucket */
-                            if ( current_request != NULL ) {
-                                // Colocar mensagem na tabela
-                                requests_bucket[index_to_store_request] = current_request;
-                                // Próxima mensagem será escrita neste índice
-                                index_to_store_request = (index_to_store_request+1) % REQUESTS_BUCKET_SIZE;
-                                // Incrementar número de mensagens no bucket
-                                requests_counter++;
-                                //increments the number of requests ever received
-                                total_requests_count++;
-                                // Forçar este estado
-                                bucket_has_requests = YES;
-                                // Sinalizar THREADS bloqueadas no estado vazio da tabela
-                                monitor_signal(&monitor_bucket_has_requests, &bucket_has_requests);
-                                /* bucket is full if the slot of the next index is not empty */
-                                bucket_is_full = requests_bucket[index_to_store_request] != NULL;
-                            }
-                            else {
-                                puts("\t--- error on create_request_with - discarding cliente request...");
-                            }
-                        }
+                    /* locks the access to the bucket */
+                    pthread_mutex_lock(&bucket_access); 
+
+                    /** If bucket is not full it will store the client_request **/
+                    if ( !bucket_is_full ) {
                         
-                        /* unlocks the bucket */
-                        pthread_mutex_unlock(&bucket_access); 
-                    }
-                    else {
-                        /** else > client_request is a reader operation so will send it a report **/
-                        struct message_t *server_response = message_create_with(OC_REPORT, CT_INVCMD, "Invalid command to switch.");
-                        //sends the response to the client
-                        int message_was_sent = server_send_response(connection_socket_fd, 1, &server_response);
-                        //error case
-                        failed_tasks+= message_was_sent == FAILED;
-
-                        /** IF some error happened, it will notify the client **/
-                        if ( failed_tasks > 0 ) {
-                            server_sends_error_msg(connection_socket_fd);
+                        /* creates a switch recognizable request */
+                        current_request = create_request_with(connection_socket_fd, client_request, NULL,0,NUMBER_OF_PROXIES, 0,NO);
+                       
+                        /* if it was created successfully it will put it on the bucket */
+                        if ( current_request != NULL ) {
+                            // Colocar mensagem na tabela
+                            requests_bucket[index_to_store_request] = current_request;
+                            // Próxima mensagem será escrita neste índice
+                            index_to_store_request = (index_to_store_request+1) % REQUESTS_BUCKET_SIZE;
+                            // Incrementar número de mensagens no bucket
+                            requests_counter++;
+                            //increments the number of requests ever received
+                            total_requests_count++;
+                            // Forçar este estado
+                            bucket_has_requests = YES;
+                            // Sinalizar THREADS bloqueadas no estado vazio da tabela
+                            monitor_signal(&monitor_bucket_has_requests, &bucket_has_requests);
+                            /* bucket is full if the slot of the next index is not empty */
+                            bucket_is_full = requests_bucket[index_to_store_request] != NULL;
+                        }
+                        else {
+                            puts("\t--- error on create_request_with - discarding cliente request...");
                         }
-
                     }
                     
-                    int timeToWaitBeforeCheck = polled_fds % 4;
-                    sleep( timeToWaitBeforeCheck );
+                    /* unlocks the bucket */
+                    pthread_mutex_unlock(&bucket_access); 
                 }
+                else {
+                    /** else > client_request is a reader operation so will send it a report **/
+                    struct message_t *server_response = message_create_with(OC_REPORT, CT_INVCMD, "Invalid command to switch.");
+                    message_set_request_id(&server_response, 1, client_request != NULL ? client_request->request_id : NO_REQUEST_ID);
+                    //sends the response to the client
+                    int message_was_sent = server_send_response(connection_socket_fd, 1, &server_response);
+                    //error case
+                    failed_tasks+= message_was_sent == FAILED;
+
+                    /** IF some error happened, it will notify the client **/
+                    if ( failed_tasks > 0 ) {
+                        server_sends_error_msg(connection_socket_fd, client_request != NULL ? client_request->request_id : NO_REQUEST_ID);
+                    }
+
+                }
+            }
+            server_connection_release(connection);
+            
+            //closed by the client, or of no use anymore
+            if ( reading == FAILED || framed == FAILED || connection->failed ) {
+                //its requests still on the bucket are not answered to whoever gets the fd next
+                requests_forget_requestor(&bucket_access, requests_bucket, connection_socket_fd);
+                server_loop_close(&loop, connection_socket_fd);
             }
-        } 
+        }
         
         /* runs the postman to ensure that the requests responses are finalized and a response is given back */
         run_postman ( &bucket_access, requests_bucket,
@@ -642,13 +770,9 @@ int switch_run ( char * my_address_and_port, char ** system_rtables, int numberO
         
     }
 
-    //closes all the sockets socket
-    int j;
-    for (j = 0; j < N_MAX_CLIENTS; j++){
-        if (connections[j].fd >= 0){
-            close(connections[j].fd);
-        }
-    }
+    //closes all the client sockets and the listening one
+    server_loop_destroy(&loop);
+    close(socket_fd);
     //destroys the table_skel
     table_skel_destroy();
 
@@ -660,6 +784,20 @@ int switch_run ( char * my_address_and_port, char ** system_rtables, int numberO
 int main ( int argc, char *argv[] ) {
 
     char * my_address_and_port = strdup(argv[1]);
+    
+    //the budget (MB) of the tuples kept in memory, if any
+    memory_budget = argc > 2 && is_number(argv[2]) ? atoll(argv[2]) * 1024 * 1024 : 0;
+    //how many write operations between two snapshots of the table (0: none)
+    snapshot_every = argc > 3 && is_number(argv[3]) ? atoll(argv[3]) : TABLE_SKEL_SNAPSHOT_EVERY;
+    //how many workers the server runs (0: one per core)
+    n_workers = argc > 4 && is_number(argv[4]) ? atoi(argv[4]) : 1;
+    if ( n_workers == 0 )
+        n_workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if ( n_workers < 1 || n_workers > TABLE_SKEL_MAX_SHARDS )
+        n_workers = n_workers < 1 ? 1 : TABLE_SKEL_MAX_SHARDS;
+
+    //every client connection is an fd
+    server_raise_fd_limit();
 
      /** gets the address_and_port of each remote table of the system **/
     char** system_rtables = NULL;
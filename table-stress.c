@@ -0,0 +1,629 @@
+//
+//  table-stress.c
+//  SD15-Product
+//
+//  Stress test of the table module: many threads doing in/out/copy (and
+//  batch outs, cursors, walks and lease expiries) on the same keys, checking that what they
+//  see is consistent. Then the same through the skeleton, with a table per
+//  thread and the writes logged: the log replayed must give the same tables.
+//  Last, the fullest messages with a request id must still fit in MAX_MSG.
+//  Not part of the SD15 executables: build it with "make stress" (with
+//  -fsanitize=thread in CC_OPTIONS and LNK_OPTIONS to have the data races
+//  reported).
+//
+//  Uso: ./SD15_STRESS [n_threads] [ops_per_thread] [memory_budget_bytes]
+//  (with a memory budget the coldest tuples go to SD15_STRESS_SPILL.bin; the
+//  log of the skeleton is SD15_STRESS_REPLAY_LOG.txt, removed at the end)
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "table-private.h"
+#include "table.h"
+#include "table_skel.h"
+#include "message-private.h"
+#include "table_skel-private.h"
+#include "list-private.h"
+#include "tuple-private.h"
+#include "entry-private.h"
+#include "slab.h"
+#include "epoch.h"
+#include "intern.h"
+#include "general_utils.h"
+
+#define DEFAULT_THREADS 8
+#define DEFAULT_OPS 20000
+#define MAX_THREADS 64
+#define N_KEYS 300
+#define TIME_WINDOW 50
+//how long the tuples put with a lease last (milliseconds)
+#define LEASE_MS 5
+//tuples put together by a batch out
+#define BATCH_SIZE 8
+//address the skeleton logs as in the replay test (its log is <this>_LOG.txt)
+#define REPLAY_ADDRESS "SD15_STRESS_REPLAY"
+//how long the ins of the replay test that wait for a put wait (milliseconds)
+#define REPLAY_WAIT_MS 2
+
+static struct table_t * table = NULL;
+//tuples put and taken out by all the threads
+static long long n_put = 0;
+static long long n_taken = 0;
+//entries put straight into a waiting in
+static long long n_handed = 0;
+//entries whose lease ended
+static long long n_expired = 0;
+//the timestamps given to the tuples put
+static long long stress_clock = 0;
+//inconsistencies seen by the threads
+static long long n_errors = 0;
+//the timestamps of the outs of the replay test, given as the switch gives them
+static long long replay_clock = 0;
+
+/*
+ * Creates a tuple (or template) with the three elements.
+ */
+struct tuple_t * stress_tuple ( char * key, char * parity, char * payload ) {
+    char *tdata[3] = {key, parity, payload};
+    return tuple_create2(3, tdata);
+}
+
+/*
+ * Returns the wall clock in milliseconds (the clock of the leases).
+ */
+long long stress_now_ms () {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/*
+ * Counts an inconsistency.
+ */
+void stress_error ( const char * what ) {
+    __atomic_add_fetch(&n_errors, 1, __ATOMIC_RELAXED);
+    fprintf(stderr, "  inconsistência: %s\n", what);
+}
+
+/*
+ * Checks that every tuple of the list has the key (if key is not NULL),
+ * destroying them if they were taken from the table, and the list.
+ * Returns the number of tuples in the list.
+ */
+int stress_check_list ( struct list_t * list, char * key, int taken ) {
+    if ( list == NULL )
+        return 0;
+
+    int n_tuples = list_size(list);
+    node_t * currentNode = list_head(list);
+    int nodesToCheck = n_tuples;
+    while ( nodesToCheck-- > 0 ) {
+        if ( key != NULL && strcmp(tuple_key(entry_value(node_entry(currentNode))), key) != 0 )
+            stress_error("tuplo com outra chave");
+        currentNode = currentNode->next;
+    }
+
+    if ( taken ) {
+        while ( !list_isEmpty(list) )
+            list_remove_node(list, list_head(list), MUST_DESTROY);
+    }
+    list_destroy(list);
+    return n_tuples;
+}
+
+/*
+ * Walks a cursor twice (with a rewind in between): both walks must agree,
+ * and on a template every entry must match it (even the ones read without
+ * locks). Returns how many entries the cursor yielded.
+ */
+int stress_cursor ( void * search_element, int get_criterion ) {
+    struct table_cursor_t cursor;
+    if ( table_cursor_open(&cursor, table, search_element, get_criterion, 0) == FAILED ) {
+        stress_error("cursor não abriu");
+        return 0;
+    }
+
+    int n_walked = 0;
+    struct entry_t * entry = NULL;
+    while ( (entry = table_cursor_next(&cursor)) != NULL ) {
+        if ( get_criterion == GET_BY_TUPLE_MATCH && !tuple_matches_template(entry_value(entry), search_element) )
+            stress_error("o cursor deu uma entrada que não corresponde");
+        n_walked++;
+    }
+    int n_yielded = n_walked;
+    table_cursor_rewind(&cursor);
+    while ( table_cursor_next(&cursor) != NULL )
+        n_walked--;
+    if ( n_walked != 0 )
+        stress_error("o cursor mudou entre as duas passagens");
+
+    table_cursor_close(&cursor);
+    return n_yielded;
+}
+
+/*
+ * Walks the matches of search_element a part at a time (table_cursor_open_walk),
+ * the locks let go between the parts. Returns how many it yielded, and how
+ * many parts in *n_parts.
+ */
+int stress_walk ( void * search_element, int get_criterion, long long timestamp, int * n_parts ) {
+    struct table_walk_t walk;
+    table_walk_init(&walk, timestamp);
+    int n_walked = 0;
+    *n_parts = 0;
+    do {
+        struct table_cursor_t cursor;
+        if ( table_cursor_open_walk(&cursor, table, search_element, get_criterion, &walk) == FAILED ) {
+            stress_error("a parte de um walk não abriu");
+            break;
+        }
+        while ( table_cursor_next(&cursor) != NULL )
+            n_walked++;
+        table_cursor_close(&cursor);
+        (*n_parts)++;
+    } while ( !walk.done );
+    table_walk_destroy(&walk);
+    return n_walked;
+}
+
+/*
+ * The work of one thread of the stress test.
+ */
+struct stress_worker_t {
+    int ops;
+    unsigned int seed;
+};
+
+void * stress_worker ( void * arg ) {
+    struct stress_worker_t * worker = (struct stress_worker_t *) arg;
+    char key[32];
+    int i;
+    for ( i = 0; i < worker->ops; i++ ) {
+        int operation = rand_r(&(worker->seed)) % 100;
+        sprintf(key, "key-%d", rand_r(&(worker->seed)) % N_KEYS);
+        
+        //like invoke: the entries copied are not freed until the request ends
+        slab_arena_begin();
+        epoch_enter();
+        
+        if ( operation < 2 ) {
+            //batch out, of several keys at once
+            long long timestamp = __atomic_add_fetch(&stress_clock, 1, __ATOMIC_RELAXED);
+            struct entry_t * entries[BATCH_SIZE];
+            int j;
+            for ( j = 0; j < BATCH_SIZE; j++ ) {
+                sprintf(key, "key-%d", rand_r(&(worker->seed)) % N_KEYS);
+                entries[j] = entry_create2(stress_tuple(key, j % 2 ? "odd" : "even", "payload"), timestamp);
+            }
+            if ( table_put_batch(table, entries, BATCH_SIZE) == SUCCEEDED )
+                __atomic_add_fetch(&n_put, BATCH_SIZE, __ATOMIC_RELAXED);
+            else
+                stress_error("table_put_batch falhou");
+        }
+        else if ( operation < 45 ) {
+            //out
+            long long timestamp = __atomic_add_fetch(&stress_clock, 1, __ATOMIC_RELAXED);
+            struct entry_t * entry = entry_create2(stress_tuple(key, operation % 2 ? "odd" : "even", "payload"), timestamp);
+            //some with a lease, that an expire takes out if no in does it first
+            if ( operation % 3 == 0 )
+                entry->expires = stress_now_ms() + LEASE_MS;
+            if ( table_put_entry(table, entry) == SUCCEEDED )
+                __atomic_add_fetch(&n_put, 1, __ATOMIC_RELAXED);
+        }
+        else if ( operation < 70 ) {
+            //copy of one key (read without locking the slot)
+            struct tuple_t * template = stress_tuple(key, NULL, NULL);
+            stress_check_list(table_get(table, template, KEEP_AT_ORIGIN, operation % 2), key, NO);
+            tuple_destroy(template);
+        }
+        else if ( operation < 80 ) {
+            //in of one key that waits a little for a put if there is nothing
+            struct table_waiter_t waiter;
+            waiter.tup_template = stress_tuple(key, NULL, NULL);
+            waiter.keep_tuples = DONT_KEEP_AT_ORIGIN;
+            waiter.taken = NULL;
+            struct list_t * matches = NULL;
+            if ( table_get_or_wait(table, &waiter, &matches) == FAILED ) {
+                stress_error("table_get_or_wait falhou");
+            }
+            else if ( matches != NULL ) {
+                __atomic_add_fetch(&n_taken, stress_check_list(matches, key, YES), __ATOMIC_RELAXED);
+            }
+            else {
+                sched_yield();
+                //if it was not waiting anymore a put handed it an entry, and that was never on the table
+                if ( !table_cancel_wait(table, &waiter) ) {
+                    if ( waiter.entry == NULL || strcmp(entry_key(waiter.entry), key) != 0 )
+                        stress_error("entrada entregue sem a chave");
+                    entry_destroy(waiter.entry);
+                    __atomic_add_fetch(&n_handed, 1, __ATOMIC_RELAXED);
+                }
+            }
+            tuple_destroy(waiter.tup_template);
+        }
+        else if ( operation < 85 ) {
+            //in of one key
+            struct tuple_t * template = stress_tuple(key, NULL, NULL);
+            int n_tuples = stress_check_list(table_get(table, template, DONT_KEEP_AT_ORIGIN, 1), key, YES);
+            __atomic_add_fetch(&n_taken, n_tuples, __ATOMIC_RELAXED);
+            tuple_destroy(template);
+        }
+        else if ( operation < 92 ) {
+            //cursor with no key (a field index or, less often, every slot), or the same a part at a time
+            struct tuple_t * template = operation == 86 ? stress_tuple(NULL, NULL, "payload") : stress_tuple(NULL, "odd", NULL);
+            int n_parts;
+            if ( operation % 2 == 0 )
+                stress_cursor(template, GET_BY_TUPLE_MATCH);
+            else
+                stress_walk(template, GET_BY_TUPLE_MATCH, -1, &n_parts);
+            tuple_destroy(template);
+        }
+        else if ( operation < 95 ) {
+            //in with no key
+            struct tuple_t * template = stress_tuple(NULL, "even", NULL);
+            int n_tuples = stress_check_list(table_get(table, template, DONT_KEEP_AT_ORIGIN, 1), NULL, YES);
+            __atomic_add_fetch(&n_taken, n_tuples, __ATOMIC_RELAXED);
+            tuple_destroy(template);
+        }
+        else if ( operation < 97 ) {
+            //the leases that ended, and only those
+            long long now = stress_now_ms();
+            struct list_t * expired = table_expire(table, now);
+            if ( expired == NULL ) {
+                stress_error("table_expire falhou");
+            }
+            else {
+                node_t * currentNode = list_head(expired);
+                int nodesToCheck = list_size(expired);
+                while ( nodesToCheck-- > 0 ) {
+                    struct entry_t * entry = node_entry(currentNode);
+                    if ( entry->expires <= 0 || entry->expires / TIMING_WHEEL_TICK_MS > now / TIMING_WHEEL_TICK_MS )
+                        stress_error("expirou uma entrada antes do tempo");
+                    currentNode = currentNode->next;
+                }
+                __atomic_add_fetch(&n_expired, stress_check_list(expired, NULL, YES), __ATOMIC_RELAXED);
+            }
+        }
+        else {
+            //what is newer than a timestamp (OC_UPDATE)
+            long long since = __atomic_load_n(&stress_clock, __ATOMIC_RELAXED) - TIME_WINDOW;
+            stress_check_list(table_get_entries(table, since, KEEP_AT_ORIGIN, 0), NULL, NO);
+            stress_cursor(&since, GET_BY_TIME);
+        }
+        
+        epoch_exit();
+        slab_arena_reset();
+    }
+    return NULL;
+}
+
+/*
+ * Reads and drops what was answered on the socket.
+ */
+void replay_drain ( int socketfd ) {
+    char sink[4096];
+    while ( recv(socketfd, sink, sizeof(sink), MSG_DONTWAIT) > 0 )
+        ;
+}
+
+/*
+ * The work of one thread of the replay test, as a worker of the server:
+ * outs (whose timestamps may reach invoke out of order, as the ones of
+ * the switch do) and ins of one key or of any key, through invoke, and
+ * ins of one key that wait for a put, answered on a socket pair.
+ */
+void * replay_worker ( void * arg ) {
+    struct stress_worker_t * worker = (struct stress_worker_t *) arg;
+    char key[32];
+    char payload[32];
+    int answers[2];
+    if ( socketpair(AF_UNIX, SOCK_STREAM, 0, answers) != 0 ) {
+        stress_error("socketpair falhou");
+        return NULL;
+    }
+    int n_parked = 0;
+    int n_answered = 0;
+    int i;
+    for ( i = 0; i < worker->ops; i++ ) {
+        n_answered += table_skel_answer_waiters();
+        replay_drain(answers[1]);
+        int operation = rand_r(&(worker->seed)) % 100;
+        sprintf(key, "key-%d", rand_r(&(worker->seed)) % N_KEYS);
+        
+        struct message_t * request = NULL;
+        if ( operation >= 85 && operation < 90 ) {
+            //a put of the key hands it its tuple, logged with that put
+            struct message_t * wait = message_create_with(OC_IN, CT_ENTRY, entry_create2(stress_tuple(key, NULL, NULL), REPLAY_WAIT_MS));
+            struct message_t ** responses = NULL;
+            int n_responses = table_skel_wait_get(wait, answers[0], &responses);
+            if ( n_responses == FAILED )
+                stress_error("table_skel_wait_get falhou");
+            if ( n_responses == 0 ) {
+                n_parked++;
+                continue;
+            }
+            free_message_set(responses, n_responses);
+            free(responses);
+            free_message(wait);
+            continue;
+        }
+        if ( operation < 60 ) {
+            long long timestamp = __atomic_add_fetch(&replay_clock, 1, __ATOMIC_RELAXED);
+            sprintf(payload, "%lld", timestamp);
+            struct entry_t * entry = entry_create2(stress_tuple(key, operation % 2 ? "odd" : "even", payload), timestamp);
+            request = message_create_with(OC_OUT, CT_ENTRY, entry);
+        }
+        else {
+            struct tuple_t * template = operation < 90 ? stress_tuple(key, NULL, NULL) : stress_tuple(NULL, "even", NULL);
+            request = message_create_with(OC_IN, CT_TUPLE, template);
+        }
+        
+        struct message_t ** responses = NULL;
+        int n_responses = invoke(request, &responses);
+        if ( n_responses == FAILED )
+            stress_error("invoke falhou");
+        free_message_set(responses, n_responses);
+        free(responses);
+        //the entry of an out is on the table now, the template of an in is not
+        if ( request->opcode == OC_IN )
+            tuple_destroy(request->content.tuple);
+        free_message2(request, NO);
+    }
+    
+    //the last ones time out
+    while ( n_answered < n_parked ) {
+        sched_yield();
+        n_answered += table_skel_answer_waiters();
+        replay_drain(answers[1]);
+    }
+    close(answers[0]);
+    close(answers[1]);
+    return NULL;
+}
+
+int replay_compare ( const void * a, const void * b ) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/*
+ * Returns the tuples of the tables of the skeleton, as text and sorted (an
+ * OC_COPY_ALL of everything), and how many in *n_tuples.
+ */
+char ** replay_dump ( int * n_tuples ) {
+    struct message_t * request = message_create_with(OC_COPY_ALL, CT_TUPLE, stress_tuple(NULL, NULL, NULL));
+    struct message_t ** responses = NULL;
+    int n_responses = invoke(request, &responses);
+    int n_announced = n_responses > 0 ? responses[0]->content.result : 0;
+    
+    char ** dump = (char **) malloc((n_announced + 1) * sizeof(char *));
+    int n_dumped = 0;
+    int i;
+    for ( i = 1; i < n_responses; i++ ) {
+        if ( responses[i]->c_type == CT_TUPLE && n_dumped < n_announced ) {
+            dump[n_dumped++] = tuple_to_string(responses[i]->content.tuple);
+            continue;
+        }
+        int j;
+        for ( j = 0; responses[i]->c_type == CT_TUPLES && j < responses[i]->content.tuples->n_tuples && n_dumped < n_announced; j++ )
+            dump[n_dumped++] = tuple_to_string(responses[i]->content.tuples->tuples[j]);
+    }
+    if ( n_dumped != n_announced )
+        stress_error("o OC_COPY_ALL trouxe outro número de tuplos");
+    qsort(dump, n_dumped, sizeof(char *), replay_compare);
+    
+    free_message_set(responses, n_responses);
+    free(responses);
+    free_message(request);
+    *n_tuples = n_dumped;
+    return dump;
+}
+
+void replay_dump_destroy ( char ** dump, int n_tuples ) {
+    while ( n_tuples > 0 )
+        free(dump[--n_tuples]);
+    free(dump);
+}
+
+/*
+ * Runs the replay test: n_threads threads doing ops outs and ins each on a
+ * skeleton with a table per thread, that logs them; then the log replayed
+ * on new tables must give exactly the tuples the tables had.
+ */
+void stress_replay ( int n_threads, int ops ) {
+    char log_path[] = REPLAY_ADDRESS "_LOG.txt";
+    remove(log_path);
+    table_shards = n_threads;
+    memory_budget = 0;
+    snapshot_every = 0;
+    
+    if ( table_skel_init_with(5, SERVER_RESPONSE_MODE, NO, YES, REPLAY_ADDRESS) == FAILED ) {
+        stress_error("table_skel_init_with falhou");
+        return;
+    }
+    pthread_t threads[MAX_THREADS];
+    struct stress_worker_t workers[MAX_THREADS];
+    int i;
+    for ( i = 0; i < n_threads; i++ ) {
+        workers[i].ops = ops;
+        workers[i].seed = i * 13 + 5;
+        pthread_create(&threads[i], NULL, replay_worker, &workers[i]);
+    }
+    for ( i = 0; i < n_threads; i++ )
+        pthread_join(threads[i], NULL);
+    
+    int n_live = 0;
+    char ** live = replay_dump(&n_live);
+    int n_records = table_skel_write_operations();
+    table_skel_destroy();
+    
+    //the log replayed, as a server restarting does
+    int n_replayed = 0;
+    char ** replayed = NULL;
+    if ( table_skel_init_with(5, SERVER_RESPONSE_MODE, YES, NO, REPLAY_ADDRESS) == FAILED ) {
+        stress_error("table_skel_init_with (replay) falhou");
+    }
+    else {
+        replayed = replay_dump(&n_replayed);
+        table_skel_destroy();
+    }
+    
+    if ( replayed != NULL && n_replayed != n_live )
+        stress_error("o log reposto tem outro número de tuplos");
+    for ( i = 0; replayed != NULL && i < n_live && i < n_replayed; i++ ) {
+        if ( strcmp(live[i], replayed[i]) != 0 ) {
+            stress_error("o log reposto tem outros tuplos");
+            break;
+        }
+    }
+    printf("  replay do log: %d escritas em %d tabelas | %d tuplos (%d depois do replay)\n",
+           n_records, n_threads, n_live, n_replayed);
+    
+    replay_dump_destroy(live, n_live);
+    replay_dump_destroy(replayed, n_replayed);
+    remove(log_path);
+}
+
+/*
+ * Checks that a message as full as the server sends them fits in MAX_MSG with
+ * a request id and comes back the same: a CT_TUPLES with every tuple that
+ * fits and the biggest tuple alone (a CT_TUPLE), whose one byte more is refused.
+ */
+void stress_frames () {
+    struct tuples_t * tuples = tuples_create(TUPLES_MAX_PER_MESSAGE);
+    char key[16];
+    int n_tuples = 0;
+    int fits = YES;
+    while ( fits ) {
+        sprintf(key, "SD-%d", n_tuples);
+        struct tuple_t * tuple = stress_tuple(key, "par", "payload");
+        fits = tuples_add_fitting(tuples, tuple);
+        n_tuples += fits;
+        if ( !fits )
+            tuple_destroy(tuple);
+    }
+    
+    //the payload of the biggest tuple: one element of TUPLES_MAX_BYTES bytes serialized
+    int payload_size = TUPLES_MAX_BYTES - TUPLE_DIMENSION_SIZE - TUPLE_ELEMENTSIZE_SIZE;
+    char * payload = (char *) malloc(payload_size + 2);
+    memset(payload, 'x', payload_size);
+    payload[payload_size] = '\0';
+    struct tuples_t * biggest = tuples_create(1);
+    tuples_add_fitting(biggest, tuple_create2(1, &payload));
+    
+    struct message_t * messages[2] = { message_of_tuples(OC_COPY_ALL+1, tuples), message_of_tuples(OC_COPY_ALL+1, biggest) };
+    int expected_ctypes[2] = { CT_TUPLES, CT_TUPLE };
+    int i;
+    for ( i = 0; i < 2; i++ ) {
+        if ( messages[i] == NULL || messages[i]->c_type != expected_ctypes[i] ) {
+            stress_error("message_of_tuples não fez a mensagem esperada");
+            continue;
+        }
+        messages[i]->request_id = 7;
+        char * buffer = NULL;
+        int size = message_to_buffer(messages[i], &buffer);
+        struct message_t * received = size > 0 && size <= MAX_MSG ? buffer_to_message(buffer, size) : NULL;
+        if ( size <= 0 || size > MAX_MSG )
+            stress_error("uma mensagem cheia com request id não cabe em MAX_MSG");
+        else if ( received == NULL || received->request_id != 7 || received->c_type != expected_ctypes[i]
+                 || (i == 0 && received->content.tuples->n_tuples != n_tuples) )
+            stress_error("uma mensagem cheia com request id não voltou igual");
+        free_message(received);
+        free(buffer);
+        free_message(messages[i]);
+    }
+    
+    //one byte more and the tuple could not go back with a request id, so it is not taken
+    payload[payload_size] = 'x';
+    payload[payload_size+1] = '\0';
+    struct message_t * too_big = message_create_with(OC_OUT, CT_TUPLE, tuple_create2(1, &payload));
+    char * buffer = NULL;
+    int size = message_to_buffer(too_big, &buffer);
+    struct message_t * received = size > 0 && size <= MAX_MSG ? buffer_to_message(buffer, size) : NULL;
+    if ( size <= 0 || size > MAX_MSG || received != NULL )
+        stress_error("um tuplo que não cabe numa resposta com request id foi aceite");
+    free_message(received);
+    free(buffer);
+    free_message(too_big);
+    free(payload);
+    
+    printf("  mensagens cheias: %d tuplos numa CT_TUPLES, um de %d bytes numa CT_TUPLE\n", n_tuples, TUPLES_MAX_BYTES);
+}
+
+int main ( int argc, char *argv[] ) {
+    int n_threads = argc > 1 ? atoi(argv[1]) : DEFAULT_THREADS;
+    int ops = argc > 2 ? atoi(argv[2]) : DEFAULT_OPS;
+    long long budget = argc > 3 ? atoll(argv[3]) : 0;
+    if ( n_threads < 1 || n_threads > MAX_THREADS || budget < 0 ) {
+        printf("Uso: %s [n_threads (1 a %d)] [ops_per_thread] [memory_budget_bytes]\n", argv[0], MAX_THREADS);
+        return 1;
+    }
+    
+    printf("Stress do módulo table: %d threads, %d operações cada, orçamento de %lld bytes\n", n_threads, ops, budget);
+    
+    //as on the server, the parities are interned
+    intern_enable(YES);
+    table = table_create(5);
+    table_index_field(table, 1);
+    if ( budget > 0 && table_set_memory_budget(table, budget, "SD15_STRESS_SPILL.bin") == FAILED ) {
+        printf("Não foi possível criar o ficheiro do spill\n");
+        return 1;
+    }
+    
+    pthread_t threads[MAX_THREADS];
+    struct stress_worker_t workers[MAX_THREADS];
+    int i;
+    for ( i = 0; i < n_threads; i++ ) {
+        workers[i].ops = ops;
+        workers[i].seed = i * 7 + 1;
+        pthread_create(&threads[i], NULL, stress_worker, &workers[i]);
+    }
+    for ( i = 0; i < n_threads; i++ )
+        pthread_join(threads[i], NULL);
+    
+    //with every thread stopped the table must hold exactly what was put and not taken
+    int expected = (int) (n_put - n_taken - n_handed - n_expired);
+    struct tuple_t * all = stress_tuple(NULL, NULL, NULL);
+    epoch_enter();
+    struct list_t * scanned = table_get(table, all, KEEP_AT_ORIGIN, 0);
+    
+    if ( table_size(table) != expected )
+        stress_error("table_size diferente de puts - ins");
+    if ( list_size(scanned) != expected )
+        stress_error("a tabela tem outro número de tuplos");
+    if ( list_size(table->time_index) + spill_size(table->spill) != expected )
+        stress_error("o índice temporal tem outro número de tuplos");
+    int n_parts;
+    if ( stress_walk(all, GET_BY_TUPLE_MATCH, -1, &n_parts) != expected )
+        stress_error("o walk às partes tem outro número de tuplos");
+    if ( stress_cursor(all, GET_BY_TUPLE_MATCH) != expected )
+        stress_error("o cursor sem locks tem outro número de tuplos");
+    
+    printf("  puts %lld | ins %lld (%lld à espera) | expirados %lld | tamanho %d (esperado %d, %d em disco, %d partes de walk) | %d slots | %llu por libertar\n",
+           n_put, n_taken + n_handed, n_handed, n_expired, table_size(table), expected, spill_size(table->spill),
+           n_parts, table_slots(table), epoch_pending());
+    
+    list_destroy(scanned);
+    epoch_exit();
+    tuple_destroy(all);
+    table_destroy(table);
+    
+    //the same kind of traffic through the skeleton, logged, and the log replayed
+    stress_replay(n_threads, ops);
+    
+    //and the biggest messages the skeleton makes, with a request id
+    stress_frames();
+    
+    if ( n_errors > 0 ) {
+        printf("%lld inconsistências\n", n_errors);
+        return 1;
+    }
+    printf("Sem inconsistências\n");
+    return 0;
+}
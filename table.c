@@ -8,6 +8,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "table.h"
 #include "table-private.h"
 #include "list.h"
@@ -15,20 +16,79 @@
 #include "tuple.h"
 #include "tuple-private.h"
 #include "general_utils.h"
+#include "field_index.h"
+#include "epoch.h"
+#include "timing_wheel.h"
+#include <time.h>
 
 /* Função para criar/inicializar uma nova tabela hash, com n
  * linhas(n = módulo da função hash)
  */
 struct table_t *table_create(int n) {
+    if ( n <= 0 )
+        return NULL;
+    
     table_t * newTable = ( table_t* ) malloc ( sizeof ( table_t ) );
     
     if ( newTable != NULL ) {
-        //should I do this malloc and if yes should check if null?
-        newTable->bucket =(struct list_t**) malloc ( (sizeof (struct list_t*) * n) );
-        newTable->size = n;
+        newTable->size = 0;
+        newTable->initial_size = n;
+        newTable->level = 0;
+        newTable->split = 0;
+        newTable->n_entries = 0;
+        newTable->n_segments = 0;
+        newTable->bucket = NULL;
+        
+        int position;
+        for ( position = 0; position < TABLE_MAX_INDEXES; position++ )
+            newTable->indexes[position] = NULL;
+        
+        newTable->key_index = NULL;
+        newTable->time_index = list_create();
+        if ( newTable->time_index == NULL ) {
+            free(newTable);
+            return NULL;
+        }
+        
+        pthread_rwlock_init(&(newTable->lock), NULL);
+        newTable->version = 0;
+        pthread_rwlock_init(&(newTable->indexes_lock), NULL);
+        newTable->indexes_version = 0;
+        for ( position = 0; position < TABLE_LOCK_STRIPES; position++ ) {
+            pthread_rwlock_init(&(newTable->stripes[position]), NULL);
+            newTable->versions[position] = 0;
+        }
+        
+        for ( position = 0; position < TABLE_WAITER_SLOTS; position++ )
+            newTable->waiters[position] = NULL;
+        newTable->wildcard_waiters = NULL;
+        newTable->n_waiters = 0;
+        newTable->waiters_sequence = 0;
+        pthread_rwlock_init(&(newTable->waiters_lock), NULL);
+        
+        //the leases are on the wall clock: they are absolute and the same on every replica
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        newTable->leases = timing_wheel_create(now.tv_sec * 1000LL + now.tv_nsec / 1000000);
+        if ( newTable->leases == NULL ) {
+            list_destroy(newTable->time_index);
+            free(newTable);
+            return NULL;
+        }
+        
+        newTable->memory_used = 0;
+        newTable->memory_budget = 0;
+        newTable->spill = NULL;
+        newTable->spills = 0;
+        
+        //creates the n initial slots
         int i = 0;
-        for (i = 0; i < n; i++)
-            newTable->bucket[i] = list_create();
+        for (i = 0; i < n; i++) {
+            if ( table_add_slot(newTable) == FAILED ) {
+                table_destroy(newTable);
+                return NULL;
+            }
+        }
     }
     
     return newTable;
@@ -42,11 +102,29 @@ void table_destroy(struct table_t *table) {
     
     int i;
     for (i = 0; i < table->size; i++ ) {
-        if ( table->bucket[i] != NULL )
-            list_destroy(table->bucket[i]);
+        if ( table_slot_list(table, i) != NULL )
+            list_destroy(table_slot_list(table, i));
     }
     
+    for (i = 0; i < table->n_segments; i++ ) {
+        free(table->bucket[i]);
+    }
+    for (i = 0; i < TABLE_MAX_INDEXES; i++ ) {
+        field_index_destroy(table->indexes[i]);
+    }
+    list_destroy(table->time_index);
+    list_destroy(table->key_index);
     free(table->bucket);
+    
+    pthread_rwlock_destroy(&(table->lock));
+    pthread_rwlock_destroy(&(table->indexes_lock));
+    for (i = 0; i < TABLE_LOCK_STRIPES; i++ )
+        pthread_rwlock_destroy(&(table->stripes[i]));
+    //the waiters still registered belong to who registered them
+    pthread_rwlock_destroy(&(table->waiters_lock));
+    //the timers of the entries still on the table go with them
+    timing_wheel_destroy(table->leases);
+    spill_destroy(table->spill);
     free(table);
 }
 
@@ -55,19 +133,288 @@ void table_destroy(struct table_t *table) {
  * Devolve 0 (ok) ou -1 (out of memory, outros erros)
  */
 int table_put_entry(struct table_t *table, struct entry_t *entry) {
-    int slot_index = table_slot_index(table, entry_key(entry));
-    if ( slot_index == -1)
+    //a tuple with operators is a template: it is never put
+    if ( table == NULL || entry == NULL || tuple_has_operators(entry_value(entry)) )
+        return FAILED;
+    
+    //with no one waiting the puts only share the waiters lock
+    pthread_rwlock_rdlock(&(table->waiters_lock));
+    if ( table->n_waiters == 0 ) {
+        int taskSuccess = table_insert_entry(table, entry);
+        pthread_rwlock_unlock(&(table->waiters_lock));
+        return taskSuccess;
+    }
+    pthread_rwlock_unlock(&(table->waiters_lock));
+    
+    //an IN waiter takes the entry before it ever is on the table
+    pthread_rwlock_wrlock(&(table->waiters_lock));
+    int taskSuccess = table_hand_to_waiters(table, entry) ? SUCCEEDED : table_insert_entry(table, entry);
+    pthread_rwlock_unlock(&(table->waiters_lock));
+    
+    return taskSuccess;
+}
+
+int table_insert_entry ( struct table_t * table, struct entry_t * entry ) {
+    pthread_rwlock_rdlock(&(table->lock));
+    
+    int slot_index = table_slot_index(table, entry_key(entry), entry_key_length(entry));
+    if ( slot_index == -1) {
+        pthread_rwlock_unlock(&(table->lock));
         return -1;
+    }
     
     int taskSuccess = -1;
     
-    struct list_t * target_list = table_slot_list(table, slot_index);
+    //only the slot of the key is write locked
+    table_lock_slots(table, slot_index, YES);
+    table_lock_indexes(table, YES);
+    taskSuccess = table_slot_add(table, slot_index, entry);
+    table_unlock_indexes(table, YES);
+    table_unlock_slots(table, slot_index, YES);
+    int mustGrow = taskSuccess == SUCCEEDED && table_needs_to_grow(table);
+    
+    //above the memory budget the coldest entries go to disk
+    if ( taskSuccess == SUCCEEDED && table_over_budget(table) )
+        table_spill(table);
+    pthread_rwlock_unlock(&(table->lock));
+    
+    //the table grows as it gets fuller (splitting moves entries between slots, so it has the table alone)
+    if ( mustGrow ) {
+        pthread_rwlock_wrlock(&(table->lock));
+        table_grow(table);
+        pthread_rwlock_unlock(&(table->lock));
+    }
+
+    return taskSuccess;
+}
+
+int table_slot_add ( struct table_t * table, int slot_index, struct entry_t * entry ) {
+    int taskSuccess = list_add(table_slot_list(table, slot_index), entry);
+    
+    if ( taskSuccess == SUCCEEDED ) {
+        __atomic_add_fetch(&(table->n_entries), 1, __ATOMIC_RELAXED);
+        table_index_entry(table, entry);
+        table_time_index_add(table, entry);
+        table_key_index_add(table, entry);
+        table_lease_entry(table, entry);
+        __atomic_add_fetch(&(table->memory_used), entry_size_bytes(entry), __ATOMIC_RELAXED);
+    }
+    return taskSuccess;
+}
+
+int table_put_batch ( struct table_t * table, struct entry_t ** entries, int n_entries ) {
+    //the batch goes in whole or not at all
+    if ( table == NULL || entries == NULL || n_entries <= 0 || !table_batch_valid(entries, n_entries) )
+        return FAILED;
+    int i;
+    
+    //with no one waiting the puts only share the waiters lock
+    pthread_rwlock_rdlock(&(table->waiters_lock));
+    if ( table->n_waiters == 0 ) {
+        int taskSuccess = table_insert_batch(table, entries, n_entries);
+        pthread_rwlock_unlock(&(table->waiters_lock));
+        return taskSuccess;
+    }
+    pthread_rwlock_unlock(&(table->waiters_lock));
+    
+    //the entries an IN waiter takes are never on the table, the others go in together
+    struct entry_t ** not_taken = (struct entry_t **) malloc(n_entries * sizeof(struct entry_t *));
+    if ( not_taken == NULL )
+        return FAILED;
+    
+    pthread_rwlock_wrlock(&(table->waiters_lock));
+    int n_not_taken = 0;
+    for ( i = 0; i < n_entries; i++ ) {
+        if ( !table_hand_to_waiters(table, entries[i]) )
+            not_taken[n_not_taken++] = entries[i];
+    }
+    int taskSuccess = n_not_taken > 0 ? table_insert_batch(table, not_taken, n_not_taken) : SUCCEEDED;
+    pthread_rwlock_unlock(&(table->waiters_lock));
+    
+    free(not_taken);
+    return taskSuccess;
+}
 
-    taskSuccess = list_add(target_list, entry);
+int table_batch_valid ( struct entry_t ** entries, int n_entries ) {
+    int i;
+    for ( i = 0; i < n_entries; i++ ) {
+        if ( entries[i] == NULL || entry_key(entries[i]) == NULL || entry_key_length(entries[i]) <= 0
+            || tuple_has_operators(entry_value(entries[i])) )
+            return NO;
+    }
+    return YES;
+}
 
+int table_insert_batch ( struct table_t * table, struct entry_t ** entries, int n_entries ) {
+    int * slots = (int *) malloc(n_entries * sizeof(int));
+    if ( slots == NULL )
+        return FAILED;
+    int touched[TABLE_LOCK_STRIPES];
+    
+    pthread_rwlock_rdlock(&(table->lock));
+    
+    //the table does not grow while its lock is held, so the slots stay the same
+    memset(touched, NO, sizeof(touched));
+    int taskSuccess = SUCCEEDED;
+    int i;
+    for ( i = 0; i < n_entries; i++ ) {
+        slots[i] = table_slot_index(table, entry_key(entries[i]), entry_key_length(entries[i]));
+        if ( slots[i] != -1 )
+            touched[slots[i] % TABLE_LOCK_STRIPES] = YES;
+        else
+            taskSuccess = FAILED;
+    }
+    
+    //each stripe of the batch locked once, in ascending order as table_lock_slots does,
+    //and the entries added in the order they came (so the timestamp index is only appended to)
+    int stripe;
+    for ( stripe = 0; stripe < TABLE_LOCK_STRIPES; stripe++ ) {
+        if ( touched[stripe] )
+            table_lock_slots(table, stripe, YES);
+    }
+    table_lock_indexes(table, YES);
+    for ( i = 0; i < n_entries; i++ ) {
+        if ( slots[i] != -1 && table_slot_add(table, slots[i], entries[i]) == FAILED )
+            taskSuccess = FAILED;
+    }
+    table_unlock_indexes(table, YES);
+    for ( stripe = TABLE_LOCK_STRIPES - 1; stripe >= 0; stripe-- ) {
+        if ( touched[stripe] )
+            table_unlock_slots(table, stripe, YES);
+    }
+    
+    int mustGrow = table_needs_to_grow(table);
+    //above the memory budget the coldest entries go to disk
+    if ( table_over_budget(table) )
+        table_spill(table);
+    pthread_rwlock_unlock(&(table->lock));
+    free(slots);
+    
+    //one split per entry, as if they had been put one by one
+    if ( mustGrow ) {
+        pthread_rwlock_wrlock(&(table->lock));
+        int n_splits = 0;
+        while ( n_splits++ < n_entries && table_needs_to_grow(table) && table_split_slot(table) == SUCCEEDED )
+            ;
+        pthread_rwlock_unlock(&(table->lock));
+    }
+    
     return taskSuccess;
 }
 
+/*
+ * Returns the list of the waiters waiting for key (NULL: the ones without key).
+ */
+struct table_waiter_t ** table_waiters_of ( struct table_t * table, char * key, int key_length ) {
+    return key == NULL ? &(table->wildcard_waiters)
+        : &(table->waiters[table_hashcode(table, key, key_length) % TABLE_WAITER_SLOTS]);
+}
+
+int table_get_or_wait ( struct table_t * table, struct table_waiter_t * waiter, struct list_t ** matches ) {
+    if ( table == NULL || waiter == NULL || waiter->tup_template == NULL || matches == NULL )
+        return FAILED;
+    
+    //no put is halfway while the table is searched and the waiter registered
+    pthread_rwlock_wrlock(&(table->waiters_lock));
+    
+    *matches = table_get(table, waiter->tup_template, waiter->keep_tuples, 1);
+    if ( list_isEmpty(*matches) ) {
+        list_destroy(*matches);
+        *matches = NULL;
+        
+        entry_template_signature(waiter->tup_template, &(waiter->signature));
+        waiter->sequence = table->waiters_sequence++;
+        waiter->entry = NULL;
+        waiter->ready = NO;
+        waiter->next = NULL;
+        
+        //at the end of its list, so each list is in registration order
+        struct table_waiter_t ** link = table_waiters_of(table, tuple_key(waiter->tup_template), tuple_key_length(waiter->tup_template));
+        while ( *link != NULL )
+            link = &((*link)->next);
+        *link = waiter;
+        table->n_waiters++;
+    }
+    
+    pthread_rwlock_unlock(&(table->waiters_lock));
+    return SUCCEEDED;
+}
+
+/*
+ * Unlinks waiter from its list, setting it ready with entry.
+ */
+void table_waiter_done ( struct table_t * table, struct table_waiter_t ** link, struct entry_t * entry ) {
+    struct table_waiter_t * waiter = *link;
+    *link = waiter->next;
+    table->n_waiters--;
+    
+    waiter->next = NULL;
+    waiter->entry = entry;
+    //the owner may be checking it on another thread
+    __atomic_store_n(&(waiter->ready), YES, __ATOMIC_RELEASE);
+}
+
+int table_cancel_wait ( struct table_t * table, struct table_waiter_t * waiter ) {
+    if ( table == NULL || waiter == NULL )
+        return NO;
+    
+    pthread_rwlock_wrlock(&(table->waiters_lock));
+    
+    int wasWaiting = !waiter->ready;
+    if ( wasWaiting ) {
+        struct table_waiter_t ** link = table_waiters_of(table, tuple_key(waiter->tup_template), tuple_key_length(waiter->tup_template));
+        while ( *link != waiter )
+            link = &((*link)->next);
+        table_waiter_done(table, link, NULL);
+    }
+    
+    pthread_rwlock_unlock(&(table->waiters_lock));
+    return wasWaiting;
+}
+
+/*
+ * Checks if the entry is what waiter waits for. YES or NO
+ */
+int table_waiter_matches ( struct table_waiter_t * waiter, struct entry_t * entry ) {
+    return entry_may_match(entry, &(waiter->signature))
+        && tuple_matches_template(entry_value(entry), waiter->tup_template);
+}
+
+int table_hand_to_waiters ( struct table_t * table, struct entry_t * entry ) {
+    //the waiters for the key of the entry and the ones for any key
+    struct table_waiter_t ** lists[2] = { table_waiters_of(table, entry_key(entry), entry_key_length(entry)), table_waiters_of(table, NULL, -1) };
+    
+    //every COPY waiter gets its copy, and the oldest IN waiter is found
+    struct table_waiter_t ** oldestTaker = NULL;
+    int i;
+    for ( i = 0; i < 2; i++ ) {
+        struct table_waiter_t ** link = lists[i];
+        while ( *link != NULL ) {
+            struct table_waiter_t * waiter = *link;
+            if ( !table_waiter_matches(waiter, entry) ) {
+                link = &(waiter->next);
+            }
+            else if ( waiter->keep_tuples == KEEP_AT_ORIGIN ) {
+                table_waiter_done(table, link, entry_dup(entry));
+            }
+            else {
+                if ( oldestTaker == NULL || waiter->sequence < (*oldestTaker)->sequence )
+                    oldestTaker = link;
+                link = &(waiter->next);
+            }
+        }
+    }
+    
+    if ( oldestTaker == NULL )
+        return NO;
+    
+    //the put still holds its write, so the take is seen as part of it
+    if ( (*oldestTaker)->taken != NULL )
+        (*oldestTaker)->taken(*oldestTaker, entry);
+    table_waiter_done(table, oldestTaker, entry);
+    return YES;
+}
+
 /* Função para adicionar um tuplo na tabela.
  * Lembrar que num espaço de tuplos podem existir tuplos iguais.
  * Devolve 0 (ok) ou -1 (out of memory, outros erros)
@@ -114,32 +461,74 @@ struct list_t *table_get_by(struct table_t *table, void * search_element, int ge
         return NULL;
     }
     
+    //the reads of one key do not lock its slot
+    if ( get_criterion == GET_BY_TUPLE_MATCH && keep_tuples == KEEP_AT_ORIGIN && tuple_key(search_element) != NULL )
+        return table_copy_key(table, search_element, one_or_all);
+    
+    pthread_rwlock_rdlock(&(table->lock));
+    
     //gets the slot index where to search or -1 (must search on every slots) (if get_by_time is always -1)
     int slotIndex = get_criterion == GET_BY_TUPLE_MATCH ?
-        table_slot_index(table, tuple_key(search_element)) : -1 ;
+        table_slot_index(table, tuple_key(search_element), tuple_key_length(search_element)) : -1 ;
+    
+    //a get on one key locks its slot only. Any other locks every slot, unless it is
+    //a read by time (the timestamp index has all it needs), and the indexes.
+    int writing = keep_tuples != KEEP_AT_ORIGIN;
+    int lockedSlots = slotIndex != -1 ? slotIndex
+        : get_criterion == GET_BY_TIME && !writing ? TABLE_NO_SLOTS : TABLE_ALL_SLOTS;
+    int lockedIndexes = slotIndex == -1 || writing;
+    table_lock_slots(table, lockedSlots, writing);
+    if ( lockedIndexes )
+        table_lock_indexes(table, writing);
+    
+    //the entries that leave the table must be unindexed before being destroyed,
+    //so the slots only take them out and the deletion happens here at the end.
+    int whatToDoWithTheNodes = keep_tuples == JUST_DELETE_NODES ? DONT_KEEP_AT_ORIGIN : keep_tuples;
+    
+    //with a prefix or a range on the key, the key index has its keys together
+    struct tuple_operator_t key_operator;
+    int byKeys = get_criterion == GET_BY_TUPLE_MATCH && slotIndex == -1 && table_key_operator(table, search_element, &key_operator);
+    
+    //with no key, the most selective field index (if any) replaces the full scan
+    struct field_index_t * field_index = get_criterion == GET_BY_TUPLE_MATCH && slotIndex == -1 && !byKeys ?
+        table_best_index(table, search_element) : NULL;
     
     //the list with all matching nodes that will then be returned
     struct list_t * allMatchingNodes = NULL;
     
-    if ( slotIndex == -1) {
+    if ( byKeys ) {
+        allMatchingNodes = table_get_by_keys(table, search_element, &key_operator, whatToDoWithTheNodes, one_or_all);
+    }
+    else if ( field_index != NULL ) {
+        allMatchingNodes = table_get_by_index(table, search_element, field_index, whatToDoWithTheNodes, one_or_all);
+    }
+    else if ( get_criterion == GET_BY_TIME ) {
+        allMatchingNodes = table_get_by_time(table, *((long long *) search_element), whatToDoWithTheNodes, one_or_all);
+    }
+    else if ( slotIndex == -1) {
         //must have it own space where to add all the nodes found on every slots of the table.
-        allMatchingNodes = list_create();
+        allMatchingNodes = list_create_temporary();
         //iterates over all slots of the table.
         int slotsToCheck = table_slots(table);
         int index =0;
         while ( slotsToCheck-- > 0 ) {
             //gets the list to search from
             struct list_t * list_to_search = table_slot_list(table, index);
+            int size_before = list_size(list_to_search);
             
             struct list_t * this_slot_matching_nodes = get_criterion == GET_BY_TUPLE_MATCH ?
-                        list_matching_nodes(list_to_search, (struct tuple_t *) search_element, keep_tuples, one_or_all)
-                        : list_entries_newer_than(list_to_search,  *((long long *) search_element), keep_tuples, one_or_all);
+                        list_matching_nodes(list_to_search, (struct tuple_t *) search_element, whatToDoWithTheNodes, one_or_all)
+                        : list_entries_newer_than(list_to_search,  *((long long *) search_element), whatToDoWithTheNodes, one_or_all);
             
             long long reference_timestamp = get_criterion == GET_BY_TIME ? *((long long *) search_element) : 0;
             //moves all this_slot_matching_nodes to the matching_nodes list using list_add criterium
             // and not keeping the matching nodes at origin once this_slot_matching_nodes is temporary.
             int move_criterion = get_criterion == GET_BY_TIME ? MOVE_WITH_CRITERION_TIME : MOVE_WITH_CRITERION_KEY;
             list_move_nodes (this_slot_matching_nodes , allMatchingNodes , move_criterion, reference_timestamp, DONT_KEEP_AT_ORIGIN );
+            //this slot list is now empty
+            list_destroy(this_slot_matching_nodes);
+            //the entries that left the slot also left the table
+            __atomic_sub_fetch(&(table->n_entries), size_before - list_size(list_to_search), __ATOMIC_RELAXED);
             
             //if its just to get one and list is not empty it found one so it stops
             if ( one_or_all == 1 && !list_isEmpty(allMatchingNodes) ) {
@@ -151,14 +540,30 @@ struct list_t *table_get_by(struct table_t *table, void * search_element, int ge
     else {
         //this is the only slot list to search from
         struct list_t * list_to_search = table_slot_list(table, slotIndex);
+        int size_before = list_size(list_to_search);
         
         //once this slot was the only to be searched from,
         //allMatchingNodes is this table_slot_list matching nodes.
         allMatchingNodes = get_criterion == GET_BY_TUPLE_MATCH ?
-            list_matching_nodes(list_to_search, (struct tuple_t *) search_element, keep_tuples, one_or_all)
-            : list_entries_newer_than(list_to_search,  *((long long *) search_element), keep_tuples, one_or_all);
+            list_matching_nodes(list_to_search, (struct tuple_t *) search_element, whatToDoWithTheNodes, one_or_all)
+            : list_entries_newer_than(list_to_search,  *((long long *) search_element), whatToDoWithTheNodes, one_or_all);
+        //the entries that left the slot also left the table
+        __atomic_sub_fetch(&(table->n_entries), size_before - list_size(list_to_search), __ATOMIC_RELAXED);
     }
-
+    
+    //the entries taken out of the table are unindexed (and destroyed if it was just to delete)
+    int foundInMemory = !list_isEmpty(allMatchingNodes);
+    if ( keep_tuples != KEEP_AT_ORIGIN )
+        table_unlink_entries(table, allMatchingNodes, keep_tuples);
+    
+    //then the entries on disk, unless it was just to get one and it is already found
+    if ( table->spill != NULL && !(one_or_all && foundInMemory) )
+        spill_get(table->spill, search_element, get_criterion, keep_tuples, one_or_all, allMatchingNodes);
+    
+    if ( lockedIndexes )
+        table_unlock_indexes(table, writing);
+    table_unlock_slots(table, lockedSlots, writing);
+    pthread_rwlock_unlock(&(table->lock));
     
     return allMatchingNodes;
 }
@@ -166,129 +571,1439 @@ struct list_t *table_get_by(struct table_t *table, void * search_element, int ge
 
 
 
-int table_get_array(struct table_t *table, struct tuple_t *tup_template, 
-    int whatToDOWithTheNodes, int one_or_all, struct tuple_t *** matching_tuples)
-{
+/*
+ * Returns the index of the field position, of tup_template, that is concrete and
+ * has the fewest candidate entries, or NULL if no concrete position is indexed.
+ */
+struct field_index_t * table_best_index ( struct table_t * table, struct tuple_t * tup_template ) {
+    struct field_index_t * best_index = NULL;
+    int best_count = 0;
+    
+    int position;
+    for ( position = 0; position < TABLE_MAX_INDEXES && position < tuple_size(tup_template); position++ ) {
+        //(the reads without locks pick one too)
+        struct field_index_t * field_index = __atomic_load_n(&(table->indexes[position]), __ATOMIC_ACQUIRE);
+        if ( field_index != NULL && tuple_element(tup_template, position) != NULL ) {
+            int count = field_index_count(field_index, tuple_element(tup_template, position),
+                                          tuple_element_length(tup_template, position));
+            if ( best_index == NULL || count < best_count ) {
+                best_index = field_index;
+                best_count = count;
+            }
+        }
+    }
+    return best_index;
+}
 
-    //gets the matching nodes on a list_t
-    struct list_t * matching_nodes = table_get(table, tup_template, whatToDOWithTheNodes, one_or_all);
-    //gets the number of matching nodes
-    int matching_tuples_num = list_size(matching_nodes);
+/*
+ * Returns the node of the slot list that holds entry, or NULL if it is not on the table.
+ */
+node_t * table_slot_node ( struct table_t * table, struct entry_t * entry ) {
+    struct list_t * slot = table_slot_list(table, table_slot_index(table, entry_key(entry), entry_key_length(entry)));
+    
+    //the entry is among the nodes with its key
+    node_t * lastBefore = list_seek_key(slot, entry_key(entry), entry_key_length(entry), NO, NULL);
+    if ( lastBefore == list_tail(slot) && lastBefore != NULL )
+        return NULL;
+    
+    node_t * currentNode = lastBefore == NULL ? list_head(slot) : lastBefore->next;
+    int nodesToCheck = list_size(slot);
+    while ( nodesToCheck-- > 0 ) {
+        if ( node_entry(currentNode) == entry )
+            return currentNode;
+        currentNode = currentNode->next;
+    }
+    return NULL;
+}
 
-    //since matching_nodes_num > 0 creates the array of tuples
-    *matching_tuples = tuple_create_array(matching_tuples_num);
+/*
+ * Takes the node of the entry out of its slot, and so out of the table
+ * (the indexes are left to table_unlink_entry), and returns a new node
+ * with the entry: the slot node may still be under a reader of the slot
+ * (see table_read_slot), so it is retired instead of being relinked.
+ */
+node_t * table_take_slot_node ( struct table_t * table, struct entry_t * entry ) {
+    node_t * slotNode = table_slot_node(table, entry);
+    list_remove_node(table_slot_list(table, table_slot_index(table, entry_key(entry), entry_key_length(entry))), slotNode, NOT_DESTROY);
+    __atomic_sub_fetch(&(table->n_entries), 1, __ATOMIC_RELAXED);
+    
+    node_t * takenNode = node_create(NULL, NULL, entry);
+    node_destroy(slotNode);
+    return takenNode;
+}
 
-    int i =0;
-    node_t * currentNode = list_head(matching_nodes);
-    for (i = 0; i < matching_tuples_num; i++ ) {
-        //saves the tuple
-        (*matching_tuples)[i] = entry_value(node_entry(currentNode));
-        //moves to list next node
-        currentNode = currentNode->next;  
+/*
+ * Same as table_get_by (by tuple match) but only checks the entries that the
+ * field_index says may match tup_template, instead of every slot of the table.
+ */
+struct list_t * table_get_by_index ( struct table_t * table, struct tuple_t * tup_template,
+                                    struct field_index_t * field_index, int whatToDoWithTheNodes, int one_or_all )
+{
+    struct list_t * matchingNodes = list_create_temporary();
+    
+    //the entries with the template value and the ones with NULL (that match any value)
+    char * value = tuple_element(tup_template, field_index->position);
+    int value_length = tuple_element_length(tup_template, field_index->position);
+    struct list_t * candidates[2] = { field_index_entries(field_index, value, value_length), field_index_entries(field_index, NULL, -1) };
+    
+    struct entry_signature_t signature;
+    entry_template_signature(tup_template, &signature);
+    
+    int stillSearching = YES;
+    int i;
+    for ( i = 0; i < 2 && stillSearching; i++ ) {
+        node_t * posting = list_head(candidates[i]);
+        int nodesToCheck = list_size(candidates[i]);
+        
+        while ( nodesToCheck-- > 0 && stillSearching ) {
+            struct entry_t * entry = node_entry(posting);
+            unsigned long long entry_signature = posting->signature;
+            posting = posting->next;
+            
+            if ( entry_signature_may_match(entry_signature, &signature) && tuple_matches_template(entry_value(entry), tup_template) ) {
+                if ( whatToDoWithTheNodes == KEEP_AT_ORIGIN ) {
+                    list_add(matchingNodes, entry);
+                }
+                else {
+                    list_add_node(matchingNodes, table_take_slot_node(table, entry), ADD_WITH_CRITERION_KEY, 0);
+                }
+                stillSearching = !one_or_all;
+            }
+        }
     }
+    
+    return matchingNodes;
+}
+
+/*
+ * Returns the first node of the key index that may have a key of the prefix
+ * or the range key_operator, or NULL if there is none: the keys are in
+ * descending order, so it is the one after the last key above them.
+ */
+node_t * table_first_key_node ( struct table_t * table, struct tuple_operator_t * key_operator ) {
+    node_t * lastBefore = key_operator->type == TUPLE_OP_PREFIX ?
+        list_seek_prefix(table->key_index, key_operator->low, key_operator->low_length)
+        : list_seek_key(table->key_index, key_operator->high, key_operator->high_length, NO, NULL);
+    
+    if ( lastBefore == NULL )
+        return list_head(table->key_index);
+    return lastBefore == list_tail(table->key_index) ? NULL : lastBefore->next;
+}
 
-    //in the end destroys the list to free memory
-    //tuple_array_destroy(matching_tuples, matching_tuples_num );
-    list_destroy(matching_nodes);
+/*
+ * Checks if the key of node, and so every key after it on the key index, is
+ * below the prefix or the range key_operator. YES or NO
+ */
+int table_keys_past ( struct tuple_operator_t * key_operator, node_t * node ) {
+    int key_length = entry_key_length(node_entry(node));
+    //a key with the prefix is, cut to its length, the same as the prefix
+    if ( key_operator->type == TUPLE_OP_PREFIX && key_length > key_operator->low_length )
+        key_length = key_operator->low_length;
+    return bytes_casecmp(node_key(node), key_length, key_operator->low, key_operator->low_length) < 0;
+}
 
-    //returns the array matching_tuples
-    return matching_tuples_num;
+int table_key_operator ( table_t * table, struct tuple_t * tup_template, struct tuple_operator_t * key_operator ) {
+    //a range of numbers is not in the order of the keys
+    return __atomic_load_n(&(table->key_index), __ATOMIC_ACQUIRE) != NULL
+        && tuple_element_operator(tup_template, 0, key_operator) != TUPLE_OP_NONE
+        && !(key_operator->type == TUPLE_OP_RANGE && key_operator->numeric);
 }
 
-void table_print( struct table_t * table )
+/*
+ * Same as table_get_by (by tuple match) but only checks the entries whose
+ * keys are on the prefix or the range key_operator of tup_template, walking
+ * them on the key index instead of every slot of the table.
+ */
+struct list_t * table_get_by_keys ( struct table_t * table, struct tuple_t * tup_template,
+                                   struct tuple_operator_t * key_operator, int whatToDoWithTheNodes, int one_or_all )
 {
-    if (table == NULL || table->size == 0 )
-        printf("Tabela vazia");
-    else {
-        int i = 0;
-        for ( i = 0; i < table->size;  i++) {
-            printf("Table > slot %d : \n", i );
-            list_print(table_slot_list(table, i));
-            printf("\n");
+    struct list_t * matchingNodes = list_create_temporary();
+    
+    struct entry_signature_t signature;
+    entry_template_signature(tup_template, &signature);
+    
+    node_t * keyNode = table_first_key_node(table, key_operator);
+    int stillSearching = YES;
+    while ( keyNode != NULL && stillSearching && !table_keys_past(key_operator, keyNode) ) {
+        struct entry_t * entry = node_entry(keyNode);
+        unsigned long long entry_signature = keyNode->signature;
+        //(the entries taken leave the key index only at the end, in table_unlink_entries)
+        keyNode = keyNode == list_tail(table->key_index) ? NULL : keyNode->next;
+        
+        if ( entry_signature_may_match(entry_signature, &signature) && tuple_matches_template(entry_value(entry), tup_template) ) {
+            if ( whatToDoWithTheNodes == KEEP_AT_ORIGIN ) {
+                list_add(matchingNodes, entry);
+            }
+            else {
+                list_add_node(matchingNodes, table_take_slot_node(table, entry), ADD_WITH_CRITERION_KEY, 0);
+            }
+            stillSearching = !one_or_all;
         }
     }
+    
+    return matchingNodes;
 }
 
-/* Função para remover um ou todos os tuplos da tabela que estejam
- * de acordo com o template tup_template, e libertar a memória
- * utilizada no armazenamento desse(s) tuplo(s).
- * O argumento one_or_all indica se a função deve remover um ou
- * todos os tuplos que estejam de acordo com o template.
- * Devolve: 0 (ok), -1 (nenhum tuplo encontrado; outros erros)
+/*
+ * Adds the entry to every field index of the table.
  */
-int table_del(struct table_t *table, struct tuple_t *tup_template, int one_or_all) {
-    //gets all the matching nodes at the table with tup_template, not keeping them at the origin slot.
-    struct list_t * allMatchingNodes = table_get(table, tup_template, JUST_DELETE_NODES, one_or_all);
-    
-    //since we choosed to JUST_DELETE_NODES on get, allMatchingNodes must be empty
-    return list_isEmpty(allMatchingNodes) ? SUCCEEDED : FAILED;
+void table_index_entry ( struct table_t * table, struct entry_t * entry ) {
+    int position;
+    for ( position = 0; position < TABLE_MAX_INDEXES; position++ ) {
+        if ( table->indexes[position] != NULL )
+            field_index_add(table->indexes[position], entry);
+    }
 }
 
-int table_slots ( struct table_t * table ) {
-    return table != NULL ? table->size : -1;
+/*
+ * Removes the entry, that is leaving the table, from every field index
+ * and from the timestamp and key indexes, and cancels its lease.
+ */
+void table_unlink_entry ( struct table_t * table, struct entry_t * entry ) {
+    int position;
+    for ( position = 0; position < TABLE_MAX_INDEXES; position++ ) {
+        if ( table->indexes[position] != NULL )
+            field_index_remove(table->indexes[position], entry);
+    }
+    
+    if ( entry->time_node != NULL ) {
+        list_remove_node(table->time_index, entry->time_node, NOT_DESTROY);
+        node_destroy(entry->time_node);
+        entry->time_node = NULL;
+    }
+    
+    if ( entry->key_node != NULL ) {
+        list_remove_node(table->key_index, entry->key_node, NOT_DESTROY);
+        node_destroy(entry->key_node);
+        entry->key_node = NULL;
+    }
+    
+    if ( entry->lease != NULL ) {
+        timing_wheel_cancel(table->leases, entry->lease);
+        free(entry->lease);
+        entry->lease = NULL;
+    }
+    
+    __atomic_sub_fetch(&(table->memory_used), entry_size_bytes(entry), __ATOMIC_RELAXED);
 }
 
-/* Devolve o número de elementos na tabela.
+/*
+ * Puts the timer of the entry on the table leases, if it expires.
+ * If there is no memory for it the entry never expires.
  */
-int table_size(struct table_t *table) {
+void table_lease_entry ( struct table_t * table, struct entry_t * entry ) {
+    if ( entry->expires <= 0 || entry->lease != NULL )
+        return;
     
-    if ( table == NULL || table->bucket ==  NULL)
-        return 0;
+    entry->lease = wheel_timer_create(entry->expires, entry);
+    timing_wheel_add(table->leases, entry->lease);
+}
+
+struct list_t * table_expire ( struct table_t * table, long long now_ms ) {
+    if ( table == NULL )
+        return NULL;
+    
+    struct list_t * expiredEntries = list_create_temporary();
+    if ( expiredEntries == NULL )
+        return NULL;
     
-    int totalNumberOfElement = 0;
-    int i =0;
+    pthread_rwlock_rdlock(&(table->lock));
     
-    for ( i = 0; i < table_slots(table); i++) {
-        totalNumberOfElement += list_size(table_slot_list(table, i));
+    //the timers that fired leave their entries: from now on the entries are taken like any other
+    table_lock_indexes(table, YES);
+    struct wheel_timer_t * expired = timing_wheel_advance(table->leases, now_ms);
+    struct wheel_timer_t * timer;
+    for ( timer = expired; timer != NULL; timer = timer->next )
+        ((struct entry_t *) timer->owner)->lease = NULL;
+    table_unlock_indexes(table, YES);
+    
+    while ( expired != NULL ) {
+        struct entry_t * entry = (struct entry_t *) expired->owner;
+        timer = expired;
+        expired = expired->next;
+        free(timer);
+        
+        //an IN may have taken it meanwhile (the epoch keeps it readable until then)
+        int slotIndex = table_slot_index(table, entry_key(entry), entry_key_length(entry));
+        table_lock_slots(table, slotIndex, YES);
+        node_t * slotNode = table_slot_node(table, entry);
+        if ( slotNode != NULL ) {
+            list_remove_node(table_slot_list(table, slotIndex), slotNode, NOT_DESTROY);
+            node_destroy(slotNode);
+            __atomic_sub_fetch(&(table->n_entries), 1, __ATOMIC_RELAXED);
+            
+            table_lock_indexes(table, YES);
+            table_unlink_entry(table, entry);
+            table_unlock_indexes(table, YES);
+            
+            list_add_with_criterion(expiredEntries, entry, ADD_WITHOUT_CRITERION, 0);
+        }
+        table_unlock_slots(table, slotIndex, YES);
     }
     
-    return totalNumberOfElement;
+    pthread_rwlock_unlock(&(table->lock));
+    
+    return expiredEntries;
 }
 
+int table_set_memory_budget ( struct table_t * table, long long budget_bytes, const char * spill_path ) {
+    if ( table == NULL || budget_bytes < 0 )
+        return FAILED;
+    
+    pthread_rwlock_wrlock(&(table->lock));
+    //(published: the reads without locks look for it)
+    if ( budget_bytes > 0 && table->spill == NULL )
+        __atomic_store_n(&(table->spill), spill_create(spill_path), __ATOMIC_RELEASE);
+    int taskSuccess = budget_bytes == 0 || table->spill != NULL ? SUCCEEDED : FAILED;
+    if ( taskSuccess == SUCCEEDED )
+        table->memory_budget = budget_bytes;
+    pthread_rwlock_unlock(&(table->lock));
+    
+    return taskSuccess;
+}
 
-/************************* Table-private implementation *****************/
+int table_over_budget ( struct table_t * table ) {
+    return table->memory_budget > 0 && table->spill != NULL
+        && __atomic_load_n(&(table->memory_used), __ATOMIC_RELAXED) > table->memory_budget;
+}
 
-struct list_t * table_slot_list ( table_t * table, int index ) {
-    return table->bucket[index];
+void table_spill ( struct table_t * table ) {
+    //the coldest entry is only a pointer between the locks
+    epoch_enter();
+    
+    while ( table_over_budget(table) ) {
+        //the oldest entry that does not expire (one that does is not worth writing)
+        table_lock_indexes(table, NO);
+        struct entry_t * coldest = NULL;
+        node_t * currentNode = list_head(table->time_index);
+        int nodesToCheck = list_size(table->time_index);
+        while ( nodesToCheck-- > 0 && coldest == NULL ) {
+            if ( node_entry(currentNode)->expires <= 0 )
+                coldest = node_entry(currentNode);
+            currentNode = currentNode->next;
+        }
+        table_unlock_indexes(table, NO);
+        if ( coldest == NULL )
+            break;
+        
+        //it leaves the memory and shows up on the spill at once, for the readers of its slot and of the indexes
+        int slotIndex = table_slot_index(table, entry_key(coldest), entry_key_length(coldest));
+        table_lock_slots(table, slotIndex, YES);
+        node_t * slotNode = table_slot_node(table, coldest);
+        struct spill_record_t * record = slotNode != NULL ? spill_write(table->spill, coldest) : NULL;
+        if ( record != NULL ) {
+            list_remove_node(table_slot_list(table, slotIndex), slotNode, NOT_DESTROY);
+            node_destroy(slotNode);
+            __atomic_sub_fetch(&(table->n_entries), 1, __ATOMIC_RELAXED);
+            
+            //counted before it shows up on the spill: a read of every slot that saw it in memory reads again
+            __atomic_add_fetch(&(table->spills), 1, __ATOMIC_SEQ_CST);
+            table_lock_indexes(table, YES);
+            table_unlink_entry(table, coldest);
+            spill_link(table->spill, record);
+            table_unlock_indexes(table, YES);
+        }
+        table_unlock_slots(table, slotIndex, YES);
+        
+        //taken meanwhile: the next one is the coldest. If the disk failed it stays in memory.
+        if ( slotNode == NULL )
+            continue;
+        if ( record == NULL )
+            break;
+        entry_destroy(coldest);
+    }
+    
+    epoch_exit();
 }
 
 /*
- * Having a table and a string key it returns the index for it or -1 if key is null
+ * Adds the entry to the timestamp index of the table, after every entry
+ * with the same or lower timestamp. Since the entries usually come in
+ * timestamp order it is found walking back from the tail.
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_time_index_add ( struct table_t * table, struct entry_t * entry ) {
+    node_t * timeNode = node_create(NULL, NULL, entry);
+    if ( timeNode == NULL )
+        return FAILED;
+    
+    node_t * lastBefore = list_tail(table->time_index);
+    int nodesToCheck = list_size(table->time_index);
+    while ( nodesToCheck > 0 && entry_timestamp(node_entry(lastBefore)) > entry_timestamp(entry) ) {
+        lastBefore = lastBefore->prev;
+        nodesToCheck--;
+    }
+    
+    int taskSuccess = nodesToCheck == 0 ? list_insert_node(table->time_index, timeNode, list_head(table->time_index), 0)
+                                        : list_insert_node(table->time_index, timeNode, lastBefore, 1);
+    if ( taskSuccess == FAILED ) {
+        node_destroy(timeNode);
+        return FAILED;
+    }
+    entry->time_node = timeNode;
+    
+    return SUCCEEDED;
+}
+
+/*
+ * Adds the entry to the key index of the table, if it has one, after every
+ * entry with a higher or equal key (in O(log n), on its express lanes).
+ * Returns 0 (OK) or -1 (error).
  */
-int table_slot_index ( table_t * table, char * key ) {
-    //gets the hascode of key
-    int hashcode = table_hashcode(table, key);
-    //if the hascode is not -1 (error flag) it returns the mod hashcode table_slots
-    return hashcode != -1 ? hashcode % table_slots(table) : -1;
+int table_key_index_add ( struct table_t * table, struct entry_t * entry ) {
+    if ( table->key_index == NULL )
+        return SUCCEEDED;
+    
+    node_t * keyNode = node_create(NULL, NULL, entry);
+    if ( keyNode == NULL )
+        return FAILED;
+    if ( list_add_node(table->key_index, keyNode, ADD_WITH_CRITERION_KEY, 0) == FAILED ) {
+        node_destroy(keyNode);
+        return FAILED;
+    }
+    entry->key_node = keyNode;
+    
+    return SUCCEEDED;
 }
+
 /*
- * Method that gets a table and a tuple key and returns the proper table index.
+ * Same as table_get_by (by time) but seeking the entries newer than timestamp
+ * on the timestamp index: it walks back from the tail to the first newer
+ * entry and then forward, so the entries come already in ascending
+ * timestamp order and there is nothing to sort.
  */
-int table_hashcode (table_t * table, char * key) {
-    if ( table == NULL || table->bucket == NULL
-        || table->size == 0|| key == NULL || strlen(key) == 0 )
-        return -1;
+struct list_t * table_get_by_time ( struct table_t * table, long long timestamp, int whatToDoWithTheNodes, int one_or_all ) {
+    struct list_t * newerEntries = list_create_temporary();
     
-    //the result hashcode
-    int hashcode = 0;
+    //seeks the oldest entry newer than timestamp
+    node_t * firstNewer = NULL;
+    int nodesToGet = 0;
+    node_t * currentNode = list_tail(table->time_index);
+    int nodesToCheck = list_size(table->time_index);
+    while ( nodesToCheck-- > 0 && entry_newer_than(node_entry(currentNode), timestamp) ) {
+        firstNewer = currentNode;
+        nodesToGet++;
+        currentNode = currentNode->prev;
+    }
+    //if it is just to get one, it is the oldest of them
+    if ( one_or_all && nodesToGet > 1 )
+        nodesToGet = 1;
     
-    unsigned long key_size = strlen(key);
-    //if table size is <=5
-    if ( key_size <= 5 ) {
-        int i = 0;
-        for ( i = 0; i < key_size; i++ ) {
-            hashcode+= key[i];
+    //and walks the newer ones, from the oldest to the newest
+    currentNode = firstNewer;
+    while ( nodesToGet-- > 0 ) {
+        struct entry_t * entry = node_entry(currentNode);
+        currentNode = currentNode->next;
+        
+        if ( whatToDoWithTheNodes == KEEP_AT_ORIGIN ) {
+            list_add_with_criterion(newerEntries, entry, ADD_WITHOUT_CRITERION, 0);
+        }
+        else {
+            list_add_node(newerEntries, table_take_slot_node(table, entry), ADD_WITHOUT_CRITERION, 0);
         }
-    }
-    //if key size is >5 its sums the first two and last three chars of the key
-    else {
-        //sums ascsii of two firsts
-        hashcode+= key[0] + key[1];
-        //and the three last
-        hashcode+= key[key_size-1] +  key[key_size-2] + key[key_size-3];
     }
     
+    return newerEntries;
+}
+
+/*
+ * Unlinks all the entries of the list (taken out of the table) from the table
+ * indexes. If whatToDoWithTheNodes is JUST_DELETE_NODES they are also destroyed.
+ */
+void table_unlink_entries ( struct table_t * table, struct list_t * list, int whatToDoWithTheNodes ) {
+    node_t * currentNode = list_head(list);
+    int nodesToUnlink = list_size(list);
+    
+    while ( nodesToUnlink-- > 0 ) {
+        node_t * nextNode = currentNode->next;
+        table_unlink_entry(table, node_entry(currentNode));
+        if ( whatToDoWithTheNodes == JUST_DELETE_NODES )
+            list_remove_node(list, currentNode, MUST_DESTROY);
+        currentNode = nextNode;
+    }
+}
+
+/*
+ * Creates an index on the given field position of the tuples, indexing all the
+ * entries already on the table. From now on, templates with a NULL key and a
+ * concrete value at this position are answered without scanning every slot.
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_index_field ( struct table_t * table, int position ) {
+    if ( table == NULL || position < 0 || position >= TABLE_MAX_INDEXES )
+        return FAILED;
+    
+    //indexing the entries already on the table needs the table alone
+    pthread_rwlock_wrlock(&(table->lock));
+    
+    if ( table->indexes[position] != NULL ) {
+        pthread_rwlock_unlock(&(table->lock));
+        return SUCCEEDED;
+    }
+    
+    struct field_index_t * field_index = field_index_create(position);
+    if ( field_index == NULL ) {
+        pthread_rwlock_unlock(&(table->lock));
+        return FAILED;
+    }
+    
+    int index;
+    for ( index = 0; index < table_slots(table); index++ ) {
+        struct list_t * slot = table_slot_list(table, index);
+        node_t * currentNode = list_head(slot);
+        int nodesToIndex = list_size(slot);
+        while ( nodesToIndex-- > 0 ) {
+            field_index_add(field_index, node_entry(currentNode));
+            currentNode = currentNode->next;
+        }
+    }
+    //published whole, for the reads without locks that pick an index
+    table_lock_indexes(table, YES);
+    __atomic_store_n(&(table->indexes[position]), field_index, __ATOMIC_RELEASE);
+    table_unlock_indexes(table, YES);
+    
+    pthread_rwlock_unlock(&(table->lock));
+    return SUCCEEDED;
+}
+
+
+int table_order_keys ( struct table_t * table ) {
+    if ( table == NULL )
+        return FAILED;
+    
+    //indexing the entries already on the table needs the table alone
+    pthread_rwlock_wrlock(&(table->lock));
+    
+    if ( table->key_index != NULL ) {
+        pthread_rwlock_unlock(&(table->lock));
+        return SUCCEEDED;
+    }
+    
+    //the walks of the key index only read lock the indexes
+    table_lock_indexes(table, YES);
+    __atomic_store_n(&(table->key_index), list_create(), __ATOMIC_RELEASE);
+    int taskSuccess = table->key_index != NULL ? SUCCEEDED : FAILED;
+    
+    int index;
+    for ( index = 0; taskSuccess == SUCCEEDED && index < table_slots(table); index++ ) {
+        struct list_t * slot = table_slot_list(table, index);
+        node_t * currentNode = list_head(slot);
+        int nodesToIndex = list_size(slot);
+        while ( taskSuccess == SUCCEEDED && nodesToIndex-- > 0 ) {
+            taskSuccess = table_key_index_add(table, node_entry(currentNode));
+            currentNode = currentNode->next;
+        }
+    }
+    
+    //an index without every key would miss them: it goes whole or not at all
+    if ( taskSuccess == FAILED && table->key_index != NULL ) {
+        node_t * keyNode = list_head(table->key_index);
+        int nodesToClear = list_size(table->key_index);
+        while ( nodesToClear-- > 0 ) {
+            node_entry(keyNode)->key_node = NULL;
+            keyNode = keyNode->next;
+        }
+        list_destroy(table->key_index);
+        __atomic_store_n(&(table->key_index), NULL, __ATOMIC_RELEASE);
+    }
+    table_unlock_indexes(table, YES);
+    
+    pthread_rwlock_unlock(&(table->lock));
+    return taskSuccess;
+}
+
+
+/*
+ * Moves the cursor to the start of the next list it must walk.
+ * Returns 0 (OK) or -1 (there are no more lists).
+ */
+int table_cursor_next_list ( struct table_cursor_t * cursor ) {
+    struct list_t * list = NULL;
+    
+    if ( cursor->n_candidates > 0 ) {
+        if ( cursor->next_candidates == cursor->n_candidates )
+            return FAILED;
+        list = cursor->candidates[cursor->next_candidates++];
+    }
+    else {
+        if ( cursor->next_slot > cursor->last_slot )
+            return FAILED;
+        list = table_slot_list(cursor->table, cursor->next_slot++);
+    }
+    
+    cursor->node = list == NULL ? NULL : list_head(list);
+    cursor->nodes_left = list_size(list);
+    return SUCCEEDED;
+}
+
+/*
+ * Adds entry to the snapshot of the cursor, making room for it if needed.
+ * Returns 0 (OK) or -1 (error, out of memory).
+ */
+int table_snapshot_add ( struct table_cursor_t * cursor, struct entry_t * entry ) {
+    if ( cursor->n_snapshot == cursor->snapshot_capacity ) {
+        int capacity = cursor->snapshot_capacity * 2;
+        struct entry_t ** snapshot = cursor->snapshot == cursor->snapshot_inline ?
+            (struct entry_t **) malloc(capacity * sizeof(struct entry_t *))
+            : (struct entry_t **) realloc(cursor->snapshot, capacity * sizeof(struct entry_t *));
+        if ( snapshot == NULL )
+            return FAILED;
+        if ( cursor->snapshot == cursor->snapshot_inline )
+            memcpy(snapshot, cursor->snapshot_inline, sizeof(cursor->snapshot_inline));
+        cursor->snapshot = snapshot;
+        cursor->snapshot_capacity = capacity;
+    }
+    cursor->snapshot[cursor->n_snapshot++] = entry;
+    return SUCCEEDED;
+}
+
+/*
+ * Adds the matches on the spill to the snapshot of the cursor, and marks the spill read.
+ */
+void table_cursor_read_spill ( struct table_cursor_t * cursor ) {
+    cursor->spill_read = YES;
+    struct list_t * spilled = list_create_temporary();
+    if ( spilled == NULL )
+        return;
+    
+    spill_get(__atomic_load_n(&(cursor->table->spill), __ATOMIC_ACQUIRE), cursor->search_element,
+              cursor->get_criterion, KEEP_AT_ORIGIN, cursor->one_or_all, spilled);
+    node_t * currentNode = list_head(spilled);
+    int nodesToAdd = list_size(spilled);
+    while ( nodesToAdd-- > 0 ) {
+        table_snapshot_add(cursor, node_entry(currentNode));
+        currentNode = currentNode->next;
+    }
+    list_destroy(spilled);
+}
+
+/*
+ * Adds the entries of list matching the template of the cursor to its
+ * snapshot, walking it through list_follow while a writer may be changing it.
+ * Returns YES if it is still searching, NO if it was just to get one and it found it.
+ */
+int table_read_list ( struct table_cursor_t * cursor, struct list_t * list ) {
+    if ( list == NULL )
+        return YES;
+    
+    node_t * currentNode = list_follow(list->head);
+    int nodesToCheck = list_follow(list->size);
+    int stillSearching = YES;
+    while ( nodesToCheck-- > 0 && currentNode != NULL && stillSearching ) {
+        if ( entry_signature_may_match(currentNode->signature, &(cursor->signature))
+            && tuple_matches_template(entry_value(node_entry(currentNode)), cursor->search_element) ) {
+            table_snapshot_add(cursor, node_entry(currentNode));
+            stillSearching = !cursor->one_or_all;
+        }
+        currentNode = list_follow(currentNode->next);
+    }
+    return stillSearching;
+}
+
+/*
+ * Adds the entries of the slot matching the template of the cursor to its
+ * snapshot, without the slot lock (see table_read_list). The writers make
+ * the version of the stripe odd while they change it, so the read only
+ * counts if the version was even and did not change until the end. The
+ * nodes it walks (even the ones removed meanwhile) are kept alive by the
+ * epoch the caller is in.
+ * Returns 0 (OK) or -1 (a writer changed the slot meanwhile: read again).
+ */
+int table_read_slot ( struct table_cursor_t * cursor, int slot, int with_spill ) {
+    unsigned int * version = &(cursor->table->versions[slot % TABLE_LOCK_STRIPES]);
+    unsigned int versionBefore = __atomic_load_n(version, __ATOMIC_ACQUIRE);
+    if ( versionBefore % 2 == 1 )
+        return FAILED;
+    
+    int first = cursor->n_snapshot;
+    int stillSearching = table_read_list(cursor, table_slot_list(cursor->table, slot));
+    
+    //an entry spilled meanwhile changed the version too, so it is never seen twice or missed
+    if ( with_spill && __atomic_load_n(&(cursor->table->spill), __ATOMIC_ACQUIRE) != NULL && stillSearching )
+        table_cursor_read_spill(cursor);
+    
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if ( __atomic_load_n(version, __ATOMIC_RELAXED) == versionBefore )
+        return SUCCEEDED;
+    cursor->n_snapshot = first;
+    return FAILED;
+}
+
+/*
+ * Adds the entries matching the template of the cursor, with no key, to its
+ * snapshot without locks: the candidates of its best field index, if there
+ * is one, and otherwise every slot, each as table_read_slot reads it (one the
+ * writers keep changing under the read lock of its stripe). The read of the
+ * index only counts if no write locked the indexes meanwhile, and either
+ * only if no entry went to the spill, where it would be read again.
+ * Returns 0 (OK) or -1 (the table changed meanwhile: read again).
+ */
+int table_read_no_key ( struct table_cursor_t * cursor ) {
+    struct table_t * table = cursor->table;
+    struct spill_t * spill = __atomic_load_n(&(table->spill), __ATOMIC_ACQUIRE);
+    unsigned int indexesBefore = __atomic_load_n(&(table->indexes_version), __ATOMIC_ACQUIRE);
+    unsigned int spillsBefore = __atomic_load_n(&(table->spills), __ATOMIC_ACQUIRE);
+    unsigned int versionBefore = __atomic_load_n(&(table->version), __ATOMIC_ACQUIRE);
+    int stillSearching = YES;
+    
+    struct field_index_t * field_index = indexesBefore % 2 == 0 ? table_best_index(table, cursor->search_element) : NULL;
+    if ( field_index != NULL ) {
+        char * value = tuple_element(cursor->search_element, field_index->position);
+        int value_length = tuple_element_length(cursor->search_element, field_index->position);
+        stillSearching = table_read_list(cursor, field_index_entries(field_index, value, value_length))
+            && table_read_list(cursor, field_index_entries(field_index, NULL, -1));
+    }
+    else {
+        int slots = __atomic_load_n(&(table->size), __ATOMIC_ACQUIRE);
+        int slot;
+        for ( slot = 0; slot < slots && stillSearching; slot++ ) {
+            int tries = 0;
+            while ( tries < TABLE_OPTIMISTIC_READS && table_read_slot(cursor, slot, NO) == FAILED )
+                tries++;
+            if ( tries == TABLE_OPTIMISTIC_READS ) {
+                //(without the table lock: a split meanwhile is still seen on the version of the table)
+                table_lock_slots(table, slot, NO);
+                table_read_slot(cursor, slot, NO);
+                table_unlock_slots(table, slot, NO);
+            }
+            stillSearching = !(cursor->one_or_all && cursor->n_snapshot > 0);
+            
+            //a split or a spill meanwhile already makes it read again, so the rest is not read
+            if ( __atomic_load_n(&(table->version), __ATOMIC_RELAXED) != versionBefore
+                 || __atomic_load_n(&(table->spills), __ATOMIC_RELAXED) != spillsBefore )
+                return FAILED;
+        }
+    }
+    
+    //what is in memory, and then the spill (the slowest part, so only if the rest still counts)
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if ( field_index != NULL && __atomic_load_n(&(table->indexes_version), __ATOMIC_RELAXED) != indexesBefore )
+        return FAILED;
+    if ( spill != NULL && stillSearching ) {
+        if ( __atomic_load_n(&(table->spills), __ATOMIC_RELAXED) != spillsBefore )
+            return FAILED;
+        table_cursor_read_spill(cursor);
+    }
+    
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&(table->spills), __ATOMIC_RELAXED) == spillsBefore ? SUCCEEDED : FAILED;
+}
+
+/*
+ * Reads into the snapshot of the cursor the entries of the table matching its
+ * template, without locks: the slot of its key (see table_read_slot) or what
+ * table_read_no_key reads. Neither counts if a split moved entries between
+ * the slots meanwhile (it makes the version of the table odd while it does).
+ * Returns 0 (OK) or -1 (the table changed meanwhile: read again).
+ */
+int table_read_unlocked ( struct table_cursor_t * cursor ) {
+    struct table_t * table = cursor->table;
+    unsigned int versionBefore = __atomic_load_n(&(table->version), __ATOMIC_ACQUIRE);
+    if ( versionBefore % 2 == 1 )
+        return FAILED;
+    
+    cursor->n_snapshot = 0;
+    char * key = tuple_key(cursor->search_element);
+    int taskSuccess = key != NULL ?
+        table_read_slot(cursor, table_slot_index(table, key, tuple_key_length(cursor->search_element)), YES)
+        : table_read_no_key(cursor);
+    
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return taskSuccess == SUCCEEDED && __atomic_load_n(&(table->version), __ATOMIC_RELAXED) == versionBefore ?
+        SUCCEEDED : FAILED;
+}
+
+/*
+ * Puts the cursor on the first entry of the timestamp index newer than
+ * timestamp (they are the last ones).
+ */
+void table_cursor_start_after ( struct table_cursor_t * cursor, long long timestamp ) {
+    node_t * currentNode = list_tail(cursor->table->time_index);
+    int nodesToCheck = list_size(cursor->table->time_index);
+    while ( nodesToCheck-- > 0 && entry_newer_than(node_entry(currentNode), timestamp) ) {
+        cursor->node = currentNode;
+        cursor->nodes_left++;
+        currentNode = currentNode->prev;
+    }
+}
+
+/*
+ * Puts the cursor of a walk on the first entry after where the walk stopped:
+ * on the key index after its key (or on the first key of the prefix or the
+ * range), or on the timestamp index after its timestamp.
+ */
+void table_cursor_start_walk ( struct table_cursor_t * cursor ) {
+    struct table_t * table = cursor->table;
+    struct table_walk_t * walk = cursor->walk;
+    cursor->walked = 0;
+    cursor->last_walked = NULL;
+    cursor->spill_read = YES;
+    
+    walk->by_keys = cursor->get_criterion == GET_BY_TUPLE_MATCH
+        && table_key_operator(table, cursor->search_element, &(cursor->key_operator));
+    cursor->by_keys = walk->by_keys;
+    if ( walk->by_keys && walk->key == NULL ) {
+        cursor->node = table_first_key_node(table, &(cursor->key_operator));
+    }
+    else if ( walk->by_keys ) {
+        node_t * lastBefore = list_seek_key(table->key_index, walk->key, walk->key_length, YES, NULL);
+        cursor->node = lastBefore == NULL ? list_head(table->key_index)
+            : ( lastBefore == list_tail(table->key_index) ? NULL : lastBefore->next );
+    }
+    else {
+        table_cursor_start_after(cursor, walk->timestamp);
+    }
+    if ( walk->by_keys )
+        cursor->nodes_left = cursor->node == NULL ? 0 : list_size(table->key_index);
+    
+    //it is done unless it stops halfway (table_walk_stop)
+    walk->done = YES;
+    cursor->exhausted = cursor->nodes_left == 0;
+}
+
+/*
+ * Checks if node has another key (on the key index) or timestamp than the
+ * last node the walk of cursor went over, so it can stop between them. YES or NO
+ */
+int table_walk_boundary ( struct table_cursor_t * cursor, node_t * node ) {
+    node_t * last = cursor->last_walked;
+    if ( last == NULL )
+        return YES;
+    if ( cursor->by_keys )
+        return bytes_casecmp(node_key(node), entry_key_length(node_entry(node)),
+                             node_key(last), entry_key_length(node_entry(last))) != 0;
+    return entry_timestamp(node_entry(node)) != entry_timestamp(node_entry(last));
+}
+
+/*
+ * Stops the walk of cursor after the last node it went over, keeping its
+ * key or timestamp on the walk for the next cursor.
+ * Returns 0 (OK) or -1 (error, out of memory: it does not stop).
+ */
+int table_walk_stop ( struct table_cursor_t * cursor ) {
+    struct table_walk_t * walk = cursor->walk;
+    struct entry_t * last = node_entry(cursor->last_walked);
+    
+    if ( cursor->by_keys ) {
+        int key_length = entry_key_length(last);
+        char * key = (char *) realloc(walk->key, key_length > 0 ? key_length : 1);
+        if ( key == NULL )
+            return FAILED;
+        memcpy(key, node_key(cursor->last_walked), key_length);
+        walk->key = key;
+        walk->key_length = key_length;
+    }
+    else {
+        walk->timestamp = entry_timestamp(last);
+    }
+    
+    walk->done = NO;
+    cursor->nodes_left = 0;
+    cursor->exhausted = YES;
+    return SUCCEEDED;
+}
+
+void table_walk_init ( struct table_walk_t * walk, long long timestamp ) {
+    walk->by_keys = NO;
+    walk->key = NULL;
+    walk->key_length = 0;
+    walk->timestamp = timestamp;
+    walk->started = NO;
+    walk->done = NO;
+}
+
+void table_walk_destroy ( struct table_walk_t * walk ) {
+    free(walk->key);
+    walk->key = NULL;
+}
+
+/*
+ * Puts the cursor on its first match (its locks must be held, if it has any).
+ */
+void table_cursor_start ( struct table_cursor_t * cursor ) {
+    struct table_t * table = cursor->table;
+    
+    cursor->n_candidates = 0;
+    cursor->next_candidates = 0;
+    cursor->next_slot = 0;
+    cursor->last_slot = -1;
+    cursor->node = NULL;
+    cursor->nodes_left = 0;
+    cursor->next_snapshot = 0;
+    cursor->exhausted = NO;
+    cursor->by_keys = NO;
+    
+    //the entries read at open (with the ones on the spill)
+    if ( cursor->from_snapshot ) {
+        cursor->exhausted = cursor->n_snapshot == 0;
+        return;
+    }
+    
+    //a walk goes on from where its last cursor stopped (with the spill, if any, on the snapshot)
+    if ( cursor->walk != NULL ) {
+        table_cursor_start_walk(cursor);
+        return;
+    }
+    
+    //the snapshot is left for the spill
+    cursor->n_snapshot = 0;
+    cursor->spill_read = __atomic_load_n(&(table->spill), __ATOMIC_ACQUIRE) == NULL;
+    
+    if ( cursor->get_criterion == GET_BY_TIME ) {
+        table_cursor_start_after(cursor, *((long long *) cursor->search_element));
+        return;
+    }
+    
+    //with no key: the same lists table_get_by would search
+    struct tuple_t * tup_template = (struct tuple_t *) cursor->search_element;
+    if ( table_key_operator(table, tup_template, &(cursor->key_operator)) ) {
+        //the keys from the first one of the prefix or the range on, until table_cursor_next gets past them
+        cursor->by_keys = YES;
+        cursor->node = table_first_key_node(table, &(cursor->key_operator));
+        cursor->nodes_left = cursor->node == NULL ? 0 : list_size(table->key_index);
+        cursor->exhausted = cursor->node == NULL;
+        return;
+    }
+    
+    struct field_index_t * field_index = table_best_index(table, tup_template);
+    if ( field_index != NULL ) {
+        cursor->candidates[0] = field_index_entries(field_index, tuple_element(tup_template, field_index->position),
+                                                    tuple_element_length(tup_template, field_index->position));
+        cursor->candidates[1] = field_index_entries(field_index, NULL, -1);
+        cursor->n_candidates = 2;
+    }
+    else {
+        cursor->last_slot = table_slots(table) - 1;
+    }
+    
+    cursor->exhausted = table_cursor_next_list(cursor) == FAILED;
+}
+
+int table_cursor_open ( struct table_cursor_t * cursor, struct table_t * table, void * search_element,
+                        int get_criterion, int one_or_all )
+{
+    if ( cursor == NULL || table == NULL || search_element == NULL )
+        return FAILED;
+    
+    cursor->table = table;
+    cursor->get_criterion = get_criterion;
+    cursor->search_element = search_element;
+    cursor->one_or_all = one_or_all;
+    cursor->from_snapshot = NO;
+    cursor->snapshot = cursor->snapshot_inline;
+    cursor->n_snapshot = 0;
+    cursor->snapshot_capacity = TABLE_CURSOR_INLINE;
+    cursor->in_epoch = NO;
+    cursor->locked_table = NO;
+    cursor->locked_slots = TABLE_NO_SLOTS;
+    cursor->locked_indexes = NO;
+    cursor->walk = NULL;
+    
+    //what is read back from the spill lives until the epoch ends
+    if ( __atomic_load_n(&(table->spill), __ATOMIC_ACQUIRE) != NULL ) {
+        epoch_enter();
+        cursor->in_epoch = YES;
+    }
+    
+    if ( get_criterion == GET_BY_TUPLE_MATCH )
+        entry_template_signature(search_element, &(cursor->signature));
+    
+    //the key and timestamp indexes are walked under the read lock of the indexes
+    if ( get_criterion == GET_BY_TIME || (tuple_key(search_element) == NULL
+                                          && table_key_operator(table, search_element, &(cursor->key_operator))) ) {
+        cursor->locked_indexes = YES;
+        table_lock_indexes(table, NO);
+        table_cursor_start(cursor);
+        return SUCCEEDED;
+    }
+    
+    //the others are read at once, without locks, unless the writers keep getting in the way
+    if ( !cursor->in_epoch )
+        epoch_enter();
+    cursor->in_epoch = YES;
+    cursor->from_snapshot = YES;
+    //(one that got as far as the spill is not tried again: it is slow, and the locks keep it from changing)
+    cursor->spill_read = NO;
+    //(nor one that reads the whole table more than a few times: the splits of a growing table get in its way)
+    int maxTries = tuple_key(search_element) != NULL ? TABLE_OPTIMISTIC_READS : TABLE_OPTIMISTIC_SCANS;
+    int tries = 0;
+    while ( tries < maxTries && table_read_unlocked(cursor) == FAILED )
+        tries = cursor->spill_read ? maxTries : tries + 1;
+    
+    //then with the same read locks table_get_by takes: the slot of the key, or every slot
+    //and the indexes, held until the cursor is closed
+    if ( tries == maxTries ) {
+        pthread_rwlock_rdlock(&(table->lock));
+        cursor->locked_table = YES;
+        char * key = tuple_key(search_element);
+        if ( key != NULL ) {
+            cursor->locked_slots = table_slot_index(table, key, tuple_key_length(search_element));
+            table_lock_slots(table, cursor->locked_slots, NO);
+            cursor->n_snapshot = 0;
+            table_read_slot(cursor, cursor->locked_slots, YES);
+        }
+        else {
+            cursor->from_snapshot = NO;
+            cursor->locked_slots = TABLE_ALL_SLOTS;
+            cursor->locked_indexes = YES;
+            table_lock_slots(table, TABLE_ALL_SLOTS, NO);
+            table_lock_indexes(table, NO);
+        }
+    }
+    
+    table_cursor_start(cursor);
+    
+    return SUCCEEDED;
+}
+
+int table_cursor_open_walk ( struct table_cursor_t * cursor, struct table_t * table, void * search_element,
+                             int get_criterion, struct table_walk_t * walk )
+{
+    if ( cursor == NULL || table == NULL || search_element == NULL || walk == NULL )
+        return FAILED;
+    
+    cursor->table = table;
+    cursor->get_criterion = get_criterion;
+    cursor->search_element = search_element;
+    cursor->one_or_all = NO;
+    cursor->from_snapshot = NO;
+    cursor->snapshot = cursor->snapshot_inline;
+    cursor->n_snapshot = 0;
+    cursor->snapshot_capacity = TABLE_CURSOR_INLINE;
+    cursor->in_epoch = NO;
+    cursor->walk = walk;
+    if ( get_criterion == GET_BY_TUPLE_MATCH )
+        entry_template_signature(search_element, &(cursor->signature));
+    
+    //the key and timestamp indexes are under the indexes lock: neither the table nor a slot is locked
+    cursor->locked_table = NO;
+    cursor->locked_slots = TABLE_NO_SLOTS;
+    cursor->locked_indexes = YES;
+    table_lock_indexes(table, NO);
+    
+    //the spill is read before any entry in memory: one that is walked and then spilled is not given twice
+    if ( __atomic_load_n(&(table->spill), __ATOMIC_ACQUIRE) != NULL ) {
+        epoch_enter();
+        cursor->in_epoch = YES;
+        if ( !walk->started )
+            table_cursor_read_spill(cursor);
+    }
+    walk->started = YES;
+    
+    table_cursor_start(cursor);
+    
+    return SUCCEEDED;
+}
+
+/*
+ * Checks if the node the cursor is on holds a matching entry. YES or NO
+ */
+int table_cursor_matches ( struct table_cursor_t * cursor, node_t * node ) {
+    if ( cursor->get_criterion == GET_BY_TIME )
+        return YES;
+    
+    return entry_signature_may_match(node->signature, &(cursor->signature))
+        && tuple_matches_template(entry_value(node_entry(node)), cursor->search_element);
+}
+
+struct entry_t * table_cursor_next ( struct table_cursor_t * cursor ) {
+    if ( cursor == NULL )
+        return NULL;
+    
+    //(a walk gives the matches on the spill before the ones in memory)
+    if ( cursor->from_snapshot || (cursor->walk != NULL && cursor->next_snapshot < cursor->n_snapshot) )
+        return cursor->next_snapshot < cursor->n_snapshot ? cursor->snapshot[cursor->next_snapshot++] : NULL;
+    
+    while ( !cursor->exhausted ) {
+        while ( cursor->nodes_left > 0 ) {
+            node_t * currentNode = cursor->node;
+            
+            //a walk that went far enough stops where the key or the timestamp changes
+            if ( cursor->walk != NULL && cursor->walked >= TABLE_WALK_NODES
+                && table_walk_boundary(cursor, currentNode) && table_walk_stop(cursor) == SUCCEEDED )
+                return NULL;
+            
+            cursor->node = currentNode->next;
+            cursor->nodes_left--;
+            
+            //the walk on the key index ends past the prefix or the range, or on its tail
+            if ( cursor->by_keys && table_keys_past(&(cursor->key_operator), currentNode) ) {
+                cursor->nodes_left = 0;
+                break;
+            }
+            if ( cursor->by_keys && currentNode == list_tail(cursor->table->key_index) )
+                cursor->nodes_left = 0;
+            if ( cursor->walk != NULL ) {
+                cursor->walked++;
+                cursor->last_walked = currentNode;
+            }
+            
+            if ( table_cursor_matches(cursor, currentNode) ) {
+                //if it is just to get one there is nothing more to yield
+                cursor->exhausted = cursor->one_or_all;
+                cursor->spill_read = cursor->spill_read || cursor->one_or_all;
+                return node_entry(currentNode);
+            }
+        }
+        cursor->exhausted = table_cursor_next_list(cursor) == FAILED;
+    }
+    
+    //the memory is done: the matches on the spill
+    if ( !cursor->spill_read ) {
+        cursor->spill_read = YES;
+        table_cursor_read_spill(cursor);
+    }
+    return cursor->next_snapshot < cursor->n_snapshot ? cursor->snapshot[cursor->next_snapshot++] : NULL;
+}
+
+void table_cursor_rewind ( struct table_cursor_t * cursor ) {
+    if ( cursor != NULL )
+        table_cursor_start(cursor);
+}
+
+void table_cursor_close ( struct table_cursor_t * cursor ) {
+    if ( cursor == NULL || cursor->table == NULL )
+        return;
+    
+    if ( cursor->locked_indexes )
+        table_unlock_indexes(cursor->table, NO);
+    table_unlock_slots(cursor->table, cursor->locked_slots, NO);
+    if ( cursor->locked_table )
+        pthread_rwlock_unlock(&(cursor->table->lock));
+    
+    if ( cursor->snapshot != cursor->snapshot_inline )
+        free(cursor->snapshot);
+    cursor->snapshot = cursor->snapshot_inline;
+    if ( cursor->in_epoch )
+        epoch_exit();
+    cursor->in_epoch = NO;
+    
+    cursor->table = NULL;
+    cursor->exhausted = YES;
+}
+
+/*
+ * Same as table_get_by (by tuple match, keeping the tuples) for a template
+ * with a key: the matches are read from a cursor, that reads the slot
+ * without locking it.
+ */
+struct list_t * table_copy_key ( struct table_t * table, struct tuple_t * tup_template, int one_or_all ) {
+    struct table_cursor_t cursor;
+    if ( table_cursor_open(&cursor, table, tup_template, GET_BY_TUPLE_MATCH, one_or_all) == FAILED )
+        return NULL;
+    
+    struct list_t * copiedEntries = list_create_temporary();
+    struct entry_t * entry = NULL;
+    while ( copiedEntries != NULL && (entry = table_cursor_next(&cursor)) != NULL )
+        list_add(copiedEntries, entry);
+    
+    table_cursor_close(&cursor);
+    return copiedEntries;
+}
+
+int table_get_array(struct table_t *table, struct tuple_t *tup_template, 
+    int whatToDOWithTheNodes, int one_or_all, struct tuple_t *** matching_tuples)
+{
+    //the tuples taken out of the table still have to be found with table_get
+    if ( whatToDOWithTheNodes != KEEP_AT_ORIGIN ) {
+        struct list_t * matching_nodes = table_get(table, tup_template, whatToDOWithTheNodes, one_or_all);
+        int matching_tuples_num = list_size(matching_nodes);
+        
+        *matching_tuples = tuple_create_array(matching_tuples_num);
+        node_t * currentNode = list_head(matching_nodes);
+        int i;
+        for ( i = 0; i < matching_tuples_num; i++ ) {
+            (*matching_tuples)[i] = entry_value(node_entry(currentNode));
+            currentNode = currentNode->next;
+        }
+        list_destroy(matching_nodes);
+        return matching_tuples_num;
+    }
+    
+    //the tuples kept on the table go straight from a cursor into the array:
+    //a first pass counts them so the array is the only allocation
+    //(the cursor keeps its snapshot, or its locks, between the passes, so both see the same tuples)
+    struct table_cursor_t cursor;
+    if ( table_cursor_open(&cursor, table, tup_template, GET_BY_TUPLE_MATCH, one_or_all) == FAILED )
+        return FAILED;
+    int matching_tuples_num = 0;
+    while ( table_cursor_next(&cursor) != NULL )
+        matching_tuples_num++;
+    
+    *matching_tuples = tuple_create_array(matching_tuples_num);
+    
+    table_cursor_rewind(&cursor);
+    int i;
+    for ( i = 0; i < matching_tuples_num; i++ )
+        (*matching_tuples)[i] = entry_value(table_cursor_next(&cursor));
+    table_cursor_close(&cursor);
+    
+    //returns the array matching_tuples
+    return matching_tuples_num;
+}
+
+void table_print( struct table_t * table )
+{
+    if (table == NULL || table->size == 0 )
+        printf("Tabela vazia");
+    else {
+        pthread_rwlock_rdlock(&(table->lock));
+        table_lock_slots(table, TABLE_ALL_SLOTS, NO);
+        int i = 0;
+        for ( i = 0; i < table->size;  i++) {
+            printf("Table > slot %d : \n", i );
+            list_print(table_slot_list(table, i));
+            printf("\n");
+        }
+        table_unlock_slots(table, TABLE_ALL_SLOTS, NO);
+        pthread_rwlock_unlock(&(table->lock));
+    }
+}
+
+/* Função para remover um ou todos os tuplos da tabela que estejam
+ * de acordo com o template tup_template, e libertar a memória
+ * utilizada no armazenamento desse(s) tuplo(s).
+ * O argumento one_or_all indica se a função deve remover um ou
+ * todos os tuplos que estejam de acordo com o template.
+ * Devolve: 0 (ok), -1 (nenhum tuplo encontrado; outros erros)
+ */
+int table_del(struct table_t *table, struct tuple_t *tup_template, int one_or_all) {
+    //gets all the matching nodes at the table with tup_template, not keeping them at the origin slot.
+    struct list_t * allMatchingNodes = table_get(table, tup_template, JUST_DELETE_NODES, one_or_all);
+    
+    //since we choosed to JUST_DELETE_NODES on get, allMatchingNodes must be empty
+    return list_isEmpty(allMatchingNodes) ? SUCCEEDED : FAILED;
+}
+
+int table_slots ( struct table_t * table ) {
+    return table != NULL ? table->size : -1;
+}
+
+/* Devolve o número de elementos na tabela.
+ */
+int table_size(struct table_t *table) {
+    
+    if ( table == NULL || table->bucket ==  NULL)
+        return 0;
+    
+    return __atomic_load_n(&(table->n_entries), __ATOMIC_RELAXED) + spill_size(table->spill);
+}
+
+
+/************************* Table-private implementation *****************/
+
+struct list_t * table_slot_list ( table_t * table, int index ) {
+    //(followed: a read without locks may be here while a split adds a slot)
+    struct list_t *** directory = __atomic_load_n(&(table->bucket), __ATOMIC_ACQUIRE);
+    struct list_t ** segment = __atomic_load_n(&(directory[index / TABLE_SEGMENT_SIZE]), __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&(segment[index % TABLE_SEGMENT_SIZE]), __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Appends a new empty slot to the table, making room for it on the directory
+ * if needed. Each part is published before the size that makes it reachable.
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_add_slot ( table_t * table ) {
+    unsigned int segment = table->size / TABLE_SEGMENT_SIZE;
+    
+    //the directory is full so it doubles it (only the segments pointers move):
+    //the old one may still be under a read without locks, so it is retired
+    if ( segment >= table->n_segments ) {
+        unsigned int n_segments = table->n_segments == 0 ? 1 : table->n_segments * 2;
+        struct list_t *** directory = (struct list_t ***) malloc(sizeof(struct list_t **) * n_segments);
+        if ( directory == NULL )
+            return FAILED;
+        
+        unsigned int i;
+        for ( i = 0; i < n_segments; i++ )
+            directory[i] = i < table->n_segments ? table->bucket[i] : NULL;
+        
+        struct list_t *** old_directory = table->bucket;
+        __atomic_store_n(&(table->bucket), directory, __ATOMIC_RELEASE);
+        table->n_segments = n_segments;
+        if ( old_directory != NULL )
+            epoch_retire(old_directory, free);
+    }
+    
+    //first slot of this segment
+    if ( table->bucket[segment] == NULL ) {
+        struct list_t ** new_segment = (struct list_t **) malloc(sizeof(struct list_t *) * TABLE_SEGMENT_SIZE);
+        if ( new_segment == NULL )
+            return FAILED;
+        __atomic_store_n(&(table->bucket[segment]), new_segment, __ATOMIC_RELEASE);
+    }
+    
+    struct list_t * new_slot = list_create();
+    if ( new_slot == NULL )
+        return FAILED;
+    
+    __atomic_store_n(&(table->bucket[segment][table->size % TABLE_SEGMENT_SIZE]), new_slot, __ATOMIC_RELEASE);
+    __atomic_store_n(&(table->size), table->size + 1, __ATOMIC_RELEASE);
+    
+    return SUCCEEDED;
+}
+
+/*
+ * Rehashes the slot pointed by table->split into itself and into a new slot
+ * appended to the table. The nodes are moved in order and added by key, so
+ * each one goes to the tail of the new slot in O(log n) and both slots keep
+ * their entries sorted (and their express lanes).
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_split_slot ( table_t * table ) {
+    
+    if ( table_add_slot(table) == FAILED )
+        return FAILED;
+    
+    int old_index = table->split;
+    struct list_t * old_slot = table_slot_list(table, old_index);
+    struct list_t * new_slot = table_slot_list(table, table->size - 1);
+    
+    //odd: the reads without locks of either slot (or of every slot) read again
+    __atomic_add_fetch(&(table->version), 1, __ATOMIC_SEQ_CST);
+    
+    //moves the split pointer (and level) forward so the new slot becomes addressable
+    if ( table->split + 1 == (table->initial_size << table->level) ) {
+        __atomic_store_n(&(table->level), table->level + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&(table->split), 0, __ATOMIC_RELEASE);
+    }
+    else {
+        __atomic_store_n(&(table->split), table->split + 1, __ATOMIC_RELEASE);
+    }
+    
+    node_t * currentNode = list_head(old_slot);
+    int nodesToCheck = list_size(old_slot);
+    
+    while ( nodesToCheck-- > 0 ) {
+        node_t * nextNode = currentNode->next;
+        
+        if ( table_slot_index(table, node_key(currentNode), entry_key_length(node_entry(currentNode))) != old_index )
+            list_move_node(old_slot, new_slot, currentNode, MOVE_WITH_CRITERION_KEY, 0, DONT_KEEP_AT_ORIGIN);
+        
+        currentNode = nextNode;
+    }
+    
+    __atomic_add_fetch(&(table->version), 1, __ATOMIC_SEQ_CST);
+    return SUCCEEDED;
+}
+
+/*
+ * Splits one slot of the table if its load factor is above TABLE_MAX_LOAD_FACTOR.
+ * Once each put adds one entry and each split adds one slot, splitting
+ * (at most) once per put is enough to keep the load factor bounded.
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_grow ( table_t * table ) {
+    if ( !table_needs_to_grow(table) )
+        return SUCCEEDED;
+    
+    return table_split_slot(table);
+}
+
+int table_needs_to_grow ( table_t * table ) {
+    return __atomic_load_n(&(table->n_entries), __ATOMIC_RELAXED) > table->size * TABLE_MAX_LOAD_FACTOR;
+}
+
+int table_reserve ( table_t * table, long long n_entries ) {
+    if ( table == NULL || n_entries < 0 )
+        return FAILED;
+    
+    pthread_rwlock_wrlock(&(table->lock));
+    long long wanted = __atomic_load_n(&(table->n_entries), __ATOMIC_RELAXED) + n_entries;
+    int taskSuccess = SUCCEEDED;
+    while ( taskSuccess == SUCCEEDED && wanted > table->size * TABLE_MAX_LOAD_FACTOR )
+        taskSuccess = table_split_slot(table);
+    pthread_rwlock_unlock(&(table->lock));
+    return taskSuccess;
+}
+
+void table_lock_slots ( struct table_t * table, int slot, int writing ) {
+    int first = slot >= 0 ? slot % TABLE_LOCK_STRIPES : 0;
+    int last = slot >= 0 ? first : slot == TABLE_ALL_SLOTS ? TABLE_LOCK_STRIPES - 1 : -1;
+    
+    //always in ascending order so two operations locking many stripes never deadlock
+    int stripe;
+    for ( stripe = first; stripe <= last; stripe++ ) {
+        if ( writing ) {
+            pthread_rwlock_wrlock(&(table->stripes[stripe]));
+            //odd: the readers walking the stripe without the lock know it is changing
+            __atomic_add_fetch(&(table->versions[stripe]), 1, __ATOMIC_SEQ_CST);
+        }
+        else {
+            pthread_rwlock_rdlock(&(table->stripes[stripe]));
+        }
+    }
+}
+
+void table_unlock_slots ( struct table_t * table, int slot, int writing ) {
+    int first = slot >= 0 ? slot % TABLE_LOCK_STRIPES : 0;
+    int last = slot >= 0 ? first : slot == TABLE_ALL_SLOTS ? TABLE_LOCK_STRIPES - 1 : -1;
+    
+    int stripe;
+    for ( stripe = last; stripe >= first; stripe-- ) {
+        //even again: the readers that walked the stripe meanwhile read it again
+        if ( writing )
+            __atomic_add_fetch(&(table->versions[stripe]), 1, __ATOMIC_SEQ_CST);
+        pthread_rwlock_unlock(&(table->stripes[stripe]));
+    }
+}
+
+void table_lock_indexes ( struct table_t * table, int writing ) {
+    if ( writing ) {
+        pthread_rwlock_wrlock(&(table->indexes_lock));
+        //odd, as the versions of the stripes
+        __atomic_add_fetch(&(table->indexes_version), 1, __ATOMIC_SEQ_CST);
+    }
+    else {
+        pthread_rwlock_rdlock(&(table->indexes_lock));
+    }
+}
+
+void table_unlock_indexes ( struct table_t * table, int writing ) {
+    if ( writing )
+        __atomic_add_fetch(&(table->indexes_version), 1, __ATOMIC_SEQ_CST);
+    pthread_rwlock_unlock(&(table->indexes_lock));
+}
+
+/*
+ * Returns the slot where the entries with the given hashcode live.
+ */
+int table_slot_of_hash ( table_t * table, unsigned long long hashcode ) {
+    //(followed: a read without locks may be here while a split moves them)
+    unsigned int level = __atomic_load_n(&(table->level), __ATOMIC_ACQUIRE);
+    unsigned int split = __atomic_load_n(&(table->split), __ATOMIC_ACQUIRE);
+    //the slot on the current level...
+    unsigned long long index = hashcode % (table->initial_size << level);
+    //...unless that slot was already split on this level
+    if ( index < split )
+        index = hashcode % (table->initial_size << (level + 1));
+    
+    return (int) index;
+}
+
+/*
+ * Having a table and a string key it returns the index for it or -1 if key is null
+ */
+int table_slot_index ( table_t * table, char * key, int key_length ) {
+    if ( table == NULL || __atomic_load_n(&(table->bucket), __ATOMIC_ACQUIRE) == NULL
+        || __atomic_load_n(&(table->size), __ATOMIC_ACQUIRE) == 0 || key == NULL || key_length <= 0 )
+        return -1;
+    
+    return table_slot_of_hash(table, table_hashcode(table, key, key_length));
+}
+
+/*
+ * Method that gets a table and a tuple key and returns its 64 bits hashcode.
+ */
+unsigned long long table_hashcode (table_t * table, char * key, int key_length) {
+    return hash_bytes_64(key, key_length);
+}
+
+int table_shard_index ( char * key, int key_length, int n_shards ) {
+    if ( key == NULL || key_length <= 0 || n_shards <= 0 )
+        return -1;
     
-    //now we have the hashcode so we just return it
-    return hashcode;
+    //the high bits, so the keys of one shard still spread over all the slots of its table
+    return (int) ((hash_bytes_64(key, key_length) >> 32) % n_shards);
 }
@@ -16,6 +16,18 @@ int logging_on;
 long long latest_put_timestamp;
 // number of operations made
 int n_write_operations;
+// bytes of tuples the table keeps in memory (0: no limit), the others go to a spill file
+long long memory_budget;
+// write operations between two snapshots of the table (0: none)
+long long snapshot_every;
+
+//snapshot_every of the server when it is not given
+#define TABLE_SKEL_SNAPSHOT_EVERY 100000
+// tables the keys are spread over, one per worker of the server (0 or 1: just one)
+int table_shards;
+
+//most tables the keys are spread over
+#define TABLE_SKEL_MAX_SHARDS 256
 
 
 int table_skel_write_operations();
@@ -59,8 +71,76 @@ int table_skel_put (struct message_t * msg_in, struct message_t *** msg_set_out
 */
 int tuples_to_message_array( struct message_t * msg_in, struct tuple_t *** matching_tuples, int ntuples, struct message_t *** msg_set_out);
 
+/*
+* Checks if the response to msg_in can be streamed with table_skel_stream_get,
+* ie, if it is a get that keeps the tuples on the table. YES or NO
+*/
+int table_skel_streams ( struct message_t * msg_in );
+/*
+* Same response as invoke but sent straight to socketfd as table cursors
+* yield the matches, so no list or array of the whole result is ever built.
+* It goes a part at a time (server_produce_response): each part is what a
+* bounded walk of a table finds (table_cursor_open_walk), read and queued
+* with the locks of the table held; the next part is read, with the locks
+* taken again, when the connection takes more. The tuples fill a CT_TUPLES message at a time.
+* msg_in is kept until the response is all sent (and then freed).
+* Returns 0 (OK) or -1 (error).
+*/
+int table_skel_stream_get ( struct message_t * msg_in, int socketfd );
+
+/*
+* Checks if msg_in is an OC_IN or OC_COPY that waits for a match if there
+* is none: its content is then an entry, with the template as its tuple
+* and how long to wait (milliseconds, > 0) as its timestamp. YES or NO
+*/
+int table_skel_waits ( struct message_t * msg_in );
+/*
+* Same as invoke for a request that waits (see table_skel_waits), if some
+* tuple matches it. If none does, the request is parked (and then it belongs
+* to the skeleton) until a put hands it a tuple or it times out, and is
+* answered on socketfd by table_skel_answer_waiters.
+* Returns the number of messages in msg_set_out, 0 if the request was parked
+* or -1 (error).
+*/
+int table_skel_wait_get ( struct message_t * msg_in, int socketfd, struct message_t *** msg_set_out );
+/*
+* Answers the parked requests of this thread that got a tuple or timed out
+* (with no tuple). The ones with no key, when there are many tables, look
+* for it again here, so they are answered on the next call after a put.
+* Returns the number of requests answered.
+*/
+int table_skel_answer_waiters ();
+/*
+* Drops the requests parked for socketfd (the client closed it). The tuples
+* already handed to them go back to the table.
+*/
+void table_skel_forget_waiters ( int socketfd );
+/*
+* Takes out of the table the tuples whose lease ended, logging each one
+* as an OC_IN of the tuple.
+* Returns the number of tuples expired.
+*/
+int table_skel_expire_leases ();
+
+/*
+* Builds the response to msg_in with the elements of list: how many there are,
+* then each entry (to an OC_UPDATE) or the tuples, as many as fit in each
+* CT_TUPLES message. Returns the number of messages or -1 (error).
+*/
 int list_to_message_array( struct message_t * msg_in, struct list_t * list, int gotBy, struct message_t *** msg_set_out);
 /*
+* Writes a snapshot of the table (to <address_and_port>_SNAPSHOT.bin) if
+* snapshot_every write operations were logged since the last one, so a
+* restart replays only the log after it. Called between requests.
+* Returns the number of tuples written, 0 if it was not the time yet, or
+* -1 (error: the last snapshot stays).
+*/
+long long table_skel_snapshot ();
+/*
+* Checks if it is time for table_skel_snapshot to write one. YES or NO
+*/
+int table_skel_snapshot_due ();
+/*
 * Prints the table
 */
 void table_skel_print();
@@ -9,11 +9,69 @@
 #include "table.h"
 #include "server_log.h"
 #include "network_utils.h"
+#include "slab.h"
+#include "epoch.h"
+#include "intern.h"
+#include "snapshot.h"
+#include "tuple-private.h"
+#include "network_server.h"
+#include <time.h>
+#include <string.h>
+#include <pthread.h>
 
 /*
- * The table where everything will happen
+ * The tables where everything will happen: the keys are spread over
+ * n_shards of them (see table_shard_index), each with its own locks, so the
+ * workers of the server putting and getting different keys do not wait for
+ * each other. What has no key to go by goes to all of them.
  */
-struct table_t * table = NULL;
+struct table_t ** shards = NULL;
+int n_shards = 0;
+
+/*
+ * A request parked waiting for a tuple: the waiter registered on the table,
+ * the request and where to answer it.
+ */
+struct parked_request_t {
+    struct table_waiter_t waiter;
+    //where the waiter is registered (NULL: on none, it is retried on all of them)
+    struct table_t * table;
+    struct message_t * request;
+    int socketfd;
+    long long deadline_ms;
+    struct parked_request_t * next;
+};
+
+/*
+ * The parked requests of each thread running the server (it is the one
+ * answering on their sockets).
+ */
+__thread struct parked_request_t * parked_requests = NULL;
+
+/*
+ * Held while a write is counted and logged, so the count is always the
+ * number of records on the log (a neighbor is sent the ones after its count).
+ * When logging, a write holds it also while it is applied to the tables
+ * (table_skel_write_begin/end), so the log has the writes in the order the
+ * tables saw them and replays to the same tables.
+ */
+pthread_mutex_t writes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The tuples the write going on in this thread handed to IN waiters (a put
+ * hands them before they are ever on the table). Each take is logged right
+ * after the write, before the writes are let go.
+ */
+__thread struct tuple_t ** handed_tuples = NULL;
+__thread int n_handed_tuples = 0;
+__thread int handed_tuples_room = 0;
+
+/*
+ * Where the snapshots of the table go (NULL: not logging, so no snapshots)
+ * and the write operations the last one had.
+ */
+char * snapshot_path = NULL;
+long long snapshot_records = 0;
 
 
 
@@ -29,16 +87,39 @@ void table_skel_init_log( char * filepath ) {
  */
 int table_skel_init(int n_lists) {
 	//case called more than once
- 	if ( table != NULL ) {
+ 	if ( shards != NULL ) {
  		perror("table_skel_init > table already initialized");
  		return SUCCEEDED;
  	}
-	//creates the server table
- 	table = table_create(n_lists);
+	//the tuples of the clients repeat a few values (status, tenant...): they share one copy of each
+    intern_enable(YES);
     
+	//creates the server tables
+    n_shards = table_shards < 1 ? 1 : table_shards > TABLE_SKEL_MAX_SHARDS ? TABLE_SKEL_MAX_SHARDS : table_shards;
+    shards = (struct table_t **) calloc(n_shards, sizeof(struct table_t *));
+    int taskSuccess = shards != NULL ? SUCCEEDED : FAILED;
+    int shard;
+    for ( shard = 0; taskSuccess == SUCCEEDED && shard < n_shards; shard++ ) {
+        shards[shard] = table_create(n_lists);
+        taskSuccess = shards[shard] != NULL ? SUCCEEDED : FAILED;
+        
+        //indexes the non key fields so templates with a wildcard key don't scan the whole table
+        int position;
+        for ( position = 1; taskSuccess == SUCCEEDED && position < TUPLE_DIMENSION; position++ )
+            table_index_field(shards[shard], position);
+        //and keeps the keys in order, for the templates with a prefix or a range on the key
+        if ( taskSuccess == SUCCEEDED )
+            table_order_keys(shards[shard]);
+    }
     
+    if ( taskSuccess == FAILED && shards != NULL ) {
+        for ( shard = 0; shard < n_shards; shard++ )
+            table_destroy(shards[shard]);
+        free(shards);
+        shards = NULL;
+    }
 	//returns success value
- 	return table != NULL ? SUCCEEDED : FAILED;
+ 	return taskSuccess;
 }
 
 int table_skel_init_with(int n_lists, int response_mode, int checklog, int logging, char * address_and_port ) {
@@ -51,11 +132,41 @@ int table_skel_init_with(int n_lists, int response_mode, int checklog, int loggi
     if ( logging )
         table_skel_init_log(address_and_port);
     
+    //before the log is replayed, so the tuples above the budget go straight to the spill
+    //(each table has its share of the budget and a spill of its own)
+    int shard;
+    for ( shard = 0; memory_budget > 0 && shard < n_shards; shard++ ) {
+        char spill_path[strlen(address_and_port) + strlen("_SPILL.bin") + 12];
+        if ( n_shards == 1 )
+            sprintf(spill_path, "%s_SPILL.bin", address_and_port);
+        else
+            sprintf(spill_path, "%s_SPILL%d.bin", address_and_port, shard);
+        if ( table_set_memory_budget(shards[shard], memory_budget / n_shards, spill_path) == FAILED )
+            return FAILED;
+    }
+    
+    if ( logging ) {
+        snapshot_path = (char *) malloc(strlen(address_and_port) + strlen("_SNAPSHOT.bin") + 1);
+        if ( snapshot_path != NULL )
+            sprintf(snapshot_path, "%s_SNAPSHOT.bin", address_and_port);
+    }
+    
     if ( checklog ) {
         RESPONSE_MODE = MUTE_RESPONSE_MODE;
         logging_on = NO;
-        server_log_invoke_over_table(table);
+        //the latest snapshot, if it is of this log, and then only the records after it
+        struct snapshot_info_t info;
+        if ( snapshot_read_info(snapshot_path, &info) == SUCCEEDED && info.log_offset <= server_log_size()
+            && snapshot_load(shards, n_shards, snapshot_path, &info) != FAILED ) {
+            n_write_operations = (int) info.log_records;
+            latest_put_timestamp = info.latest_put;
+            server_log_invoke_from(shards[0], info.log_offset);
+        }
+        else {
+            server_log_invoke_over_table(shards[0]);
+        }
     }
+    snapshot_records = n_write_operations;
     logging_on = logging;
     RESPONSE_MODE = response_mode;
     
@@ -65,8 +176,15 @@ int table_skel_init_with(int n_lists, int response_mode, int checklog, int loggi
 /* Libertar toda a memória e recursos alocados pela função anterior.
  */
 int table_skel_destroy() {
-	// destroyes the table
- 	table_destroy(table);
+	// destroyes the tables
+    int shard;
+    for ( shard = 0; shards != NULL && shard < n_shards; shard++ )
+        table_destroy(shards[shard]);
+    free(shards);
+    shards = NULL;
+    
+    free(snapshot_path);
+    snapshot_path = NULL;
     
  	return SUCCEEDED;
 }
@@ -93,21 +211,148 @@ int table_skel_error(struct message_t *** msg_set_out ) {
  	return init_response_with_message(msg_set_out, 1, message_of_error());
 }
 
+/*
+ * Returns the table of the key of tuple, or NULL if it has no key and there
+ * are many (what matches it may be on any of them).
+ */
+struct table_t * table_skel_table_of ( struct tuple_t * tuple ) {
+    if ( n_shards == 1 )
+        return shards[0];
+    int shard = table_shard_index(tuple_key(tuple), tuple_key_length(tuple), n_shards);
+    return shard != -1 ? shards[shard] : NULL;
+}
+
+/*
+ * Puts the entries of batch on the tables of their keys, each table getting
+ * its own in one table_put_batch (in the order they came). The whole batch
+ * is checked first, so none of it is put if any entry would be refused.
+ * Returns 0 (OK) or -1 (error)
+ */
+int table_skel_put_batch ( struct batch_t * batch ) {
+    if ( n_shards == 1 )
+        return table_put_batch(shards[0], batch->entries, batch->n_entries);
+    if ( batch->n_entries <= 0 || !table_batch_valid(batch->entries, batch->n_entries) )
+        return FAILED;
+    
+    int * shard_of = (int *) malloc(batch->n_entries * sizeof(int));
+    struct entry_t ** by_shard = (struct entry_t **) malloc(batch->n_entries * sizeof(struct entry_t *));
+    int starts[n_shards + 1];
+    memset(starts, 0, sizeof(starts));
+    int taskSuccess = shard_of != NULL && by_shard != NULL ? SUCCEEDED : FAILED;
+    
+    //a counting sort by table
+    int i;
+    for ( i = 0; taskSuccess == SUCCEEDED && i < batch->n_entries; i++ ) {
+        shard_of[i] = batch->entries[i] == NULL ? -1
+            : table_shard_index(entry_key(batch->entries[i]), entry_key_length(batch->entries[i]), n_shards);
+        if ( shard_of[i] == -1 )
+            taskSuccess = FAILED;
+        else
+            starts[shard_of[i] + 1]++;
+    }
+    int shard;
+    for ( shard = 0; taskSuccess == SUCCEEDED && shard < n_shards; shard++ )
+        starts[shard + 1] += starts[shard];
+    int next[n_shards];
+    memcpy(next, starts, sizeof(next));
+    for ( i = 0; taskSuccess == SUCCEEDED && i < batch->n_entries; i++ )
+        by_shard[next[shard_of[i]]++] = batch->entries[i];
+    
+    for ( shard = 0; taskSuccess == SUCCEEDED && shard < n_shards; shard++ ) {
+        if ( starts[shard + 1] > starts[shard]
+            && table_put_batch(shards[shard], by_shard + starts[shard], starts[shard + 1] - starts[shard]) == FAILED )
+            taskSuccess = FAILED;
+    }
+    
+    free(shard_of);
+    free(by_shard);
+    return taskSuccess;
+}
+
+/*
+ * Adds the entries of from to into: at the end or, by time, each at its place
+ * (both are in timestamp order, so it is one pass over each). The nodes of
+ * from are left as they were.
+ */
+void table_skel_merge ( struct list_t * into, struct list_t * from, int get_mode ) {
+    node_t * place = list_head(into);
+    int placesLeft = get_mode == GET_BY_TIME ? list_size(into) : 0;
+    
+    node_t * currentNode = list_head(from);
+    int nodesToMerge = list_size(from);
+    while ( nodesToMerge-- > 0 ) {
+        struct entry_t * entry = node_entry(currentNode);
+        while ( placesLeft > 0 && entry_timestamp(node_entry(place)) <= entry_timestamp(entry) ) {
+            place = place->next;
+            placesLeft--;
+        }
+        
+        node_t * newNode = node_create(NULL, NULL, entry);
+        if ( newNode != NULL && placesLeft > 0 )
+            list_insert_node(into, newNode, place, 0);
+        else if ( newNode != NULL )
+            list_add_node(into, newNode, ADD_WITHOUT_CRITERION, 0);
+        currentNode = currentNode->next;
+    }
+}
+
+/*
+ * Same as table_get_by, on the table of the key of search_element or, if it
+ * has none (or by time), on all of them, merging what each one had.
+ */
+struct list_t * table_skel_get_by ( void * search_element, int get_mode, int keep_tuples, int one_or_all ) {
+    struct table_t * table = get_mode == GET_BY_TUPLE_MATCH ? table_skel_table_of((struct tuple_t *) search_element)
+        : n_shards == 1 ? shards[0] : NULL;
+    if ( table != NULL )
+        return table_get_by(table, search_element, get_mode, keep_tuples, one_or_all);
+    
+    struct list_t * gotten = NULL;
+    int shard;
+    for ( shard = 0; shard < n_shards; shard++ ) {
+        struct list_t * more = table_get_by(shards[shard], search_element, get_mode, keep_tuples, one_or_all);
+        if ( gotten == NULL ) {
+            gotten = more;
+        }
+        else if ( more != NULL ) {
+            table_skel_merge(gotten, more, get_mode);
+            list_destroy(more);
+        }
+        //an IN or COPY stops at the first table with a match
+        if ( one_or_all && gotten != NULL && !list_isEmpty(gotten) )
+            break;
+    }
+    return gotten;
+}
+
 int table_skel_size (struct message_t * msg_in, struct message_t *** msg_set_out ) {
- 	int tablesize = table_size(table);
-	return init_response_with_message(msg_set_out, 1, message_create_with(msg_in->opcode+1, CT_RESULT, &tablesize));
+ 	int tablesize = 0;
+    int shard;
+    for ( shard = 0; shard < n_shards; shard++ )
+        tablesize += table_size(shards[shard]);
+    return init_response_with_message(msg_set_out, 1, message_create_with(msg_in->opcode+1, CT_RESULT, &tablesize));
 }
 int table_skel_put (struct message_t * msg_in, struct message_t *** msg_set_out ) {
     
  	//puts the entry IF its more recent than the last entered one
  	int successValue = FAILED;
     
-    /* updates the latest_put_timestamp */
-    if ( msg_in->c_type == CT_ENTRY && msg_in->content.entry->timestamp > latest_put_timestamp ) {
-        successValue = table_put_entry(table, msg_in->content.entry);
-        if ( successValue == SUCCEEDED) {
-            latest_put_timestamp = msg_in->content.entry->timestamp;
-        }
+    /* updates the latest_put_timestamp (a compare and swap, so puts on other threads can not reorder it) */
+    //the entries of a batch all have the timestamp the switch gave it
+    int is_batch = msg_in->c_type == CT_BATCH;
+    if ( msg_in->c_type == CT_ENTRY || msg_in->c_type == CT_LEASE || is_batch ) {
+        long long timestamp = is_batch ? msg_in->content.batch->entries[0]->timestamp : msg_in->content.entry->timestamp;
+        long long latest = __atomic_load_n(&latest_put_timestamp, __ATOMIC_ACQUIRE);
+        while ( timestamp > latest
+               && !__atomic_compare_exchange_n(&latest_put_timestamp, &latest, timestamp, NO, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) )
+            ;
+        if ( timestamp > latest )
+            successValue = is_batch ? table_skel_put_batch(msg_in->content.batch)
+                : table_put_entry(table_skel_table_of(entry_value(msg_in->content.entry)), msg_in->content.entry);
+    }
+    //a tuple put back (table_skel_put_back) only comes from a log, and does not move the latest timestamp
+    else if ( msg_in->c_type == CT_TUPLE && RESPONSE_MODE == MUTE_RESPONSE_MODE ) {
+        struct entry_t * entry = entry_create2(tuple_retain(msg_in->content.tuple), table_skel_latest_put_timestamp());
+        successValue = entry == NULL ? FAILED : table_put_entry(table_skel_table_of(msg_in->content.tuple), entry);
     }
     
 	//so the first elem of the array is the message with the success value
@@ -126,6 +371,9 @@ int action_on_get_tuples (struct message_t * operation ) {
 void * get_search_element ( struct message_t * msg_in ) {
     if ( msg_in->opcode == OC_UPDATE )
         return &(msg_in->content.result);
+    //a get that waits brings the template in an entry
+    else if ( msg_in->c_type == CT_ENTRY )
+        return entry_value(msg_in->content.entry);
     else
         return msg_in->content.tuple;
 }
@@ -140,16 +388,546 @@ int table_skel_get (struct message_t * msg_in, struct message_t *** msg_set_out
     int get_mode = msg_in->opcode == OC_UPDATE ? GET_BY_TIME : GET_BY_TUPLE_MATCH;
 	//pointer to the tuple template
  	void * search_element = get_search_element(msg_in);
+    //the timestamp of an update comes as a result (int) but is searched as a long long
+    long long update_timestamp = msg_in->content.result;
+    if ( get_mode == GET_BY_TIME )
+        search_element = &update_timestamp;
     
     //gets the matching tuples
-    struct list_t * gotten_list = table_get_by(table, search_element, get_mode, whatToDoWithTheTuples, one_or_all);
+    struct list_t * gotten_list = table_skel_get_by(search_element, get_mode, whatToDoWithTheTuples, one_or_all);
     
     int n_msgs = list_to_message_array(msg_in, gotten_list, get_mode, msg_set_out);
     
+    //the messages point to the tuples/entries, so only the nodes are freed
+    list_destroy(gotten_list);
+    
  	return n_msgs;
 }
+int table_skel_streams ( struct message_t * msg_in ) {
+    return shards != NULL && message_valid_opcode(msg_in) && message_opcode_getter(msg_in)
+        && action_on_get_tuples(msg_in) == KEEP_AT_ORIGIN;
+}
+
+/*
+ * Queues on socketfd the message with the tuples (if there are any), as the
+ * next of response (its opcode and request id), and frees it.
+ * Returns 0 (OK) or -1 (error).
+ */
+int table_skel_queue_tuples ( int socketfd, struct message_t * response, struct tuples_t * tuples ) {
+    if ( tuples == NULL )
+        return SUCCEEDED;
+    struct message_t * message = message_of_tuples(response->opcode, tuples);
+    if ( message == NULL ) {
+        tuples_destroy(tuples, NO);
+        return FAILED;
+    }
+    message->request_id = response->request_id;
+    int taskSuccess = server_queue_response(socketfd, 1, &message) != FAILED ? SUCCEEDED : FAILED;
+    free_message2(message, NO);
+    return taskSuccess;
+}
+
+/*
+ * A getter whose response is sent a part at a time, as its connection takes
+ * it (table_skel_stream_produce): the tables shards[next_shard..last_shard]
+ * are still to read, the one at next_shard from where walk stopped.
+ */
+struct table_skel_stream_t {
+    struct message_t * request;
+    int next_shard;
+    int last_shard;
+    //what an OC_UPDATE walks from (its search element)
+    long long timestamp;
+    //one key, or just one tuple: each table is read at once, with the cursor table_get_by would use
+    int at_once;
+    struct table_walk_t walk;
+};
+
+/*
+ * Producer of a table_skel_stream_t: reads the next part of the matches
+ * (the ones of a cursor, with the locks of the table held only while it is
+ * open) and queues it on socketfd: a CT_PART (or, the last one, a CT_RESULT)
+ * with how many follow, and then the tuples, as many as fit in each message,
+ * or the entries of an update, one per message.
+ */
+int table_skel_stream_produce ( void * state, int socketfd ) {
+    struct table_skel_stream_t * stream = (struct table_skel_stream_t *) state;
+    struct message_t * msg_in = stream->request;
+    int one_or_all = msg_in->opcode == OC_IN || msg_in->opcode == OC_COPY;
+    int get_mode = msg_in->opcode == OC_UPDATE ? GET_BY_TIME : GET_BY_TUPLE_MATCH;
+    void * search_element = get_mode == GET_BY_TIME ? &stream->timestamp : get_search_element(msg_in);
+    
+    struct table_cursor_t cursor;
+    struct table_t * table = shards[stream->next_shard];
+    if ( (stream->at_once ? table_cursor_open(&cursor, table, search_element, get_mode, one_or_all)
+          : table_cursor_open_walk(&cursor, table, search_element, get_mode, &stream->walk)) == FAILED )
+        return FAILED;
+    
+    //the matches of this part (a bounded walk, so a bounded array), sent before the cursor lets the table go
+    int n_elems = 0;
+    int capacity = TABLE_CURSOR_INLINE;
+    struct entry_t ** elems = (struct entry_t **) malloc(capacity * sizeof(struct entry_t *));
+    struct entry_t * entry;
+    int taskSuccess = elems != NULL ? SUCCEEDED : FAILED;
+    while ( taskSuccess == SUCCEEDED && (entry = table_cursor_next(&cursor)) != NULL ) {
+        if ( n_elems == capacity ) {
+            capacity *= 2;
+            struct entry_t ** grown = (struct entry_t **) realloc(elems, capacity * sizeof(struct entry_t *));
+            if ( grown == NULL )
+                taskSuccess = FAILED;
+            else
+                elems = grown;
+        }
+        if ( taskSuccess == SUCCEEDED )
+            elems[n_elems++] = entry;
+    }
+    
+    //the table is done with its walk (or read at once): the next part reads the next one from its start
+    int table_done = stream->at_once || stream->walk.done;
+    int last_part = (table_done && stream->next_shard == stream->last_shard) || (one_or_all && n_elems > 0);
+    
+    //a part with nothing is not sent, unless it is the last one
+    struct message_t response;
+    struct message_t * responses = &response;
+    response.request_id = msg_in->request_id;
+    if ( taskSuccess == SUCCEEDED && (n_elems > 0 || last_part) ) {
+        response.opcode = msg_in->opcode + 1;
+        response.c_type = last_part ? CT_RESULT : CT_PART;
+        response.content.result = n_elems;
+        taskSuccess = server_queue_response(socketfd, 1, &responses) != FAILED ? SUCCEEDED : FAILED;
+    }
+    
+    //the entries of an update go one per message, the tuples as many as fit in each
+    response.opcode = msg_in->opcode == OC_UPDATE ? OC_OUT : msg_in->opcode + 1;
+    response.c_type = CT_ENTRY;
+    struct tuples_t * tuples = NULL;
+    int i;
+    for ( i = 0; i < n_elems && taskSuccess == SUCCEEDED; i++ ) {
+        if ( msg_in->opcode == OC_UPDATE ) {
+            response.content.entry = elems[i];
+            taskSuccess = server_queue_response(socketfd, 1, &responses) != FAILED ? SUCCEEDED : FAILED;
+        }
+        else if ( tuples == NULL || !tuples_add_fitting(tuples, entry_value(elems[i])) ) {
+            //the message being filled is full: it goes, and the tuple starts the next one
+            taskSuccess = table_skel_queue_tuples(socketfd, &response, tuples);
+            tuples = tuples_create(TUPLES_MAX_PER_MESSAGE);
+            if ( tuples == NULL || !tuples_add_fitting(tuples, entry_value(elems[i])) )
+                taskSuccess = FAILED;
+        }
+    }
+    if ( taskSuccess == SUCCEEDED )
+        taskSuccess = table_skel_queue_tuples(socketfd, &response, tuples);
+    else
+        tuples_destroy(tuples, NO);
+    free(elems);
+    table_cursor_close(&cursor);
+    
+    if ( taskSuccess == FAILED )
+        return FAILED;
+    if ( last_part )
+        return NO;
+    if ( table_done ) {
+        stream->next_shard++;
+        table_walk_destroy(&stream->walk);
+        table_walk_init(&stream->walk, stream->timestamp);
+    }
+    return YES;
+}
+
+void table_skel_stream_destroy ( void * state ) {
+    struct table_skel_stream_t * stream = (struct table_skel_stream_t *) state;
+    table_walk_destroy(&stream->walk);
+    free_message2(stream->request, NO);
+    free(stream);
+}
+
+int table_skel_stream_get ( struct message_t * msg_in, int socketfd ) {
+    
+    struct table_skel_stream_t * stream = (struct table_skel_stream_t *) malloc(sizeof(struct table_skel_stream_t));
+    if ( stream == NULL ) {
+        free_message2(msg_in, NO);
+        return FAILED;
+    }
+    stream->request = msg_in;
+    stream->timestamp = msg_in->opcode == OC_UPDATE ? msg_in->content.result : -1;
+    table_walk_init(&stream->walk, stream->timestamp);
+    
+    //the table of the key or, with no key (or by time), each of them
+    struct tuple_t * tup_template = msg_in->opcode == OC_UPDATE ? NULL : (struct tuple_t *) get_search_element(msg_in);
+    char * key = tup_template != NULL ? tuple_key(tup_template) : NULL;
+    int shard = key == NULL ? -1 : n_shards == 1 ? 0 : table_shard_index(key, tuple_key_length(tup_template), n_shards);
+    stream->next_shard = shard != -1 ? shard : 0;
+    stream->last_shard = shard != -1 ? shard : n_shards - 1;
+    stream->at_once = shard != -1 || msg_in->opcode == OC_IN || msg_in->opcode == OC_COPY;
+    
+    struct server_producer_t producer;
+    producer.produce = table_skel_stream_produce;
+    producer.destroy = table_skel_stream_destroy;
+    producer.state = stream;
+    return server_produce_response(socketfd, producer);
+}
+
+/*
+ * Returns the current time in milliseconds.
+ */
+long long table_skel_now_ms () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/*
+ * Starts a write: if logging, takes writes_lock until table_skel_write_end,
+ * so no other write is applied or logged in between.
+ */
+void table_skel_write_begin () {
+    if ( logging_on )
+        pthread_mutex_lock(&writes_lock);
+}
+
+/*
+ * Counts and logs (if logging) the write msg_in, with the writes held by the caller.
+ */
+void table_skel_log_write ( struct message_t * msg_in ) {
+    __atomic_add_fetch(&n_write_operations, 1, __ATOMIC_RELAXED);
+    if ( logging_on )
+        server_log_message(msg_in);
+}
+
+/*
+ * Counts and logs (if logging) the take of tuple, as the OC_IN of the tuple
+ * itself, with the writes held by the caller.
+ */
+void table_skel_log_take ( struct tuple_t * tuple ) {
+    struct message_t take;
+    take.opcode = OC_IN;
+    take.c_type = CT_TUPLE;
+    take.request_id = NO_REQUEST_ID;
+    take.content.tuple = tuple;
+    table_skel_log_write(&take);
+}
+
+/*
+ * The taken callback of the IN waiters: the put handing entry to waiter is
+ * a write of this thread, so the take is logged when that write ends.
+ */
+void table_skel_waiter_taken ( struct table_waiter_t * waiter, struct entry_t * entry ) {
+    if ( n_handed_tuples == handed_tuples_room ) {
+        int room = handed_tuples_room == 0 ? 8 : 2 * handed_tuples_room;
+        struct tuple_t ** tuples = (struct tuple_t **) realloc(handed_tuples, room * sizeof(struct tuple_t *));
+        if ( tuples == NULL )
+            return;
+        handed_tuples = tuples;
+        handed_tuples_room = room;
+    }
+    handed_tuples[n_handed_tuples++] = tuple_retain(entry_value(entry));
+}
+
+/*
+ * Ends the write started by table_skel_write_begin, counting and logging
+ * msg_in (NULL: nothing was written) and then the takes of the IN waiters
+ * it handed a tuple.
+ */
+void table_skel_write_end ( struct message_t * msg_in ) {
+    if ( msg_in != NULL )
+        table_skel_log_write(msg_in);
+    int i;
+    for ( i = 0; i < n_handed_tuples; i++ ) {
+        table_skel_log_take(handed_tuples[i]);
+        tuple_destroy(handed_tuples[i]);
+    }
+    n_handed_tuples = 0;
+    if ( logging_on )
+        pthread_mutex_unlock(&writes_lock);
+}
+
+/*
+ * Puts back on the table the entry an IN was handed but its client never
+ * got, with the writes held by the caller. It is logged as an OC_OUT of the
+ * tuple, before the put (that may hand it to another waiter at once).
+ */
+void table_skel_put_back ( struct entry_t * entry ) {
+    struct message_t put_back;
+    put_back.opcode = OC_OUT;
+    put_back.c_type = CT_TUPLE;
+    put_back.request_id = NO_REQUEST_ID;
+    put_back.content.tuple = entry_value(entry);
+    table_skel_log_write(&put_back);
+    table_put_entry(table_skel_table_of(entry_value(entry)), entry);
+}
+
+int table_skel_waits ( struct message_t * msg_in ) {
+    return shards != NULL && msg_in != NULL && (msg_in->opcode == OC_IN || msg_in->opcode == OC_COPY)
+        && msg_in->c_type == CT_ENTRY && msg_in->content.entry != NULL && msg_in->content.entry->timestamp > 0;
+}
+
+int table_skel_wait_get ( struct message_t * msg_in, int socketfd, struct message_t *** msg_set_out ) {
+    struct parked_request_t * parked = (struct parked_request_t *) malloc(sizeof(struct parked_request_t));
+    if ( parked == NULL )
+        return FAILED;
+    
+    parked->waiter.tup_template = entry_value(msg_in->content.entry);
+    parked->waiter.keep_tuples = action_on_get_tuples(msg_in);
+    parked->waiter.owner = parked;
+    parked->waiter.taken = table_skel_waiter_taken;
+    parked->waiter.entry = NULL;
+    parked->waiter.ready = NO;
+    parked->table = table_skel_table_of(parked->waiter.tup_template);
+    
+    slab_arena_begin();
+    epoch_enter();
+    
+    //either there is a match now or the waiter is registered before any other put
+    //(with no key and many tables it is not registered: it looks on all of them again until it finds one)
+    struct list_t * matches = NULL;
+    int n_msgs = FAILED;
+    int wasParked = NO;
+    int taskSuccess = SUCCEEDED;
+    //an IN that finds its tuple now is logged with the take (a parked one when it is answered)
+    int takes = message_opcode_taker(msg_in);
+    if ( takes )
+        table_skel_write_begin();
+    if ( parked->table != NULL ) {
+        taskSuccess = table_get_or_wait(parked->table, &(parked->waiter), &matches);
+    }
+    else {
+        matches = table_skel_get_by(parked->waiter.tup_template, GET_BY_TUPLE_MATCH, parked->waiter.keep_tuples, 1);
+        if ( matches != NULL && list_isEmpty(matches) ) {
+            list_destroy(matches);
+            matches = NULL;
+        }
+    }
+    if ( taskSuccess == SUCCEEDED ) {
+        if ( matches != NULL ) {
+            n_msgs = list_to_message_array(msg_in, matches, GET_BY_TUPLE_MATCH, msg_set_out);
+            list_destroy(matches);
+            if ( takes )
+                table_skel_write_end(msg_in);
+            takes = NO;
+        }
+        else {
+            parked->request = msg_in;
+            parked->socketfd = socketfd;
+            parked->deadline_ms = table_skel_now_ms() + msg_in->content.entry->timestamp;
+            parked->next = parked_requests;
+            parked_requests = parked;
+            wasParked = YES;
+            n_msgs = 0;
+        }
+    }
+    if ( takes )
+        table_skel_write_end(NULL);
+    
+    epoch_exit();
+    slab_arena_reset();
+    
+    if ( !wasParked )
+        free(parked);
+    return n_msgs;
+}
+
+/*
+ * Answers the parked request with the entry it was handed (or with nothing)
+ * and frees it. If holding_writes the caller holds the writes (it took the
+ * entry itself), so an IN is logged now, if its client gets the tuple; one
+ * handed its entry by a put was logged by that put.
+ */
+void table_skel_answer_parked ( struct parked_request_t * parked, int holding_writes ) {
+    struct entry_t * entry = parked->waiter.entry;
+    
+    slab_arena_begin();
+    struct list_t * handed = list_create_temporary();
+    if ( entry != NULL )
+        list_add(handed, entry);
+    
+    struct message_t ** response = NULL;
+    int n_msgs = list_to_message_array(parked->request, handed, GET_BY_TUPLE_MATCH, &response);
+    int answered = n_msgs > 0 && server_send_response(parked->socketfd, n_msgs, response) == SUCCEEDED;
+    if ( n_msgs <= 0 )
+        server_sends_error_msg(parked->socketfd, parked->request->request_id);
+    free_message_set(response, n_msgs);
+    free(response);
+    list_destroy(handed);
+    slab_arena_reset();
+    
+    if ( entry != NULL && message_opcode_taker(parked->request) ) {
+        //the client got it: a take not logged yet is logged now
+        if ( answered ) {
+            if ( holding_writes )
+                table_skel_log_take(entry_value(entry));
+            entry_destroy(entry);
+        }
+        //it did not: the tuple goes back to the table, a write of its own if its take was logged
+        else if ( holding_writes ) {
+            table_put_entry(table_skel_table_of(entry_value(entry)), entry);
+        }
+        else {
+            table_skel_write_begin();
+            table_skel_put_back(entry);
+            table_skel_write_end(NULL);
+        }
+    }
+    else {
+        //a copy
+        entry_destroy(entry);
+    }
+    
+    free_message(parked->request);
+    free(parked);
+}
+
+/*
+ * Looks for a match of the parked request that is not registered on any
+ * table, taking it or a copy as the waiter would be handed.
+ * Returns YES if it found one (it is then on the waiter), NO otherwise.
+ */
+int table_skel_retry_parked ( struct parked_request_t * parked ) {
+    slab_arena_begin();
+    epoch_enter();
+    
+    struct list_t * matches = table_skel_get_by(parked->waiter.tup_template, GET_BY_TUPLE_MATCH, parked->waiter.keep_tuples, 1);
+    struct entry_t * entry = matches != NULL && !list_isEmpty(matches) ? node_entry(list_head(matches)) : NULL;
+    //a copy waiter gets its own copy, as a put would hand it
+    if ( entry != NULL )
+        parked->waiter.entry = parked->waiter.keep_tuples == KEEP_AT_ORIGIN ? entry_dup(entry) : entry;
+    list_destroy(matches);
+    
+    epoch_exit();
+    slab_arena_reset();
+    
+    return parked->waiter.entry != NULL;
+}
+
+int table_skel_answer_waiters () {
+    long long now = table_skel_now_ms();
+    int n_answered = 0;
+    
+    struct parked_request_t ** link = &parked_requests;
+    while ( *link != NULL ) {
+        struct parked_request_t * parked = *link;
+        //its connection is sending a response that can not be cut: this one goes after it
+        if ( server_socket_producing(parked->socketfd) ) {
+            link = &(parked->next);
+            continue;
+        }
+        //one with no table takes its tuple itself: the take and its log are one write
+        int takes = parked->table == NULL && message_opcode_taker(parked->request);
+        if ( takes )
+            table_skel_write_begin();
+        int ready = parked->table != NULL ? __atomic_load_n(&(parked->waiter.ready), __ATOMIC_ACQUIRE)
+            : table_skel_retry_parked(parked);
+        
+        if ( !ready && now < parked->deadline_ms ) {
+            if ( takes )
+                table_skel_write_end(NULL);
+            link = &(parked->next);
+            continue;
+        }
+        //timed out, unless a put handed it a tuple meanwhile
+        if ( !ready && parked->table != NULL )
+            table_cancel_wait(parked->table, &(parked->waiter));
+        
+        *link = parked->next;
+        table_skel_answer_parked(parked, takes);
+        if ( takes )
+            table_skel_write_end(NULL);
+        n_answered++;
+    }
+    return n_answered;
+}
+
+void table_skel_forget_waiters ( int socketfd ) {
+    struct parked_request_t ** link = &parked_requests;
+    while ( *link != NULL ) {
+        struct parked_request_t * parked = *link;
+        if ( parked->socketfd != socketfd ) {
+            link = &(parked->next);
+            continue;
+        }
+        
+        *link = parked->next;
+        if ( parked->table != NULL && !table_cancel_wait(parked->table, &(parked->waiter)) ) {
+            //what an IN was handed goes back, a copy is just dropped
+            if ( message_opcode_taker(parked->request) ) {
+                table_skel_write_begin();
+                table_skel_put_back(parked->waiter.entry);
+                table_skel_write_end(NULL);
+            }
+            else {
+                entry_destroy(parked->waiter.entry);
+            }
+        }
+        free_message(parked->request);
+        free(parked);
+    }
+}
+
+int table_skel_expire_leases () {
+    if ( shards == NULL )
+        return 0;
+    
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    
+    slab_arena_begin();
+    epoch_enter();
+    
+    int n_expired = 0;
+    int shard;
+    for ( shard = 0; shard < n_shards; shard++ ) {
+        //the expiries are taken and logged as one write
+        table_skel_write_begin();
+        struct list_t * expired = table_expire(shards[shard], now.tv_sec * 1000LL + now.tv_nsec / 1000000);
+        int n_expired_here = expired != NULL ? list_size(expired) : 0;
+        
+        //each expiry is logged as the IN of its tuple, so the log replayed (or sent
+        //to a neighbor) takes the same tuples out of the table
+        node_t * currentNode = n_expired_here > 0 ? list_head(expired) : NULL;
+        int nodesToLog = n_expired_here;
+        while ( nodesToLog-- > 0 ) {
+            struct entry_t * entry = node_entry(currentNode);
+            table_skel_log_take(entry_value(entry));
+            entry_destroy(entry);
+            currentNode = currentNode->next;
+        }
+        table_skel_write_end(NULL);
+        list_destroy(expired);
+        n_expired += n_expired_here;
+    }
+    
+    epoch_exit();
+    slab_arena_reset();
+    
+    return n_expired;
+}
+
+int table_skel_snapshot_due () {
+    return shards != NULL && snapshot_path != NULL && snapshot_every > 0
+        && table_skel_write_operations() - snapshot_records >= snapshot_every;
+}
+
+long long table_skel_snapshot () {
+    if ( !table_skel_snapshot_due() )
+        return 0;
+    
+    //no write meanwhile, so the tables are exactly the log up to its size
+    table_skel_write_begin();
+    long long n_operations = table_skel_write_operations();    
+    struct snapshot_info_t info;
+    info.log_records = n_operations;
+    info.log_offset = server_log_size();
+    info.latest_put = table_skel_latest_put_timestamp();
+    long long n_written = snapshot_write(shards, n_shards, snapshot_path, &info);
+    table_skel_write_end(NULL);
+    if ( n_written != FAILED )
+        snapshot_records = n_operations;
+    return n_written;
+}
+
 void table_skel_print() {
- 	table_print(table);
+    int shard;
+    for ( shard = 0; shard < n_shards; shard++ )
+        table_print(shards[shard]);
 }
 
 int list_to_message_array( struct message_t * msg_in, struct list_t * list, int gotBy, struct message_t *** msg_set_out) {
@@ -168,34 +946,54 @@ int list_to_message_array( struct message_t * msg_in, struct list_t * list, int
     
     /* common values for all the tuple/entry messages */
     int msgs_opcode = msg_in->opcode == OC_UPDATE ?  OC_OUT :  msg_in->opcode + 1;
-    int msgs_ctype = msg_in->opcode == OC_UPDATE ? CT_ENTRY : CT_TUPLE;
+    int msgs_ctype = msg_in->opcode == OC_UPDATE ? CT_ENTRY : CT_TUPLES;
     
-    /* iterates over the list to create the response */
+    /* iterates over the list to create the response: an entry per message, or as many tuples as fit in each */
     node_t * currentNode = list_head(list);
+    struct tuples_t * tuples = NULL;
  	int i = 1;
+    int n_taken = 0;
  	int sent_successfully = YES;
- 	while ( i <= (n_messages-1) && sent_successfully ) {
- 		//saves the message with the tuple...
-        
-        void * msg_content = msgs_ctype == CT_ENTRY ? (void*) node_entry(currentNode) : (void*) entry_value(node_entry(currentNode));
-        
- 		(*msg_set_out)[i] = message_create_with(msgs_opcode, msgs_ctype, msg_content);
- 		
- 		//if error stops
- 		if ((*msg_set_out)[i] == NULL )
-			sent_successfully = NO;
+ 	while ( n_messages > 1 && n_taken < n_elems && sent_successfully ) {
+ 		//saves the message with the entry...
+        if ( msgs_ctype == CT_ENTRY ) {
+            (*msg_set_out)[i++] = message_create_with(msgs_opcode, msgs_ctype, node_entry(currentNode));
+            sent_successfully = (*msg_set_out)[i-1] != NULL;
+        }
+        //...or the tuple, on the message being filled or, if it is full, on a new one
+        else {
+            if ( tuples != NULL && !tuples_add_fitting(tuples, entry_value(node_entry(currentNode))) ) {
+                (*msg_set_out)[i++] = message_of_tuples(msgs_opcode, tuples);
+                sent_successfully = (*msg_set_out)[i-1] != NULL;
+                tuples = NULL;
+            }
+            if ( tuples == NULL ) {
+                tuples = tuples_create(TUPLES_MAX_PER_MESSAGE);
+                sent_successfully = sent_successfully && tuples != NULL
+                    && tuples_add_fitting(tuples, entry_value(node_entry(currentNode)));
+            }
+        }
         
         currentNode = currentNode->next;
-		//moves forward
- 		i++;
+        n_taken++;
  	}
+    if ( tuples != NULL ) {
+        (*msg_set_out)[i++] = sent_successfully ? message_of_tuples(msgs_opcode, tuples) : NULL;
+        if ( (*msg_set_out)[i-1] == NULL ) {
+            tuples_destroy(tuples, NO);
+            sent_successfully = NO;
+        }
+    }
+    
+    if ( sent_successfully )
+        message_set_request_id(*msg_set_out, n_messages > 1 ? i : n_messages, msg_in->request_id);
     
-    //number of message is the first message saying number of nodes followed by each tuple message
- 	return  sent_successfully ? n_messages : FAILED;
+    //number of message is the first message saying number of nodes followed by the messages with them
+ 	return  sent_successfully ? (n_messages > 1 ? i : n_messages) : FAILED;
 }
 
 long long table_skel_latest_put_timestamp() {
-    return latest_put_timestamp;
+    return __atomic_load_n(&latest_put_timestamp, __ATOMIC_ACQUIRE);
 }
 
 void table_skel_set_response_mode(int mode ) {
@@ -206,14 +1004,22 @@ int table_skel_get_response_mode( ) {
 }
 
 int table_skel_write_operations() {
-    return n_write_operations;
+    return __atomic_load_n(&n_write_operations, __ATOMIC_RELAXED);
 }
 
 void table_skel_update_neighboor (int neighbor_fd, struct message_t * msg_in ) {
-    int updates_being_sent = n_write_operations - msg_in->content.result;
-    send_message(neighbor_fd, message_create_with(msg_in->opcode+1, CT_RESULT, &updates_being_sent));
+    //the count is the number of records on the log while the writes are held; the writes
+    //logged after it only add records after those, so the neighbor is sent exactly that many
+    pthread_mutex_lock(&writes_lock);
+    int n_records = table_skel_write_operations();
+    pthread_mutex_unlock(&writes_lock);
+    
+    int updates_being_sent = n_records - msg_in->content.result;
+    struct message_t * response = message_create_with(msg_in->opcode+1, CT_RESULT, &updates_being_sent);
+    server_send_response(neighbor_fd, 1, &response);
+    free_message(response);
     if ( updates_being_sent > 0 )
-        server_log_send_to(neighbor_fd, msg_in->content.result);
+        server_log_send_to(neighbor_fd, msg_in->content.result, n_records);
 }
 
 /* Executa uma operação (indicada pelo opcode na msg_in) e retorna o(s)
@@ -222,7 +1028,7 @@ void table_skel_update_neighboor (int neighbor_fd, struct message_t * msg_in ) {
  * (erro, por exemplo, tabela não inicializada).
  */
 int invoke(struct message_t *msg_in, struct message_t ***msg_set_out) {
- 	if ( table == NULL ) {
+ 	if ( shards == NULL ) {
         printf(" INVOKE! > table == NULL");
  		return FAILED;
     }
@@ -230,6 +1036,16 @@ int invoke(struct message_t *msg_in, struct message_t ***msg_set_out) {
  	if ( ! message_valid_opcode(msg_in))
 		return FAILED;
     
+    //a write is applied and logged as one step
+    int is_write = msg_in->opcode == OC_OUT || msg_in->opcode == OC_IN || msg_in->opcode == OC_IN_ALL;
+    if ( is_write )
+        table_skel_write_begin();
+    
+    //the temporary lists of this request are taken from the arena, and the
+    //entries they point to are not freed (by other threads) until it ends
+    slab_arena_begin();
+    epoch_enter();
+    
 	//by default the number of messages is FAILED
 	int number_of_msgs = FAILED;
 	//then is set to a value depending on the
@@ -243,11 +1059,14 @@ int invoke(struct message_t *msg_in, struct message_t ***msg_set_out) {
 		number_of_msgs = table_skel_size(msg_in, msg_set_out);
 	}
     
-    if ( (msg_in->opcode == OC_OUT || msg_in->opcode == OC_IN || msg_in->opcode == OC_IN_ALL) ) {
-        n_write_operations++;
-        if ( logging_on )
-            server_log_message(msg_in);
-    }
+    if ( is_write )
+        table_skel_write_end(msg_in);
+    
+    //a pipelined request knows its response by its id
+    message_set_request_id(*msg_set_out, number_of_msgs, msg_in->request_id);
+    
+    epoch_exit();
+    slab_arena_reset();
     
 	return number_of_msgs;
 }
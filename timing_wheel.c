@@ -0,0 +1,155 @@
+//
+//  timing_wheel.c
+//  SD15-Product
+//
+//  Hierarchical timing wheel.
+//
+
+#include <stdlib.h>
+#include "timing_wheel.h"
+#include "general_utils.h"
+
+/*
+ * Returns the number of ticks the level l spans (a slot of level l + 1).
+ */
+long long timing_wheel_span ( int level ) {
+    return 1LL << (TIMING_WHEEL_SLOT_BITS * level);
+}
+
+struct timing_wheel_t * timing_wheel_create ( long long now_ms ) {
+    struct timing_wheel_t * wheel = (struct timing_wheel_t *) calloc(1, sizeof(struct timing_wheel_t));
+    if ( wheel != NULL )
+        wheel->next_tick = now_ms / TIMING_WHEEL_TICK_MS;
+    return wheel;
+}
+
+void timing_wheel_destroy ( struct timing_wheel_t * wheel ) {
+    free(wheel);
+}
+
+struct wheel_timer_t * wheel_timer_create ( long long expires_ms, void * owner ) {
+    struct wheel_timer_t * timer = (struct wheel_timer_t *) malloc(sizeof(struct wheel_timer_t));
+    if ( timer != NULL ) {
+        timer->expires = expires_ms;
+        timer->owner = owner;
+        timer->prev = NULL;
+        timer->next = NULL;
+        timer->level = -1;
+        timer->slot = 0;
+    }
+    return timer;
+}
+
+/*
+ * Returns the list where the timer is linked.
+ */
+struct wheel_timer_t ** timing_wheel_list ( struct timing_wheel_t * wheel, struct wheel_timer_t * timer ) {
+    return timer->level == TIMING_WHEEL_LEVELS ? &(wheel->far) : &(wheel->slots[timer->level][timer->slot]);
+}
+
+/*
+ * Links the timer at the head of the list of its level and slot.
+ */
+void timing_wheel_link ( struct timing_wheel_t * wheel, struct wheel_timer_t * timer ) {
+    struct wheel_timer_t ** list = timing_wheel_list(wheel, timer);
+    timer->prev = NULL;
+    timer->next = *list;
+    if ( *list != NULL )
+        (*list)->prev = timer;
+    *list = timer;
+}
+
+void timing_wheel_add ( struct timing_wheel_t * wheel, struct wheel_timer_t * timer ) {
+    if ( wheel == NULL || timer == NULL || timer->level != -1 )
+        return;
+
+    //a timer already due fires on the next tick processed
+    long long tick = timer->expires / TIMING_WHEEL_TICK_MS;
+    if ( tick < wheel->next_tick )
+        tick = wheel->next_tick;
+    long long ticksAway = tick - wheel->next_tick;
+
+    //the lowest level whose span holds it
+    int level = 0;
+    while ( level < TIMING_WHEEL_LEVELS && ticksAway >= timing_wheel_span(level + 1) )
+        level++;
+
+    timer->level = level;
+    timer->slot = level == TIMING_WHEEL_LEVELS ? 0
+        : (int) ((tick >> (TIMING_WHEEL_SLOT_BITS * level)) & (TIMING_WHEEL_SLOTS - 1));
+    timing_wheel_link(wheel, timer);
+    wheel->n_timers++;
+}
+
+void timing_wheel_cancel ( struct timing_wheel_t * wheel, struct wheel_timer_t * timer ) {
+    if ( wheel == NULL || timer == NULL || timer->level == -1 )
+        return;
+
+    if ( timer->prev != NULL )
+        timer->prev->next = timer->next;
+    else
+        *timing_wheel_list(wheel, timer) = timer->next;
+    if ( timer->next != NULL )
+        timer->next->prev = timer->prev;
+
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->level = -1;
+    wheel->n_timers--;
+}
+
+/*
+ * Takes every timer out of list and adds them again (to lower levels, now
+ * that the wheel got closer to them).
+ */
+void timing_wheel_cascade ( struct timing_wheel_t * wheel, struct wheel_timer_t ** list ) {
+    struct wheel_timer_t * timer = *list;
+    *list = NULL;
+
+    while ( timer != NULL ) {
+        struct wheel_timer_t * next = timer->next;
+        timer->level = -1;
+        wheel->n_timers--;
+        timing_wheel_add(wheel, timer);
+        timer = next;
+    }
+}
+
+struct wheel_timer_t * timing_wheel_advance ( struct timing_wheel_t * wheel, long long now_ms ) {
+    if ( wheel == NULL )
+        return NULL;
+
+    long long lastTick = now_ms / TIMING_WHEEL_TICK_MS;
+    struct wheel_timer_t * expired = NULL;
+
+    while ( wheel->next_tick <= lastTick ) {
+        //with nothing on the wheel there is nothing to walk through
+        if ( wheel->n_timers == 0 ) {
+            wheel->next_tick = lastTick + 1;
+            break;
+        }
+
+        long long tick = wheel->next_tick;
+
+        //each level whose slot starts at this tick moves its timers down, lowest level first
+        int level;
+        for ( level = 1; level < TIMING_WHEEL_LEVELS && tick % timing_wheel_span(level) == 0; level++ )
+            timing_wheel_cascade(wheel, &(wheel->slots[level][(tick >> (TIMING_WHEEL_SLOT_BITS * level)) & (TIMING_WHEEL_SLOTS - 1)]));
+        //and, once a turn of the last level, the far ones are looked at again
+        if ( level == TIMING_WHEEL_LEVELS )
+            timing_wheel_cascade(wheel, &(wheel->far));
+
+        //what is on the slot of this tick expired
+        struct wheel_timer_t ** slot = &(wheel->slots[0][tick & (TIMING_WHEEL_SLOTS - 1)]);
+        while ( *slot != NULL ) {
+            struct wheel_timer_t * timer = *slot;
+            timing_wheel_cancel(wheel, timer);
+            timer->next = expired;
+            expired = timer;
+        }
+
+        wheel->next_tick++;
+    }
+
+    return expired;
+}
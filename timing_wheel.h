@@ -0,0 +1,81 @@
+//
+//  timing_wheel.h
+//  SD15-Product
+//
+//  Hierarchical timing wheel: timers are added, cancelled and expired in
+//  constant time, however many there are, and nothing is ever scanned to
+//  find the ones that are due.
+//
+//  Each level has TIMING_WHEEL_SLOTS slots; a slot of level l covers
+//  TIMING_WHEEL_SLOTS^l ticks. A timer goes to the lowest level whose
+//  span holds how far it is, and moves down a level (cascades) when the
+//  wheel gets to its slot, until it fires from level 0. The timers too
+//  far for the last level wait on a far list.
+//
+//  The timers belong to whoever adds them; the wheel only links them.
+//  It is not thread safe: its owner guards it.
+//
+
+#ifndef SD15_Product_timing_wheel_h
+#define SD15_Product_timing_wheel_h
+
+//milliseconds of each tick (the precision of the wheel)
+#define TIMING_WHEEL_TICK_MS 10
+//bits of the slot index of each level and the levels (5 levels of 64 slots: ~124 days)
+#define TIMING_WHEEL_SLOT_BITS 6
+#define TIMING_WHEEL_SLOTS (1 << TIMING_WHEEL_SLOT_BITS)
+#define TIMING_WHEEL_LEVELS 5
+
+/*
+ * A timer: when it expires (milliseconds) and whose it is.
+ */
+struct wheel_timer_t {
+    long long expires;
+    void * owner;
+    struct wheel_timer_t * prev;
+    struct wheel_timer_t * next;
+    //where it is linked (level -1: not on the wheel, TIMING_WHEEL_LEVELS: the far list)
+    int level;
+    int slot;
+};
+
+struct timing_wheel_t {
+    //the next tick to be processed
+    long long next_tick;
+    struct wheel_timer_t * slots[TIMING_WHEEL_LEVELS][TIMING_WHEEL_SLOTS];
+    struct wheel_timer_t * far;
+    int n_timers;
+};
+
+/*
+ * Creates an empty wheel whose time starts at now_ms.
+ */
+struct timing_wheel_t * timing_wheel_create ( long long now_ms );
+
+/*
+ * Destroys the wheel (not the timers on it).
+ */
+void timing_wheel_destroy ( struct timing_wheel_t * wheel );
+
+/*
+ * Creates a timer for owner expiring at expires_ms, not on any wheel.
+ */
+struct wheel_timer_t * wheel_timer_create ( long long expires_ms, void * owner );
+
+/*
+ * Adds timer to the wheel. If it is already due it fires on the next advance.
+ */
+void timing_wheel_add ( struct timing_wheel_t * wheel, struct wheel_timer_t * timer );
+
+/*
+ * Takes timer out of the wheel (nothing if it is not on it).
+ */
+void timing_wheel_cancel ( struct timing_wheel_t * wheel, struct wheel_timer_t * timer );
+
+/*
+ * Moves the wheel to now_ms and returns the timers that expired meanwhile,
+ * already out of the wheel, linked by next (NULL if none).
+ */
+struct wheel_timer_t * timing_wheel_advance ( struct timing_wheel_t * wheel, long long now_ms );
+
+#endif
@@ -15,10 +15,91 @@
 #define TUPLE_DIMENSION 3
 #define TUPLE_ELEM_NULL "*"
 
+//the operators a template element may have instead of a value
+#define TUPLE_OP_NONE 0
+//the element starts with the bytes of low: "low"* as text
+#define TUPLE_OP_PREFIX 1
+//the element is between low and high, both included: "low".."high" as text
+#define TUPLE_OP_RANGE 2
+#define TUPLE_RANGE_TEXT ".."
+//the size an element with an operator is serialized with (before its type and bounds)
+#define TUPLE_ELEMENT_OPERATOR -2
+//the longest element taken as a number by a range
+#define TUPLE_NUMBER_MAX_LENGTH 63
+
+/*
+ * An operator of a template element. A range of two numbers is a range of
+ * their values (and only numbers match it); any other range is in the
+ * order of the keys of the table (bytes_casecmp). A prefix is of the
+ * bytes themselves.
+ */
+struct tuple_operator_t {
+    int type;
+    char * low;
+    int low_length;
+    char * high;
+    int high_length;
+    //set by tuple_create_template: YES if both bounds of the range are numbers
+    int numeric;
+    double low_value;
+    double high_value;
+};
+
 
 char * tuple_element (struct tuple_t* tuple, int iElement ) ;
+/*
+ * Gets one more reference to the tuple, that is shared instead of copied:
+ * each tuple_destroy gives one back. Returns the tuple.
+ */
+struct tuple_t * tuple_retain ( struct tuple_t * tuple );
+/*
+ * Returns the number of deep copies made by tuple_dup so far.
+ */
+unsigned long long tuple_copies_made ();
+/*
+ * Creates a tuple whose element i has the first lengths[i] bytes of
+ * elements[i] (NULL element if lengths[i] is -1).
+ */
+struct tuple_t * tuple_create_with_lengths ( int tuple_dim, char ** elements, int * lengths );
+/*
+ * Same as tuple_create_with_lengths for a template: the elements whose
+ * operators[i].type is not TUPLE_OP_NONE get that operator instead (and
+ * elements[i] is ignored). operators may be NULL.
+ * To everything but tuple_matches_template an element with an operator is
+ * a NULL element (a wildcard), so it never takes a template to one slot
+ * or to a field index: the key index (table_order_keys) is what finds
+ * the keys of a prefix or a range.
+ */
+struct tuple_t * tuple_create_template ( int tuple_dim, char ** elements, int * lengths, struct tuple_operator_t * operators );
+/*
+ * Returns the type of the operator of the iElement of the tuple
+ * (TUPLE_OP_NONE if it has none) and, if operator is not NULL, copies the
+ * operator there (its bounds point into the tuple).
+ */
+int tuple_element_operator ( struct tuple_t * tuple, int iElement, struct tuple_operator_t * operator );
+/*
+ * Checks if any element of the tuple has an operator (it is a template, never put). YES or NO
+ */
+int tuple_has_operators ( struct tuple_t * tuple );
+/*
+ * Checks if the length bytes of element satisfy the operator. YES or NO
+ */
+int tuple_operator_matches ( struct tuple_operator_t * operator, char * element, int length );
+/*
+ * Returns the length of the iElement of the tuple, -1 if it is NULL.
+ */
+int tuple_element_length ( struct tuple_t * tuple, int iElement );
+/*
+ * Returns the id of the iElement of the tuple on the intern pool, -1 if
+ * its bytes are on the tuple (or it is NULL).
+ */
+int tuple_element_id ( struct tuple_t * tuple, int iElement );
 char * tuple_elem_str(struct tuple_t * tuple, int i);
 char * tuple_key (struct tuple_t * tuple );
+/*
+ * Returns the length of the key of the tuple, -1 if it is NULL.
+ */
+int tuple_key_length ( struct tuple_t * tuple );
 int tuple_size( struct tuple_t * tuple );
 int tuple_size_bytes ( struct tuple_t* tuple);
 int tuple_size_as_string (struct tuple_t* tuple) ;
@@ -26,6 +107,11 @@ char * tuple_to_string( struct tuple_t * tuple );
 int tuple_serialize(struct tuple_t *tuple, char **buffer);
 struct tuple_t *tuple_deserialize(char *buffer, int size);
 struct tuple_t* create_tuple_from_input (const char *user_input);
+/*
+ * Same as create_tuple_from_input, also pointing end (if not NULL) to
+ * just after the tuple, where the text goes on.
+ */
+struct tuple_t * tuple_from_text ( const char * user_input, const char ** end );
 
 void tuple_print ( struct tuple_t * tuple );
 
@@ -14,21 +14,152 @@
 #include <assert.h>
 #include "general_utils.h"
 #include "inet.h"
+#include "slab.h"
+#include "intern.h"
+#include "tuple-private.h"
+
+//deep copies made by tuple_dup (the sharing of tuple_retain is not counted)
+static unsigned long long tuple_copies = 0;
+
+/*
+ * Returns the number of bytes of the whole block of a tuple.
+ */
+size_t tuple_block_size ( int tuple_dim, int body_size ) {
+    return sizeof(struct tuple_t) + tuple_dim * sizeof(struct tuple_element_t) + body_size;
+}
+
+/*
+ * Returns the body of the tuple (the bytes of the elements).
+ */
+char * tuple_body ( struct tuple_t * tuple ) {
+    return (char *) &(tuple->elements[tuple->tuple_dimension]);
+}
+
+/*
+ * Returns the number of bytes an operator takes on the body of a template:
+ * the operator itself (copied there as it is) and its bounds, each followed by '\0'.
+ */
+int tuple_operator_body_size ( struct tuple_operator_t * operator ) {
+    return (int) sizeof(struct tuple_operator_t) + operator->low_length + 1 + operator->high_length + 1;
+}
+
+/*
+ * Reads the length bytes as a number (all of them must be part of it).
+ * Returns YES with *value set, or NO if they are not a number.
+ */
+int tuple_bytes_number ( const char * bytes, int length, double * value ) {
+    char number[TUPLE_NUMBER_MAX_LENGTH + 1];
+    if ( bytes == NULL || length <= 0 || length > TUPLE_NUMBER_MAX_LENGTH )
+        return NO;
+    memcpy(number, bytes, length);
+    number[length] = '\0';
+    //(strtod also takes spaces, hexadecimals, inf and nan, that are not taken as numbers here)
+    if ( strspn(number, "0123456789+-.eE") != length )
+        return NO;
+    
+    char * end = NULL;
+    *value = strtod(number, &end);
+    return end == number + length;
+}
+
+struct tuple_t * tuple_create_with_lengths ( int tuple_dim, char ** elements, int * lengths ) {
+    return tuple_create_template(tuple_dim, elements, lengths, NULL);
+}
+
+/*
+ * Creates a tuple, in one block, whose element i has the lengths[i] bytes
+ * of elements[i] (NULL element if lengths[i] is -1).
+ * With the intern pool on, the short elements other than the key are kept
+ * on the pool instead: their offset is -(id + 1).
+ * The elements with an operator are NULL elements whose offset is
+ * -(where the operator is on the body + 1).
+ */
+struct tuple_t * tuple_create_template ( int tuple_dim, char ** elements, int * lengths, struct tuple_operator_t * operators ) {
+    //the body has each non NULL element (not interned) followed by '\0', and the operators
+    int ids[tuple_dim];
+    int body_size = 0;
+    int i;
+    for ( i = 0; i < tuple_dim; i++ ) {
+        int has_operator = operators != NULL && operators[i].type != TUPLE_OP_NONE;
+        if ( has_operator ) {
+            //a range of numbers compares their values
+            operators[i].numeric = operators[i].type == TUPLE_OP_RANGE
+                && tuple_bytes_number(operators[i].low, operators[i].low_length, &(operators[i].low_value))
+                && tuple_bytes_number(operators[i].high, operators[i].high_length, &(operators[i].high_value));
+            if ( operators[i].type != TUPLE_OP_RANGE )
+                operators[i].high_length = 0;
+            body_size += tuple_operator_body_size(&(operators[i]));
+        }
+        ids[i] = i > 0 && !has_operator && lengths[i] != -1 ? intern_acquire(elements[i], lengths[i]) : -1;
+        if ( !has_operator && lengths[i] != -1 && ids[i] == -1 )
+            body_size += lengths[i] + 1;
+    }
+    
+    //allocs memory (from the slab pools)
+    struct tuple_t * newTuple = (struct tuple_t*) slab_alloc (tuple_block_size(tuple_dim, body_size));
+    
+    if ( newTuple == NULL ) {
+        for ( i = 0; i < tuple_dim; i++ ) {
+            if ( ids[i] != -1 )
+                intern_release(ids[i]);
+        }
+    }
+    else {
+        newTuple->tuple_dimension = tuple_dim;
+        newTuple->body_size = body_size;
+        newTuple->refs = 1;
+        
+        char * body = tuple_body(newTuple);
+        int offset = 0;
+        for ( i = 0; i < tuple_dim; i++ ) {
+            if ( operators != NULL && operators[i].type != TUPLE_OP_NONE ) {
+                struct tuple_operator_t * operator = &(operators[i]);
+                newTuple->elements[i].offset = -(offset + 1);
+                newTuple->elements[i].length = -1;
+                memcpy(body + offset, operator, sizeof(struct tuple_operator_t));
+                char * bounds = body + offset + sizeof(struct tuple_operator_t);
+                memcpy(bounds, operator->low, operator->low_length);
+                bounds[operator->low_length] = '\0';
+                if ( operator->high_length > 0 )
+                    memcpy(bounds + operator->low_length + 1, operator->high, operator->high_length);
+                bounds[operator->low_length + 1 + operator->high_length] = '\0';
+                offset += tuple_operator_body_size(operator);
+                continue;
+            }
+            newTuple->elements[i].offset = ids[i] != -1 ? -(ids[i] + 1) : offset;
+            newTuple->elements[i].length = lengths[i];
+            if ( lengths[i] != -1 && ids[i] == -1 ) {
+                memcpy(body + offset, elements[i], lengths[i]);
+                body[offset + lengths[i]] = '\0';
+                offset += lengths[i] + 1;
+            }
+        }
+    }
+    return newTuple;
+}
 
 /* Função que cria um novo tuplo (isto é, que inicializa
  * a estrutura e aloca a memória necessária).
+ * Todos os elementos do tuplo criado são NULL.
  */
 struct tuple_t *tuple_create(int tuple_dim) {
     //checks if required dim is valid
     if ( tuple_dim <= 0)
         return NULL;
     
-    //allocs memory
-    struct tuple_t * newTuple = (struct tuple_t*) malloc (sizeof(struct tuple_t));
+    //allocs memory (from the slab pools)
+    struct tuple_t * newTuple = (struct tuple_t*) slab_alloc (tuple_block_size(tuple_dim, 0));
     
     if ( newTuple != NULL ) {
         newTuple->tuple_dimension = tuple_dim;
-        newTuple->tuple = (char**) malloc(tuple_dim * sizeof(char*) );
+        newTuple->body_size = 0;
+        newTuple->refs = 1;
+        //all elements start as NULL (wildcards)
+        int i;
+        for ( i = 0; i < tuple_dim; i++ ) {
+            newTuple->elements[i].offset = 0;
+            newTuple->elements[i].length = -1;
+        }
     }
     return newTuple;
 }
@@ -39,15 +170,13 @@ struct tuple_t *tuple_create2(int tuple_dim, char **tuple) {
     if ( tuple_dim <= 0 || tuple == NULL)
         return NULL;
     
-    struct tuple_t * newTuple = tuple_create(tuple_dim);
-    //if it was allocated we just need to copy the tuple values
-    if ( newTuple != NULL ) {
-        int i;
-        for ( i=0; i<newTuple->tuple_dimension; i++) {
-            newTuple->tuple[i] = tuple[i] == NULL ? NULL :  strdup(tuple[i]);
-        }
+    //the lengths are taken once, here, and kept on the tuple
+    int lengths[tuple_dim];
+    int i;
+    for ( i=0; i<tuple_dim; i++) {
+        lengths[i] = tuple[i] == NULL ? -1 : (int) strlen(tuple[i]);
     }
-    return newTuple;
+    return tuple_create_with_lengths(tuple_dim, tuple, lengths);
 }
 struct tuple_t ** tuple_create_array(int tuples_num) {
     if ( tuples_num <= 0 ) return NULL;
@@ -65,18 +194,19 @@ void tuple_array_destroy(struct tuple_t ** tuples, int num ) {
 }
 
 /*
- * Função que destrói um bloco de dados e liberta toda a memoria.
+ * Função que larga uma referência ao tuplo, libertando toda a memoria
+ * se era a última.
  */
 void tuple_destroy(struct tuple_t *tuple) {
-    if ( tuple != NULL && tuple->tuple != NULL ) {
+    //the others holding it still read it
+    if ( tuple != NULL && __atomic_sub_fetch(&(tuple->refs), 1, __ATOMIC_ACQ_REL) == 0 ) {
+        //the elements are on the same block, or on the intern pool
         int i;
         for ( i = 0; i < tuple->tuple_dimension; i++ ) {
-            if (tuple->tuple[i] != NULL ) {
-                free(tuple->tuple[i]);
-            }
+            if ( tuple_element_id(tuple, i) != -1 )
+                intern_release(tuple_element_id(tuple, i));
         }
-        free(tuple->tuple);
-        free(tuple);
+        slab_free(tuple, tuple_block_size(tuple->tuple_dimension, tuple->body_size));
     }
 }
 
@@ -86,11 +216,38 @@ void tuple_destroy(struct tuple_t *tuple) {
  * memória necessária).
  */
 struct tuple_t *tuple_dup (struct tuple_t *tuple) {
-    if ( tuple == NULL || tuple->tuple == NULL)
+    if ( tuple == NULL )
         return NULL;
     
-    //if tuple is valid
-    return tuple_create2(tuple->tuple_dimension, tuple->tuple);
+    //if tuple is valid its block is copied as a whole
+    size_t block_size = tuple_block_size(tuple->tuple_dimension, tuple->body_size);
+    struct tuple_t * newTuple = (struct tuple_t*) slab_alloc(block_size);
+    if ( newTuple != NULL ) {
+        //(all but the references, that others may be changing)
+        newTuple->tuple_dimension = tuple->tuple_dimension;
+        newTuple->body_size = tuple->body_size;
+        newTuple->refs = 1;
+        memcpy(newTuple->elements, tuple->elements, block_size - sizeof(struct tuple_t));
+        __atomic_add_fetch(&tuple_copies, 1, __ATOMIC_RELAXED);
+        //the interned elements are shared
+        int i;
+        for ( i = 0; i < tuple->tuple_dimension; i++ ) {
+            if ( tuple_element_id(tuple, i) != -1 )
+                intern_retain(tuple_element_id(tuple, i));
+        }
+    }
+    
+    return newTuple;
+}
+
+struct tuple_t * tuple_retain ( struct tuple_t * tuple ) {
+    if ( tuple != NULL )
+        __atomic_add_fetch(&(tuple->refs), 1, __ATOMIC_RELAXED);
+    return tuple;
+}
+
+unsigned long long tuple_copies_made () {
+    return __atomic_load_n(&tuple_copies, __ATOMIC_RELAXED);
 }
 
 
@@ -100,7 +257,67 @@ struct tuple_t *tuple_dup (struct tuple_t *tuple) {
  * Method that returns the iElement of a given tuple.
  */
 char * tuple_element ( struct tuple_t * tuple, int iElement ) {
-    return tuple->tuple[iElement];
+    if ( tuple->elements[iElement].length == -1 )
+        return NULL;
+    return tuple->elements[iElement].offset < 0 ? intern_bytes(-tuple->elements[iElement].offset - 1)
+        : tuple_body(tuple) + tuple->elements[iElement].offset;
+}
+
+/*
+ * Method that returns the id of the iElement of a given tuple on the intern pool (-1 if not interned).
+ */
+int tuple_element_id ( struct tuple_t * tuple, int iElement ) {
+    return tuple->elements[iElement].length != -1 && tuple->elements[iElement].offset < 0 ?
+        -tuple->elements[iElement].offset - 1 : -1;
+}
+
+/*
+ * Method that returns the length of the iElement of a given tuple (-1 if NULL).
+ */
+int tuple_element_length ( struct tuple_t * tuple, int iElement ) {
+    return tuple->elements[iElement].length;
+}
+
+int tuple_element_operator ( struct tuple_t * tuple, int iElement, struct tuple_operator_t * operator ) {
+    struct tuple_operator_t copy;
+    if ( operator == NULL )
+        operator = &copy;
+    
+    //a NULL element with a negative offset has an operator there
+    if ( tuple->elements[iElement].length != -1 || tuple->elements[iElement].offset >= 0 ) {
+        operator->type = TUPLE_OP_NONE;
+        return TUPLE_OP_NONE;
+    }
+    
+    char * stored = tuple_body(tuple) - tuple->elements[iElement].offset - 1;
+    memcpy(operator, stored, sizeof(struct tuple_operator_t));
+    operator->low = stored + sizeof(struct tuple_operator_t);
+    operator->high = operator->low + operator->low_length + 1;
+    return operator->type;
+}
+
+int tuple_has_operators ( struct tuple_t * tuple ) {
+    int i;
+    for ( i = 0; i < tuple_size(tuple); i++ ) {
+        if ( tuple->elements[i].length == -1 && tuple->elements[i].offset < 0 )
+            return YES;
+    }
+    return NO;
+}
+
+int tuple_operator_matches ( struct tuple_operator_t * operator, char * element, int length ) {
+    if ( operator->type == TUPLE_OP_PREFIX )
+        return length >= operator->low_length && memcmp(element, operator->low, operator->low_length) == 0;
+    
+    if ( operator->type == TUPLE_OP_RANGE && operator->numeric ) {
+        double value;
+        return tuple_bytes_number(element, length, &value) && value >= operator->low_value && value <= operator->high_value;
+    }
+    
+    //a range of bytes is in the order of the keys of the table
+    return operator->type == TUPLE_OP_RANGE
+        && bytes_casecmp(element, length, operator->low, operator->low_length) >= 0
+        && bytes_casecmp(element, length, operator->high, operator->high_length) <= 0;
 }
 
 char * tuple_elem_str(struct tuple_t * tuple, int i) {
@@ -114,6 +331,10 @@ char * tuple_key (struct tuple_t * tuple ) {
     return tuple_element(tuple,0);
 }
 
+int tuple_key_length ( struct tuple_t * tuple ) {
+    return tuple_element_length(tuple, 0);
+}
+
 /*
  * Method that returns the size of a given tuple.
  */
@@ -131,21 +352,123 @@ int tuple_size_bytes ( struct tuple_t* tuple) {
     
     int i;
     for ( i = 0; i < tuple_size(tuple); i++) {
-        //sums the number of bytes needed to alloc for each element of the tuple
-        long elementSize = tuple_element(tuple,i) == NULL ? 1 : strlen(tuple_element(tuple,i));
+        //sums the number of bytes needed to alloc for each element of the tuple (none if NULL)
+        long elementSize = tuple_element_length(tuple,i) == -1 ? 0 : tuple_element_length(tuple,i);
         nBytes+= TUPLE_ELEMENTSIZE_SIZE + elementSize;
+        
+        //an operator: [type][size_low][bytes_low][size_high][bytes_high] after the size
+        struct tuple_operator_t operator;
+        if ( tuple_element_operator(tuple, i, &operator) != TUPLE_OP_NONE )
+            nBytes+= 3 * TUPLE_ELEMENTSIZE_SIZE + operator.low_length + operator.high_length;
     }
     
     return nBytes;
 }
 
+/*
+ * Checks if byte goes to the text of an element as it is. YES or NO
+ */
+int tuple_text_plain ( unsigned char byte ) {
+    return byte >= ' ' && byte < 0x7f && byte != '"' && byte != '\\';
+}
+
+/*
+ * Returns the number of bytes of the length bytes as text, the way
+ * tuple_bytes_to_text writes them.
+ */
+int tuple_bytes_text_size ( char * bytes, int length ) {
+    //an element that is just * is "\x2a"
+    if ( length == 1 && bytes[0] == TUPLE_ELEM_NULL[0] )
+        return 2 + 4;
+    
+    int size = 2;
+    int j;
+    for ( j = 0; j < length; j++ ) {
+        unsigned char byte = (unsigned char) bytes[j];
+        size += tuple_text_plain(byte) ? 1 : byte == '"' || byte == '\\' ? 2 : 4;
+    }
+    return size;
+}
+
+/*
+ * Writes the length bytes as text to text: between quotes, with '"' and
+ * '\\' escaped (\" and \\) and the bytes that are not printable as \xHH,
+ * so any bytes go through the log and the command line.
+ * Returns where the text ends.
+ */
+char * tuple_bytes_to_text ( char * bytes, int length, char * text ) {
+    *text++ = '"';
+    if ( length == 1 && bytes[0] == TUPLE_ELEM_NULL[0] ) {
+        text += sprintf(text, "\\x%02x", (unsigned char) bytes[0]);
+    }
+    else {
+        int j;
+        for ( j = 0; j < length; j++ ) {
+            unsigned char byte = (unsigned char) bytes[j];
+            if ( tuple_text_plain(byte) )
+                *text++ = byte;
+            else if ( byte == '"' || byte == '\\' ) {
+                *text++ = '\\';
+                *text++ = byte;
+            }
+            else
+                text += sprintf(text, "\\x%02x", byte);
+        }
+    }
+    *text++ = '"';
+    return text;
+}
+
+/*
+ * Returns the number of bytes of the element i of the tuple as text, the
+ * way tuple_element_to_text writes it.
+ */
+int tuple_element_text_size ( struct tuple_t * tuple, int i ) {
+    struct tuple_operator_t operator;
+    if ( tuple_element_operator(tuple, i, &operator) == TUPLE_OP_PREFIX )
+        return tuple_bytes_text_size(operator.low, operator.low_length) + 1;
+    if ( operator.type == TUPLE_OP_RANGE )
+        return tuple_bytes_text_size(operator.low, operator.low_length) + 2 + tuple_bytes_text_size(operator.high, operator.high_length);
+    
+    //NULL is "*"
+    if ( tuple_element_length(tuple, i) == -1 )
+        return 2 + 1;
+    return tuple_bytes_text_size(tuple_element(tuple, i), tuple_element_length(tuple, i));
+}
+
+/*
+ * Writes the element i of the tuple as text to text (see tuple_bytes_to_text):
+ * NULL is "*", a prefix "bytes"* and a range "low".."high".
+ * Returns where the text ends.
+ */
+char * tuple_element_to_text ( struct tuple_t * tuple, int i, char * text ) {
+    struct tuple_operator_t operator;
+    if ( tuple_element_operator(tuple, i, &operator) != TUPLE_OP_NONE ) {
+        text = tuple_bytes_to_text(operator.low, operator.low_length, text);
+        if ( operator.type == TUPLE_OP_PREFIX ) {
+            *text++ = TUPLE_ELEM_NULL[0];
+            return text;
+        }
+        memcpy(text, TUPLE_RANGE_TEXT, strlen(TUPLE_RANGE_TEXT));
+        return tuple_bytes_to_text(operator.high, operator.high_length, text + strlen(TUPLE_RANGE_TEXT));
+    }
+    
+    if ( tuple_element_length(tuple, i) == -1 ) {
+        *text++ = '"';
+        *text++ = TUPLE_ELEM_NULL[0];
+        *text++ = '"';
+        return text;
+    }
+    return tuple_bytes_to_text(tuple_element(tuple, i), tuple_element_length(tuple, i), text);
+}
+
 int tuple_size_as_string (struct tuple_t* tuple) {
     int size = 0;
     
     int i;
     for ( i = 0; i < tuple_size(tuple); i++ ) {
-        //each elem size is the "" and a space after
-        size+= ( 1 + strlen(tuple_elem_str(tuple, i)) + 1 + 1);
+        //each elem size is its text and a space after
+        size+= tuple_element_text_size(tuple, i) + 1;
     }
     
     return size;
@@ -178,10 +501,25 @@ int tuple_serialize(struct tuple_t *tuple, char **buffer) {
     //serializes each element following the patter [elemSize][elemContent]
     int i;
     for ( i = 0; i < tuple_size(tuple); i++) {
-        //gets tuple element information
-        char* currentElementValue = tuple_element(tuple, i) == NULL ? TUPLE_ELEM_NULL : tuple_element(tuple, i);
-    //    printf("value %d (%s) has size %lu\n",i, currentElementValue, strlen(currentElementValue));
-        long currentElementSize = currentElementValue == NULL ? 1 : strlen(currentElementValue);
+        //gets tuple element information (the NULL elements are sent with size -1 and no bytes)
+        char* currentElementValue = tuple_element(tuple, i);
+        int currentElementSize = tuple_element_length(tuple, i);
+        
+        //an operator is sent with size TUPLE_ELEMENT_OPERATOR, its type and its bounds
+        struct tuple_operator_t operator;
+        if ( tuple_element_operator(tuple, i, &operator) != TUPLE_OP_NONE ) {
+            int header[4] = { htonl(TUPLE_ELEMENT_OPERATOR), htonl(operator.type), htonl(operator.low_length), 0 };
+            memcpy((buffer[0]+offset), header, 3 * TUPLE_ELEMENTSIZE_SIZE);
+            offset+=3 * TUPLE_ELEMENTSIZE_SIZE;
+            memcpy((buffer[0]+offset), operator.low, operator.low_length);
+            offset+=operator.low_length;
+            header[3] = htonl(operator.high_length);
+            memcpy((buffer[0]+offset), &header[3], TUPLE_ELEMENTSIZE_SIZE);
+            offset+=TUPLE_ELEMENTSIZE_SIZE;
+            memcpy((buffer[0]+offset), operator.high, operator.high_length);
+            offset+=operator.high_length;
+            continue;
+        }
         
         // 1. first inserts element size
         int tuple_elementSizeI_htonl = htonl(currentElementSize);
@@ -189,11 +527,11 @@ int tuple_serialize(struct tuple_t *tuple, char **buffer) {
         memcpy((buffer[0]+offset), &tuple_elementSizeI_htonl, TUPLE_ELEMENTSIZE_SIZE);
         //moves offset
         offset+=TUPLE_ELEMENTSIZE_SIZE;
-        //2. then inserts the string itself
-       // printf("tuple_serialize > element %s has size %ld\n", currentElementValue, currentElementSize);
-        memcpy((buffer[0]+offset), currentElementValue, currentElementSize);
-        
-        offset+=currentElementSize;
+        //2. then inserts the bytes themselves
+        if ( currentElementSize > 0 ) {
+            memcpy((buffer[0]+offset), currentElementValue, currentElementSize);
+            offset+=currentElementSize;
+        }
     }
     
     //to make sure its working
@@ -203,10 +541,12 @@ int tuple_serialize(struct tuple_t *tuple, char **buffer) {
 }
 
 void tuple_print ( struct tuple_t * tuple ) {
-    if ( tuple == NULL || tuple->tuple == NULL || tuple->tuple_dimension <= 0)
+    if ( tuple == NULL || tuple->tuple_dimension <= 0)
         printf(" <tuplo nulo> ");
     else {
-        printf("<%s,%s,%s>", tuple_element(tuple, 0), tuple_element(tuple, 1),tuple_element(tuple, 2));
+        char * text = tuple_to_string(tuple);
+        printf("<%s>", text);
+        free(text);
     }
 }
 
@@ -228,86 +568,205 @@ struct tuple_t *tuple_deserialize(char *buffer, int size) {
     memcpy(&tupleSize_nl, buffer+offset, TUPLE_DIMENSION_SIZE );
     int tupleSize = ntohl(tupleSize_nl);
     
-    //creates a tuple to create with the content from the buffer
-    struct tuple_t * tuple = tuple_create(tupleSize);
     //moves  offset
     offset+=TUPLE_DIMENSION_SIZE;
     
+    //a tuple can not have more elements than the bytes of the buffer
+    if ( tupleSize <= 0 || tupleSize > size )
+        return NULL;
+    
+    //the elements are pointed at on the buffer and copied at once to the tuple block
+    char * elements[tupleSize];
+    int lengths[tupleSize];
+    struct tuple_operator_t operators[tupleSize];
+    
     //2.gets first element size
     int i;
     for ( i = 0; i < tupleSize; i++ ) {
+        //memory security check !!!: the element size must be on the buffer
+        if ( offset + TUPLE_ELEMENTSIZE_SIZE > size )
+            return NULL;
+        
         //1. gets i element size
         int elementSize_nl = 0;
         memcpy(&elementSize_nl, buffer+offset, TUPLE_ELEMENTSIZE_SIZE );
         offset+= TUPLE_ELEMENTSIZE_SIZE;
         int elementSize = ntohl(elementSize_nl);
-      //  printf("tuple_deserialize > element %d has size nl %d and host %d\n", i, elementSize_nl, elementSize);
-
         
-        //memory security check !!!: if elementSize is bigger then space to
-        // read from buffer operation is canceled
-        if ( offset + elementSize > size) {
-            tuple_destroy(tuple);
-            return NULL;
+        //an operator: its type and its two bounds, each with its size
+        operators[i].type = TUPLE_OP_NONE;
+        if ( elementSize == TUPLE_ELEMENT_OPERATOR ) {
+            int field_nl[2];
+            if ( offset + 2 * TUPLE_ELEMENTSIZE_SIZE > size )
+                return NULL;
+            memcpy(field_nl, buffer+offset, 2 * TUPLE_ELEMENTSIZE_SIZE);
+            offset+= 2 * TUPLE_ELEMENTSIZE_SIZE;
+            operators[i].type = ntohl(field_nl[0]);
+            operators[i].low = buffer+offset;
+            operators[i].low_length = ntohl(field_nl[1]);
+            if ( (operators[i].type != TUPLE_OP_PREFIX && operators[i].type != TUPLE_OP_RANGE)
+                || operators[i].low_length < 0 || operators[i].low_length > size - offset - TUPLE_ELEMENTSIZE_SIZE )
+                return NULL;
+            offset+= operators[i].low_length;
+            memcpy(field_nl, buffer+offset, TUPLE_ELEMENTSIZE_SIZE);
+            offset+= TUPLE_ELEMENTSIZE_SIZE;
+            operators[i].high = buffer+offset;
+            operators[i].high_length = ntohl(field_nl[0]);
+            if ( operators[i].high_length < 0 || operators[i].high_length > size - offset )
+                return NULL;
+            offset+= operators[i].high_length;
+            elements[i] = NULL;
+            lengths[i] = -1;
+            continue;
         }
         
-        //2. sets the i element value into the tuple
-        char * elementValue = (char*) malloc(elementSize);
+        //memory security check !!!: if elementSize is bigger then space to
+        // read from buffer operation is canceled (-1 is a NULL element, with no bytes)
+        if ( elementSize < -1 || offset + elementSize > size)
+            return NULL;
         
-        memcpy(elementValue, (buffer+offset), elementSize);
-        tuple->tuple[i] = strncmp(elementValue, TUPLE_ELEM_NULL, 1) == 0 ? NULL : strndup(elementValue, elementSize);
-    //    printf("tuple[%d] is %s || elementValue is %s and size %d\n",i, tuple->tuple[i], elementValue, elementSize);
-        free(elementValue);
-        offset+=elementSize;
+        //2. saves where the i element value is
+        elements[i] = elementSize == -1 ? NULL : buffer+offset;
+        lengths[i] = elementSize;
+        offset+= elementSize == -1 ? 0 : elementSize;
     }
     
     //returns it
-    return tuple;
+    return tuple_create_template(tupleSize, elements, lengths, operators);
 }
 
 
 char * tuple_to_string( struct tuple_t * tuple ) {
-    int size = 0;
-    int i;
-    for (i = 0; i < tuple_size(tuple); i++)
-        size+= strlen(tuple_elem_str(tuple, i)) + 3 ; //+3 is the two " " and the space
+    //the elements as text, separated by a space
+    char * tuple_string = malloc (tuple_size_as_string(tuple));
+    if ( tuple_string == NULL )
+        return NULL;
     
-    char * tuple_string = malloc (size);
-    sprintf(tuple_string, "\"%s\" \"%s\" \"%s\"", tuple_elem_str(tuple,0), tuple_elem_str(tuple,1), tuple_elem_str(tuple,2));
-    tuple_string[size-1] = '\0';
+    char * text = tuple_string;
+    int i;
+    for (i = 0; i < tuple_size(tuple); i++) {
+        if ( i > 0 )
+            *text++ = ' ';
+        text = tuple_element_to_text(tuple, i, text);
+    }
+    *text = '\0';
     
     return tuple_string;
 }
-//
 
+/*
+ * Returns the value of the hexadecimal digit, -1 if it is not one.
+ */
+int tuple_hex_value ( char digit ) {
+    if ( digit >= '0' && digit <= '9' )
+        return digit - '0';
+    if ( digit >= 'a' && digit <= 'f' )
+        return digit - 'a' + 10;
+    if ( digit >= 'A' && digit <= 'F' )
+        return digit - 'A' + 10;
+    return -1;
+}
 
 /*
- *  Creates a tuple from user input.
- *
+ *  Creates a tuple from user input: everything before the first '"' is
+ *  skipped and then come the TUPLE_DIMENSION elements as tuple_to_string
+ *  writes them ("*" is a NULL element).
+ *  Returns NULL if the input has no such elements.
  */
 struct tuple_t* create_tuple_from_input (const char *user_input) {
+    return tuple_from_text(user_input, NULL);
+}
+
+/*
+ * Reads the bytes of the text between quotes at *input (just after the
+ * opening quote) to bytes, undoing what tuple_bytes_to_text does, and
+ * moves *input to after the closing quote.
+ * Returns the number of bytes, or -1 if the text ends before the quote.
+ */
+int tuple_text_to_bytes ( const char ** input, char * bytes ) {
+    const char * text = *input;
+    int length = 0;
+    while ( *text != '"' ) {
+        char byte = *text++;
+        if ( byte == '\0' )
+            return -1;
+        else if ( byte == '\\' && text[0] == 'x' && tuple_hex_value(text[1]) != -1 && tuple_hex_value(text[2]) != -1 ) {
+            byte = (char) (tuple_hex_value(text[1]) * 16 + tuple_hex_value(text[2]));
+            text += 3;
+        }
+        else if ( byte == '\\' && text[0] != '\0' ) {
+            byte = *text++;
+        }
+        bytes[length++] = byte;
+    }
+    *input = text + 1;
+    return length;
+}
+
+struct tuple_t * tuple_from_text ( const char * user_input, const char ** end ) {
     
-    char *token;
-    char *search = "\"";
-    char* tuple_data[3];
-    struct tuple_t * tuple_to_send;
-    
-    char * user_input_p = strdup(user_input);
+    const char * input = strchr(user_input, '"');
+    //the bytes of the elements are never more than their text
+    char * bytes = malloc (strlen(user_input) + 1);
+    if ( input == NULL || bytes == NULL ) {
+        free(bytes);
+        return NULL;
+    }
     
-    // Avanca para o primeiro elemento (salta o nome da operacao)
-    strtok(user_input_p, search);
+    char* tuple_data[TUPLE_DIMENSION];
+    int lengths[TUPLE_DIMENSION];
+    struct tuple_operator_t operators[TUPLE_DIMENSION];
+    int used = 0;
+    int valid = YES;
     
     int i;
-    for (i = 0; i< TUPLE_DIMENSION; i++ ) {
-        token = strtok(NULL, search);
-        tuple_data[i] = strcmp(token, TUPLE_ELEM_NULL) == 0 ? NULL : strdup (token);
-        strtok(NULL, search);
-
+    for (i = 0; i < TUPLE_DIMENSION && valid; i++ ) {
+        operators[i].type = TUPLE_OP_NONE;
+        
+        //each element starts on a quote, after the spaces
+        while ( *input == ' ' )
+            input++;
+        if ( *input++ != '"' ) {
+            valid = NO;
+            break;
+        }
+        
+        //a lone * (not escaped) is the NULL element
+        if ( input[0] == TUPLE_ELEM_NULL[0] && input[1] == '"' ) {
+            tuple_data[i] = NULL;
+            lengths[i] = -1;
+            input += 2;
+            continue;
+        }
+        
+        tuple_data[i] = bytes + used;
+        lengths[i] = tuple_text_to_bytes(&input, tuple_data[i]);
+        valid = lengths[i] != -1;
+        used += valid ? lengths[i] : 0;
+        
+        //"bytes"* is a prefix and "low".."high" a range
+        if ( valid && *input == TUPLE_ELEM_NULL[0] ) {
+            operators[i].type = TUPLE_OP_PREFIX;
+            input++;
+        }
+        else if ( valid && strncmp(input, TUPLE_RANGE_TEXT "\"", strlen(TUPLE_RANGE_TEXT) + 1) == 0 ) {
+            input += strlen(TUPLE_RANGE_TEXT) + 1;
+            operators[i].type = TUPLE_OP_RANGE;
+            operators[i].high = bytes + used;
+            operators[i].high_length = tuple_text_to_bytes(&input, operators[i].high);
+            valid = operators[i].high_length != -1;
+            used += valid ? operators[i].high_length : 0;
+        }
+        operators[i].low = tuple_data[i];
+        operators[i].low_length = lengths[i];
     }
+    
     //creates new tuple to send
-    tuple_to_send = tuple_create2(TUPLE_DIMENSION, tuple_data);
+    struct tuple_t * tuple_to_send = valid ? tuple_create_template(TUPLE_DIMENSION, tuple_data, lengths, operators) : NULL;
+    if ( valid && end != NULL )
+        *end = input;
     
-    free(user_input_p);
+    free(bytes);
     return tuple_to_send;
 }
 
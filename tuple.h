@@ -1,11 +1,25 @@
 #ifndef _DATA_H
 #define _DATA_H
 
+/* Posição e tamanho dos bytes de um elemento no corpo do tuplo.
+ */
+struct tuple_element_t {
+    int offset;          /* Início do elemento no corpo (-(id + 1) se está no intern pool) */
+    int length;          /* Tamanho sem o '\0' (-1 se o elemento é NULL) */
+};
+
 /* Estrutura que define um tuplo.
+ * O tuplo ocupa um só bloco de memória: esta estrutura, o array de
+ * elementos e o corpo, com os bytes de cada elemento terminados por '\0'.
+ * Depois de criado o tuplo não muda, por isso é partilhado (tuple_retain)
+ * em vez de copiado: tuple_destroy larga uma referência e o tuplo só é
+ * libertado com a última.
  */
 struct tuple_t {
     int tuple_dimension; /* Número de elementos no tuplo */
-    char **tuple;        /* Conteúdo arbitrário */
+    int body_size;       /* Número de bytes do corpo */
+    int refs;            /* Número de referências ao tuplo */
+    struct tuple_element_t elements[]; /* Seguido do corpo */
 };
 
 /* Função que cria um novo tuplo (isto é, que inicializa
@@ -19,7 +33,8 @@ struct tuple_t *tuple_create(int tuple_dim);
 struct tuple_t *tuple_create2(int tuple_dim, char **tuple);
 
 /* 
- * Função que destrói um bloco de dados e liberta toda a memoria.
+ * Função que larga uma referência ao tuplo, libertando toda a memoria
+ * se era a última.
  */
 void tuple_destroy(struct tuple_t *tuple);
 